@@ -27,6 +27,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include "mailinfoform.h"
 #include "petinfoform.h"
 #include "afkinfoform.h"
+#include "protostatsform.h"
 
 #include "signaldispatcher.h"
 #include "injector.h"
@@ -88,6 +89,12 @@ InfoForm::InfoForm(int defaultPage, QWidget* parent)
 		ui.tabWidget->addTab(pAfkInfoForm_, tr("afkinfo"));
 	}
 
+	pProtoStatsForm_ = new ProtoStatsForm;
+	if (pProtoStatsForm_)
+	{
+		ui.tabWidget->addTab(pProtoStatsForm_, tr("protostats"));
+	}
+
 	onResetControlTextLanguage();
 	onApplyHashSettingsToUI();
 
@@ -135,10 +142,12 @@ void InfoForm::onResetControlTextLanguage()
 	ui.tabWidget->setTabText(4, tr("mailinfo"));
 	ui.tabWidget->setTabText(5, tr("petinfo"));
 	ui.tabWidget->setTabText(6, tr("afkinfo"));
+	ui.tabWidget->setTabText(7, tr("protostats"));
 
 	pPlayerInfoForm_->onResetControlTextLanguage();
 	pItemInfoForm_->onResetControlTextLanguage();
 	pChatInfoForm_->onResetControlTextLanguage();
+	pProtoStatsForm_->onResetControlTextLanguage();
 
 }
 
@@ -28,6 +28,7 @@ class ChatInfoForm;
 class MailInfoForm;
 class PetInfoForm;
 class AfkInfoForm;
+class ProtoStatsForm;
 
 class InfoForm : public QWidget
 {
@@ -58,4 +59,5 @@ private:
 	MailInfoForm* pMailInfoForm_ = nullptr;
 	PetInfoForm* pPetInfoForm_ = nullptr;
 	AfkInfoForm* pAfkInfoForm_ = nullptr;
+	ProtoStatsForm* pProtoStatsForm_ = nullptr;
 };
@@ -87,6 +87,9 @@ MapForm::MapForm(QWidget* parent)
 	SignalDispatcher& signalDispatcher = SignalDispatcher::getInstance();
 	connect(&signalDispatcher, &SignalDispatcher::updateNpcList, this, &MapForm::onUpdateNpcList, Qt::UniqueConnection);
 
+	//天氣變化時刷新NPC列表
+	recvSubscription_ = RecvSubscription({ LSSPROTO_EF_RECV });
+
 }
 
 MapForm::~MapForm()
@@ -20,6 +20,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
 #include <QWidget>
 #include "ui_mapform.h"
+#include "net/recvregistry.h"
 class Interpreter;
 class MapForm : public QWidget
 {
@@ -46,4 +47,5 @@ private:
 	QHash<int, QPoint> npc_hash_;
 
 	QScopedPointer<Interpreter> interpreter_;
+	RecvSubscription recvSubscription_;
 };
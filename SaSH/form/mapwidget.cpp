@@ -19,6 +19,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include "stdafx.h"
 #include "mapwidget.h"
 #include "util.h"
+#include "signaldispatcher.h"
 #include "injector.h"
 #include "net/tcpserver.h"
 #include "map/mapanalyzer.h"
@@ -63,6 +64,25 @@ MapWidget::MapWidget(QWidget* parent)
 	connect(&downloadMapTimer_, &QTimer::timeout, this, &MapWidget::onDownloadMapTimeout);
 	downloadMapTimer_.start(500);
 
+	//周圍單位只按收到的單位ID更新 不再每次刷新都掃描整個周圍單位表
+	qRegisterMetaType<QVector<int>>("QVector<int>");
+	SignalDispatcher& signalDispatcher = SignalDispatcher::getInstance();
+	connect(&signalDispatcher, &SignalDispatcher::mapUnitsAdded, this, [this](const QVector<int>& ids) { updateUnitEntries(ids, false); });
+	connect(&signalDispatcher, &SignalDispatcher::mapUnitsMoved, this, [this](const QVector<int>& ids) { updateUnitEntries(ids, true); });
+	connect(&signalDispatcher, &SignalDispatcher::mapUnitsChanged, this, [this](const QVector<int>& ids) { updateUnitEntries(ids, false); });
+	connect(&signalDispatcher, &SignalDispatcher::mapUnitsRemoved, this, &MapWidget::removeUnitEntries);
+	connect(&signalDispatcher, &SignalDispatcher::mapUnitsCleared, this, [this]()
+		{
+			unitEntries_.clear();
+			unitRows_.clear();
+			unitListDirty_ = true;
+		});
+
+	//打開窗口前已經存在的單位
+	Injector& injector = Injector::getInstance();
+	if (!injector.server.isNull())
+		updateUnitEntries(injector.server->mapUnitHash.keys().toVector(), false);
+
 	util::FormSettingManager formManager(this);
 	formManager.loadSettings();
 }
@@ -243,208 +263,60 @@ void MapWidget::onRefreshTimeOut()
 	map_t m_map = {};
 	injector.server->mapAnalyzer->getMapDataByFloor(floor, &m_map);
 
-	util::SafeHash<int, mapunit_t> unitHash = injector.server->mapUnitHash;
-	auto findMapUnitByPoint = [&unitHash](const QPoint& p, mapunit_t* u)->bool
-	{
-		for (auto it = unitHash.begin(); it != unitHash.end(); ++it)
-		{
-			if (it->p == p)
-			{
-				if (u)
-					*u = it.value();
-				return true;
-			}
-		}
-		return false;
-	};
-
-
 #if 1
-	QStringList vGM;
-	QStringList vNPC;
-	QStringList vITEM;
-	QStringList vGOLD;
-	QStringList vPET;
-	QStringList vHUMAN;
-	QStringList vSTAIR;
-	QSet<QPoint> stair_cache;
-
-	for (const qmappoint_t& it : m_map.stair)
-	{
-		if (stair_cache.contains(it.p)) continue;
-		QString typeStr = "\0";
-		switch (it.type)
-		{
-		case util::OBJ_UP:
-			typeStr = tr("UP");
-			break;
-		case util::OBJ_DOWN:
-			typeStr = tr("DWON");
-			break;
-		case util::OBJ_JUMP:
-			typeStr = tr("JUMP");
-			break;
-		case util::OBJ_WARP:
-			typeStr = tr("WARP");
-			break;
-		default:
-			typeStr = tr("UNKNOWN");
-			continue;
-		}
-
-		stair_cache.insert(it.p);
-		mapunit_t u = {};
-		if (findMapUnitByPoint(it.p, &u))
-		{
-			if (!u.name.isEmpty() && (u.name != _ch.name))
-			{
-				if (u.isvisible)
-				{
-					vSTAIR.append(QString("[%1]%2").arg(typeStr).arg(u.name));
-					vSTAIR.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
-				}
-				else
-				{
-					vSTAIR.append(QString(tr("X[%1]%2")).arg(typeStr).arg(u.name));
-					vSTAIR.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
-				}
-				continue;
-			}
-		}
-		vSTAIR.append(QString("[%1]").arg(typeStr));
-		vSTAIR.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
-	}
-
-	const QList<mapunit_t> units = unitHash.values();
-	for (const mapunit_t& it : units)
+	//樓層或樓梯數量改變時重新整理地圖樓梯
+	const int stairs = m_map.stair.size();
+	if ((floor != unitListFloor_) || (stairs != unitListStairs_))
 	{
-		if (it.objType == util::OBJ_GM)
-		{
-			vGM.append(QString("[GM]%1").arg(it.name));
-			vGM.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
-		}
-		else
+		unitListFloor_ = floor;
+		unitListStairs_ = stairs;
+		mapStairs_.clear();
+		stairPoints_.clear();
+		for (const qmappoint_t& it : m_map.stair)
 		{
-			if (it.name == _ch.name)
-				continue;
-
-			switch (it.objType)
-			{
-			case util::OBJ_ITEM:
+			if (stairPoints_.contains(it.p)) continue;
+			QString typeStr = "\0";
+			switch (it.type)
 			{
-				vITEM.append(QString(tr("[I]%1")).arg(it.item_name));
-				vITEM.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
-				break;
-			}
-			case util::OBJ_GOLD:
-			{
-				vGOLD.append(QString(tr("[G]%1")).arg(it.gold));
-				vGOLD.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
+			case util::OBJ_UP:
+				typeStr = tr("UP");
 				break;
-			}
-			case util::OBJ_PET:
-			{
-				if (it.isvisible)
-					vPET.append(it.freeName.isEmpty() ? QString(tr("[P]%2")).arg(it.name) : QString(tr("[P]%2")).arg(it.freeName));
-				else
-					vPET.append(it.freeName.isEmpty() ? QString(tr("X[P]%2")).arg(it.name) : QString(tr("[P]%2")).arg(it.freeName));
-				vPET.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
+			case util::OBJ_DOWN:
+				typeStr = tr("DWON");
 				break;
-			}
-			case util::OBJ_HUMAN:
-			{
-				if (it.isvisible)
-					vHUMAN.append(QString(tr("[H]%1")).arg(it.name));
-				else
-					vHUMAN.append(QString(tr("X[H]%1")).arg(it.name));
-				vHUMAN.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
+			case util::OBJ_JUMP:
+				typeStr = tr("JUMP");
 				break;
-			}
-			case util::OBJ_NPC:
-			{
-				if (it.isvisible)
-					vNPC.append(QString("[NPC][%1]%2").arg(it.graNo).arg(it.name));
-				else
-					vNPC.append(QString(tr("X[NPC][%1]%2")).arg(it.graNo).arg(it.name));
-				vNPC.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
+			case util::OBJ_WARP:
+				typeStr = tr("WARP");
 				break;
+			default:
+				typeStr = tr("UNKNOWN");
+				continue;
 			}
-			case util::OBJ_JUMP:
-			case util::OBJ_DOWN:
-			case util::OBJ_UP:
-			{
-				if (stair_cache.contains(it.p)) continue;
-				QString typeStr = "\0";
-				switch (it.objType)
-				{
-				case util::OBJ_UP:
-					typeStr = tr("UP");
-					break;
-				case util::OBJ_DOWN:
-					typeStr = tr("DWON");
-					break;
-				case util::OBJ_JUMP:
-					typeStr = tr("JUMP");
-					break;
-				case util::OBJ_WARP:
-					typeStr = tr("WARP");
-					break;
-				default:
-					typeStr = tr("UNKNOWN");
-					break;
-				}
 
-				if (!it.name.isEmpty())
-				{
-					if (it.isvisible)
-					{
-						vSTAIR.append(QString("[%1]%2").arg(typeStr).arg(it.name));
-						vSTAIR.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
-					}
-					else
-					{
-						vSTAIR.append(QString("X[%1]%2").arg(typeStr).arg(it.name));
-						vSTAIR.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
-					}
-				}
-				else
-				{
-					vSTAIR.append(QString("[%1]").arg(typeStr));
-					vSTAIR.append(QString("%1,%2").arg(it.p.x()).arg(it.p.y()));
-				}
-				break;
-			}
-			default: continue;
-			}
+			stairPoints_.insert(it.p);
+			mapStairs_.append(qMakePair(it.p, typeStr));
 		}
+		unitListDirty_ = true;
+	}
 
-		QBrush brush;
-		if (it.name.contains(u8"傳送石"))
-		{
-			brush = QBrush(MAP_COLOR_HASH.value(util::OBJ_JUMP), Qt::SolidPattern);
-		}
-		else
-			brush = QBrush(MAP_COLOR_HASH.value(it.objType), Qt::SolidPattern);
-		QPen pen(brush, 1.0, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-		QPainter painter(&ppix);
+	//從單位顯示資料畫出周圍單位 不需要複製整個周圍單位表
+	QPainter painter(&ppix);
+	for (const unitentry_t& it : unitEntries_)
+	{
+		if ((it.group == kUnitGroupNone) || (it.isStair && stairPoints_.contains(it.p)))
+			continue;
+
+		QPen pen(QBrush(it.color, Qt::SolidPattern), 1.0, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
 		painter.setPen(pen);
 		painter.drawPoint(it.p);
-		painter.end();
-
 	}
+	painter.end();
 
-
-	QVariantList vlist;
-	QVariant dataVar;
-	vlist.append(vGM);
-	vlist.append(vNPC);
-	vlist.append(vITEM);
-	vlist.append(vGOLD);
-	vlist.append(vPET);
-	vlist.append(vHUMAN);
-	vlist.append(vSTAIR);
-	dataVar.setValue(vlist);
-	updateNpcListAllContents(dataVar);
+	//周圍單位與地圖樓梯都沒有變化時不需要重建表格
+	if (unitListDirty_)
+		rebuildNpcList();
 #endif
 
 	zoom(ui.widget, ppix, &scaleWidth_, &scaleHeight_, &zoom_value_, fix_zoom_value_);
@@ -774,6 +646,219 @@ void MapWidget::updateNpcListAllContents(const QVariant& d)
 	ui.tableWidget_NPCList->setUpdatesEnabled(true);
 }
 
+//重新計算指定單位的顯示資料 只有坐標改變時直接改寫該行
+void MapWidget::updateUnitEntries(const QVector<int>& ids, bool moved)
+{
+	Injector& injector = Injector::getInstance();
+	if (injector.server.isNull())
+		return;
+
+	const QString selfName = injector.server->getPC().name;
+	auto makeEntry = [this, &selfName](const mapunit_t& it)->unitentry_t
+	{
+		unitentry_t entry;
+		entry.p = it.p;
+		entry.name = it.name;
+		entry.isvisible = it.isvisible;
+		entry.color = MAP_COLOR_HASH.value(it.name.contains(u8"傳送石") ? util::OBJ_JUMP : it.objType);
+
+		if (it.objType == util::OBJ_GM)
+		{
+			entry.group = kUnitGroupGM;
+			entry.label = QString("[GM]%1").arg(it.name);
+			return entry;
+		}
+
+		if (it.name == selfName)
+			return entry;
+
+		switch (it.objType)
+		{
+		case util::OBJ_ITEM:
+		{
+			entry.group = kUnitGroupItem;
+			entry.label = QString(tr("[I]%1")).arg(it.item_name);
+			break;
+		}
+		case util::OBJ_GOLD:
+		{
+			entry.group = kUnitGroupGold;
+			entry.label = QString(tr("[G]%1")).arg(it.gold);
+			break;
+		}
+		case util::OBJ_PET:
+		{
+			entry.group = kUnitGroupPet;
+			if (it.isvisible)
+				entry.label = it.freeName.isEmpty() ? QString(tr("[P]%2")).arg(it.name) : QString(tr("[P]%2")).arg(it.freeName);
+			else
+				entry.label = it.freeName.isEmpty() ? QString(tr("X[P]%2")).arg(it.name) : QString(tr("[P]%2")).arg(it.freeName);
+			break;
+		}
+		case util::OBJ_HUMAN:
+		{
+			entry.group = kUnitGroupHuman;
+			if (it.isvisible)
+				entry.label = QString(tr("[H]%1")).arg(it.name);
+			else
+				entry.label = QString(tr("X[H]%1")).arg(it.name);
+			break;
+		}
+		case util::OBJ_NPC:
+		{
+			entry.group = kUnitGroupNPC;
+			if (it.isvisible)
+				entry.label = QString("[NPC][%1]%2").arg(it.graNo).arg(it.name);
+			else
+				entry.label = QString(tr("X[NPC][%1]%2")).arg(it.graNo).arg(it.name);
+			break;
+		}
+		case util::OBJ_JUMP:
+		case util::OBJ_DOWN:
+		case util::OBJ_UP:
+		{
+			QString typeStr = "\0";
+			switch (it.objType)
+			{
+			case util::OBJ_UP:
+				typeStr = tr("UP");
+				break;
+			case util::OBJ_DOWN:
+				typeStr = tr("DWON");
+				break;
+			default:
+				typeStr = tr("JUMP");
+				break;
+			}
+
+			entry.group = kUnitGroupStair;
+			entry.isStair = true;
+			if (!it.name.isEmpty())
+				entry.label = it.isvisible ? QString("[%1]%2").arg(typeStr).arg(it.name) : QString("X[%1]%2").arg(typeStr).arg(it.name);
+			else
+				entry.label = QString("[%1]").arg(typeStr);
+			break;
+		}
+		default:
+			break;
+		}
+
+		return entry;
+	};
+
+	for (const int id : ids)
+	{
+		//通知排隊期間已被刪除的單位交給刪除通知處理
+		if (!injector.server->mapUnitHash.contains(id))
+			continue;
+
+		const unitentry_t entry = makeEntry(injector.server->mapUnitHash.value(id));
+		const unitentry_t old = unitEntries_.value(id);
+		const bool existed = unitEntries_.contains(id);
+		unitEntries_.insert(id, entry);
+		if (unitListDirty_)
+			continue;
+
+		//分組與名稱不變 且不影響地圖樓梯的顯示時 只改寫該行坐標
+		auto row = unitRows_.constFind(id);
+		if (moved && existed && (row != unitRows_.cend())
+			&& (old.group == entry.group) && (old.label == entry.label) && !entry.isStair
+			&& !stairPoints_.contains(old.p) && !stairPoints_.contains(entry.p))
+		{
+			QTableWidgetItem* item = ui.tableWidget_NPCList->item(row.value(), 1);
+			if (item)
+				item->setText(QString("%1,%2").arg(entry.p.x()).arg(entry.p.y()));
+			continue;
+		}
+
+		//不在列表中也不在地圖樓梯上的單位不影響表格
+		if ((old.group == kUnitGroupNone) && (entry.group == kUnitGroupNone)
+			&& !stairPoints_.contains(old.p) && !stairPoints_.contains(entry.p))
+			continue;
+
+		unitListDirty_ = true;
+	}
+}
+
+void MapWidget::removeUnitEntries(const QVector<int>& ids)
+{
+	for (const int id : ids)
+	{
+		if (!unitEntries_.contains(id))
+			continue;
+
+		const unitentry_t old = unitEntries_.take(id);
+		unitRows_.remove(id);
+		if ((old.group != kUnitGroupNone) || stairPoints_.contains(old.p))
+			unitListDirty_ = true;
+	}
+}
+
+//由單位顯示資料與地圖樓梯重建表格 只在有單位增減或分組改變時執行
+void MapWidget::rebuildNpcList()
+{
+	Injector& injector = Injector::getInstance();
+	if (injector.server.isNull())
+		return;
+
+	const QString selfName = injector.server->getPC().name;
+	QStringList groups[kUnitGroupCount];
+	QVector<int> groupIds[kUnitGroupCount];
+
+	//地圖樓梯上有單位時顯示單位名稱
+	QHash<QPoint, int> pointIds;
+	for (auto it = unitEntries_.cbegin(); it != unitEntries_.cend(); ++it)
+	{
+		if (stairPoints_.contains(it->p))
+			pointIds.insert(it->p, it.key());
+	}
+
+	for (const QPair<QPoint, QString>& stair : mapStairs_)
+	{
+		QString label = QString("[%1]").arg(stair.second);
+		auto found = pointIds.constFind(stair.first);
+		if (found != pointIds.cend())
+		{
+			const unitentry_t u = unitEntries_.value(found.value());
+			if (!u.name.isEmpty() && (u.name != selfName))
+				label = u.isvisible ? QString("[%1]%2").arg(stair.second).arg(u.name) : QString(tr("X[%1]%2")).arg(stair.second).arg(u.name);
+		}
+
+		groups[kUnitGroupStair].append(label);
+		groups[kUnitGroupStair].append(QString("%1,%2").arg(stair.first.x()).arg(stair.first.y()));
+		groupIds[kUnitGroupStair].append(-1);
+	}
+
+	for (auto it = unitEntries_.cbegin(); it != unitEntries_.cend(); ++it)
+	{
+		if ((it->group == kUnitGroupNone) || (it->isStair && stairPoints_.contains(it->p)))
+			continue;
+
+		groups[it->group].append(it->label);
+		groups[it->group].append(QString("%1,%2").arg(it->p.x()).arg(it->p.y()));
+		groupIds[it->group].append(it.key());
+	}
+
+	QVariantList vlist;
+	QVariant dataVar;
+	int row = 0;
+	unitRows_.clear();
+	for (int i = 0; i < kUnitGroupCount; ++i)
+	{
+		vlist.append(groups[i]);
+		for (const int id : groupIds[i])
+		{
+			if (id != -1)
+				unitRows_.insert(id, row);
+			++row;
+		}
+	}
+	dataVar.setValue(vlist);
+
+	updateNpcListAllContents(dataVar);
+	unitListDirty_ = false;
+}
+
 void MapWidget::on_tableWidget_NPCList_cellDoubleClicked(int row, int)
 {
 	QTableWidgetItem* item = ui.tableWidget_NPCList->item(row, 1);
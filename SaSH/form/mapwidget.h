@@ -39,6 +39,36 @@ private:
 	void __fastcall downloadNextBlock();
 	void __fastcall updateNpcListAllContents(const QVariant& d);
 
+	//列表分組 順序與表格中的顯示順序相同
+	enum UnitGroup
+	{
+		kUnitGroupNone = -1,
+		kUnitGroupGM,
+		kUnitGroupNPC,
+		kUnitGroupItem,
+		kUnitGroupGold,
+		kUnitGroupPet,
+		kUnitGroupHuman,
+		kUnitGroupStair,
+		kUnitGroupCount,
+	};
+
+	//單個周圍單位在列表與地圖上的顯示資料
+	typedef struct unitentry_s
+	{
+		int group = kUnitGroupNone;
+		QString label;
+		QPoint p;
+		QString name;
+		bool isvisible = false;
+		bool isStair = false;
+		QColor color;
+	} unitentry_t;
+
+	void __fastcall updateUnitEntries(const QVector<int>& ids, bool moved);
+	void __fastcall removeUnitEntries(const QVector<int>& ids);
+	void __fastcall rebuildNpcList();
+
 private:
 	bool bClicked_ = false;
 	QPointF pLast_ = { 0.0, 0.0 };
@@ -70,6 +100,17 @@ private:
 
 	int counter_ = 10;
 
+	//周圍單位顯示資料 只在收到對應單位ID的變化通知時更新
+	QHash<int, unitentry_t> unitEntries_;
+	//單位ID在表格中的行號 移動時只改寫該行坐標
+	QHash<int, int> unitRows_;
+	//地圖樓梯的坐標與類型文字 同坐標的樓梯類單位不另外列出
+	QVector<QPair<QPoint, QString>> mapStairs_;
+	QSet<QPoint> stairPoints_;
+	bool unitListDirty_ = true;
+	int unitListFloor_ = -1;
+	int unitListStairs_ = -1;
+
 #if OPEN_GL_ON
 
 	QTimer gltimer_;
@@ -0,0 +1,142 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#include "stdafx.h"
+#include "protostatsform.h"
+
+namespace
+{
+	enum
+	{
+		kColumnFunc,
+		kColumnCount,
+		kColumnRate,
+		kColumnBytes,
+		kColumnDecode,
+		kColumnHandler,
+		kColumnHandlerTotal,
+		kColumnMax,
+	};
+
+	QString formatUs(const ProtoStats::metricsummary_t& m)
+	{
+		auto us = [](quint32 ns) { return QString::number(static_cast<double>(ns) / 1e3, 'f', 1); };
+		return QString("%1 / %2 / %3").arg(us(m.p50)).arg(us(m.p99)).arg(us(m.max));
+	}
+}
+
+ProtoStatsForm::ProtoStatsForm(QWidget* parent)
+	: QWidget(parent)
+{
+	tableWidget_ = new QTableWidget(this);
+	tableWidget_->setColumnCount(kColumnMax);
+	tableWidget_->setSelectionMode(QAbstractItemView::SingleSelection);
+	tableWidget_->setSelectionBehavior(QAbstractItemView::SelectRows);
+	tableWidget_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+	tableWidget_->setStyleSheet(R"(
+		QTableWidget { font-size:11px; } 
+			QTableView::item:selected { background-color: black; color: white;
+		})");
+	tableWidget_->verticalHeader()->setVisible(false);
+	tableWidget_->verticalHeader()->setDefaultSectionSize(11);
+	tableWidget_->horizontalHeader()->setStretchLastSection(true);
+	tableWidget_->horizontalHeader()->setHighlightSections(false);
+	tableWidget_->horizontalHeader()->setDefaultAlignment(Qt::AlignLeft);
+
+	copyButton_ = new QPushButton(this);
+
+	QVBoxLayout* layout = new QVBoxLayout(this);
+	layout->setContentsMargins(0, 0, 0, 0);
+	layout->addWidget(tableWidget_);
+	layout->addWidget(copyButton_);
+
+	connect(copyButton_, &QPushButton::clicked, this, &ProtoStatsForm::onCopyClicked);
+	connect(&refreshTimer_, &QTimer::timeout, this, &ProtoStatsForm::onRefresh);
+
+	onResetControlTextLanguage();
+
+	intervalTimer_.start();
+	onRefresh();
+	refreshTimer_.start(1000);
+}
+
+ProtoStatsForm::~ProtoStatsForm()
+{
+	refreshTimer_.stop();
+}
+
+void ProtoStatsForm::onResetControlTextLanguage()
+{
+	const QStringList headers = {
+		tr("func"), tr("count"), tr("msg/s"), tr("bytes"),
+		tr("decode p50/p99/max us"), tr("handler p50/p99/max us"), tr("handler total ms"),
+	};
+	tableWidget_->setHorizontalHeaderLabels(headers);
+	copyButton_->setText(tr("copy"));
+}
+
+void ProtoStatsForm::onRefresh()
+{
+	if (!isVisible() && !lastCounts_.isEmpty())
+		return;
+
+	const double seconds = qMax<qint64>(intervalTimer_.restart(), 1) / 1000.0;
+	const QVector<ProtoStats::funcsummary_t> summaries = ProtoStats::getInstance().snapshot();
+
+	tableWidget_->setUpdatesEnabled(false);
+	tableWidget_->setRowCount(summaries.size());
+
+	int row = 0;
+	for (const ProtoStats::funcsummary_t& s : summaries)
+	{
+		const quint64 last = lastCounts_.value(s.func, s.count);
+		lastCounts_.insert(s.func, s.count);
+
+		const QString texts[kColumnMax] = {
+			QString::number(s.func),
+			QString::number(s.count),
+			QString::number(static_cast<double>(s.count - last) / seconds, 'f', 1),
+			QString::number(s.metrics[ProtoStats::kBytes].total),
+			formatUs(s.metrics[ProtoStats::kDecodeNs]),
+			formatUs(s.metrics[ProtoStats::kHandlerNs]),
+			QString::number(static_cast<double>(s.metrics[ProtoStats::kHandlerNs].total) / 1e6, 'f', 3),
+		};
+
+		for (int column = 0; column < kColumnMax; ++column)
+		{
+			QTableWidgetItem* item = tableWidget_->item(row, column);
+			if (item == nullptr)
+			{
+				item = new QTableWidgetItem;
+				tableWidget_->setItem(row, column, item);
+			}
+			item->setText(texts[column]);
+		}
+
+		++row;
+	}
+
+	tableWidget_->setUpdatesEnabled(true);
+}
+
+void ProtoStatsForm::onCopyClicked()
+{
+	QClipboard* clipboard = QApplication::clipboard();
+	if (clipboard != nullptr)
+		clipboard->setText(ProtoStats::getInstance().dump());
+}
@@ -0,0 +1,46 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+
+#include <QWidget>
+#include "net/protostats.h"
+
+//協議統計面板 每秒刷新一次 速率以兩次刷新之間的差值計算
+class ProtoStatsForm : public QWidget
+{
+	Q_OBJECT
+
+public:
+	ProtoStatsForm(QWidget* parent = nullptr);
+	~ProtoStatsForm();
+
+public slots:
+	void onResetControlTextLanguage();
+
+private slots:
+	void onRefresh();
+	void onCopyClicked();
+
+private:
+	QTableWidget* tableWidget_ = nullptr;
+	QPushButton* copyButton_ = nullptr;
+	QTimer refreshTimer_;
+	QElapsedTimer intervalTimer_;
+	QHash<int, quint64> lastCounts_;
+};
@@ -158,10 +158,15 @@ inline void SPD_CLOSE(int index)
 	}
 }
 
+//調試日誌是否開啟 在高頻路徑上先檢查再組字串 (讀取原子副本 不加鎖)
+inline bool SPD_ISENABLED()
+{
+	return Injector::getInstance().isDebugLogEnabled();
+}
+
 inline void SPD_LOG(int index, const QString& msg, SPD_LOGTYPE logtype = SPD_INFO)
 {
-	Injector& injector = Injector::getInstance();
-	if (!injector.getEnableHash(util::kScriptDebugModeEnable))
+	if (!SPD_ISENABLED())
 		return;
 
 
@@ -210,8 +215,7 @@ inline void SPD_LOG(int index, const QString& msg, SPD_LOGTYPE logtype = SPD_INF
 
 inline void SPD_LOG(const QString& name, const QString& msg, SPD_LOGTYPE logtype = SPD_INFO)
 {
-	Injector& injector = Injector::getInstance();
-	if (!injector.getEnableHash(util::kScriptDebugModeEnable))
+	if (!SPD_ISENABLED())
 		return;
 
 	try
@@ -254,8 +258,7 @@ inline void SPD_LOG(const QString& name, const QString& msg, SPD_LOGTYPE logtype
 
 inline void SPD_LOG(const std::string& name, const std::string& msg, SPD_LOGTYPE logtype = SPD_INFO)
 {
-	Injector& injector = Injector::getInstance();
-	if (!injector.getEnableHash(util::kScriptDebugModeEnable))
+	if (!SPD_ISENABLED())
 		return;
 
 	try
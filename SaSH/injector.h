@@ -112,7 +112,12 @@ public:
 
 	inline void setValueHash(util::UserSetting setting, int value) { userSetting_value_hash_.insert(setting, value); }
 
-	inline void setEnableHash(util::UserSetting setting, bool enable) { userSetting_enable_hash_.insert(setting, enable); }
+	inline void setEnableHash(util::UserSetting setting, bool enable)
+	{
+		userSetting_enable_hash_.insert(setting, enable);
+		if (setting == util::kScriptDebugModeEnable)
+			isDebugLogEnabled_.store(enable, std::memory_order_relaxed);
+	}
 
 	inline void setStringHash(util::UserSetting setting, const QString& string) { userSetting_string_hash_.insert(setting, string); }
 
@@ -130,7 +135,14 @@ public:
 
 	inline void setValueHash(const util::SafeHash<util::UserSetting, int>& hash) { userSetting_value_hash_ = hash; }
 
-	inline void setEnableHash(const util::SafeHash<util::UserSetting, bool>& hash) { userSetting_enable_hash_ = hash; }
+	inline void setEnableHash(const util::SafeHash<util::UserSetting, bool>& hash)
+	{
+		userSetting_enable_hash_ = hash;
+		isDebugLogEnabled_.store(hash.value(util::kScriptDebugModeEnable), std::memory_order_relaxed);
+	}
+
+	//調試日誌開關的副本 每個封包都會檢查 不經過設置表的鎖
+	Q_REQUIRED_RESULT inline bool isDebugLogEnabled() const { return isDebugLogEnabled_.load(std::memory_order_relaxed); }
 
 	inline void setStringHash(const util::SafeHash<util::UserSetting, QString>& hash) { userSetting_string_hash_ = hash; }
 
@@ -403,6 +415,8 @@ private:
 
 	};
 
+	std::atomic_bool isDebugLogEnabled_ = false; //與kScriptDebugModeEnable同步 只由setEnableHash更新
+
 	util::SafeHash<util::UserSetting, QString> userSetting_string_hash_ = {
 		{ util::kAutoDropItemString, "" },
 		{ util::kLockAttackString, "" },
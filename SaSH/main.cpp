@@ -19,6 +19,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include "stdafx.h"
 #include "mainform.h"
 #include "util.h"
+#include "injector.h"
 #include <QtWidgets/QApplication>
 
 #pragma comment(lib, "ws2_32.lib")
@@ -272,6 +273,32 @@ void fontInitialize(const QString& currentWorkPath, QApplication& a)
 	a.setFont(font);
 }
 
+//不啟動界面 重播錄製檔後輸出統計 報告同時寫入錄製檔旁的.txt
+int replayCapture(const QString& path, bool realtime)
+{
+	Injector& injector = Injector::getInstance();
+	injector.server.reset(new Server(nullptr));
+
+	QScopedPointer<capture::report_t> report(new capture::report_t);
+	const bool ok = injector.server->replayCapture(path, realtime, report.data());
+	injector.server.reset(nullptr);
+
+	if (!ok)
+	{
+		std::cerr << "failed to replay " << path.toUtf8().constData() << std::endl;
+		return 1;
+	}
+
+	const QByteArray text = report->toString().toUtf8();
+	std::cout << text.constData() << std::endl;
+
+	QFile file(path + ".txt");
+	if (file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+		file.write(text);
+
+	return 0;
+}
+
 int main(int argc, char* argv[])
 {
 	QApplication::setAttribute(Qt::AA_Use96Dpi, true);// DPI support
@@ -338,6 +365,17 @@ int main(int argc, char* argv[])
 	if (pool != nullptr)
 		pool->setMaxThreadCount(count);
 
+	//--capture <目錄> 錄製所有連線的封包
+	//--replay <檔案> [--max-speed] 重播錄製檔後結束
+	const QStringList arguments = a.arguments();
+	int argIndex = arguments.indexOf("--capture");
+	if (argIndex != -1 && argIndex + 1 < arguments.size())
+		qputenv("CAPTURE_DIR", arguments.at(argIndex + 1).toUtf8());
+
+	argIndex = arguments.indexOf("--replay");
+	if (argIndex != -1 && argIndex + 1 < arguments.size())
+		return replayCapture(arguments.at(argIndex + 1), !arguments.contains("--max-speed"));
+
 	MainForm w;
 	w.show();
 	return a.exec();
@@ -71,6 +71,29 @@ MainObject::MainObject(QObject* parent)
 	: ThreadPlugin(parent)
 {
 	pointerWriterSync_.setCancelOnWait(true);
+
+	//只收集有變動的單位ID 在發送端線程直接寫入待處理集合
+	SignalDispatcher& signalDispatcher = SignalDispatcher::getInstance();
+	auto queueNpcUnits = [this](const QVector<int>& ids)
+	{
+		QMutexLocker locker(&npcPendingMutex_);
+		for (const int id : ids)
+			npcPendingIds_.insert(id);
+	};
+	connect(&signalDispatcher, &SignalDispatcher::mapUnitsAdded, this, queueNpcUnits, Qt::DirectConnection);
+	connect(&signalDispatcher, &SignalDispatcher::mapUnitsMoved, this, queueNpcUnits, Qt::DirectConnection);
+	connect(&signalDispatcher, &SignalDispatcher::mapUnitsChanged, this, queueNpcUnits, Qt::DirectConnection);
+	connect(&signalDispatcher, &SignalDispatcher::mapUnitsRemoved, this, [this](const QVector<int>& ids)
+		{
+			QMutexLocker locker(&npcPendingMutex_);
+			for (const int id : ids)
+				npcPendingIds_.remove(id);
+		}, Qt::DirectConnection);
+	connect(&signalDispatcher, &SignalDispatcher::mapUnitsCleared, this, [this]()
+		{
+			QMutexLocker locker(&npcPendingMutex_);
+			npcPendingIds_.clear();
+		}, Qt::DirectConnection);
 }
 
 MainObject::~MainObject()
@@ -202,6 +225,7 @@ void MainObject::mainProc()
 {
 	Injector& injector = Injector::getInstance();
 	QElapsedTimer freeMemTimer; freeMemTimer.start();
+	QElapsedTimer rttProbeTimer; rttProbeTimer.start();
 	//首次先釋放一次記憶體，並且開始計時
 	if (injector.getEnableHash(util::kAutoFreeMemoryEnable))
 	{
@@ -249,6 +273,13 @@ void MainObject::mainProc()
 		//有些數據需要和客戶端內存同步
 		injector.server->updateDatasFromMemory();
 
+		//定時探測往返時間 供走路、對話與戰鬥的節奏調整
+		if (rttProbeTimer.hasExpired(5000))
+		{
+			rttProbeTimer.restart();
+			injector.server->probeRtt();
+		}
+
 		//其他所有功能
 		int status = checkAndRunFunctions();
 
@@ -932,8 +963,56 @@ void MainObject::checkAutoWalk()
 
 		autowalk_future_ = QtConcurrent::run([&injector, current_pos, this]()
 			{
+				constexpr int kPatrolStepsPerSend = 4;//每次發送的步數 與原先的gcgc相同
+				static const QVector<QChar> kDirChars = { 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h' };
+
 				bool current_side = false;
 
+				//預先計算的巡邏迴路
+				QString patrol;
+				int patrolIndex = 0;
+				int patrolFloor = -1;
+				int patrolLength = -1;
+				int patrolDirection = -1;
+				QPoint patrolOrigin;
+				QPoint patrolCursor;
+
+				//規劃失敗時的條件 每次規劃都要重新解析地圖檔 條件沒變時不再重試
+				//沒有地圖數據時只在換地圖或設置後重試 找不到迴路時換到沒試過的座標也重試
+				int failedFloor = -1;
+				int failedLength = -1;
+				int failedDirection = -1;
+				bool failedNoMap = false;
+				QSet<QPoint> failedOrigins;
+
+				//以絕對時間點控制步伐 不受sleep與發送耗時影響
+				util::StepPacer pacer(injector.getValueHash(util::kAutoWalkDelayValue) + 1);
+
+				//以當前座標重新規劃可通行的閉合迴路 失敗則返回false noMap表示沒有地圖數據
+				auto planPatrol = [&injector, &patrol, &patrolIndex, &patrolFloor, &patrolOrigin, &patrolCursor](int floor, const QPoint& pos, int length, int direction, bool* noMap)->bool
+				{
+					patrol.clear();
+					patrolIndex = 0;
+					*noMap = true;
+
+					QSharedPointer<MapAnalyzer> mapAnalyzer = injector.server->mapAnalyzer;
+					if (mapAnalyzer.isNull())
+						return false;
+
+					map_t map;
+					if (!mapAnalyzer->readFromBinary(floor, injector.server->nowFloorName) || !mapAnalyzer->getMapDataByFloor(floor, &map))
+						return false;
+
+					*noMap = false;
+					if (!mapAnalyzer->calcPatrolRoute(map, pos, length, direction, &patrol))
+						return false;
+
+					patrolFloor = floor;
+					patrolOrigin = pos;
+					patrolCursor = pos;
+					return true;
+				};
+
 				for (;;)
 				{
 					//如果主線程關閉則自動退出
@@ -954,6 +1033,9 @@ void MainObject::checkAutoWalk()
 						//先等一小段時間
 						QThread::msleep(100);
 
+						//戰鬥結束後第一步立即出發
+						pacer.reset();
+
 						//如果已經退出戰鬥就等待1.5秒避免太快開始移動不夠時間吃肉補血丟東西...等
 						//if(!injector.server->getBattleFlag())
 						//{
@@ -975,54 +1057,111 @@ void MainObject::checkAutoWalk()
 					int walk_speed = injector.getValueHash(util::kAutoWalkDelayValue);//走路速度
 
 					//走路遇敵
-					if (enableAutoWalk)
+					if (enableAutoWalk || enableFastAutoWalk)
 					{
-						int walk_len = injector.getValueHash(util::kAutoWalkDistanceValue);//走路距離
-						int walk_dir = injector.getValueHash(util::kAutoWalkDirectionValue);//走路方向
+						//快速遇敵只需要一格來回
+						int walk_len = enableAutoWalk ? injector.getValueHash(util::kAutoWalkDistanceValue) + 1 : 1;//走路距離
+						int walk_dir = enableAutoWalk ? injector.getValueHash(util::kAutoWalkDirectionValue) : 0;//走路方向
 
-						//如果direction是0，則current_pos +- x，否則 +- y 如果是2 則隨機加減
-						//一次性移動walk_len格
+						//一圈走完後 如果座標、地圖或設置有變化則重新規劃
+						if (patrolIndex >= patrol.size())
+						{
+							if (!patrol.isEmpty())
+								SPD_LOG(g_logger_name, QString("[mainthread] autowalk pace: %1 steps/s").arg(pacer.stepsPerSecond(), 0, 'f', 2));
+
+							patrolIndex = 0;
+							patrolCursor = patrolOrigin;
+							const int floor = injector.server->nowFloor;
+							const QPoint pos = injector.server->getPoint();
+							const bool sameFailure = (failedFloor == floor)
+								&& (failedLength == walk_len)
+								&& (failedDirection == walk_dir)
+								&& (failedNoMap || failedOrigins.contains(pos));
+							if ((patrol.isEmpty() && !sameFailure)
+								|| (!patrol.isEmpty()
+									&& (patrolFloor != floor
+										|| patrolLength != walk_len
+										|| patrolDirection != walk_dir
+										|| pos != patrolOrigin)))
+							{
+								patrolLength = walk_len;
+								patrolDirection = walk_dir;
+								bool noMap = false;
+								if (planPatrol(floor, pos, walk_len, walk_dir, &noMap))
+								{
+									failedFloor = -1;
+									failedOrigins.clear();
+								}
+								else
+								{
+									if ((failedFloor != floor) || (failedLength != walk_len) || (failedDirection != walk_dir))
+										failedOrigins.clear();
+									failedFloor = floor;
+									failedLength = walk_len;
+									failedDirection = walk_dir;
+									failedNoMap = noMap;
+									failedOrigins.insert(pos);
+								}
+							}
+						}
 
-						int x = 0, y = 0;
-						if (walk_dir == 0)
+						if (!patrol.isEmpty())
 						{
-							if (current_side)
-								x = current_pos.x() + walk_len + 1;
+							//沿迴路發送下一段方向 座標為該段起點
+							QString steps = patrol.mid(patrolIndex, kPatrolStepsPerSend);
+							if (injector.server->move(patrolCursor, steps))
+							{
+								for (const QChar& ch : steps)
+									patrolCursor += util::fix_point.at(kDirChars.indexOf(ch));
+								patrolIndex += steps.size();
+								pacer.step(steps.size());
+							}
 							else
-								x = current_pos.x() - walk_len - 1;
-
-							y = current_pos.y();
+							{
+								//沒有發出(戰鬥中、離線)時座標已不可信 下一輪由當前座標重新規劃
+								patrol.clear();
+								patrolIndex = 0;
+							}
 						}
-						else if (walk_dir == 1)
+						else if (enableAutoWalk)
 						{
-							x = current_pos.x();
-
-							if (current_side)
-								y = current_pos.y() + walk_len + 1;
+							//沒有地圖數據時退回原先的直線來回
+							int x = 0, y = 0;
+							if (walk_dir == 0)
+							{
+								x = current_pos.x() + (current_side ? walk_len : -walk_len);
+								y = current_pos.y();
+							}
+							else if (walk_dir == 1)
+							{
+								x = current_pos.x();
+								y = current_pos.y() + (current_side ? walk_len : -walk_len);
+							}
 							else
-								y = current_pos.y() - walk_len - 1;
+							{
+								//取隨機數
+								QRandomGenerator* random = QRandomGenerator::global();
+								x = random->bounded(current_pos.x() - walk_len, current_pos.x() + walk_len);
+								y = random->bounded(current_pos.y() - walk_len, current_pos.y() + walk_len);
+							}
+
+							//每次循環切換方向
+							current_side = !current_side;
+
+							//移動 每次只發送一個目標座標 以一步計
+							injector.server->move(QPoint(x, y));
+							pacer.step();
 						}
-						else
+						else //快速遇敵 (封包)
 						{
-							//取隨機數
-							QRandomGenerator* random = QRandomGenerator::global();
-							x = random->bounded(current_pos.x() - walk_len, current_pos.x() + walk_len);
-							y = random->bounded(current_pos.x() - walk_len, current_pos.x() + walk_len);
+							injector.server->move(QPoint(0, 0), "gcgc");
+							pacer.step(kPatrolStepsPerSend);
 						}
-
-						//每次循環切換方向
-						if (current_side)
-							current_side = false;
-						else
-							current_side = true;
-
-						//移動
-						injector.server->move(QPoint(x, y));
-						injector.server->move(QPoint(x, y), "gcgc");
 					}
-					else if (enableFastAutoWalk) //快速遇敵 (封包)
-						injector.server->move(QPoint(0, 0), "gcgc");
-					QThread::msleep(walk_speed + 1);//避免太快無論如何都+15ms (太快並不會遇比較快)
+
+					//避免太快無論如何都+1ms (太快並不會遇比較快)
+					pacer.setInterval(walk_speed + 1);
+					pacer.wait();
 				}
 			});
 	}
@@ -1966,25 +2105,46 @@ void MainObject::checkRecordableNpcInfo()
 	if (injector.server.isNull())
 		return;
 
-	pointerWriterSync_.addFuture(QtConcurrent::run([this]()
+	if ((injector.server->getWorldStatus() != 9) || (injector.server->getGameStatus() != 3))
+		return;
+
+	//只處理收到變化通知的單位 沒有待處理的單位時不需要掃描
+	QSet<int> ids;
+	{
+		QMutexLocker locker(&npcPendingMutex_);
+		if (npcPendingIds_.isEmpty())
+			return;
+		ids.swap(npcPendingIds_);
+	}
+
+	pointerWriterSync_.addFuture(QtConcurrent::run([this, ids]()
 		{
 			Injector& injector = Injector::getInstance();
-			if (injector.server.isNull())
-				return;
+			QSet<int> remaining = ids;
+			//中途中斷或狀態改變時 未處理的單位放回待處理集合下次再試
+			auto requeue = [this, &remaining]()
+			{
+				QMutexLocker locker(&npcPendingMutex_);
+				npcPendingIds_.unite(remaining);
+			};
 
-			util::SafeHash<int, mapunit_t> units = injector.server->mapUnitHash;
-			for (const mapunit_t& unit : units)
+			for (const int id : ids)
 			{
-				if (isInterruptionRequested())
+				if (isInterruptionRequested() || injector.server.isNull()
+					|| (injector.server->getWorldStatus() != 9)
+					|| (injector.server->getGameStatus() != 3))
+				{
+					requeue();
 					return;
+				}
 
-				if (injector.server.isNull())
-					return;
+				remaining.remove(id);
+				if (!injector.server->mapUnitHash.contains(id))
+					continue;
 
+				const mapunit_t unit = injector.server->mapUnitHash.value(id);
 				if ((unit.objType != util::OBJ_NPC)
 					|| unit.name.isEmpty()
-					|| (injector.server->getWorldStatus() != 9)
-					|| (injector.server->getGameStatus() != 3)
 					|| injector.server->npcUnitPointHash.contains(QPoint(unit.x, unit.y)))
 				{
 					continue;
@@ -2034,7 +2194,7 @@ void MainObject::checkRecordableNpcInfo()
 						}
 						if (!flag)
 						{
-							return;
+							continue;
 						}
 					}
 				}
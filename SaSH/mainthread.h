@@ -85,6 +85,10 @@ private:
 	bool login_run_once_flag_ = false;
 	bool battle_run_once_flag_ = false;
 
+	//等待記錄的周圍單位ID 由單位變化通知寫入 實際處理過才移除
+	QMutex npcPendingMutex_;
+	QSet<int> npcPendingIds_;
+
 	bool flagBattleDialogEnable_ = false;
 	bool flagAutoLoginEnable_ = false;
 	bool flagAutoReconnectEnable_ = false;
@@ -27,9 +27,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
 #pragma region ASTAR
 
-constexpr int kStepValue = 24;//10;
-constexpr int kObliqueValue = 32;//14;
-
 CAStar::CAStar()
 	: step_val_(kStepValue)
 	, oblique_val_(kObliqueValue)
@@ -88,6 +85,7 @@ void CAStar::init(const CAStarParam& param)
 {
 	width_ = param.width;
 	height_ = param.height;
+	start_ = param.start;
 	can_pass_ = param.can_pass;
 	mapping_.clear();
 	mapping_.resize(width_ * height_);
@@ -127,6 +125,19 @@ bool CAStar::get_node_index(Node*& node, int* index)
 	return false;
 }
 
+// 展開優先度比較
+__forceinline bool CAStar::is_worse(const Node* a, const Node* b)
+{
+	if (a->f() != b->f())
+		return a->f() > b->f();
+
+	//f相同時優先展開離終點較近的 可減少在開闊地形上的無效展開
+	if (a->h != b->h)
+		return a->h > b->h;
+
+	return a->cross > b->cross;
+}
+
 // 二叉堆上濾
 void CAStar::percolate_up(int& hole)
 {
@@ -134,7 +145,7 @@ void CAStar::percolate_up(int& hole)
 	while (hole > 0)
 	{
 		parent = (hole - 1) / 2;
-		if (open_list_[hole]->f() < open_list_[parent]->f())
+		if (is_worse(open_list_[parent], open_list_[hole]))
 		{
 #if _MSVC_LANG > 201703L
 			std::ranges::swap(open_list_[hole], open_list_[parent]);
@@ -179,18 +190,32 @@ __forceinline int CAStar::calcul_g_value(Node*& parent, const QPoint& current)
 #endif
 }
 
-// 計算F值
+// 計算H值
 __forceinline int CAStar::calcul_h_value(const QPoint& current, const QPoint& end)
 {
 #if defined(Chebyshev_distance)
 	int h_value = Chebyshev_Distance(current, end);
+	return h_value * kStepValue;
 #elif defined(Euclidean_distance)
 	int h_value = Euclidean_Distance(current, end);
+	return h_value * kStepValue;
 #else
-	int h_value = (end - current).manhattanLength();
-
+	//對角距離 與實際步進成本一致 不會高估 保證路徑最短
+	const int dx = std::abs(end.x() - current.x());
+	const int dy = std::abs(end.y() - current.y());
+	const int diagonal = std::min(dx, dy);
+	return (diagonal * kObliqueValue) + ((std::max(dx, dy) - diagonal) * kStepValue);
 #endif
-	return h_value * kStepValue;
+}
+
+// 計算偏離值 (當前點與起點分別到終點的向量外積)
+__forceinline int CAStar::calcul_cross_value(const QPoint& current, const QPoint& end)
+{
+	const int dx1 = current.x() - end.x();
+	const int dy1 = current.y() - end.y();
+	const int dx2 = start_.x() - end.x();
+	const int dy2 = start_.y() - end.y();
+	return std::abs((dx1 * dy2) - (dx2 * dy1));
 }
 
 // 節點是否存在於開啟列表
@@ -302,6 +327,7 @@ void CAStar::handle_not_found_node(Node*& current, Node*& destination, const QPo
 {
 	destination->parent = current;
 	destination->h = calcul_h_value(destination->pos, end);
+	destination->cross = calcul_cross_value(destination->pos, end);
 	destination->g = calcul_g_value(current, destination->pos);
 
 	Node*& reference_node = mapping_[(int)destination->pos.y() * width_ + (int)destination->pos.x()];
@@ -315,7 +341,7 @@ void CAStar::handle_not_found_node(Node*& current, Node*& destination, const QPo
 	std::push_heap(open_list_.begin(), open_list_.end(), [](const Node* a, const Node* b)->bool
 #endif
 		{
-			return a->f() > b->f();
+			return is_worse(a, b);
 		});
 }
 
@@ -353,7 +379,7 @@ QVector<QPoint> CAStar::find(const CAStarParam& param)
 		std::pop_heap(open_list_.begin(), open_list_.end(), [](const Node* a, const Node* b)->bool
 #endif
 			{
-				return a->f() > b->f();
+				return is_worse(a, b);
 			});
 		open_list_.pop_back();
 		mapping_[(int)current->pos.y() * width_ + (int)current->pos.x()]->state = NodeState::IN_CLOSEDLIST;
@@ -25,6 +25,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
 using Callback = std::function<bool(const QPoint&)>;
 
+constexpr int kStepValue = 24;//10;
+constexpr int kObliqueValue = 32;//14;
+
 class CAStarParam
 {
 public:
@@ -63,6 +66,7 @@ private:
 	{
 		int         g;          // 與起點距離
 		int         h;          // 與終點距離
+		int         cross;      // 偏離起終點連線的程度 (同f同h時優先展開較小者)
 		QPoint      pos;        // 節點位置
 		NodeState   state;      // 節點狀態
 		Node* parent;     // 父節點
@@ -73,7 +77,7 @@ private:
 		inline int __fastcall  f() const { return g + h; }
 
 		inline Node(const QPoint& pos)
-			: g(0), h(0), pos(pos), parent(nullptr), state(NodeState::NOTEXIST)
+			: g(0), h(0), cross(0), pos(pos), parent(nullptr), state(NodeState::NOTEXIST)
 		{
 		}
 	};
@@ -126,6 +130,11 @@ private:
 	bool __fastcall  is_vlid_params(const CAStarParam& param) const;
 
 private:
+	/**
+	 * 節點a的展開優先度是否低於b (f相同時比較h 再比較cross 保證結果固定)
+	 */
+	static __forceinline bool __fastcall  is_worse(const Node* a, const Node* b);
+
 	/**
 	 * 二叉堆上濾
 	 */
@@ -142,10 +151,15 @@ private:
 	__forceinline int __fastcall  calcul_g_value(Node*& parent, const QPoint& current);
 
 	/**
-	 * 計算F值
+	 * 計算H值
 	 */
 	__forceinline int __fastcall  calcul_h_value(const QPoint& current, const QPoint& end);
 
+	/**
+	 * 計算偏離起終點連線的程度
+	 */
+	__forceinline int __fastcall  calcul_cross_value(const QPoint& current, const QPoint& end);
+
 	/**
 	 * 節點是否存在於開啟列表
 	 */
@@ -187,6 +201,7 @@ private:
 	std::vector<Node*>          mapping_;
 	int                     height_;
 	int                     width_;
+	QPoint                  start_;
 	Callback                can_pass_;
 	std::vector<Node*>      open_list_;
 #if _MSVC_LANG >= 201703L
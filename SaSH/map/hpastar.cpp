@@ -0,0 +1,438 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#include "stdafx.h"
+#include "hpastar.h"
+#include "astar.h"
+#include <queue>
+#include <QSet>
+
+#pragma region HPASTAR
+
+//入口長度超過此值時在兩端各放一個入口 否則只在中間放一個
+constexpr int kMaxSingleEntranceLength = 6;
+
+CHPAStar::CHPAStar(int width, int height, const std::vector<bool>& passable)
+	: width_(width)
+	, height_(height)
+	, sectorCols_((width + kSectorSize - 1) / kSectorSize)
+	, sectorRows_((height + kSectorSize - 1) / kSectorSize)
+	, passable_(passable)
+{
+	const int count = sectorCols_ * sectorRows_;
+	sectors_.resize(count);
+	borders_[0].resize(count);
+	borders_[1].resize(count);
+
+	for (int sector = 0; sector < count; ++sector)
+	{
+		buildBorder(sector, 0);
+		buildBorder(sector, 1);
+	}
+
+	for (int sector = 0; sector < count; ++sector)
+		buildSector(sector);
+
+	buildTransitions();
+}
+
+// 兩點是否值得走抽象圖
+bool CHPAStar::isLongDistance(const QPoint& src, const QPoint& dst) const
+{
+	const int dx = qAbs(src.x() / kSectorSize - dst.x() / kSectorSize);
+	const int dy = qAbs(src.y() / kSectorSize - dst.y() / kSectorSize);
+	return (dx > 1) || (dy > 1);
+}
+
+// 重建分區邊界的入口
+void CHPAStar::buildBorder(int sector, int dir)
+{
+	QVector<QPair<int, int>>& border = borders_[dir][sector];
+	border.clear();
+
+	const int sx = sector % sectorCols_;
+	const int sy = sector / sectorCols_;
+
+	//邊界上連續可通行的一段為一個入口
+	auto addRun = [this, &border, dir](int fixed, int begin, int end)
+	{
+		auto pairAt = [this, dir, fixed](int i)->QPair<int, int>
+		{
+			if (dir == 0)
+				return qMakePair(indexOf(fixed, i), indexOf(fixed + 1, i));
+			return qMakePair(indexOf(i, fixed), indexOf(i, fixed + 1));
+		};
+
+		const int length = end - begin + 1;
+		if (length < kMaxSingleEntranceLength)
+		{
+			border.append(pairAt(begin + length / 2));
+		}
+		else
+		{
+			border.append(pairAt(begin));
+			border.append(pairAt(end));
+		}
+	};
+
+	int fixed = 0, first = 0, last = 0;
+	if (dir == 0)
+	{
+		if (sx + 1 >= sectorCols_)
+			return;
+		fixed = (sx + 1) * kSectorSize - 1;
+		first = sy * kSectorSize;
+		last = qMin((sy + 1) * kSectorSize, height_) - 1;
+	}
+	else
+	{
+		if (sy + 1 >= sectorRows_)
+			return;
+		fixed = (sy + 1) * kSectorSize - 1;
+		first = sx * kSectorSize;
+		last = qMin((sx + 1) * kSectorSize, width_) - 1;
+	}
+
+	int runBegin = -1;
+	for (int i = first; i <= last; ++i)
+	{
+		const bool open = (dir == 0)
+			? (isPassable(fixed, i) && isPassable(fixed + 1, i))
+			: (isPassable(i, fixed) && isPassable(i, fixed + 1));
+
+		if (open && runBegin == -1)
+		{
+			runBegin = i;
+		}
+		else if (!open && runBegin != -1)
+		{
+			addRun(fixed, runBegin, i - 1);
+			runBegin = -1;
+		}
+	}
+
+	if (runBegin != -1)
+		addRun(fixed, runBegin, last);
+}
+
+// 重建分區內入口間的距離
+void CHPAStar::buildSector(int sector)
+{
+	Sector& s = sectors_[sector];
+	s.nodes.clear();
+	s.edges.clear();
+
+	const int sx = sector % sectorCols_;
+	const int sy = sector / sectorCols_;
+
+	auto addNode = [&s](int index)
+	{
+		if (!s.nodes.contains(index))
+			s.nodes.append(index);
+	};
+
+	//本區的東、南邊界取內側格 西、北鄰區的邊界取外側格
+	for (const QPair<int, int>& it : borders_[0][sector])
+		addNode(it.first);
+	for (const QPair<int, int>& it : borders_[1][sector])
+		addNode(it.first);
+	if (sx > 0)
+	{
+		for (const QPair<int, int>& it : borders_[0][sector - 1])
+			addNode(it.second);
+	}
+	if (sy > 0)
+	{
+		for (const QPair<int, int>& it : borders_[1][sector - sectorCols_])
+			addNode(it.second);
+	}
+
+	for (int node : s.nodes)
+	{
+		const QHash<int, int> distances = sectorDistances(sector, node, s.nodes);
+		QVector<Edge>& edges = s.edges[node];
+		for (auto it = distances.constBegin(); it != distances.constEnd(); ++it)
+		{
+			if (it.key() != node)
+				edges.append(Edge{ it.key(), it.value() });
+		}
+	}
+}
+
+// 重建跨區連線索引
+void CHPAStar::buildTransitions()
+{
+	transitions_.clear();
+	for (int dir = 0; dir < 2; ++dir)
+	{
+		for (const QVector<QPair<int, int>>& border : borders_[dir])
+		{
+			for (const QPair<int, int>& it : border)
+			{
+				transitions_[it.first].append(Edge{ it.second, kStepValue });
+				transitions_[it.second].append(Edge{ it.first, kStepValue });
+			}
+		}
+	}
+}
+
+// 在分區範圍內做Dijkstra
+QHash<int, int> CHPAStar::sectorDistances(int sector, int start, const QVector<int>& targets) const
+{
+	QHash<int, int> result;
+	if (targets.isEmpty())
+		return result;
+
+	const int x0 = (sector % sectorCols_) * kSectorSize;
+	const int y0 = (sector / sectorCols_) * kSectorSize;
+	const int x1 = qMin(x0 + kSectorSize, width_);
+	const int y1 = qMin(y0 + kSectorSize, height_);
+	const int w = x1 - x0;
+
+	auto local = [x0, y0, w](int x, int y)->int { return (y - y0) * w + (x - x0); };
+
+	std::vector<int> distance(w * (y1 - y0), std::numeric_limits<int>::max());
+	using Item = std::pair<int, int>;//<距離, 全域索引>
+	std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+
+	const QPoint sp = pointOf(start);
+	distance[local(sp.x(), sp.y())] = 0;
+	queue.push(Item(0, start));
+
+	int remain = targets.size();
+	while (!queue.empty() && remain > 0)
+	{
+		const Item item = queue.top();
+		queue.pop();
+
+		const QPoint p = pointOf(item.second);
+		if (item.first > distance[local(p.x(), p.y())])
+			continue;
+
+		if (targets.contains(item.second) && !result.contains(item.second))
+		{
+			result.insert(item.second, item.first);
+			--remain;
+		}
+
+		for (int dy = -1; dy <= 1; ++dy)
+		{
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				if (!dx && !dy)
+					continue;
+
+				const int nx = p.x() + dx;
+				const int ny = p.y() + dy;
+				if (nx < x0 || nx >= x1 || ny < y0 || ny >= y1 || !isPassable(nx, ny))
+					continue;
+
+				//斜向移動要求兩側直向格子都能通行 與CAStar一致
+				if (dx && dy && (!isPassable(nx, p.y()) || !isPassable(p.x(), ny)))
+					continue;
+
+				const int cost = item.first + ((dx && dy) ? kObliqueValue : kStepValue);
+				int& old = distance[local(nx, ny)];
+				if (cost < old)
+				{
+					old = cost;
+					queue.push(Item(cost, indexOf(nx, ny)));
+				}
+			}
+		}
+	}
+
+	return result;
+}
+
+// 對角距離估值
+int CHPAStar::octile(int from, int to) const
+{
+	const QPoint a = pointOf(from);
+	const QPoint b = pointOf(to);
+	const int dx = qAbs(a.x() - b.x());
+	const int dy = qAbs(a.y() - b.y());
+	return kObliqueValue * qMin(dx, dy) + kStepValue * (qMax(dx, dy) - qMin(dx, dy));
+}
+
+// 增量更新
+void CHPAStar::update(const std::vector<bool>& passable)
+{
+	if (passable.size() != passable_.size())
+		return;
+
+	QSet<int> dirty;
+	for (int y = 0; y < height_; ++y)
+	{
+		for (int x = 0; x < width_; ++x)
+		{
+			const int index = indexOf(x, y);
+			if (passable[index] != passable_[index])
+				dirty.insert(sectorOf(x, y));
+		}
+	}
+
+	if (dirty.isEmpty())
+		return;
+
+	passable_ = passable;
+
+	//變動分區的四條邊界都要重建 入口改變會影響相鄰分區的節點
+	QSet<int> rebuild;
+	for (int sector : dirty)
+	{
+		const int sx = sector % sectorCols_;
+		const int sy = sector / sectorCols_;
+
+		buildBorder(sector, 0);
+		buildBorder(sector, 1);
+		rebuild.insert(sector);
+
+		if (sx > 0)
+		{
+			buildBorder(sector - 1, 0);
+			rebuild.insert(sector - 1);
+		}
+		if (sx + 1 < sectorCols_)
+			rebuild.insert(sector + 1);
+		if (sy > 0)
+		{
+			buildBorder(sector - sectorCols_, 1);
+			rebuild.insert(sector - sectorCols_);
+		}
+		if (sy + 1 < sectorRows_)
+			rebuild.insert(sector + sectorCols_);
+	}
+
+	for (int sector : rebuild)
+		buildSector(sector);
+
+	buildTransitions();
+}
+
+// 在抽象圖上搜尋
+bool CHPAStar::find(const QPoint& src, const QPoint& dst, QVector<QPoint>* waypoints) const
+{
+	if (src.x() < 0 || src.x() >= width_ || src.y() < 0 || src.y() >= height_)
+		return false;
+	if (dst.x() < 0 || dst.x() >= width_ || dst.y() < 0 || dst.y() >= height_)
+		return false;
+
+	const int start = indexOf(src.x(), src.y());
+	const int goal = indexOf(dst.x(), dst.y());
+	const int startSector = sectorOf(src.x(), src.y());
+	const int goalSector = sectorOf(dst.x(), dst.y());
+
+	//起終點暫時接入所在分區的入口
+	const QHash<int, int> startEdges = sectorDistances(startSector, start, sectors_[startSector].nodes);
+	const QHash<int, int> goalEdges = sectorDistances(goalSector, goal, sectors_[goalSector].nodes);
+	if (startEdges.isEmpty() || goalEdges.isEmpty())
+		return false;
+
+	struct Item
+	{
+		int f;
+		int h;
+		int node;
+		bool operator>(const Item& other) const
+		{
+			//f相同時優先展開離終點較近的節點
+			return (f != other.f) ? (f > other.f) : (h > other.h);
+		}
+	};
+
+	std::priority_queue<Item, std::vector<Item>, std::greater<Item>> open;
+	QHash<int, int> g;
+	QHash<int, int> parent;
+
+	g.insert(start, 0);
+	open.push(Item{ octile(start, goal), octile(start, goal), start });
+
+	auto relax = [this, &g, &parent, &open, goal](int from, int to, int cost)
+	{
+		const int value = g.value(from) + cost;
+		auto it = g.find(to);
+		if (it != g.end() && it.value() <= value)
+			return;
+
+		g.insert(to, value);
+		parent.insert(to, from);
+		const int h = octile(to, goal);
+		open.push(Item{ value + h, h, to });
+	};
+
+	bool found = false;
+	while (!open.empty())
+	{
+		const Item item = open.top();
+		open.pop();
+
+		const int current = item.node;
+		if (item.f - item.h > g.value(current))
+			continue;
+
+		if (current == goal)
+		{
+			found = true;
+			break;
+		}
+
+		if (current == start)
+		{
+			for (auto it = startEdges.constBegin(); it != startEdges.constEnd(); ++it)
+				relax(current, it.key(), it.value());
+		}
+
+		const Sector& sector = sectors_[sectorOf(current % width_, current / width_)];
+		auto edges = sector.edges.constFind(current);
+		if (edges != sector.edges.constEnd())
+		{
+			for (const Edge& edge : edges.value())
+				relax(current, edge.to, edge.cost);
+		}
+
+		auto crossing = transitions_.constFind(current);
+		if (crossing != transitions_.constEnd())
+		{
+			for (const Edge& edge : crossing.value())
+				relax(current, edge.to, edge.cost);
+		}
+
+		auto last = goalEdges.constFind(current);
+		if (last != goalEdges.constEnd())
+			relax(current, goal, last.value());
+	}
+
+	if (!found)
+		return false;
+
+	if (waypoints)
+	{
+		QVector<QPoint> ret;
+		for (int node = goal; ; node = parent.value(node))
+		{
+			ret.prepend(pointOf(node));
+			if (node == start)
+				break;
+		}
+		*waypoints = ret;
+	}
+
+	return true;
+}
+#pragma endregion
@@ -0,0 +1,122 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+#pragma execution_character_set("utf-8")
+
+#include <vector>
+#include <QPoint>
+#include <QVector>
+#include <QHash>
+
+/**
+ * 分區階層式尋路 (HPA*)
+ * 將地圖切成固定大小的分區，預先計算分區邊界入口與分區內入口間的距離，
+ * 查詢時只在抽象圖上搜尋，由呼叫端再細化即將要走的一段。
+ */
+class CHPAStar
+{
+public:
+	static constexpr int kSectorSize = 16;
+
+	explicit CHPAStar(int width, int height, const std::vector<bool>& passable);
+
+	virtual ~CHPAStar() = default;
+
+public:
+	/**
+	 * 地圖大小是否與抽象圖相符
+	 */
+	Q_REQUIRED_RESULT inline bool __fastcall isCompatible(int width, int height) const { return (width == width_) && (height == height_); }
+
+	/**
+	 * 可通行數據是否與建立抽象圖時完全相同 (相同時不需要重建)
+	 */
+	Q_REQUIRED_RESULT inline bool __fastcall isSameData(const std::vector<bool>& passable) const { return passable == passable_; }
+
+	/**
+	 * 兩點是否值得走抽象圖 (同區或相鄰分區直接用A*較快)
+	 */
+	Q_REQUIRED_RESULT bool __fastcall isLongDistance(const QPoint& src, const QPoint& dst) const;
+
+	/**
+	 * 以新的可通行數據增量更新 只重建有變動的分區與其相鄰邊界
+	 */
+	void __fastcall update(const std::vector<bool>& passable);
+
+	/**
+	 * 在抽象圖上搜尋 輸出包含起點與終點的路標序列
+	 */
+	bool __fastcall find(const QPoint& src, const QPoint& dst, QVector<QPoint>* waypoints) const;
+
+private:
+	struct Edge
+	{
+		int to = 0;
+		int cost = 0;
+	};
+
+	struct Sector
+	{
+		QVector<int> nodes;                // 分區內的入口格
+		QHash<int, QVector<Edge>> edges;   // 入口格到同區其他入口格的距離
+	};
+
+	Q_REQUIRED_RESULT inline int __fastcall indexOf(int x, int y) const { return y * width_ + x; }
+	Q_REQUIRED_RESULT inline QPoint __fastcall pointOf(int index) const { return QPoint(index % width_, index / width_); }
+	Q_REQUIRED_RESULT inline int __fastcall sectorOf(int x, int y) const { return (y / kSectorSize) * sectorCols_ + (x / kSectorSize); }
+	Q_REQUIRED_RESULT inline bool __fastcall isPassable(int x, int y) const
+	{
+		return (x >= 0) && (x < width_) && (y >= 0) && (y < height_) && passable_[indexOf(x, y)];
+	}
+
+	/**
+	 * 重建分區east(dir=0)或south(dir=1)邊界的入口
+	 */
+	void __fastcall buildBorder(int sector, int dir);
+
+	/**
+	 * 重建分區內入口間的距離
+	 */
+	void __fastcall buildSector(int sector);
+
+	/**
+	 * 重建跨區連線索引
+	 */
+	void __fastcall buildTransitions();
+
+	/**
+	 * 在分區範圍內由start做Dijkstra 返回到各目標格的距離
+	 */
+	QHash<int, int> __fastcall sectorDistances(int sector, int start, const QVector<int>& targets) const;
+
+	/**
+	 * 對角距離估值 與kStepValue/kObliqueValue一致
+	 */
+	Q_REQUIRED_RESULT int __fastcall octile(int from, int to) const;
+
+private:
+	int width_ = 0;
+	int height_ = 0;
+	int sectorCols_ = 0;
+	int sectorRows_ = 0;
+	std::vector<bool> passable_;
+	std::vector<Sector> sectors_;
+	std::vector<QVector<QPair<int, int>>> borders_[2]; // [0]東側邊界 [1]南側邊界 每個分區各一條
+	QHash<int, QVector<Edge>> transitions_;           // 入口格到相鄰分區入口格
+};
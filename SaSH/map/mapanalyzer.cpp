@@ -1347,9 +1347,48 @@ bool __fastcall MapAnalyzer::getMapDataByFloor(int floor, map_t* map)
 	return false;
 }
 
-void __fastcall MapAnalyzer::setMapDataByFloor(int floor, const map_t& map)
+//超過此面積的地圖才建立分區抽象圖
+constexpr int kMinHierarchicalArea = 200 * 200;
+
+void __fastcall MapAnalyzer::setMapDataByFloor(int floor, const map_t& map, quint64 stamp)
 {
 	maps_.insert(floor, map);
+	if (stamp != 0)
+		stamps_.insert(floor, stamp);
+	else
+		stamps_.remove(floor);
+
+	if (map.width * map.height < kMinHierarchicalArea)
+	{
+		hpa_.remove(floor);
+		return;
+	}
+
+	std::vector<bool> passable(static_cast<size_t>(map.width) * map.height, false);
+	for (auto it = map.data.constBegin(); it != map.data.constEnd(); ++it)
+	{
+		const QPoint& p = it.key();
+		if (it.value() != util::OBJ_ROAD)
+			continue;
+		if (p.x() < 0 || p.x() >= map.width || p.y() < 0 || p.y() >= map.height)
+			continue;
+		passable[static_cast<size_t>(p.y()) * map.width + p.x()] = true;
+	}
+
+	//同尺寸的舊抽象圖只重建變動的分區 其餘沿用 (複製後替換 避免影響正在查詢的線程)
+	//檔案更新後可通行數據沒變時直接沿用 不複製也不掃描分區
+	QSharedPointer<CHPAStar> hpa = hpa_.value(floor);
+	if (!hpa.isNull() && hpa->isCompatible(map.width, map.height) && hpa->isSameData(passable))
+		return;
+
+	if (!hpa.isNull() && hpa->isCompatible(map.width, map.height))
+	{
+		QSharedPointer<CHPAStar> next(new CHPAStar(*hpa));
+		next->update(passable);
+		hpa_.insert(floor, next);
+	}
+	else
+		hpa_.insert(floor, QSharedPointer<CHPAStar>(new CHPAStar(map.width, map.height, passable)));
 }
 
 void __fastcall MapAnalyzer::setPixmapByIndex(int index, const QPixmap& pix)
@@ -1671,7 +1710,17 @@ bool __fastcall MapAnalyzer::loadFromBinary(int floor, map_t* _map)
 
 
 	const QString fileName(util::applicationDirPath() + "/map/" + QString::number(floor) + ".dat");
-	if (!QFile::exists(fileName)) return false;
+	const QFileInfo info(fileName);
+	if (!info.exists()) return false;
+
+	//每次尋路都會走到這裡 檔案沒變且已讀過時直接沿用 不重新解析也不重建分區抽象圖
+	const quint64 stamp = (static_cast<quint64>(info.lastModified().toMSecsSinceEpoch()) << 20) ^ static_cast<quint64>(info.size());
+	if ((stamp != 0) && (stamps_.value(floor) == stamp) && maps_.contains(floor))
+	{
+		if (_map)
+			*_map = maps_.value(floor);
+		return true;
+	}
 
 	std::string f(fileName.toStdString());
 	std::ifstream ifs(f, std::ios::binary | std::ios::in);
@@ -1726,7 +1775,7 @@ bool __fastcall MapAnalyzer::loadFromBinary(int floor, map_t* _map)
 	}
 
 	ifs.close();
-	setMapDataByFloor(floor, map);
+	setMapDataByFloor(floor, map, stamp);
 	if (_map)
 	{
 		*_map = map;
@@ -1825,7 +1874,7 @@ bool __fastcall MapAnalyzer::saveAsBinary(map_t map, const QString& fileName)
 	return true;
 }
 
-bool __fastcall MapAnalyzer::calcNewRoute(const map_t& map, const QPoint& src, const QPoint& dst, QVector<QPoint>* path)
+bool __fastcall MapAnalyzer::calcNewRoute(const map_t& map, const QPoint& src, const QPoint& dst, QVector<QPoint>* path, int* estimate)
 {
 	util::ObjectType obj = map.data.value(dst, util::OBJ_UNKNOWN);
 	bool isWrapPoint = (obj == util::OBJ_WARP) || (obj == util::OBJ_JUMP) || (obj == util::OBJ_UP) || (obj == util::OBJ_DOWN);
@@ -1859,6 +1908,47 @@ bool __fastcall MapAnalyzer::calcNewRoute(const map_t& map, const QPoint& src, c
 
 	QVector<QPoint> pathret = {};
 
+	//大地圖的長距離尋路 先在分區抽象圖上找路標 只細化即將要走的一段 (呼叫端每走幾步就會重算)
+	QSharedPointer<CHPAStar> hpa = hpa_.value(map.floor);
+	if (!hpa.isNull() && hpa->isCompatible(map.width, map.height) && hpa->isLongDistance(src, dst))
+	{
+		QVector<QPoint> waypoints;
+		if (hpa->find(src, dst, &waypoints) && waypoints.size() > 1)
+		{
+			//跳過離起點太近的路標 避免每次只細化寥寥數步
+			int next = 1;
+			while ((next + 1) < waypoints.size())
+			{
+				const QPoint& p = waypoints.at(next);
+				if (qMax(qAbs(p.x() - src.x()), qAbs(p.y() - src.y())) >= CHPAStar::kSectorSize)
+					break;
+				++next;
+			}
+
+			CAStar astar;
+			CAStarParam param(map.height, map.width, callback, src, waypoints.at(next));
+			pathret = astar.find(param);
+			if (!pathret.isEmpty())
+			{
+				if (path)
+					*path = pathret;
+
+				//只有第一段是實際路徑 其後以路標間的對角距離估算總步數
+				if (estimate)
+				{
+					int total = pathret.size();
+					for (int i = next + 1; i < waypoints.size(); ++i)
+					{
+						const QPoint d = waypoints.at(i) - waypoints.at(i - 1);
+						total += qMax(qAbs(d.x()), qAbs(d.y()));
+					}
+					*estimate = total;
+				}
+				return true;
+			}
+		}
+	}
+
 	CAStar astar;
 	CAStarParam param(map.height, map.width, callback, src, dst);
 
@@ -1869,6 +1959,8 @@ bool __fastcall MapAnalyzer::calcNewRoute(const map_t& map, const QPoint& src, c
 	{
 		if (path)
 			*path = pathret;
+		if (estimate)
+			*estimate = pathret.size();
 	}
 	return bret;
 }
@@ -1908,6 +2000,132 @@ bool __fastcall MapAnalyzer::isPassable(int floor, const QPoint& src, const QPoi
 	return bret;
 }
 
+//計算走路遇敵的巡邏迴路 從src出發走length步後原路折返 路線上每一格都可通行且屬於src所在的連通區域
+//direction: 0 沿X軸 1 沿Y軸 其他 隨機方向
+//route: 以W2封包的方向字元(a-h)表示的閉合路線
+bool __fastcall MapAnalyzer::calcPatrolRoute(const map_t& map, const QPoint& src, int length, int direction, QString* route)
+{
+	constexpr int kMaxPatrolLength = 100;
+	if (length <= 0 || map.width <= 0 || map.height <= 0)
+		return false;
+
+	if (length > kMaxPatrolLength)
+		length = kMaxPatrolLength;
+
+	auto can_pass = [&map](const QPoint& p)->bool
+	{
+		if (p.x() < 0 || p.x() >= map.width || p.y() < 0 || p.y() >= map.height)
+			return false;
+		return map.data.value(p, util::OBJ_UNKNOWN) == util::OBJ_ROAD;
+	};
+
+	//只在以src為中心 邊長2*length+1的窗口內做廣度優先搜尋
+	const int side = length * 2 + 1;
+	const QPoint origin(src.x() - length, src.y() - length);
+	auto index_of = [&origin, side](const QPoint& p)->int
+	{
+		return (p.y() - origin.y()) * side + (p.x() - origin.x());
+	};
+
+	std::vector<int> distance(side * side, -1);
+	std::vector<char> from(side * side, -1);//進入該格時的方向
+	QVector<QPoint> queue;
+	queue.reserve(side * side);
+
+	distance[index_of(src)] = 0;
+	queue.append(src);
+
+	int reach = 0;
+	for (int head = 0; head < queue.size(); ++head)
+	{
+		const QPoint current = queue.at(head);
+		const int currentDistance = distance[index_of(current)];
+		if (currentDistance >= length)
+			continue;
+
+		for (int dir = 0; dir < MAX_DIR; ++dir)
+		{
+			const QPoint& offset = util::fix_point.at(dir);
+			const QPoint next = current + offset;
+			if (qAbs(next.x() - src.x()) > length || qAbs(next.y() - src.y()) > length)
+				continue;
+
+			const int nextIndex = index_of(next);
+			if (distance[nextIndex] != -1 || !can_pass(next))
+				continue;
+
+			//斜向移動時與尋路相同 要求兩側直向格子都能通行
+			if (offset.x() && offset.y()
+				&& (!can_pass(QPoint(next.x(), current.y())) || !can_pass(QPoint(current.x(), next.y()))))
+				continue;
+
+			distance[nextIndex] = currentDistance + 1;
+			from[nextIndex] = static_cast<char>(dir);
+			reach = qMax(reach, currentDistance + 1);
+			queue.append(next);
+		}
+	}
+
+	if (reach <= 0)
+		return false;
+
+	//在最遠可達的格子中按方向偏好挑選折返點
+	QVector<QPoint> candidates;
+	int bestScore = std::numeric_limits<int>::min();
+	for (const QPoint& p : queue)
+	{
+		if (distance[index_of(p)] != reach)
+			continue;
+
+		const int dx = qAbs(p.x() - src.x());
+		const int dy = qAbs(p.y() - src.y());
+		int score = 0;
+		if (direction == 0)
+			score = dx * side - dy;
+		else if (direction == 1)
+			score = dy * side - dx;
+
+		if (score > bestScore)
+		{
+			bestScore = score;
+			candidates.clear();
+		}
+
+		if (score == bestScore)
+			candidates.append(p);
+	}
+
+	if (candidates.isEmpty())
+		return false;
+
+	QPoint turn = candidates.first();
+	if (direction != 0 && direction != 1)
+		turn = candidates.at(QRandomGenerator::global()->bounded(candidates.size()));
+
+	//沿著來源方向回溯出去程 回程為去程反向
+	QVector<int> outward;
+	outward.reserve(reach);
+	QPoint p = turn;
+	while (p != src)
+	{
+		const int dir = from[index_of(p)];
+		outward.prepend(dir);
+		p -= util::fix_point.at(dir);
+	}
+
+	static const char kDirChars[] = "abcdefgh";
+	QString ret;
+	ret.reserve(outward.size() * 2);
+	for (int dir : outward)
+		ret.append(QChar(kDirChars[dir]));
+	for (int i = outward.size() - 1; i >= 0; --i)
+		ret.append(QChar(kDirChars[(outward.at(i) + 4) % MAX_DIR]));
+
+	if (route)
+		*route = ret;
+	return true;
+}
+
 // 取靠近目標的最佳座標和方向
 int __fastcall MapAnalyzer::calcBestFollowPointByDstPoint(int floor, const QPoint& src, const QPoint& dst, QPoint* ret, bool enableExt, int npcdir)
 {
@@ -23,7 +23,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <string>
 #include <QPoint>
 #include <QString>
+#include <QSharedPointer>
 #include <util.h>
+#include "hpastar.h"
 
 static const QHash<util::ObjectType, QColor> MAP_COLOR_HASH = {
 	{ util::OBJ_UNKNOWN,  QColor(0, 0, 1) },		 //黑
@@ -101,18 +103,21 @@ public:
 	virtual ~MapAnalyzer();
 	bool __fastcall readFromBinary(int floor, const QString& name, bool enableDraw = false);
 	bool __fastcall getMapDataByFloor(int floor, map_t* map);
-	bool __fastcall calcNewRoute(const map_t& map, const QPoint& src, const QPoint& dst, QVector<QPoint>* path);
-	void clear() { maps_.clear(); pixMap_.clear(); }
-	void clear(int floor) { maps_.remove(floor); pixMap_.remove(floor); }
+	//大地圖的長距離尋路只返回第一段 estimate為估算的總步數 (完整路徑時等於路徑長度)
+	bool __fastcall calcNewRoute(const map_t& map, const QPoint& src, const QPoint& dst, QVector<QPoint>* path, int* estimate = nullptr);
+	void clear() { maps_.clear(); pixMap_.clear(); hpa_.clear(); stamps_.clear(); }
+	//保留分區抽象圖 重新讀取同一樓層時只需增量更新
+	void clear(int floor) { maps_.remove(floor); pixMap_.remove(floor); stamps_.remove(floor); }
 	bool __fastcall saveAsBinary(map_t map, const QString& fileName);
 	Q_REQUIRED_RESULT QPixmap __fastcall getPixmapByIndex(int index) const { return pixMap_.value(index); }
 	int __fastcall calcBestFollowPointByDstPoint(int floor, const QPoint& src, const QPoint& dst, QPoint* ret, bool enableExt, int npcdir);
 	bool __fastcall isPassable(int floor, const QPoint& src, const QPoint& dst);
+	bool __fastcall calcPatrolRoute(const map_t& map, const QPoint& src, int length, int direction, QString* route);
 
 private:
 	Q_REQUIRED_RESULT inline QString __fastcall getCurrentMapPath(int floor) const;
 
-	inline void __fastcall setMapDataByFloor(int floor, const map_t& map);
+	inline void __fastcall setMapDataByFloor(int floor, const map_t& map, quint64 stamp = 0);
 	void __fastcall setPixmapByIndex(int index, const QPixmap& pix);
 
 	bool __fastcall loadFromBinary(int floor, map_t* _map);
@@ -188,6 +193,8 @@ private:
 	QString directory = "";
 	util::SafeHash<int, QPixmap> pixMap_;
 	util::SafeHash<int, map_t> maps_;
+	util::SafeHash<int, QSharedPointer<CHPAStar>> hpa_; //大地圖的分區抽象圖
+	util::SafeHash<int, quint64> stamps_; //由.dat讀入的地圖對應檔案的修改時間與大小 沒變時不重新讀取
 	QMutex mutex_;
 
 };
@@ -83,6 +83,13 @@ signals:
 	//mapform
 	void updateNpcList(int floor);
 
+	//周圍單位變化 每個封包每種類型最多一次 只帶有變動的單位ID
+	void mapUnitsAdded(const QVector<int>& ids);
+	void mapUnitsMoved(const QVector<int>& ids);
+	void mapUnitsChanged(const QVector<int>& ids);
+	void mapUnitsRemoved(const QVector<int>& ids);
+	void mapUnitsCleared();
+
 	//afkform
 	void updateComboBoxItemText(int type, const QStringList& textList);
 
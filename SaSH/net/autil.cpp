@@ -29,104 +29,226 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
 #include <injector.h>
 
-//char Autil::MesgSlice[sizeof(char*) * Autil::SLICE_MAX][Autil::SLICE_SIZE];
-
 namespace Autil
 {
-	QByteArray MesgSlice[sizeof(char*) * SLICE_SIZE];
-	util::SafeData<size_t> SliceCount;
-	util::SafeData<QString> PersonalKey;
-	QMutex MesgMutex;
-	QByteArray emptyByteArray(Autil::SLICE_SIZE, '\0');
+	//發送端可能由多個線程同時調用 各自使用自己的暫存區
+	thread_local ScratchArena SendScratch;
+
+	constexpr size_t INTCODESIZE = (sizeof(int) * 8 + 5) / 6;
+
+	//編碼後的長度上限 (每3字節4字符 另加不足3字節的尾部與結尾)
+	constexpr size_t encodedSize(size_t len)
+	{
+		return ((len + 2) / 3) * 4 + 1;
+	}
 }
 
-// -------------------------------------------------------------------
-// Initialize utilities
-//
-void __stdcall Autil::util_Init(void)
+Autil::KeySchedule::KeySchedule(const char* data, size_t size)
 {
-	QMutexLocker locker(&MesgMutex);
-	constexpr auto size = sizeof(char*) * Autil::SLICE_MAX;
-	for (int i = 0; i < size; ++i)
+	if (!data)
+		return;
+
+	if (size > PERSONALKEYSIZE)
+		size = PERSONALKEYSIZE;
+
+	//與舊的字串金鑰一致 遇'\0'截止
+	while ((length < static_cast<int>(size)) && (data[length] != '\0'))
 	{
-		Autil::MesgSlice[i] = emptyByteArray;
+		const char c = data[length];
+		key[length] = c;
+		//原本以無號整數計算後取模64 等價於只取低6位
+		add[length] = static_cast<unsigned char>(c & 0x3f);
+		sub[length] = static_cast<unsigned char>((64 - (c & 0x3f)) & 0x3f);
+		++length;
 	}
-	SliceCount = 0;
+	key[length] = '\0';
+
+	//向量化編解碼一次讀取一整段移位量 將金鑰重複展開以免換行
+	for (int i = length; (length > 0) && (i < static_cast<int>(sizeof(add))); ++i)
+	{
+		add[i] = add[i - length];
+		sub[i] = sub[i - length];
+	}
+}
+
+Autil::LineBuffer::LineBuffer(size_t capacity)
+	: data_(capacity)
+{
 }
 
-void __stdcall Autil::util_Release(void)
+bool Autil::LineBuffer::append(const char* data, size_t size)
 {
-	QMutexLocker locker(&MesgMutex);
-	constexpr auto size = sizeof(char*) * Autil::SLICE_MAX;
-	for (int i = 0; i < size; ++i)
+	if ((end_ + size) > data_.size())
 	{
-		Autil::MesgSlice[i] = emptyByteArray;
+		//只搬移未完成的行 已取出的行不再需要
+		const size_t pending = end_ - begin_;
+		if (begin_ > 0)
+			memmove(data_.data(), data_.data() + begin_, pending);
+		scan_ -= begin_;
+		begin_ = 0;
+		end_ = pending;
+
+		if ((end_ + size) > data_.size())
+		{
+			clear();
+			return false;
+		}
 	}
-	SliceCount = 0;
+
+	memcpy(data_.data() + end_, data, size);
+	end_ += size;
+	return true;
 }
 
-void __stdcall Autil::util_Clear(void)
+bool Autil::LineBuffer::takeLine(char** line, size_t* size)
 {
-	QMutexLocker locker(&MesgMutex);
-	constexpr auto size = sizeof(char*) * Autil::SLICE_MAX;
-	for (int i = 0; i < size; ++i)
+	char* base = data_.data();
+	char* newline = reinterpret_cast<char*>(memchr(base + scan_, '\n', end_ - scan_));
+	if (!newline)
 	{
-		Autil::MesgSlice[i] = emptyByteArray;
+		scan_ = end_;
+		return false;
 	}
-	SliceCount = 0;
+
+	char* head = base + begin_;
+	char* tail = std::remove(head, newline, '\r');
+	*tail = '\0';
+
+	*line = head;
+	*size = static_cast<size_t>(tail - head);
+
+	begin_ = static_cast<size_t>(newline - base) + 1;
+	scan_ = begin_;
+	if (begin_ == end_)
+		clear();
+
+	return true;
+}
+
+void Autil::LineBuffer::discardLines()
+{
+	//最後一個'\n'之前都是完整的行 只需往回掃過未完成的行
+	size_t last = end_;
+	while ((last > begin_) && (data_[last - 1] != '\n'))
+		--last;
+
+	if (last == begin_)
+		return;
+
+	begin_ = last;
+	scan_ = end_;
+	if (begin_ == end_)
+		clear();
+}
+
+Autil::ProtocolCodec::ProtocolCodec()
+	: sendKey_(std::make_shared<const KeySchedule>())
+{
+	clear();
+}
+
+char* Autil::ProtocolCodec::emptySlice()
+{
+	static char empty[1] = { '\0' };
+	return empty;
+}
+
+// -------------------------------------------------------------------
+// Clear all slices
+//
+void Autil::ProtocolCodec::clear()
+{
+	setSlices(nullptr, 0);
 }
 
 // -------------------------------------------------------------------
-// Split up a message into slices by spearator.  Store those slices
-// into a global buffer "char **MesgSlice"
+// Store the slices of a message.  Unused slices point to an empty string
+// so that no slice ever refers to a scratch buffer that has been reused.
+//
+void Autil::ProtocolCodec::setSlices(char* const* slices, size_t count)
+{
+	if (count > SLICE_MAX + 1)
+		count = SLICE_MAX + 1;
+
+	for (size_t i = 0; i <= SLICE_MAX; ++i)
+		slices_[i] = (i < count) ? slices[i] : emptySlice();
+
+	sliceCount_ = count;
+}
+
+bool Autil::ProtocolCodec::setPersonalKey(const char* data, size_t size)
+{
+	if (!data)
+		return false;
+
+	if (size > PERSONALKEYSIZE)
+		size = PERSONALKEYSIZE;
+
+	//每次收到數據都會調用 原始字節沒變時不必重建
+	if ((size == rawKeySize_) && (memcmp(data, rawKey_, size) == 0))
+		return false;
+
+	memcpy(rawKey_, data, size);
+	rawKeySize_ = size;
+
+	const KeySchedule key(data, size);
+	if (key == key_)
+		return false;
+
+	key_ = key;
+	std::atomic_store(&sendKey_, std::make_shared<const KeySchedule>(key));
+	return true;
+}
+
+std::shared_ptr<const Autil::KeySchedule> Autil::ProtocolCodec::sendKey() const
+{
+	return std::atomic_load(&sendKey_);
+}
+
+// -------------------------------------------------------------------
+// Split up a message into slices by spearator.  The separators are
+// replaced by '\0' in place and the slices of codec point into source,
+// so source must stay untouched until the message is dispatched.
 //
 // arg: source=message string;  separator=message separator (1 byte)
 // ret: (none)
-bool __stdcall Autil::util_SplitMessage(char* source, size_t dstlen, char* separator)
+bool __stdcall Autil::util_SplitMessage(ProtocolCodec& codec, char* source, size_t, char* separator)
 {
-	QMutexLocker locker(&MesgMutex);
+	char* slices[SLICE_MAX + 1] = {};
+	size_t count = 0;
 	if (source && separator)
 	{	// NULL input is invalid.
 		char* ptr = nullptr;
 		char* head = source;
 
-		while ((ptr = reinterpret_cast<char*>(strstr(head, separator))) && (SliceCount <= Autil::SLICE_MAX))
+		while ((ptr = reinterpret_cast<char*>(strstr(head, separator))) && (count <= Autil::SLICE_MAX))
 		{
 			ptr[0] = '\0';
-			if (strlen(head) < Autil::SLICE_SIZE)
+			if (static_cast<size_t>(ptr - head) < Autil::SLICE_SIZE)
 			{	// discard slices too large
-				//strcpy_s(MesgSlice[SliceCount], Autil::SLICE_SIZE - 1, head);
-				//_snprintf_s(MesgSlice[SliceCount].data(), Autil::SLICE_SIZE, _TRUNCATE, "%s", head);
-				MesgSlice[SliceCount] = head;
-				int count = SliceCount;
-				++count;
-				SliceCount = count;
+				slices[count++] = head;
 			}
 
 			head = ptr + 1;
 		}
-
-		strcpy_s(source, dstlen, head);	// remove splited slices
 	}
+
+	codec.setSlices(slices, count);
 	return true;
 }
 
 // -------------------------------------------------------------------
 // Encode the message
 //
-// arg: dst=output  src=input
-// ret: (none)
-void __stdcall Autil::util_EncodeMessage(char* dst, size_t dstlen, char* src)
+// arg: dst=output  src=input  len=src length
+// ret: length of dst, 0=failed
+int __stdcall Autil::util_EncodeMessage(char* dst, size_t dstlen, const char* src, size_t len)
 {
 	std::mt19937 generator(std::random_device{}());
 	std::uniform_int_distribution<int> distribution(0, 99);
 	int rn = distribution(generator);
 	int t1 = 0, t2 = 0;
-	//char t3[LBUFSIZE], tz[LBUFSIZE];
-	QByteArray t3(LBUFSIZE, '\0');
-	QByteArray tz(LBUFSIZE, '\0');
-	//memset(tz, 0, sizeof(tz));
-	//memset(t3, 0, sizeof(t3));
+	char seed[16] = {};	// This buffer is enough for an integer.
 
 #ifdef _BACK_VERSION
 	util_swapint(&t1, &rn, "3421");	// encode seed
@@ -135,14 +257,30 @@ void __stdcall Autil::util_EncodeMessage(char* dst, size_t dstlen, char* src)
 #endif
 	//  t2 = t1 ^ 0x0f0f0f0f;
 	t2 = t1 ^ 0xffffffff;
-	Autil::util_256to64(tz.data(), reinterpret_cast<char*>(&t2), sizeof(int), const_cast<char*>(Autil::DEFAULTTABLE));
-
-	Autil::util_shlstring(t3.data(), dstlen, src, rn);
+	const size_t seedlen = kernel::encode(seed, reinterpret_cast<char*>(&t2), sizeof(int), kernel::kZeroStream, 1);
 	//  printf("random number=%d\n", rn);
-	//strcat_s(tz.data(), t3.data());
-	strcat_s(tz.data(), LBUFSIZE, t3.data());
-	Autil::util_xorstring(dst, tz.data());
+	if ((seedlen + len + 1) > dstlen)
+	{
+		dst[0] = '\0';
+		return 0;
+	}
 
+	//種子與左移rn後的內容一次寫出並反相 (原util_shlstring後再util_xorstring)
+	char* out = dst;
+	for (size_t i = 0; i < seedlen; ++i)
+		*out++ = seed[i] ^ 255;
+
+	if (len)
+	{
+		const size_t offs = rn % len;
+		for (size_t i = offs; i < len; ++i)
+			*out++ = src[i] ^ 255;
+		for (size_t i = 0; i < offs; ++i)
+			*out++ = src[i] ^ 255;
+	}
+
+	*out = '\0';
+	return static_cast<int>(out - dst);
 }
 
 // -------------------------------------------------------------------
@@ -150,37 +288,37 @@ void __stdcall Autil::util_EncodeMessage(char* dst, size_t dstlen, char* src)
 //
 // arg: dst=output  src=input
 // ret: (none)
-void __stdcall Autil::util_DecodeMessage(char* dst, size_t dstlen, char* src)
+void __stdcall Autil::util_DecodeMessage(ProtocolCodec& codec, char* dst, size_t dstlen, char* src)
 {
 	//  strcpy(dst, src);
 	//  util_xorstring(dst, src);
 
-	constexpr auto INTCODESIZE = (sizeof(int) * 8 + 5) / 6;
-
 	int rn = 0;
 	int* t1 = nullptr;
 	int t2 = 0;
-	//char t3[4096], t4[4096];	// This buffer is enough for an integer.
-	//char tz[LBUFSIZE];
-	QByteArray t3(SBUFSIZE, '\0');
-	QByteArray t4(SBUFSIZE, '\0');
-	QByteArray tz(LBUFSIZE, '\0');
+	char t3[16] = {};	// This buffer is enough for an integer.
+	char t4[16] = {};
 
-	//memset(tz, 0, sizeof(tz));
-	//memset(t3, 0, sizeof(t3));
-	//memset(t4, 0, sizeof(t4));
+	size_t len = strlen(src);
+	if (len && (src[len - 1] == '\n'))
+		src[--len] = 0;
 
-	if (src[strlen(src) - 1] == '\n')
-		src[strlen(src) - 1] = 0;
-	Autil::util_xorstring(tz.data(), src);
+	if (len < INTCODESIZE)
+	{
+		dst[0] = '\0';
+		return;
+	}
+
+	char* tz = codec.reserve(ScratchArena::kXor, len + 1);
+	Autil::util_xorstring(tz, src);
 
 	rn = INTCODESIZE;
 	//  printf("INTCODESIZE=%d\n", rn);
 
-	strncpy_s(t4.data(), SBUFSIZE, tz.data(), INTCODESIZE);
-	t4.data()[INTCODESIZE] = '\0';
-	Autil::util_64to256(t3.data(), t4.data(), const_cast<char*>(Autil::DEFAULTTABLE));
-	t1 = reinterpret_cast<int*>(t3.data());
+	memcpy(t4, tz, INTCODESIZE);
+	t4[INTCODESIZE] = '\0';
+	kernel::decode(t3, t4, kernel::kZeroStream, 1);
+	t1 = reinterpret_cast<int*>(t3);
 
 	//  t2 = *t1 ^ 0x0f0f0f0f;
 	t2 = *t1 ^ 0xffffffff;
@@ -190,37 +328,31 @@ void __stdcall Autil::util_DecodeMessage(char* dst, size_t dstlen, char* src)
 	Autil::util_swapint(&rn, &t2, const_cast<char*>("3142"));
 #endif
 	//  printf("random number=%d\n", rn);
-	Autil::util_shrstring(dst, dstlen, tz.data() + INTCODESIZE, rn);
+	Autil::util_shrstring(dst, dstlen, tz + INTCODESIZE, rn);
 
 }
 
 // -------------------------------------------------------------------
-// Get a function information from MesgSlice.  A function is a complete
+// Get a function information from the slices.  A function is a complete
 // and identifiable message received, beginned at DEFAULTFUNCBEGIN and
 // ended at DEFAULTFUNCEND.  This routine will return the function ID
 // (Action ID) and how many fields this function have.
 //
 // arg: func=return function ID    fieldcount=return fields of the function
 // ret: 1=success  0=failed (function not complete)
-int __stdcall Autil::util_GetFunctionFromSlice(int* func, int* fieldcount)
+int __stdcall Autil::util_GetFunctionFromSlice(ProtocolCodec& codec, int* func, int* fieldcount)
 {
-	QMutexLocker locker(&MesgMutex);
-	//char t1[NETDATASIZE];
-	QByteArray t1(NETDATASIZE, '\0');
-	//memset(t1, 0, sizeof(t1));
 	int i = 0;
 
-	if (strcmp(MesgSlice[0], DEFAULTFUNCBEGIN) != 0)
-		util_DiscardMessage();
-
-	strcpy_s(t1.data(), NETDATASIZE, MesgSlice[1]);
+	if (strcmp(codec.slice(0), DEFAULTFUNCBEGIN) != 0)
+		util_DiscardMessage(codec);
 
 	// Robin adjust
 	//*func=atoi(t1);
-	*func = std::atoi(t1.data()) - 23;
+	*func = std::atoi(codec.slice(1)) - 23;
 	for (i = 0; i < Autil::SLICE_MAX; ++i)
 	{
-		if (strcmp(MesgSlice[i], Autil::DEFAULTFUNCEND) == 0)
+		if (strcmp(codec.slice(i), Autil::DEFAULTFUNCEND) == 0)
 		{
 			*fieldcount = i - 2;	// - "&" - "#" - "func" 3 fields
 			return 1;
@@ -231,43 +363,93 @@ int __stdcall Autil::util_GetFunctionFromSlice(int* func, int* fieldcount)
 }
 
 // -------------------------------------------------------------------
-// Discard a message from MesgSlice.
+// Discard a message from the slices.
 //
-void __stdcall Autil::util_DiscardMessage(void)
+void __stdcall Autil::util_DiscardMessage(ProtocolCodec& codec)
 {
-	SliceCount = 0;
+	codec.discardMessage();
+}
+
+Autil::PacketWriter::PacketWriter(int func)
+{
+	//sprintf_s(t1.data(), NETDATASIZE, "&;%d%s;#;", func + 13, buffer);
+	constexpr int FUNCTION_OFFSET = 13;
+	constexpr size_t FUNCSIZE = 12; // 函數編號 + 結尾
+	char* ptr = tail(2 + FUNCSIZE);
+	ptr[0] = '&';
+	ptr[1] = ';';
+	const int n = _snprintf_s(ptr + 2, FUNCSIZE, _TRUNCATE, "%d", func + FUNCTION_OFFSET);
+	size_ = 2 + static_cast<size_t>(qMax(n, 0));
+	data_[size_] = '\0';
+}
+
+char* Autil::PacketWriter::tail(size_t extra)
+{
+	//暫存區可能因擴充而搬移 每次都重新取得
+	data_ = SendScratch.reserve(ScratchArena::kField, size_ + extra + 1);
+	return data_ + size_;
+}
+
+char* Autil::PacketWriter::beginField(size_t maxSize)
+{
+	char* ptr = tail(1 + maxSize);
+	ptr[0] = *SEPARATOR;	// It's important to append a SEPARATOR between fields
+	return ptr + 1;
+}
+
+void Autil::PacketWriter::endField(size_t written)
+{
+	size_ += 1 + written;
+	data_[size_] = '\0';
+}
+
+const char* Autil::PacketWriter::finish(size_t* size)
+{
+	constexpr char FRAMEEND[] = ";#;";
+	constexpr size_t FRAMEENDSIZE = sizeof(FRAMEEND) - 1;
+	char* ptr = tail(FRAMEENDSIZE);
+	memcpy(ptr, FRAMEEND, FRAMEENDSIZE);
+	size_ += FRAMEENDSIZE;
+	data_[size_] = '\0';
+
+	if (size)
+		*size = size_;
+
+	if (size_ >= NETDATASIZE)
+		return nullptr;
+
+	return data_;
 }
 
 // -------------------------------------------------------------------
 // Send a message
 //
-// arg: fd=socket fd   func=function ID   buffer=data to send
-void __stdcall Autil::util_SendMesg(int func, char* buffer)
+// arg: writer=framed fields of the message
+void __stdcall Autil::util_SendMesg(PacketWriter& writer)
 {
-	//char t1[NETDATASIZE], t2[NETDATASIZE];
-	//memset(t1, 0, sizeof(t1));
-	//memset(t2, 0, sizeof(t2));
-	QByteArray t1(NETDATASIZE, '\0');
-	QByteArray t2(NETDATASIZE, '\0');
+	size_t framed = 0;
+	const char* t1 = writer.finish(&framed);
+	if (!t1)
+		return;
 
-	//sprintf_s(t1.data(), NETDATASIZE, "&;%d%s;#;", func + 13, buffer);
-	constexpr auto FUNCTION_OFFSET = 13;
-	constexpr auto FORMAT = "&;%d%s;#;";
-	_snprintf_s(t1.data(), NETDATASIZE, _TRUNCATE, FORMAT, func + FUNCTION_OFFSET, buffer);
+	const size_t t2len = framed + INTCODESIZE + 2; // 另留換行與結尾
+	char* t2 = SendScratch.reserve(ScratchArena::kPacket, t2len);
 #ifdef _NEWNET_
-	util_EncodeMessageTea(t2, t1);
+	util_EncodeMessageTea(t2, const_cast<char*>(t1));
+	int size = static_cast<int>(strlen(t2));
 #else
-	Autil::util_EncodeMessage(t2.data(), NETDATASIZE, t1.data());
+	int size = Autil::util_EncodeMessage(t2, t2len, t1, framed);
 #endif
+	if (size <= 0)
+		return;
 
 	Injector& injector = Injector::getInstance();
 
-	int size = static_cast<int>(strlen(t2.data()));
-	t2.data()[size] = '\n';
+	t2[size] = '\n';
 	size += 1;
 	HANDLE hProcess = injector.getProcess();
 	util::VirtualMemory ptr(hProcess, size, true);
-	mem::write(hProcess, ptr, t2.data(), size);
+	mem::write(hProcess, ptr, t2, size);
 	injector.sendMessage(Injector::kSendPacket, ptr, size);
 }
 
@@ -607,6 +789,50 @@ int __stdcall Autil::util_shr_64to256(char* dst, char* src, char* table, char* k
 	return dwcounter;
 }
 
+// -------------------------------------------------------------------
+// Same as util_256to64_shr on DEFAULTTABLE, using a key schedule.
+//
+int __stdcall Autil::util_256to64_shr(char* dst, const char* src, int len, const KeySchedule& key)
+{
+	if (!dst || !src || !key.isValid())
+		return 0;
+
+	return kernel::encode(dst, src, len, key.add, key.length);
+}
+
+// -------------------------------------------------------------------
+// Same as util_256to64_shl on DEFAULTTABLE, using a key schedule.
+//
+int __stdcall Autil::util_256to64_shl(char* dst, const char* src, int len, const KeySchedule& key)
+{
+	if (!dst || !src || !key.isValid())
+		return 0;
+
+	return kernel::encode(dst, src, len, key.sub, key.length);
+}
+
+// -------------------------------------------------------------------
+// Same as util_shl_64to256 on DEFAULTTABLE, using a key schedule.
+//
+int __stdcall Autil::util_shl_64to256(char* dst, const char* src, const KeySchedule& key)
+{
+	if (!dst || !src || !key.isValid())
+		return 0;
+
+	return kernel::decode(dst, src, key.sub, key.length);
+}
+
+// -------------------------------------------------------------------
+// Same as util_shr_64to256 on DEFAULTTABLE, using a key schedule.
+//
+int __stdcall Autil::util_shr_64to256(char* dst, const char* src, const KeySchedule& key)
+{
+	if (!dst || !src || !key.isValid())
+		return 0;
+
+	return kernel::decode(dst, src, key.add, key.length);
+}
+
 // -------------------------------------------------------------------
 // Swap a integer (4 byte).
 // The value "rule" indicates the swaping rule.  It's a 4 byte string
@@ -628,8 +854,9 @@ void __stdcall Autil::util_swapint(int* dst, int* src, char* rule)
 void __stdcall Autil::util_xorstring(char* dst, char* src)
 {
 	unsigned int i = 0;
+	const size_t len = strlen(src);
 
-	for (i = 0; i < strlen(src); ++i)
+	for (i = 0; i < len; ++i)
 		dst[i] = src[i] ^ 255;
 
 	dst[i] = '\0';
@@ -640,17 +867,21 @@ void __stdcall Autil::util_xorstring(char* dst, char* src)
 //
 void __stdcall Autil::util_shrstring(char* dst, size_t dstlen, char* src, int offs)
 {
-	char* ptr = nullptr;
-	//int len = strlen(src);
+	if (!dst || !src)
+		return;
 
-	if (!dst || !src || (strlen(src) < 1))
+	const size_t len = strlen(src);
+	if ((len < 1) || (len >= dstlen))
+	{
+		if (dstlen)
+			dst[0] = '\0';
 		return;
+	}
 
-	offs = strlen(src) - (offs % strlen(src));
-	ptr = src + offs;
-	strcpy_s(dst, dstlen, ptr);
-	strncat_s(dst, dstlen, src, offs);
-	dst[strlen(src)] = '\0';
+	offs = static_cast<int>(len - (offs % len));
+	memcpy(dst, src + offs, len - offs);
+	memcpy(dst + (len - offs), src, offs);
+	dst[len] = '\0';
 }
 
 // -------------------------------------------------------------------
@@ -658,33 +889,101 @@ void __stdcall Autil::util_shrstring(char* dst, size_t dstlen, char* src, int of
 //
 void __stdcall Autil::util_shlstring(char* dst, size_t dstlen, char* src, int offs)
 {
-	char* ptr = nullptr;
-	if (!dst || !src || (strlen(src) < 1))
+	if (!dst || !src)
 		return;
 
-	offs = offs % strlen(src);
-	ptr = src + offs;
-	strcpy_s(dst, dstlen, ptr);
-	strncat_s(dst, dstlen, src, offs);
-	dst[strlen(src)] = '\0';
+	const size_t len = strlen(src);
+	if ((len < 1) || (len >= dstlen))
+	{
+		if (dstlen)
+			dst[0] = '\0';
+		return;
+	}
+
+	offs = static_cast<int>(offs % len);
+	memcpy(dst, src + offs, len - offs);
+	memcpy(dst + (len - offs), src, offs);
+	dst[len] = '\0';
+}
+
+// -------------------------------------------------------------------
+// Unescape a string field in place.
+//
+// Only the runs between backslashes are moved, and only once an escape has
+// shortened the span; the runs themselves are found with memchr.
+//
+size_t __stdcall Autil::util_unescape(char* src, size_t len)
+{
+	if (!src || !len)
+		return 0;
+
+	char* const end = src + len;
+	char* dst = src;
+	char* cur = src;
+
+	for (;;)
+	{
+		char* p = static_cast<char*>(memchr(cur, '\\', end - cur));
+		if (p == nullptr)
+			break;
+
+		//連續的雙字節範圍字節為奇數個時 反斜線是前一個字的尾字節
+		//cur必定落在字的邊界上 (字串開頭或ASCII之後) 往回數到cur即可
+		size_t run = 0;
+		for (const char* q = p; q > cur; --q)
+		{
+			const unsigned char u = static_cast<unsigned char>(q[-1]);
+			if (u < 0x81 || u > 0xfe)
+				break;
+			++run;
+		}
+
+		char escaped = '\0';
+		if (!(run & 1) && (p + 1 < end))
+			escaped = ESCAPETABLE.value[static_cast<unsigned char>(p[1])];
+
+		if (escaped == '\0')
+		{
+			//原樣保留反斜線
+			++p;
+			if (dst != cur)
+				memmove(dst, cur, p - cur);
+			dst += p - cur;
+			cur = p;
+			continue;
+		}
+
+		if (dst != cur)
+			memmove(dst, cur, p - cur);
+		dst += p - cur;
+		*dst++ = escaped;
+		cur = p + 2;
+	}
+
+	if (dst == cur)
+		return len;
+
+	memmove(dst, cur, end - cur);
+	dst += end - cur;
+	*dst = '\0';
+	return static_cast<size_t>(dst - src);
 }
 
 // -------------------------------------------------------------------
 // Convert a message slice into integer.  Return a checksum.
 //
-// arg: sliceno=slice index in MesgSlice    value=result
+// arg: sliceno=slice index in codec    value=result
 // ret: checksum, this value must match the one generated by util_mkint
-int __stdcall Autil::util_deint(int sliceno, int* value)
+int __stdcall Autil::util_deint(ProtocolCodec& codec, int sliceno, int* value)
 {
-	QMutexLocker locker(&MesgMutex);
 	int* t1 = nullptr;
 	int t2 = 0;
-	//char t3[4096];	// This buffer is enough for an integer.
-	//memset(t3, 0, sizeof(t3));
-	QByteArray t3(SBUFSIZE, '\0');
+	char* slice = codec.slice(sliceno);
+	char* t3 = codec.reserve(ScratchArena::kField, strlen(slice) + sizeof(int) + 1);
+	memset(t3, 0, sizeof(int) + 1);	// short slices leave the tail of the integer zeroed
 
-	Autil::util_shl_64to256(t3.data(), MesgSlice[sliceno].data(), const_cast<char*>(Autil::DEFAULTTABLE), PersonalKey.data().toUtf8().data());
-	t1 = reinterpret_cast<int*>(t3.data());
+	Autil::util_shl_64to256(t3, slice, codec.personalKey());
+	t1 = reinterpret_cast<int*>(t3);
 	t2 = *t1 ^ 0xffffffff;
 #ifdef _BACK_VERSION
 	util_swapint(value, &t2, "3421");
@@ -697,14 +996,11 @@ int __stdcall Autil::util_deint(int sliceno, int* value)
 // -------------------------------------------------------------------
 // Pack a integer into buffer (a string).  Return a checksum.
 //
-// arg: buffer=output   value=data to pack
+// arg: writer=output   value=data to pack   key=personal key
 // ret: checksum, this value must match the one generated by util_deint
-int __stdcall Autil::util_mkint(char* buffer, int value)
+int __stdcall Autil::util_mkint(PacketWriter& writer, int value, const KeySchedule& key)
 {
 	int t1 = 0, t2 = 0;
-	//char t3[4096];	// This buffer is enough for an integer.
-	//memset(t3, 0, sizeof(t3));
-	QByteArray t3(SBUFSIZE, '\0');
 
 #ifdef _BACK_VERSION
 	util_swapint(&t1, &value, "4312");
@@ -712,40 +1008,47 @@ int __stdcall Autil::util_mkint(char* buffer, int value)
 	Autil::util_swapint(&t1, &value, const_cast<char*>("3142"));
 #endif
 	t2 = t1 ^ 0xffffffff;
-	Autil::util_256to64_shr(t3.data(), (char*)&t2, sizeof(int), const_cast<char*>(Autil::DEFAULTTABLE), PersonalKey.data().toUtf8().data());
-	strcat_s(buffer, NETDATASIZE, SEPARATOR);	// It's important to append a SEPARATOR between fields
-	strcat_s(buffer, NETDATASIZE, t3.data());
+	char* t3 = writer.beginField(INTCODESIZE);
+	writer.endField(Autil::util_256to64_shr(t3, reinterpret_cast<const char*>(&t2), sizeof(int), key));
 
 	return value;
 }
 
 // -------------------------------------------------------------------
-// Convert a message slice into string.  Return a checksum.
+// Convert a message slice into string in place.  Return a checksum.
 //
-// arg: sliceno=slice index in MesgSlice    value=result
+// arg: sliceno=slice index in codec    value=result, points into the slice
 // ret: checksum, this value must match the one generated by util_mkstring
-int __stdcall Autil::util_destring(int sliceno, char* value)
+int __stdcall Autil::util_destring(ProtocolCodec& codec, int sliceno, char** value)
 {
-	QMutexLocker locker(&MesgMutex);
-	Autil::util_shr_64to256(value, MesgSlice[sliceno].data(), const_cast<char*>(Autil::DEFAULTTABLE), PersonalKey.data().toUtf8().data());
+	char* slice = codec.slice(sliceno);
+	*value = slice;
+	if (slice[0] == '\0')
+		return 0;
 
-	return strlen(value);
+	if (((strlen(slice) * 3) / 4 + 1) >= NETDATASIZE)
+	{
+		slice[0] = '\0';
+		return 0;	// keep the old limit of NETDATASIZE bytes per string
+	}
+
+	//解碼結果不會比原文長 逐段讀取後才寫回 可直接覆寫欄位
+	if (Autil::util_shr_64to256(slice, slice, codec.personalKey()) <= 0)
+		slice[0] = '\0';
+
+	return strlen(slice);
 }
 
 // -------------------------------------------------------------------
 // Convert a string into buffer (a string).  Return a checksum.
 //
-// arg: buffer=output   value=data to pack
+// arg: writer=output   value=data to pack   key=personal key
 // ret: checksum, this value must match the one generated by util_destring
-int __stdcall Autil::util_mkstring(char* buffer, char* value)
+int __stdcall Autil::util_mkstring(PacketWriter& writer, char* value, const KeySchedule& key)
 {
-	//char t1[Autil::SLICE_SIZE];
-	QByteArray t1(LBUFSIZE, '\0');
-	//memset(t1, 0, sizeof(t1));
-
-	Autil::util_256to64_shl(t1.data(), value, strlen(value), const_cast<char*>(Autil::DEFAULTTABLE), PersonalKey.data().toUtf8().data());
-	strcat_s(buffer, NETDATASIZE, SEPARATOR);	// It's important to append a SEPARATOR between fields
-	strcat_s(buffer, NETDATASIZE, t1.data());
+	const size_t len = strlen(value);
+	char* t1 = writer.beginField(encodedSize(len));
+	writer.endField(Autil::util_256to64_shl(t1, value, static_cast<int>(len), key));
 
-	return strlen(value);
+	return static_cast<int>(len);
 }
\ No newline at end of file
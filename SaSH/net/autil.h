@@ -20,6 +20,12 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
 #pragma once
 #include <util.h>
+#include <memory>
+#include <atomic>
+#include <type_traits>
+
+#include "autilsimd.h"
+
 namespace Autil
 {
 	constexpr size_t NETDATASIZE = 16384;
@@ -28,12 +34,182 @@ namespace Autil
 	constexpr size_t SLICE_SIZE = 65500;
 	constexpr size_t LBUFSIZE = 65500;
 	constexpr size_t SBUFSIZE = 4096;
-	extern QByteArray MesgSlice[];//autil.cpp//[][Autil::SLICE_SIZE];	// store message slices
-	extern util::SafeData<size_t> SliceCount;//autil.cpp		// count slices in MesgSlice
+	constexpr size_t LINEBUFSIZE = NETBUFSIZ * 16;
+
+	//接收端的行緩衝 容量固定 取出的行直接指向緩衝區內不複製 下次append前有效
+	//未完成的行會搬到開頭等待後續數據 單行超過容量時視為錯誤數據並整個丟棄
+	class LineBuffer
+	{
+	public:
+		explicit LineBuffer(size_t capacity = LINEBUFSIZE);
+
+		/**
+		 * 追加接收到的數據 超過容量時清空並返回false
+		 */
+		bool __fastcall append(const char* data, size_t size);
+
+		/**
+		 * 取出下一個完整的行 已移除'\r'並以'\0'取代'\n' 沒有完整的行時返回false
+		 */
+		bool __fastcall takeLine(char** line, size_t* size);
+
+		/**
+		 * 丟棄尚未取出的完整行 保留未完成的行
+		 */
+		void __fastcall discardLines();
+
+		inline void __fastcall clear() { begin_ = end_ = scan_ = 0; }
+
+		Q_REQUIRED_RESULT inline bool __fastcall isEmpty() const { return begin_ == end_; }
+
+	private:
+		std::vector<char> data_;
+		size_t begin_ = 0;  // 下一行的開頭
+		size_t end_ = 0;    // 已接收數據的結尾
+		size_t scan_ = 0;   // 已確認沒有'\n'的位置 避免重複搜尋未完成的行
+	};
+
+	//可重複使用的暫存區 只增不減 不做清零 使用端需自行記錄寫入長度並補上結尾
+	class ScratchArena
+	{
+	public:
+		enum Slot
+		{
+			kLine,      // 解碼後的整行 (分割後由欄位表指向)
+			kXor,       // 解碼中間結果
+			kField,     // 單個欄位的解碼 / 發送端組裝中的封包
+			kPacket,    // 待發送的封包
+			kSlotCount,
+		};
+
+		Q_REQUIRED_RESULT inline char* __fastcall reserve(Slot slot, size_t size)
+		{
+			std::vector<char>& buffer = buffers_[slot];
+			if (buffer.size() < size)
+				buffer.resize(qMax(size, buffer.size() * 2));
+			return buffer.data();
+		}
+
+	private:
+		std::vector<char> buffers_[kSlotCount];
+	};
 
 	constexpr size_t PERSONALKEYSIZE = 32;
-	//extern QScopedArrayPointer<char> PersonalKey;
-	extern util::SafeData<QString> PersonalKey;//autil.cpp
+
+	/**
+	 * 預先展開的金鑰 欄位編解碼時直接查表 不做任何字串處理
+	 */
+	struct KeySchedule
+	{
+		char key[PERSONALKEYSIZE + 1] = {};   // 原始金鑰 以'\0'結尾
+		int length = 0;                       // 有效長度 (遇'\0'截止)
+		unsigned char add[PERSONALKEYSIZE + kernel::kStreamPad] = {}; // 第j個字符的右移量 (x + key[j]) % 64 依金鑰長度重複展開
+		unsigned char sub[PERSONALKEYSIZE + kernel::kStreamPad] = {}; // 第j個字符的左移量 (x + 64 - key[j]) % 64 依金鑰長度重複展開
+
+		KeySchedule() = default;
+		KeySchedule(const char* data, size_t size);
+
+		Q_REQUIRED_RESULT inline bool __fastcall isValid() const { return length > 0; }
+
+		Q_REQUIRED_RESULT inline bool operator==(const KeySchedule& other) const
+		{
+			return (length == other.length) && (memcmp(key, other.key, length) == 0);
+		}
+	};
+
+	/**
+	 * 單一連線的封包編解碼狀態 (欄位表 金鑰 暫存區)
+	 * 接收端的操作只應由同一時間的單一線程調用 因此不加鎖
+	 * 發送端可由任意線程調用 只讀取以原子方式發布的金鑰副本 暫存區則各線程自備
+	 */
+	class ProtocolCodec
+	{
+	public:
+		ProtocolCodec();
+
+		/**
+		 * 清空欄位表 (原util_Clear)
+		 */
+		void __fastcall clear();
+
+		/**
+		 * 捨棄當前訊息 (原SliceCount = 0)
+		 */
+		inline void __fastcall discardMessage() { sliceCount_ = 0; }
+
+		/**
+		 * 設置欄位表 count之後的欄位都會指向空字串
+		 */
+		void __fastcall setSlices(char* const* slices, size_t count);
+
+		Q_REQUIRED_RESULT inline char* __fastcall slice(size_t index) const { return (index <= SLICE_MAX) ? slices_[index] : emptySlice(); }
+		Q_REQUIRED_RESULT inline size_t __fastcall sliceCount() const { return sliceCount_; }
+
+		/**
+		 * 以原始金鑰字節更新金鑰 返回金鑰是否有變動
+		 * 與上次的原始字節相同時只做一次memcmp 不重建金鑰表
+		 */
+		bool __fastcall setPersonalKey(const char* data, size_t size);
+
+		/**
+		 * 接收端使用的金鑰
+		 */
+		Q_REQUIRED_RESULT inline const KeySchedule& __fastcall personalKey() const { return key_; }
+
+		/**
+		 * 發送端使用的金鑰副本 可跨線程讀取
+		 */
+		Q_REQUIRED_RESULT std::shared_ptr<const KeySchedule> __fastcall sendKey() const;
+
+		Q_REQUIRED_RESULT inline char* __fastcall reserve(ScratchArena::Slot slot, size_t size) { return scratch_.reserve(slot, size); }
+
+	private:
+		static char* __fastcall emptySlice();
+
+	private:
+		char* slices_[SLICE_MAX + 1] = {};
+		size_t sliceCount_ = 0;
+		char rawKey_[PERSONALKEYSIZE] = {};
+		size_t rawKeySize_ = 0;
+		KeySchedule key_;
+		std::shared_ptr<const KeySchedule> sendKey_;
+		ScratchArena scratch_;
+	};
+
+	/**
+	 * 發送封包的組裝游標 欄位直接編碼到當前線程重複使用的暫存區尾端
+	 * 內容依序為 "&;函數編號" ";欄位"... ";#;" 全程不重新掃描已寫入的部分
+	 */
+	class PacketWriter
+	{
+	public:
+		explicit PacketWriter(int func);
+
+		/**
+		 * 開始一個欄位 先寫入分隔符 返回可寫入至少maxSize+1字節的位置
+		 */
+		Q_REQUIRED_RESULT char* __fastcall beginField(size_t maxSize);
+
+		/**
+		 * 結束欄位 written為實際寫入的字節數 (不含結尾)
+		 */
+		void __fastcall endField(size_t written);
+
+		/**
+		 * 補上封包結尾 返回完整內容 長度超過NETDATASIZE時返回nullptr
+		 */
+		Q_REQUIRED_RESULT const char* __fastcall finish(size_t* size);
+
+	private:
+		/**
+		 * 確保尾端還有extra字節可寫 返回寫入位置
+		 */
+		char* __fastcall tail(size_t extra);
+
+	private:
+		char* data_ = nullptr;
+		size_t size_ = 0;
+	};
 
 	constexpr const char* SEPARATOR = ";";
 
@@ -41,19 +217,18 @@ namespace Autil
 	constexpr const char* DEFAULTFUNCBEGIN = "&";
 	constexpr const char* DEFAULTFUNCEND = "#";
 
-
-	void __stdcall util_Init(void);
-	void __stdcall util_Release(void);
-	void __stdcall util_Clear(void);
-	bool __stdcall util_SplitMessage(char* source, size_t dstlen, char* separator);
-	void __stdcall util_EncodeMessage(char* dst, size_t dstlen, char* src);
-	void __stdcall util_DecodeMessage(char* dst, size_t dstlen, char* src);
-	int __stdcall util_GetFunctionFromSlice(int* func, int* fieldcount);
-	void __stdcall util_DiscardMessage(void);
-	void __stdcall util_SendMesg(int func, char* buffer);
+	bool __stdcall util_SplitMessage(ProtocolCodec& codec, char* source, size_t dstlen, char* separator);
+	int __stdcall util_EncodeMessage(char* dst, size_t dstlen, const char* src, size_t len);
+	void __stdcall util_DecodeMessage(ProtocolCodec& codec, char* dst, size_t dstlen, char* src);
+	int __stdcall util_GetFunctionFromSlice(ProtocolCodec& codec, int* func, int* fieldcount);
+	void __stdcall util_DiscardMessage(ProtocolCodec& codec);
+	void __stdcall util_SendMesg(PacketWriter& writer);
 
 	// -------------------------------------------------------------------
 	// Encoding function units.  Use in Encrypting functions.
+	// These table/char* versions are the original implementation and are
+	// kept unchanged as the reference for the kernel based variants below:
+	// any change to Autil::kernel must produce identical output to them.
 	int __stdcall util_256to64(char* dst, char* src, int len, char* table);
 	int __stdcall util_64to256(char* dst, char* src, char* table);
 	int __stdcall util_256to64_shr(char* dst, char* src, int len, char* table, char* key);
@@ -61,54 +236,134 @@ namespace Autil
 	int __stdcall util_256to64_shl(char* dst, char* src, int len, char* table, char* key);
 	int __stdcall util_shr_64to256(char* dst, char* src, char* table, char* key);
 
+	// Keyed variants on DEFAULTTABLE with a precomputed key schedule.
+	int __stdcall util_256to64_shr(char* dst, const char* src, int len, const KeySchedule& key);
+	int __stdcall util_shl_64to256(char* dst, const char* src, const KeySchedule& key);
+	int __stdcall util_256to64_shl(char* dst, const char* src, int len, const KeySchedule& key);
+	int __stdcall util_shr_64to256(char* dst, const char* src, const KeySchedule& key);
+
 	void __stdcall util_swapint(int* dst, int* src, char* rule);
 	void __stdcall util_xorstring(char* dst, char* src);
 	void __stdcall util_shrstring(char* dst, size_t dstlen, char* src, int offs);
 	void __stdcall util_shlstring(char* dst, size_t dstlen, char* src, int offs);
+
+	// Server side escapes inside string fields: a backslash followed by
+	// n, c, z or y.  value[c] is the byte it stands for, 0 for any other c.
+	struct EscapeTable
+	{
+		char value[256];
+
+		constexpr EscapeTable()
+			: value()
+		{
+			value['n'] = '\n';
+			value['c'] = ',';
+			value['z'] = '|';
+			value['y'] = '\\';
+		}
+	};
+
+	constexpr EscapeTable ESCAPETABLE;
+
+	// Unescape a GB2312 byte span in place before it is transcoded.  A backslash
+	// that is the trail byte of a double byte character is left alone.
+	// Nothing is written when the span holds no escape.  Return the new length.
+	size_t __stdcall util_unescape(char* src, size_t len);
+
 	// -------------------------------------------------------------------
 	// Encrypting functions
-	int __stdcall util_deint(int sliceno, int* value);
-	int __stdcall util_mkint(char* buffer, int value);
-	int __stdcall util_destring(int sliceno, char* value);
-	int __stdcall util_mkstring(char* buffer, char* value);
+	int __stdcall util_deint(ProtocolCodec& codec, int sliceno, int* value);
+	int __stdcall util_mkint(PacketWriter& writer, int value, const KeySchedule& key);
+	int __stdcall util_destring(ProtocolCodec& codec, int sliceno, char** value);
+	int __stdcall util_mkstring(PacketWriter& writer, char* value, const KeySchedule& key);
 
-	// 輔助函數，處理整數參數
-	template<typename Arg>
-	inline void util_SendProcessArg(int& sum, char* buffer, Arg arg)
+	// 輔助函數，接收整數欄位
+	inline int util_RecvProcessArg(ProtocolCodec& codec, int sliceno, int& arg)
 	{
-		sum += util_mkint(buffer, arg);
+		return util_deint(codec, sliceno, &arg);
 	}
 
-	// 輔助函數，處理字符串參數（重載版本）
-	inline void util_SendProcessArg(int& sum, char* buffer, char* arg)
+	// 輔助函數，接收字符串欄位 (原地解碼 指向欄位表內的字串 處理下一個訊息前有效)
+	inline int util_RecvProcessArg(ProtocolCodec& codec, int sliceno, char*& arg)
 	{
-		sum += util_mkstring(buffer, arg);
+		return util_destring(codec, sliceno, &arg);
 	}
 
-	// 輔助函數，遞歸處理參數
+	// 輔助函數，處理最後一個欄位
+	template<typename Arg>
+	void util_RecvProcessArgs(int& sum, ProtocolCodec& codec, int& sliceno, Arg& arg)
+	{
+		sum += util_RecvProcessArg(codec, sliceno++, arg);
+	}
+
+	// 輔助函數，遞歸處理欄位
 	template<typename Arg, typename... Args>
-	void util_SendProcessArgs(int& sum, char* buffer, Arg arg, Args... args)
+	void util_RecvProcessArgs(int& sum, ProtocolCodec& codec, int& sliceno, Arg& arg, Args&... args)
+	{
+		sum += util_RecvProcessArg(codec, sliceno++, arg);
+		util_RecvProcessArgs(sum, codec, sliceno, args...);
+	}
+
+	// 主接收函數 依參數順序由第2個欄位開始解碼 最後一個欄位為校驗值 不符時捨棄訊息並返回false
+	template<typename... Args>
+	Q_REQUIRED_RESULT bool util_Recv(ProtocolCodec& codec, Args&... args)
+	{
+		int iChecksum = 0;
+		int sliceno = 2;
+		util_RecvProcessArgs(iChecksum, codec, sliceno, args...);
+
+		int iChecksumrecv = 0;
+		util_deint(codec, sliceno, &iChecksumrecv);
+		if (iChecksum != iChecksumrecv)
+		{
+			codec.discardMessage();
+			return false;
+		}
+
+		return true;
+	}
+
+	// 輔助函數，處理整數參數
+	template<typename Arg>
+	inline void util_SendProcessArg(int& sum, PacketWriter& writer, const KeySchedule& key, Arg arg)
 	{
-		util_SendProcessArg(sum, buffer, arg);
-		util_SendProcessArgs(sum, buffer, args...);
+		static_assert(std::is_integral<Arg>::value || std::is_enum<Arg>::value, "lssproto fields must be int or char*");
+		sum += util_mkint(writer, arg, key);
+	}
+
+	// 輔助函數，處理字符串參數（重載版本）
+	inline void util_SendProcessArg(int& sum, PacketWriter& writer, const KeySchedule& key, char* arg)
+	{
+		sum += util_mkstring(writer, arg, key);
 	}
 
 	// 輔助函數，處理最後一個參數
 	template<typename Arg>
-	void util_SendProcessArgs(int& sum, char* buffer, Arg arg)
+	void util_SendProcessArgs(int& sum, PacketWriter& writer, const KeySchedule& key, Arg arg)
 	{
-		util_SendProcessArg(sum, buffer, arg);
+		util_SendProcessArg(sum, writer, key, arg);
+	}
+
+	// 輔助函數，遞歸處理參數
+	template<typename Arg, typename... Args>
+	void util_SendProcessArgs(int& sum, PacketWriter& writer, const KeySchedule& key, Arg arg, Args... args)
+	{
+		util_SendProcessArg(sum, writer, key, arg);
+		util_SendProcessArgs(sum, writer, key, args...);
 	}
 
 	// 主發送函數
 	template<typename... Args>
-	void util_Send(int func, Args... args)
+	void util_Send(const ProtocolCodec& codec, int func, Args... args)
 	{
+		//整個封包使用同一份金鑰 避免中途被接收端更新
+		const std::shared_ptr<const KeySchedule> key = codec.sendKey();
+		const KeySchedule& pkey = *key;
+
 		int iChecksum = 0;
-		char buffer[NETDATASIZE] = {};
-		memset(buffer, 0, sizeof(buffer));
-		util_SendProcessArgs(iChecksum, buffer, args...);
-		util_mkint(buffer, iChecksum);
-		util_SendMesg(func, buffer);
+		PacketWriter writer(func);
+		util_SendProcessArgs(iChecksum, writer, pkey, args...);
+		util_mkint(writer, iChecksum, pkey);
+		util_SendMesg(writer);
 	}
 }
\ No newline at end of file
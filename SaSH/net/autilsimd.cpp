@@ -0,0 +1,469 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#include "stdafx.h"
+#include "autilsimd.h"
+#include "autil.h"
+
+#include <intrin.h>
+#include <immintrin.h>
+
+#include <atomic>
+
+namespace Autil
+{
+	namespace kernel
+	{
+		const unsigned char kZeroStream[1 + kStreamPad] = {};
+
+		//DEFAULTTABLE的反查表 不在表內的字符為-1
+		struct ReverseTable
+		{
+			signed char value[256];
+
+			constexpr ReverseTable()
+				: value()
+			{
+				for (int i = 0; i < 256; ++i)
+					value[i] = -1;
+				for (int i = 0; i < 64; ++i)
+					value[static_cast<unsigned char>(DEFAULTTABLE[i])] = static_cast<signed char>(i);
+			}
+		};
+
+		constexpr ReverseTable kReverse;
+
+		inline int __fastcall advance(int j, int step, int period)
+		{
+			j += step;
+			return (j >= period) ? (j % period) : j;
+		}
+
+		// -------------------------------------------------------------------
+		// Scalar continuation of encode from byte i (a multiple of 3).  Whole
+		// groups are done 3 bytes at a time, the tail step by step exactly like
+		// the original: the last character is only emitted if its bits are not 0.
+		int __fastcall encodeFrom(char* dst, int o, const char* src, int i, int len, const unsigned char* stream, int period, int j)
+		{
+			const unsigned char* s = reinterpret_cast<const unsigned char*>(src);
+
+			while ((i + 3) <= len)
+			{
+				const unsigned int w = s[i] | (s[i + 1] << 8) | (s[i + 2] << 16);
+				const unsigned char* k = stream + j;
+				dst[o] = DEFAULTTABLE[(w + k[0]) & 0x3f];
+				dst[o + 1] = DEFAULTTABLE[((w >> 6) + k[1]) & 0x3f];
+				dst[o + 2] = DEFAULTTABLE[((w >> 12) + k[2]) & 0x3f];
+				dst[o + 3] = DEFAULTTABLE[((w >> 18) + k[3]) & 0x3f];
+				o += 4;
+				i += 3;
+				j = advance(j, 4, period);
+			}
+
+			unsigned int dw = 0u;
+			if ((len - i) == 1)
+			{
+				dst[o++] = DEFAULTTABLE[(s[i] + stream[j]) & 0x3f];
+				j = advance(j, 1, period);
+				dw = s[i] >> 6;
+			}
+			else if ((len - i) == 2)
+			{
+				const unsigned int w = s[i] | (s[i + 1] << 8);
+				dst[o++] = DEFAULTTABLE[(w + stream[j]) & 0x3f];
+				j = advance(j, 1, period);
+				dst[o++] = DEFAULTTABLE[((w >> 6) + stream[j]) & 0x3f];
+				j = advance(j, 1, period);
+				dw = w >> 12;
+			}
+
+			if (dw)
+				dst[o++] = DEFAULTTABLE[(dw + stream[j]) & 0x3f];
+
+			dst[o] = '\0';
+			return o;
+		}
+
+		// -------------------------------------------------------------------
+		// Scalar continuation of decode from character i (a multiple of 4).
+		// value is the table index of the previous character: the original
+		// table scan kept its pointer when a character was not found, so an
+		// invalid character repeats the previous one.
+		int __fastcall decodeFrom(char* dst, int o, const char* src, int i, int n, const unsigned char* stream, int period, int j, int value)
+		{
+			const unsigned char* s = reinterpret_cast<const unsigned char*>(src);
+
+			while ((i + 4) <= n)
+			{
+				const int a = kReverse.value[s[i]];
+				const int b = kReverse.value[s[i + 1]];
+				const int c = kReverse.value[s[i + 2]];
+				const int d = kReverse.value[s[i + 3]];
+				if ((a | b | c | d) < 0)
+					break;
+
+				const unsigned char* k = stream + j;
+				const unsigned int w = ((a + k[0]) & 0x3f)
+					| (((b + k[1]) & 0x3f) << 6)
+					| (((c + k[2]) & 0x3f) << 12)
+					| (((d + k[3]) & 0x3f) << 18);
+				dst[o] = static_cast<char>(w & 0xff);
+				dst[o + 1] = static_cast<char>((w >> 8) & 0xff);
+				dst[o + 2] = static_cast<char>((w >> 16) & 0xff);
+				o += 3;
+				i += 4;
+				j = advance(j, 4, period);
+				value = d;
+			}
+
+			unsigned int dw = 0u;
+			for (; i < n; ++i)
+			{
+				const int found = kReverse.value[s[i]];
+				if (found >= 0)
+					value = found;
+				else if (value < 0)
+					return 0;
+
+				const unsigned int bits = (value + stream[j]) & 0x3f;
+				j = advance(j, 1, period);
+
+				if (i % 4)
+				{
+					dw = (bits << ((4 - (i % 4)) << 1)) | dw;
+					dst[o++] = static_cast<char>(dw & 0xff);
+					dw = dw >> 8;
+				}
+				else
+				{
+					dw = bits;
+				}
+			}
+
+			if (dw)
+				dst[o++] = static_cast<char>(dw & 0xff);
+
+			dst[o] = '\0';
+			return o;
+		}
+
+		// -------------------------------------------------------------------
+		// Map 16 6-bit values to DEFAULTTABLE characters:
+		// 0-9 -> '0'+v, 10-35 -> 'A'+v-10, 36-62 -> 'a'+v-36 ('{' at 62), 63 -> '}'
+		inline __m128i toChars(__m128i v)
+		{
+			__m128i off = _mm_set1_epi8(48);
+			off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(9)), _mm_set1_epi8(7)));
+			off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(35)), _mm_set1_epi8(6)));
+			off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(62)), _mm_set1_epi8(1)));
+			return _mm_add_epi8(v, off);
+		}
+
+		// Map 16 characters to 6-bit values.  Returns false if any of them is
+		// not in DEFAULTTABLE (bytes >= 0x80 compare negative and fail every range).
+		inline bool fromChars(__m128i c, __m128i* v)
+		{
+			const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c));
+			const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), c));
+			const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('{' + 1), c));
+			const __m128i close = _mm_cmpeq_epi8(c, _mm_set1_epi8('}'));
+
+			const __m128i valid = _mm_or_si128(_mm_or_si128(digit, upper), _mm_or_si128(lower, close));
+			if (_mm_movemask_epi8(valid) != 0xffff)
+				return false;
+
+			const __m128i off = _mm_or_si128(
+				_mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(-48)), _mm_and_si128(upper, _mm_set1_epi8(-55))),
+				_mm_or_si128(_mm_and_si128(lower, _mm_set1_epi8(-61)), _mm_and_si128(close, _mm_set1_epi8(-62))));
+			*v = _mm_add_epi8(c, off);
+			return true;
+		}
+
+		inline __m256i toChars(__m256i v)
+		{
+			__m256i off = _mm256_set1_epi8(48);
+			off = _mm256_add_epi8(off, _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(9)), _mm256_set1_epi8(7)));
+			off = _mm256_add_epi8(off, _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(35)), _mm256_set1_epi8(6)));
+			off = _mm256_add_epi8(off, _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(62)), _mm256_set1_epi8(1)));
+			return _mm256_add_epi8(v, off);
+		}
+
+		inline bool fromChars(__m256i c, __m256i* v)
+		{
+			const __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+			const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+			const __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('{' + 1), c));
+			const __m256i close = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('}'));
+
+			const __m256i valid = _mm256_or_si256(_mm256_or_si256(digit, upper), _mm256_or_si256(lower, close));
+			if (_mm256_movemask_epi8(valid) != -1)
+				return false;
+
+			const __m256i off = _mm256_or_si256(
+				_mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(-48)), _mm256_and_si256(upper, _mm256_set1_epi8(-55))),
+				_mm256_or_si256(_mm256_and_si256(lower, _mm256_set1_epi8(-61)), _mm256_and_si256(close, _mm256_set1_epi8(-62))));
+			*v = _mm256_add_epi8(c, off);
+			return true;
+		}
+
+		// Store the 12 packed bytes at the bottom of v without touching dst[12..15].
+		inline void store12(char* dst, __m128i v)
+		{
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), v);
+			const int tail = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+			memcpy(dst + 8, &tail, sizeof(tail));
+		}
+
+		typedef int(__fastcall* EncodeFn)(char*, const char*, int, const unsigned char*, int);
+		typedef int(__fastcall* DecodeFn)(char*, const char*, const unsigned char*, int);
+
+		Level __fastcall detect()
+		{
+			int info[4] = {};
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+
+			__cpuid(info, 1);
+			const bool ssse3 = (info[2] & (1 << 9)) != 0;
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+
+			bool avx2 = false;
+			if ((maxLeaf >= 7) && osxsave && avx && ((_xgetbv(0) & 0x6) == 0x6))
+			{
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+			}
+
+			if (avx2)
+				return kAvx2;
+			if (ssse3)
+				return kSsse3;
+			return kScalar;
+		}
+
+		struct Dispatch
+		{
+			const Level detected = kScalar;
+			std::atomic<Level> level { kScalar };
+			std::atomic<EncodeFn> encode { encodeScalar };
+			std::atomic<DecodeFn> decode { decodeScalar };
+
+			Dispatch()
+				: detected(detect())
+			{
+				select(detected);
+			}
+
+			Level select(Level limit)
+			{
+				const Level use = (limit < detected) ? limit : detected;
+				switch (use)
+				{
+				case kAvx2:
+					encode.store(encodeAvx2, std::memory_order_relaxed);
+					decode.store(decodeAvx2, std::memory_order_relaxed);
+					break;
+				case kSsse3:
+					encode.store(encodeSsse3, std::memory_order_relaxed);
+					decode.store(decodeSsse3, std::memory_order_relaxed);
+					break;
+				default:
+					encode.store(encodeScalar, std::memory_order_relaxed);
+					decode.store(decodeScalar, std::memory_order_relaxed);
+					break;
+				}
+
+				level.store(use, std::memory_order_relaxed);
+				return use;
+			}
+		};
+
+		Dispatch& __fastcall dispatch()
+		{
+			static Dispatch instance;
+			return instance;
+		}
+	}
+}
+
+Autil::kernel::Level Autil::kernel::level()
+{
+	return dispatch().level.load(std::memory_order_relaxed);
+}
+
+Autil::kernel::Level Autil::kernel::setLevel(Level limit)
+{
+	return dispatch().select(limit);
+}
+
+int Autil::kernel::encode(char* dst, const char* src, int len, const unsigned char* stream, int period)
+{
+	return dispatch().encode.load(std::memory_order_relaxed)(dst, src, len, stream, period);
+}
+
+int Autil::kernel::decode(char* dst, const char* src, const unsigned char* stream, int period)
+{
+	return dispatch().decode.load(std::memory_order_relaxed)(dst, src, stream, period);
+}
+
+int Autil::kernel::encodeScalar(char* dst, const char* src, int len, const unsigned char* stream, int period)
+{
+	return encodeFrom(dst, 0, src, 0, len, stream, period, 0);
+}
+
+int Autil::kernel::decodeScalar(char* dst, const char* src, const unsigned char* stream, int period)
+{
+	return decodeFrom(dst, 0, src, 0, static_cast<int>(strlen(src)), stream, period, 0, -1);
+}
+
+// -------------------------------------------------------------------
+// 12 bytes -> 16 characters per iteration.  Each 32-bit lane holds
+// b0 | b1 << 8 | b2 << 16 and is split into four 6-bit fields, lowest first.
+int Autil::kernel::encodeSsse3(char* dst, const char* src, int len, const unsigned char* stream, int period)
+{
+	const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i mask = _mm_set1_epi8(0x3f);
+
+	int i = 0;
+	int o = 0;
+	int j = 0;
+	while ((i + 16) <= len) // 讀取16字節 只使用前12字節
+	{
+		const __m128i w = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), spread);
+		const __m128i c0 = _mm_and_si128(w, _mm_set1_epi32(0x3f));
+		const __m128i c1 = _mm_and_si128(_mm_slli_epi32(w, 2), _mm_set1_epi32(0x3f00));
+		const __m128i c2 = _mm_and_si128(_mm_slli_epi32(w, 4), _mm_set1_epi32(0x3f0000));
+		const __m128i c3 = _mm_and_si128(_mm_slli_epi32(w, 6), _mm_set1_epi32(0x3f000000));
+		__m128i v = _mm_or_si128(_mm_or_si128(c0, c1), _mm_or_si128(c2, c3));
+
+		v = _mm_and_si128(_mm_add_epi8(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(stream + j))), mask);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + o), toChars(v));
+
+		i += 12;
+		o += 16;
+		j = advance(j, 16, period);
+	}
+
+	return encodeFrom(dst, o, src, i, len, stream, period, j);
+}
+
+// -------------------------------------------------------------------
+// 16 characters -> 12 bytes per iteration.  maddubs joins pairs into 12-bit
+// values (v0 + v1 * 64), madd joins those into 24 bits, pshufb packs 3 bytes
+// of every lane.  A block with any character outside the table is left to
+// the scalar path, which reproduces the original handling of such input.
+int Autil::kernel::decodeSsse3(char* dst, const char* src, const unsigned char* stream, int period)
+{
+	const int n = static_cast<int>(strlen(src));
+	const __m128i mask = _mm_set1_epi8(0x3f);
+	const __m128i pair = _mm_set1_epi32(0x40014001);
+	const __m128i quad = _mm_set1_epi32(0x10000001);
+	const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	int i = 0;
+	int o = 0;
+	int j = 0;
+	while ((i + 16) <= n)
+	{
+		__m128i v;
+		if (!fromChars(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), &v))
+			break;
+
+		v = _mm_and_si128(_mm_add_epi8(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(stream + j))), mask);
+		v = _mm_madd_epi16(_mm_maddubs_epi16(v, pair), quad);
+		store12(dst + o, _mm_shuffle_epi8(v, pack));
+
+		i += 16;
+		o += 12;
+		j = advance(j, 16, period);
+	}
+
+	const int value = (i > 0) ? kReverse.value[static_cast<unsigned char>(src[i - 1])] : -1;
+	return decodeFrom(dst, o, src, i, n, stream, period, j, value);
+}
+
+// -------------------------------------------------------------------
+// Same as encodeSsse3 with 24 bytes -> 32 characters; each 128-bit lane
+// takes 12 bytes.
+int Autil::kernel::encodeAvx2(char* dst, const char* src, int len, const unsigned char* stream, int period)
+{
+	const __m256i spread = _mm256_setr_epi8(
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i mask = _mm256_set1_epi8(0x3f);
+
+	int i = 0;
+	int o = 0;
+	int j = 0;
+	while ((i + 28) <= len) // 第二半從i+12讀取16字節
+	{
+		const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 12));
+		const __m256i w = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), spread);
+		const __m256i c0 = _mm256_and_si256(w, _mm256_set1_epi32(0x3f));
+		const __m256i c1 = _mm256_and_si256(_mm256_slli_epi32(w, 2), _mm256_set1_epi32(0x3f00));
+		const __m256i c2 = _mm256_and_si256(_mm256_slli_epi32(w, 4), _mm256_set1_epi32(0x3f0000));
+		const __m256i c3 = _mm256_and_si256(_mm256_slli_epi32(w, 6), _mm256_set1_epi32(0x3f000000));
+		__m256i v = _mm256_or_si256(_mm256_or_si256(c0, c1), _mm256_or_si256(c2, c3));
+
+		v = _mm256_and_si256(_mm256_add_epi8(v, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stream + j))), mask);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + o), toChars(v));
+
+		i += 24;
+		o += 32;
+		j = advance(j, 32, period);
+	}
+
+	return encodeFrom(dst, o, src, i, len, stream, period, j);
+}
+
+// -------------------------------------------------------------------
+// Same as decodeSsse3 with 32 characters -> 24 bytes.
+int Autil::kernel::decodeAvx2(char* dst, const char* src, const unsigned char* stream, int period)
+{
+	const int n = static_cast<int>(strlen(src));
+	const __m256i mask = _mm256_set1_epi8(0x3f);
+	const __m256i pair = _mm256_set1_epi32(0x40014001);
+	const __m256i quad = _mm256_set1_epi32(0x10000001);
+	const __m256i pack = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	int i = 0;
+	int o = 0;
+	int j = 0;
+	while ((i + 32) <= n)
+	{
+		__m256i v;
+		if (!fromChars(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), &v))
+			break;
+
+		v = _mm256_and_si256(_mm256_add_epi8(v, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stream + j))), mask);
+		v = _mm256_shuffle_epi8(_mm256_madd_epi16(_mm256_maddubs_epi16(v, pair), quad), pack);
+		store12(dst + o, _mm256_castsi256_si128(v));
+		store12(dst + o + 12, _mm256_extracti128_si256(v, 1));
+
+		i += 32;
+		o += 24;
+		j = advance(j, 32, period);
+	}
+
+	const int value = (i > 0) ? kReverse.value[static_cast<unsigned char>(src[i - 1])] : -1;
+	return decodeFrom(dst, o, src, i, n, stream, period, j, value);
+}
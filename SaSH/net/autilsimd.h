@@ -0,0 +1,72 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+
+// 6-bit/8-bit transcoding kernels on DEFAULTTABLE.
+//
+// Every output (encode) or input (decode) character j is shifted by
+// stream[j % period] modulo 64.  Streams must be laid out repeatedly and
+// hold at least period + kStreamPad entries, so that a vector can load the
+// shifts of a whole block without wrapping.  An unkeyed codec uses
+// kZeroStream with period 1.
+namespace Autil
+{
+	namespace kernel
+	{
+		constexpr int kStreamPad = 32;
+
+		typedef enum
+		{
+			kScalar,
+			kSsse3,
+			kAvx2,
+		}Level;
+
+		extern const unsigned char kZeroStream[];
+
+		/**
+		 * 目前使用的等級 (預設為CPU支援的最高等級 只偵測一次)
+		 */
+		Q_REQUIRED_RESULT Level __fastcall level();
+
+		/**
+		 * 限制使用的最高等級 超過CPU支援時以CPU為準 返回實際使用的等級 (供驗證與效能比較)
+		 */
+		Level __fastcall setLevel(Level limit);
+
+		/**
+		 * 8-bit轉6-bit 返回輸出字符數 (不含結尾)
+		 */
+		int __fastcall encode(char* dst, const char* src, int len, const unsigned char* stream, int period);
+
+		/**
+		 * 6-bit轉8-bit 返回輸出字節數 (不含結尾) 首字符不在表內時返回0且不寫入結尾
+		 * 寫入位置永遠落後於讀取位置 dst可與src相同 (原地解碼)
+		 */
+		int __fastcall decode(char* dst, const char* src, const unsigned char* stream, int period);
+
+		// 各等級的實作 供驗證使用 呼叫端需自行確認CPU支援
+		int __fastcall encodeScalar(char* dst, const char* src, int len, const unsigned char* stream, int period);
+		int __fastcall encodeSsse3(char* dst, const char* src, int len, const unsigned char* stream, int period);
+		int __fastcall encodeAvx2(char* dst, const char* src, int len, const unsigned char* stream, int period);
+		int __fastcall decodeScalar(char* dst, const char* src, const unsigned char* stream, int period);
+		int __fastcall decodeSsse3(char* dst, const char* src, const unsigned char* stream, int period);
+		int __fastcall decodeAvx2(char* dst, const char* src, const unsigned char* stream, int period);
+	}
+}
@@ -0,0 +1,271 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#include "stdafx.h"
+#include "battlepacket.h"
+#include "autil.h"
+
+namespace battle
+{
+	namespace
+	{
+		inline bool isSpace(char c)
+		{
+			return (c == ' ') || (c >= '\t' && c <= '\r');
+		}
+
+		// GB2312/GBK 首字節
+		inline bool isLeadByte(char c)
+		{
+			const unsigned char u = static_cast<unsigned char>(c);
+			return u >= 0x81 && u <= 0xfe;
+		}
+
+		// 依序取出以'|'分隔的欄位 取出後將分隔符改寫為'\0'
+		class FieldReader
+		{
+		public:
+			explicit FieldReader(char* src)
+				: cur_(src)
+			{
+			}
+
+			// 已無欄位時返回nullptr
+			char* next()
+			{
+				if (cur_ == nullptr)
+					return nullptr;
+
+				char* field = cur_;
+				char* p = cur_;
+				++count_;
+				while (*p != '\0' && *p != '|')
+				{
+					if (isLeadByte(*p) && p[1] != '\0')
+						++p;
+					++p;
+				}
+
+				if (*p == '|')
+				{
+					*p = '\0';
+					cur_ = p + 1;
+				}
+				else
+				{
+					cur_ = nullptr;
+				}
+
+				return field;
+			}
+
+			// 與 QString::toInt(ok, base) 相同 允許前後空白與正負號 溢位視為失敗
+			bool nextInt(int base, int* value)
+			{
+				*value = 0;
+				const char* p = next();
+				if (p == nullptr)
+					return false;
+
+				while (isSpace(*p))
+					++p;
+
+				bool negative = false;
+				if (*p == '-' || *p == '+')
+				{
+					negative = (*p == '-');
+					++p;
+				}
+
+				long long v = 0;
+				const char* digits = p;
+				for (;; ++p)
+				{
+					int d;
+					if (*p >= '0' && *p <= '9')
+						d = *p - '0';
+					else if (base == 16 && *p >= 'a' && *p <= 'f')
+						d = *p - 'a' + 10;
+					else if (base == 16 && *p >= 'A' && *p <= 'F')
+						d = *p - 'A' + 10;
+					else
+						break;
+
+					v = v * base + d;
+					if (v > static_cast<long long>(INT_MAX) + 1)
+						return false;
+				}
+
+				if (p == digits)
+					return false;
+
+				while (isSpace(*p))
+					++p;
+				if (*p != '\0')
+					return false;
+
+				if (negative)
+					v = -v;
+				if (v > INT_MAX || v < INT_MIN)
+					return false;
+
+				*value = static_cast<int>(v);
+				return true;
+			}
+
+			// 失敗時為0
+			int nextHex()
+			{
+				int value = 0;
+				nextInt(16, &value);
+				return value;
+			}
+
+			// 失敗時為-1
+			int nextDec()
+			{
+				int value = 0;
+				return nextInt(10, &value) ? value : -1;
+			}
+
+			// 轉碼前先在原地還原轉義字符
+			QString nextString()
+			{
+				char* p = next();
+				if (p == nullptr || *p == '\0')
+					return QString();
+				Autil::util_unescape(p, strlen(p));
+				return util::toUnicode(p).simplified();
+			}
+
+			// 已取出的欄位數
+			inline int count() const { return count_; }
+
+		private:
+			char* cur_ = nullptr;
+			int count_ = 0;
+		};
+	}
+
+	Kind __fastcall classify(char* command, char** ppayload)
+	{
+		*ppayload = nullptr;
+		if (command == nullptr || command[0] == '\0' || command[1] == '\0' || command[2] == '\0')
+			return kNone;
+
+		*ppayload = command + 3;
+		if (**ppayload == '\0')
+			return kNone;
+
+		if (command[0] == 'B')
+		{
+			switch (command[1])
+			{
+			case 'C':
+				return kC;
+			case 'P':
+				return kP;
+			case 'A':
+				return kA;
+			case 'U':
+				return kU;
+			case 'D':
+				return kD;
+			case 'H':
+				return kH;
+			default:
+				break;
+			}
+		}
+		else if (command[0] == 'b' && command[1] == 'n')
+		{
+			return kN;
+		}
+
+		return kUnknown;
+	}
+
+	void __fastcall decodeC(char* payload, round_t* result)
+	{
+		FieldReader reader(payload);
+
+		result->count = 0;
+		result->fieldAttr = reader.nextDec();
+		for (int i = 0; i < MAX_ENEMY; ++i)
+			result->units[i] = battleobject_t{};
+
+		for (;;)
+		{
+			int pos = 0;
+			if (!reader.nextInt(16, &pos))
+				break;
+
+			if (pos < 0 || pos >= MAX_ENEMY)
+				break;
+
+			battleobject_t& obj = result->units[pos];
+			if (obj.pos == -1 && result->count < MAX_ENEMY)
+				result->order[result->count++] = pos;
+
+			obj = battleobject_t{};
+			obj.pos = pos;
+			obj.name = reader.nextString();
+			obj.freename = reader.nextString();
+			obj.faceid = reader.nextHex();
+			obj.level = reader.nextHex();
+			obj.hp = reader.nextHex();
+			obj.maxHp = reader.nextHex();
+			obj.hpPercent = util::percent(obj.hp, obj.maxHp);
+			obj.status = reader.nextHex();
+			obj.rideFlag = reader.nextDec();
+			obj.rideName = reader.nextString();
+			obj.rideLevel = reader.nextHex();
+			obj.rideHp = reader.nextHex();
+			obj.rideMaxHp = reader.nextHex();
+			obj.rideHpPercent = util::percent(obj.rideHp, obj.rideMaxHp);
+		}
+	}
+
+	bool __fastcall decodeP(char* payload, int* myNo, int* bpFlag, int* mp)
+	{
+		FieldReader reader(payload);
+		const int no = reader.nextHex();
+		const int flag = reader.nextHex();
+		const int value = reader.nextHex();
+		if (reader.count() < 3)
+			return false;
+
+		*myNo = no;
+		*bpFlag = flag;
+		*mp = value;
+		return true;
+	}
+
+	bool __fastcall decodeA(char* payload, int* animFlag, int* turnNo)
+	{
+		FieldReader reader(payload);
+		const int flag = reader.nextHex();
+		const int turn = reader.nextHex();
+		if (reader.count() < 2)
+			return false;
+
+		*animFlag = flag;
+		*turnNo = turn;
+		return true;
+	}
+}
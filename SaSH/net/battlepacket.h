@@ -0,0 +1,73 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+
+#include "database.h"
+
+// 戰鬥封包(B)解碼
+//
+// 直接在已解密的GB2312原始字節上單次掃描 以'\0'原地截斷各欄位
+// 只有名稱欄位需要轉為UNICODE 其餘欄位就地解析為整數
+// 掃描分隔符時會跳過雙字節字符的尾字節 與遊戲客戶端相同
+namespace battle
+{
+	typedef enum
+	{
+		kNone,
+		kUnknown,
+		kC,  // BC 戰場上所有單位
+		kP,  // BP 本回合自己的編號與MP
+		kA,  // BA 單位已出手的旗標
+		kU,  // BU 逃跑
+		kD,
+		kH,
+		kN,  // bn
+	}Kind;
+
+	// BC 每個單位固定13個欄位
+	constexpr int kUnitFieldCount = 13;
+
+	typedef struct round_s
+	{
+		int fieldAttr = 0;
+		int count = 0;
+		int order[MAX_ENEMY] = {};          // 各單位依封包內的出現順序記錄的位置
+		battleobject_t units[MAX_ENEMY] = {}; // 以位置為索引 不存在的位置pos為-1
+	}round_t;
+
+	/**
+	 * 分類子訊息 ppayload指向第一個分隔符之後的內容
+	 */
+	Q_REQUIRED_RESULT Kind __fastcall classify(char* command, char** ppayload);
+
+	/**
+	 * BC 所有單位 遇到無效的位置即停止
+	 */
+	void __fastcall decodeC(char* payload, round_t* result);
+
+	/**
+	 * BP 自己的編號|BP旗標|MP 欄位不足時返回false
+	 */
+	Q_REQUIRED_RESULT bool __fastcall decodeP(char* payload, int* myNo, int* bpFlag, int* mp);
+
+	/**
+	 * BA 出手旗標|回合數 欄位不足時返回false
+	 */
+	Q_REQUIRED_RESULT bool __fastcall decodeA(char* payload, int* animFlag, int* turnNo);
+}
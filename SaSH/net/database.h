@@ -1632,6 +1632,17 @@ typedef struct mapunit_s
 	CHR_STATUS status = CHR_STATUS::CHR_STATUS_NONE;
 } mapunit_t;
 
+//周圍單位與上一次的差異 只記錄實際變動的單位ID
+typedef struct mapunitdiff_s
+{
+	QVector<int> added;
+	QVector<int> moved;   //只有坐標或方向改變
+	QVector<int> changed; //坐標以外的屬性改變
+	QVector<int> removed;
+
+	inline bool isEmpty() const { return added.isEmpty() && moved.isEmpty() && changed.isEmpty() && removed.isEmpty(); }
+} mapunitdiff_t;
+
 typedef struct bankpet_s
 {
 	int level = 0;
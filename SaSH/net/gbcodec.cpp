@@ -0,0 +1,62 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#include "stdafx.h"
+#include "gbcodec.h"
+
+int __fastcall gbcodec::decode(const unsigned short* pairTable, const char* str, int size, unsigned short* dst)
+{
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(str);
+	const unsigned char* end = p + size;
+	unsigned short* out = dst;
+	while (p < end)
+	{
+		const unsigned char c = *p;
+		if (c < 0x80)
+		{
+			*out++ = c;
+			++p;
+			continue;
+		}
+
+		if (pairTable[c] != 0)
+		{
+			*out++ = pairTable[c];
+			++p;
+			continue;
+		}
+
+		if ((p + 1) == end)
+			return -1;
+
+		const unsigned short ch = pairTable[(c << 8) | p[1]];
+		if (ch == 0)
+			return -1;
+
+		*out++ = ch;
+		p += 2;
+	}
+
+	return static_cast<int>(out - dst);
+}
+
+void __fastcall gbcodec::mapChars(const unsigned short* table, unsigned short* data, int size)
+{
+	for (unsigned short* end = data + size; data != end; ++data)
+		*data = table[*data];
+}
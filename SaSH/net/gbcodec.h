@@ -0,0 +1,78 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+#include <vector>
+
+// GB2312/GBK雙字節文字的查表解碼 不依賴Qt 由util::toUnicode使用
+//
+// 對照表以 (首字節 << 8) | 尾字節 為索引 值為解碼後的UTF-16字符 首字節位置的0x80~0xff項
+// 為可以單獨解碼的高位字節 (例如CP936的0x80) 0表示不能單獨解碼成一個字符
+// (非法組合、GB18030四字節序列等) 遇到時由呼叫端改用完整的解碼器
+namespace gbcodec
+{
+	constexpr int kTableSize = 0x10000;
+
+	/**
+	 * 以解碼函數建立對照表 decodeBytes(const char* bytes, int size, unsigned short* out)->bool
+	 * 只有解碼成功且結果為單個非代理、非替代(U+FFFD)字符時才寫入
+	 */
+	template<typename Fn>
+	Q_REQUIRED_RESULT std::vector<unsigned short> buildPairTable(Fn decodeBytes)
+	{
+		std::vector<unsigned short> table(kTableSize, 0);
+		auto decodeOne = [&decodeBytes](const char* bytes, int size)->unsigned short
+		{
+			unsigned short ch = 0;
+			if (!decodeBytes(bytes, size, &ch))
+				return 0;
+
+			if ((ch == 0xfffd) || ((ch >= 0xd800) && (ch <= 0xdfff)))
+				return 0;
+
+			return ch;
+		};
+
+		char bytes[2] = {};
+		for (int lead = 0x80; lead <= 0xff; ++lead)
+		{
+			bytes[0] = static_cast<char>(lead);
+			table[lead] = decodeOne(bytes, 1);
+			if (table[lead] != 0)
+				continue;
+
+			for (int trail = 0x01; trail <= 0xff; ++trail)
+			{
+				bytes[1] = static_cast<char>(trail);
+				table[(lead << 8) | trail] = decodeOne(bytes, 2);
+			}
+		}
+		return table;
+	}
+
+	/**
+	 * 解碼size字節到dst (至少需要size個字符的空間) 返回寫入的字符數
+	 * 含表外的組合或結尾有落單的首字節時返回-1 此時dst的內容無效
+	 */
+	int __fastcall decode(const unsigned short* pairTable, const char* str, int size, unsigned short* dst);
+
+	/**
+	 * 以逐字對照表 (kTableSize項) 原地映射
+	 */
+	void __fastcall mapChars(const unsigned short* table, unsigned short* data, int size);
+}
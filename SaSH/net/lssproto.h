@@ -52,11 +52,15 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #pragma endregion
 
 #include "database.h"
+#include "autil.h"
+#include "rtttracker.h"
 
 
 class Lssproto
 {
 public:
+	Q_REQUIRED_RESULT inline const RttTracker& getRttTracker() const { return rtt_; }
+
 	void lssproto_W_send(const QPoint& pos, char* direction);
 	void lssproto_W2_send(const QPoint& pos, char* direction);
 	void lssproto_EV_send(int event, int seqno, const QPoint& pos, int dir);
@@ -258,7 +262,7 @@ public:
 #ifdef _OUTOFBATTLESKILL			// (不可開) Syu ADD 非戰鬥時技能Protocol
 	virtual void lssproto_BATTLESKILL_recv(char* data) = 0;
 #endif
-	virtual void lssproto_CHAREFFECT_recv(char* data) = 0;
+	virtual void lssproto_CHAREFFECT_recv(const util::LazyText& data) = 0;
 
 #ifdef _STREET_VENDOR
 	virtual void lssproto_STREET_VENDOR_recv(char* data) = 0;	// 擺攤功能
@@ -296,7 +300,7 @@ public:
 	virtual void lssproto_DancemanOption_recv(int option) = 0;	//動一動狀態
 #endif
 #ifdef _ANNOUNCEMENT_
-	virtual void lssproto_DENGON_recv(char* data, int colors, int nums) = 0;
+	virtual void lssproto_DENGON_recv(const util::LazyText& data, int colors, int nums) = 0;
 #endif
 #ifdef _HUNDRED_KILL
 	virtual void lssproto_hundredkill_recv(int flag) = 0;
@@ -316,4 +320,8 @@ public:
 	virtual void lssproto_CustomWN_recv(const QString& data) = 0;
 	virtual void lssproto_CustomTK_recv(const QString& data) = 0;
 #pragma endregion
+
+protected:
+	Autil::ProtocolCodec codec_; //本連線的封包編解碼狀態
+	RttTracker rtt_;             //往返時間估計 送出時登記 收到回應時取樣
 };
\ No newline at end of file
@@ -0,0 +1,234 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#include "stdafx.h"
+#include "packetcapture.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#endif
+
+namespace capture
+{
+	namespace
+	{
+		constexpr char kMagic[] = { 'S', 'A', 'C', 'A', 'P' };
+		constexpr char kVersion = 1;
+		constexpr int kHeaderSize = sizeof(kMagic) + 1;
+
+		// 每字節7位 低位在前
+		void appendVarint(QByteArray* out, quint64 value)
+		{
+			while (value >= 0x80)
+			{
+				out->append(static_cast<char>((value & 0x7f) | 0x80));
+				value >>= 7;
+			}
+			out->append(static_cast<char>(value));
+		}
+
+		bool readVarint(const QByteArray& in, int* pos, quint64* value)
+		{
+			quint64 result = 0;
+			for (int shift = 0; shift < 64; shift += 7)
+			{
+				if (*pos >= in.size())
+					return false;
+
+				const unsigned char c = static_cast<unsigned char>(in.at((*pos)++));
+				result |= static_cast<quint64>(c & 0x7f) << shift;
+				if ((c & 0x80) == 0)
+				{
+					*value = result;
+					return true;
+				}
+			}
+			return false;
+		}
+
+#ifdef _DEBUG
+		std::atomic<qint64> g_allocations{ 0 };
+		_CRT_ALLOC_HOOK g_previousHook = nullptr;
+
+		int __cdecl countAllocation(int type, void* data, size_t size, int blockType, long request, const unsigned char* file, int line)
+		{
+			if (type == _HOOK_ALLOC || type == _HOOK_REALLOC)
+				g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+			if (g_previousHook != nullptr)
+				return g_previousHook(type, data, size, blockType, request, file, line);
+			return TRUE;
+		}
+#endif
+	}
+
+	bool Writer::open(const QString& path)
+	{
+		close();
+
+		file_.setFileName(path);
+		if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate))
+			return false;
+
+		file_.write(kMagic, sizeof(kMagic));
+		file_.write(&kVersion, 1);
+
+		lastUs_ = 0;
+		timer_.start();
+		return true;
+	}
+
+	void Writer::close()
+	{
+		if (!file_.isOpen())
+			return;
+
+		file_.flush();
+		file_.close();
+	}
+
+	void Writer::write(RecordType type, const char* data, size_t size)
+	{
+		if (!file_.isOpen())
+			return;
+
+		const qint64 nowUs = timer_.nsecsElapsed() / 1000;
+		buffer_.clear();
+		buffer_.append(static_cast<char>(type));
+		appendVarint(&buffer_, static_cast<quint64>(nowUs - lastUs_));
+		appendVarint(&buffer_, static_cast<quint64>(size));
+		buffer_.append(data, static_cast<int>(size));
+		lastUs_ = nowUs;
+
+		file_.write(buffer_);
+	}
+
+	bool Reader::open(const QString& path)
+	{
+		QFile file(path);
+		if (!file.open(QIODevice::ReadOnly))
+			return false;
+
+		content_ = file.readAll();
+		pos_ = kHeaderSize;
+		timeUs_ = 0;
+
+		return (content_.size() >= kHeaderSize)
+			&& (memcmp(content_.constData(), kMagic, sizeof(kMagic)) == 0)
+			&& (content_.at(sizeof(kMagic)) == kVersion);
+	}
+
+	bool Reader::next(record_t* record)
+	{
+		if (pos_ >= content_.size())
+			return false;
+
+		const char type = content_.at(pos_++);
+		quint64 deltaUs = 0;
+		quint64 size = 0;
+		if (!readVarint(content_, &pos_, &deltaUs) || !readVarint(content_, &pos_, &size))
+			return false;
+
+		if (size > static_cast<quint64>(content_.size() - pos_))
+			return false;
+
+		if (type != kData && type != kKey)
+			return false;
+
+		timeUs_ += static_cast<qint64>(deltaUs);
+		record->type = static_cast<RecordType>(type);
+		record->timeUs = timeUs_;
+		record->data = content_.mid(pos_, static_cast<int>(size));
+		pos_ += static_cast<int>(size);
+		return true;
+	}
+
+	DispatchTimer::~DispatchTimer()
+	{
+		if (report_ == nullptr)
+			return;
+
+		const quint64 ns = static_cast<quint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - begin_).count());
+
+		//無法解析的封包計入0號
+		funcstats_t& stats = report_->funcs[(func_ > 0 && func_ < kFuncCount) ? func_ : 0];
+		++stats.count;
+		stats.totalNs += ns;
+		if (ns > stats.maxNs)
+			stats.maxNs = ns;
+	}
+
+	AllocationCounter::AllocationCounter()
+	{
+#ifdef _DEBUG
+		g_allocations.store(0, std::memory_order_relaxed);
+		g_previousHook = _CrtSetAllocHook(countAllocation);
+#endif
+	}
+
+	AllocationCounter::~AllocationCounter()
+	{
+#ifdef _DEBUG
+		_CrtSetAllocHook(g_previousHook);
+		g_previousHook = nullptr;
+#endif
+	}
+
+	qint64 AllocationCounter::count() const
+	{
+#ifdef _DEBUG
+		return g_allocations.load(std::memory_order_relaxed);
+#else
+		return -1;
+#endif
+	}
+
+	QString report_t::toString() const
+	{
+		const double busyMs = static_cast<double>(busyNs) / 1e6;
+		const double mbps = (busyNs > 0) ? (static_cast<double>(bytes) / 1048576.0) / (static_cast<double>(busyNs) / 1e9) : 0.0;
+
+		QStringList lines;
+		lines.append(QString("records %1 bytes %2 busy %3 ms throughput %4 MB/s allocations %5")
+			.arg(records).arg(bytes).arg(busyMs, 0, 'f', 3).arg(mbps, 0, 'f', 2)
+			.arg(allocations >= 0 ? QString::number(allocations) : QString("n/a")));
+
+		//依總耗時排序
+		QVector<int> order;
+		for (int func = 0; func < kFuncCount; ++func)
+		{
+			if (funcs[func].count > 0)
+				order.append(func);
+		}
+
+		std::sort(order.begin(), order.end(), [this](int a, int b) { return funcs[a].totalNs > funcs[b].totalNs; });
+
+		for (const int func : order)
+		{
+			const funcstats_t& stats = funcs[func];
+			lines.append(QString("func %1 count %2 avg %3 us max %4 us total %5 ms")
+				.arg(func, 3).arg(stats.count)
+				.arg(static_cast<double>(stats.totalNs) / stats.count / 1e3, 0, 'f', 2)
+				.arg(static_cast<double>(stats.maxNs) / 1e3, 0, 'f', 2)
+				.arg(static_cast<double>(stats.totalNs) / 1e6, 0, 'f', 3));
+		}
+
+		return lines.join("\n");
+	}
+}
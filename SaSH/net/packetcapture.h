@@ -0,0 +1,136 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+
+#include <chrono>
+#include <atomic>
+
+// 封包錄製與重播
+//
+// 錄製檔以 "SACAP" 加版本號開頭 之後每筆記錄為
+//   類型(1字節) 與上一筆的間隔微秒(varint) 長度(varint) 原始字節
+// 數據記錄是 handleData 收到的原始數據 金鑰記錄是當時生效的 PersonalKey
+// 重播時依序交給 handleData 不連接遊戲 所有內存讀取都返回預設值
+namespace capture
+{
+	constexpr int kFuncCount = 256;
+
+	typedef enum
+	{
+		kData = 1,
+		kKey = 2,
+	}RecordType;
+
+	typedef struct record_s
+	{
+		RecordType type = kData;
+		qint64 timeUs = 0;  // 自錄製開始起算
+		QByteArray data;
+	}record_t;
+
+	typedef struct funcstats_s
+	{
+		quint64 count = 0;
+		quint64 totalNs = 0;
+		quint64 maxNs = 0;
+	}funcstats_t;
+
+	typedef struct report_s
+	{
+		quint64 records = 0;
+		quint64 bytes = 0;
+		quint64 busyNs = 0;      // 只計算 handleData 的時間
+		qint64 allocations = -1; // -1表示此組建無法統計
+		funcstats_t funcs[kFuncCount] = {};
+
+		Q_REQUIRED_RESULT QString toString() const;
+	}report_t;
+
+	class Writer
+	{
+	public:
+		Writer() = default;
+		~Writer() { close(); }
+
+		bool open(const QString& path);
+		void close();
+
+		Q_REQUIRED_RESULT inline bool isOpen() const { return file_.isOpen(); }
+
+		void write(RecordType type, const char* data, size_t size);
+
+	private:
+		Q_DISABLE_COPY_MOVE(Writer);
+
+		QFile file_;
+		QElapsedTimer timer_;
+		qint64 lastUs_ = 0;
+		QByteArray buffer_;
+	};
+
+	class Reader
+	{
+	public:
+		bool open(const QString& path);
+
+		//沒有下一筆或檔案已損壞時返回false
+		bool next(record_t* record);
+
+	private:
+		QByteArray content_;
+		int pos_ = 0;
+		qint64 timeUs_ = 0;
+	};
+
+	//記錄一次派發的耗時 func在解構時才讀取 report為nullptr時不計時
+	class DispatchTimer
+	{
+	public:
+		DispatchTimer(report_t* report, const int& func)
+			: report_(report)
+			, func_(func)
+		{
+			if (report_ != nullptr)
+				begin_ = std::chrono::steady_clock::now();
+		}
+
+		~DispatchTimer();
+
+	private:
+		Q_DISABLE_COPY_MOVE(DispatchTimer);
+
+		report_t* report_ = nullptr;
+		const int& func_;
+		std::chrono::steady_clock::time_point begin_;
+	};
+
+	//統計期間整個進程的堆分配次數 只有調試版CRT支援
+	class AllocationCounter
+	{
+	public:
+		AllocationCounter();
+		~AllocationCounter();
+
+		//不支援時返回-1
+		Q_REQUIRED_RESULT qint64 count() const;
+
+	private:
+		Q_DISABLE_COPY_MOVE(AllocationCounter);
+	};
+}
@@ -0,0 +1,212 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#include "stdafx.h"
+#include "protostats.h"
+#include <intrin.h>
+
+//線程結束時交還計數 讓之後建立的線程沿用
+struct ProtoStats::ShardHandle
+{
+	Shard* shard = nullptr;
+
+	~ShardHandle()
+	{
+		if (shard != nullptr)
+			ProtoStats::getInstance().releaseShard(shard);
+	}
+};
+
+namespace
+{
+	//只有擁有者線程會寫入 不需要原子的讀改寫
+	template <typename T, typename V>
+	inline void addRelaxed(std::atomic<T>& counter, V value)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + static_cast<T>(value), std::memory_order_relaxed);
+	}
+
+	inline void maxRelaxed(std::atomic<quint32>& counter, quint32 value)
+	{
+		if (value > counter.load(std::memory_order_relaxed))
+			counter.store(value, std::memory_order_relaxed);
+	}
+}
+
+ProtoStats& ProtoStats::getInstance()
+{
+	static ProtoStats instance;
+	return instance;
+}
+
+int ProtoStats::bucketOf(quint32 value)
+{
+	if (value < kSubBucketCount)
+		return static_cast<int>(value);
+
+	unsigned long msb = 0;
+	_BitScanReverse(&msb, value);
+
+	const int sub = static_cast<int>((value >> (msb - kSubBucketBits)) & (kSubBucketCount - 1));
+	return static_cast<int>(msb - kSubBucketBits + 1) * kSubBucketCount + sub;
+}
+
+quint32 ProtoStats::bucketUpperBound(int bucket)
+{
+	if (bucket < kSubBucketCount)
+		return static_cast<quint32>(bucket);
+
+	const int msb = bucket / kSubBucketCount + kSubBucketBits - 1;
+	const quint64 lower = static_cast<quint64>(kSubBucketCount + bucket % kSubBucketCount) << (msb - kSubBucketBits);
+	const quint64 width = 1ull << (msb - kSubBucketBits);
+	return static_cast<quint32>(qMin<quint64>(lower + width - 1, UINT_MAX));
+}
+
+ProtoStats::Shard* ProtoStats::acquireShard()
+{
+	QMutexLocker lock(&mutex_);
+	for (Shard* shard : shards_)
+	{
+		if (!shard->inUse)
+		{
+			shard->inUse = true;
+			return shard;
+		}
+	}
+
+	Shard* shard = new Shard;
+	shard->inUse = true;
+	shards_.append(shard);
+	return shard;
+}
+
+void ProtoStats::releaseShard(Shard* shard)
+{
+	QMutexLocker lock(&mutex_);
+	shard->inUse = false;
+}
+
+void ProtoStats::record(int func, quint32 decodeNs, quint32 handlerNs, quint32 bytes)
+{
+	if (func < 0 || func >= kFuncCount)
+		return;
+
+	thread_local ShardHandle handle;
+	if (handle.shard == nullptr)
+		handle.shard = acquireShard();
+
+	Counters& counters = handle.shard->funcs[func];
+	const quint32 values[kMetricCount] = { decodeNs, handlerNs, bytes };
+
+	addRelaxed(counters.count, 1);
+	for (int metric = 0; metric < kMetricCount; ++metric)
+	{
+		const quint32 value = values[metric];
+		addRelaxed(counters.total[metric], value);
+		maxRelaxed(counters.max[metric], value);
+		addRelaxed(counters.buckets[metric][bucketOf(value)], 1);
+	}
+}
+
+QVector<ProtoStats::funcsummary_t> ProtoStats::snapshot() const
+{
+	QVector<funcsummary_t> result;
+
+	QMutexLocker lock(&mutex_);
+	for (int func = 0; func < kFuncCount; ++func)
+	{
+		funcsummary_t summary;
+		summary.func = func;
+
+		quint64 buckets[kMetricCount][kBucketCount] = {};
+		for (const Shard* shard : shards_)
+		{
+			const Counters& counters = shard->funcs[func];
+			const quint32 count = counters.count.load(std::memory_order_relaxed);
+			if (count == 0)
+				continue;
+
+			summary.count += count;
+			for (int metric = 0; metric < kMetricCount; ++metric)
+			{
+				metricsummary_t& m = summary.metrics[metric];
+				m.total += counters.total[metric].load(std::memory_order_relaxed);
+				m.max = qMax(m.max, counters.max[metric].load(std::memory_order_relaxed));
+				for (int bucket = 0; bucket < kBucketCount; ++bucket)
+					buckets[metric][bucket] += counters.buckets[metric][bucket].load(std::memory_order_relaxed);
+			}
+		}
+
+		if (summary.count == 0)
+			continue;
+
+		//計數與分桶可能相差正在寫入的那一筆 以分桶總和為準
+		for (int metric = 0; metric < kMetricCount; ++metric)
+		{
+			quint64 total = 0;
+			for (int bucket = 0; bucket < kBucketCount; ++bucket)
+				total += buckets[metric][bucket];
+
+			metricsummary_t& m = summary.metrics[metric];
+			const quint64 ranks[] = { (total * 50 + 99) / 100, (total * 90 + 99) / 100, (total * 99 + 99) / 100 };
+			quint32* const outputs[] = { &m.p50, &m.p90, &m.p99 };
+
+			quint64 seen = 0;
+			int rank = 0;
+			for (int bucket = 0; bucket < kBucketCount && rank < 3; ++bucket)
+			{
+				seen += buckets[metric][bucket];
+				while (rank < 3 && seen >= ranks[rank] && ranks[rank] > 0)
+				{
+					*outputs[rank] = qMin(bucketUpperBound(bucket), m.max);
+					++rank;
+				}
+			}
+		}
+
+		result.append(summary);
+	}
+
+	return result;
+}
+
+QString ProtoStats::dump() const
+{
+	QVector<funcsummary_t> summaries = snapshot();
+	std::sort(summaries.begin(), summaries.end(), [](const funcsummary_t& a, const funcsummary_t& b)
+		{
+			return a.metrics[kHandlerNs].total > b.metrics[kHandlerNs].total;
+		});
+
+	auto us = [](quint32 ns) { return QString::number(static_cast<double>(ns) / 1e3, 'f', 1); };
+
+	QStringList lines;
+	lines.append("func count bytes decode(p50/p99/max us) handler(p50/p99/max us) handler total ms");
+	for (const funcsummary_t& s : summaries)
+	{
+		const metricsummary_t& decode = s.metrics[kDecodeNs];
+		const metricsummary_t& handler = s.metrics[kHandlerNs];
+		lines.append(QString("%1 %2 %3 %4/%5/%6 %7/%8/%9 %10")
+			.arg(s.func, 3).arg(s.count).arg(s.metrics[kBytes].total)
+			.arg(us(decode.p50)).arg(us(decode.p99)).arg(us(decode.max))
+			.arg(us(handler.p50)).arg(us(handler.p99)).arg(us(handler.max))
+			.arg(static_cast<double>(handler.total) / 1e6, 0, 'f', 3));
+	}
+
+	return lines.join("\n");
+}
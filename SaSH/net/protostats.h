@@ -0,0 +1,101 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+
+#include <atomic>
+
+// 協議統計 常駐開啟
+//
+// 以功能編號分別記錄解碼耗時、處理耗時與封包字節數的總和、最大值與直方圖
+// 直方圖為對數線性分桶 每個2的冪次再分4格 相對誤差不超過25%
+// 每個記錄線程各自持有一份計數 只由該線程寫入 讀取時才彙總所有線程
+class ProtoStats
+{
+public:
+	static constexpr int kFuncCount = 256;
+	static constexpr int kSubBucketBits = 2;
+	static constexpr int kSubBucketCount = 1 << kSubBucketBits;
+	static constexpr int kBucketCount = (32 - kSubBucketBits + 1) * kSubBucketCount;
+
+	typedef enum
+	{
+		kDecodeNs,
+		kHandlerNs,
+		kBytes,
+		kMetricCount,
+	}Metric;
+
+	typedef struct metricsummary_s
+	{
+		quint64 total = 0;
+		quint32 max = 0;
+		quint32 p50 = 0;
+		quint32 p90 = 0;
+		quint32 p99 = 0;
+	}metricsummary_t;
+
+	typedef struct funcsummary_s
+	{
+		int func = 0;
+		quint64 count = 0;
+		metricsummary_t metrics[kMetricCount] = {};
+	}funcsummary_t;
+
+	static ProtoStats& getInstance();
+
+	//記錄一則訊息 只寫入調用線程自己的計數
+	void record(int func, quint32 decodeNs, quint32 handlerNs, quint32 bytes);
+
+	//彙總所有線程 只返回有記錄的功能編號
+	Q_REQUIRED_RESULT QVector<funcsummary_t> snapshot() const;
+
+	//依處理總耗時排序的文字表格
+	Q_REQUIRED_RESULT QString dump() const;
+
+	Q_REQUIRED_RESULT static int bucketOf(quint32 value);
+
+	//該分桶可容納的最大值
+	Q_REQUIRED_RESULT static quint32 bucketUpperBound(int bucket);
+
+private:
+	ProtoStats() = default;
+	Q_DISABLE_COPY_MOVE(ProtoStats);
+
+	struct Counters
+	{
+		std::atomic<quint32> count;
+		std::atomic<quint64> total[kMetricCount];
+		std::atomic<quint32> max[kMetricCount];
+		std::atomic<quint32> buckets[kMetricCount][kBucketCount];
+	};
+
+	struct Shard
+	{
+		Counters funcs[kFuncCount] = {};
+		bool inUse = false;
+	};
+
+	struct ShardHandle;
+
+	Shard* acquireShard();
+	void releaseShard(Shard* shard);
+
+	mutable QMutex mutex_;
+	QVector<Shard*> shards_;  //線程結束後保留計數 由下一個新線程接手
+};
@@ -0,0 +1,87 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#include "stdafx.h"
+#include "recvregistry.h"
+
+RecvRegistry& RecvRegistry::getInstance()
+{
+	static RecvRegistry instance;
+	return instance;
+}
+
+void RecvRegistry::subscribe(int func)
+{
+	if (func < 0 || func >= kFuncCount)
+		return;
+
+	subscribers_[func].fetch_add(1, std::memory_order_relaxed);
+}
+
+void RecvRegistry::unsubscribe(int func)
+{
+	if (func < 0 || func >= kFuncCount)
+		return;
+
+	const int previous = subscribers_[func].fetch_sub(1, std::memory_order_relaxed);
+	if (previous <= 0)
+	{
+		//未訂閱卻取消 還原計數
+		subscribers_[func].fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+RecvSubscription::RecvSubscription(std::initializer_list<int> funcs)
+{
+	RecvRegistry& registry = RecvRegistry::getInstance();
+	for (const int func : funcs)
+	{
+		registry.subscribe(func);
+		funcs_.append(func);
+	}
+}
+
+RecvSubscription::~RecvSubscription()
+{
+	reset();
+}
+
+RecvSubscription::RecvSubscription(RecvSubscription&& other) noexcept
+	: funcs_(std::move(other.funcs_))
+{
+	other.funcs_.clear();
+}
+
+RecvSubscription& RecvSubscription::operator=(RecvSubscription&& other) noexcept
+{
+	if (this != &other)
+	{
+		reset();
+		funcs_ = std::move(other.funcs_);
+		other.funcs_.clear();
+	}
+	return *this;
+}
+
+void RecvSubscription::reset()
+{
+	RecvRegistry& registry = RecvRegistry::getInstance();
+	for (const int func : funcs_)
+		registry.unsubscribe(func);
+	funcs_.clear();
+}
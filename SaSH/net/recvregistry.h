@@ -0,0 +1,70 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <initializer_list>
+
+// 接收封包的訂閱登記
+//
+// 可選的封包(煙火、人物特效、佈告欄、天氣與音效等)只在有訂閱者時才轉碼並套用
+// 沒有訂閱者時只解碼校驗和後丟棄 其餘封包不受影響
+// 訂閱以功能編號計數 介面、腳本、戰鬥與錄製等消費端以 RecvSubscription 持有
+class RecvRegistry
+{
+public:
+	static constexpr int kFuncCount = 256;
+
+	static RecvRegistry& getInstance();
+
+	void subscribe(int func);
+	void unsubscribe(int func);
+
+	Q_REQUIRED_RESULT inline bool isSubscribed(int func) const
+	{
+		return (func >= 0 && func < kFuncCount) && (subscribers_[func].load(std::memory_order_relaxed) > 0);
+	}
+
+private:
+	RecvRegistry() = default;
+	Q_DISABLE_COPY_MOVE(RecvRegistry);
+
+	std::array<std::atomic_int, kFuncCount> subscribers_ = {};
+};
+
+//在生命週期內訂閱指定的封包 一般作為消費端的成員
+class RecvSubscription
+{
+public:
+	RecvSubscription() = default;
+	RecvSubscription(std::initializer_list<int> funcs);
+	~RecvSubscription();
+
+	RecvSubscription(RecvSubscription&& other) noexcept;
+	RecvSubscription& operator=(RecvSubscription&& other) noexcept;
+
+	//取消所有訂閱
+	void reset();
+
+private:
+	Q_DISABLE_COPY(RecvSubscription);
+
+	QVector<int> funcs_;
+};
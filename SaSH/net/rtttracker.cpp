@@ -0,0 +1,165 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#include "stdafx.h"
+#include "rtttracker.h"
+
+namespace
+{
+	constexpr char kProbePrefix[] = "hoge";
+	constexpr int kProbePrefixSize = sizeof(kProbePrefix) - 1;
+}
+
+void RttTracker::expect(Kind kind)
+{
+	if (kind < 0 || kind >= kKindCount)
+		return;
+
+	const Clock::time_point now = Clock::now();
+
+	QMutexLocker lock(&mutex_);
+	Pending& pending = pending_[kind];
+	if (pending.valid && (now - pending.sent) < kMaxWait)
+		return;
+
+	pending.sent = now;
+	pending.valid = true;
+}
+
+void RttTracker::acknowledge(Kind kind)
+{
+	if (kind < 0 || kind >= kKindCount)
+		return;
+
+	const Clock::time_point now = Clock::now();
+
+	QMutexLocker lock(&mutex_);
+	Pending& pending = pending_[kind];
+	if (!pending.valid)
+		return;
+
+	pending.valid = false;
+	addSample(now - pending.sent);
+}
+
+QByteArray RttTracker::makeProbe()
+{
+	QMutexLocker lock(&mutex_);
+	const quint32 seq = nextSeq_++;
+	if (nextSeq_ == 0)
+		nextSeq_ = 1;
+
+	Pending& probe = probes_[seq % kProbeCount];
+	probe.sent = Clock::now();
+	probe.seq = seq;
+	probe.valid = true;
+
+	return QByteArray(kProbePrefix) + QByteArray::number(seq);
+}
+
+bool RttTracker::acknowledgeProbe(const char* text)
+{
+	if (text == nullptr || strncmp(text, kProbePrefix, kProbePrefixSize) != 0)
+		return false;
+
+	bool ok = false;
+	const quint32 seq = QByteArray(text + kProbePrefixSize).toUInt(&ok);
+	if (!ok || seq == 0)
+		return false;
+
+	const Clock::time_point now = Clock::now();
+
+	//過期或重複的探測不取樣 但仍然是探測的回應
+	QMutexLocker lock(&mutex_);
+	Pending& probe = probes_[seq % kProbeCount];
+	if (!probe.valid || probe.seq != seq)
+		return true;
+
+	probe.valid = false;
+	addSample(now - probe.sent);
+	return true;
+}
+
+//需持有 mutex_
+void RttTracker::addSample(Clock::duration elapsed)
+{
+	//太久才回應的多半不是這個封包的回應
+	if (elapsed >= kMaxWait)
+		return;
+
+	const qint64 sampleUs = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+	const int samples = samples_.load(std::memory_order_relaxed);
+	qint64 srtt = srttUs_.load(std::memory_order_relaxed);
+	qint64 rttvar = rttvarUs_.load(std::memory_order_relaxed);
+
+	if (samples == 0)
+	{
+		srtt = sampleUs;
+		rttvar = sampleUs / 2;
+	}
+	else
+	{
+		//暖機後遠大於逾時的取樣多半混入了伺服器端的處理時間 不列入
+		if (samples >= kWarmupSamples && sampleUs > 4 * (srtt + 4 * rttvar))
+			return;
+
+		rttvar = (3 * rttvar + qAbs(srtt - sampleUs)) / 4;
+		srtt = (7 * srtt + sampleUs) / 8;
+	}
+
+	srttUs_.store(srtt, std::memory_order_relaxed);
+	rttvarUs_.store(rttvar, std::memory_order_relaxed);
+	samples_.store(samples + 1, std::memory_order_release);
+}
+
+qint64 RttTracker::srttMs() const
+{
+	if (!hasSample())
+		return -1;
+	return srttUs_.load(std::memory_order_relaxed) / 1000;
+}
+
+qint64 RttTracker::jitterMs() const
+{
+	if (!hasSample())
+		return -1;
+	return rttvarUs_.load(std::memory_order_relaxed) / 1000;
+}
+
+qint64 RttTracker::rtoMs(qint64 fallbackMs) const
+{
+	if (!hasSample())
+		return fallbackMs;
+	return (srttUs_.load(std::memory_order_relaxed) + 4 * rttvarUs_.load(std::memory_order_relaxed)) / 1000;
+}
+
+qint64 RttTracker::paceMs(qint64 floorMs) const
+{
+	if (!hasSample())
+		return floorMs;
+
+	const qint64 linkMs = (srttUs_.load(std::memory_order_relaxed) + 2 * rttvarUs_.load(std::memory_order_relaxed)) / 1000;
+	return qMax(floorMs, linkMs);
+}
+
+qint64 RttTracker::oneWayMs() const
+{
+	if (!hasSample())
+		return 0;
+	return srttUs_.load(std::memory_order_relaxed) / 2000;
+}
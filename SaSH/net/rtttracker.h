@@ -0,0 +1,92 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+// 連線往返時間估計
+//
+// 取樣來源為帶序號的ECHO探測 以及送出後伺服器會立即回應的封包(傳送點、對話框)
+// 戰鬥指令的回應要等全隊出手後才送出 包含伺服器端的等待 不作為取樣來源
+// 平滑方式與TCP相同 (RFC 6298): srtt = 7/8 srtt + 1/8 R, rttvar = 3/4 rttvar + 1/4 |srtt - R|
+// 尚無取樣時所有估計值都返回呼叫端給的預設值 行為與固定延時相同
+class RttTracker
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	typedef enum
+	{
+		kWarp,    // EV -> EV
+		kDialog,  // WN -> WN
+		kKindCount,
+	}Kind;
+
+	//送出需要回應的封包 同類尚未回應時保留較早的時間
+	void expect(Kind kind);
+
+	//收到回應 沒有等待中的封包時忽略
+	void acknowledge(Kind kind);
+
+	//產生帶序號的ECHO探測字串
+	Q_REQUIRED_RESULT QByteArray makeProbe();
+
+	//收到ECHO 返回是否為帶序號的探測字串 不是時忽略 (例如伺服器定時發送的ECHO或元神歸位的"hoge")
+	bool acknowledgeProbe(const char* text);
+
+	Q_REQUIRED_RESULT inline bool hasSample() const { return samples_.load(std::memory_order_relaxed) > 0; }
+	Q_REQUIRED_RESULT inline int sampleCount() const { return samples_.load(std::memory_order_relaxed); }
+
+	//沒有取樣時返回-1
+	Q_REQUIRED_RESULT qint64 srttMs() const;
+	Q_REQUIRED_RESULT qint64 jitterMs() const;
+
+	//等待回應的逾時 srtt + 4 * rttvar
+	Q_REQUIRED_RESULT qint64 rtoMs(qint64 fallbackMs) const;
+
+	//連續送出封包的最小間隔 不低於floorMs
+	Q_REQUIRED_RESULT qint64 paceMs(qint64 floorMs) const;
+
+	//單向延遲估計 沒有取樣時為0
+	Q_REQUIRED_RESULT qint64 oneWayMs() const;
+
+private:
+	void addSample(Clock::duration elapsed);
+
+	static constexpr int kProbeCount = 8;
+	static constexpr int kWarmupSamples = 4;
+	static constexpr auto kMaxWait = std::chrono::seconds(5);
+
+	struct Pending
+	{
+		Clock::time_point sent;
+		quint32 seq = 0;
+		bool valid = false;
+	};
+
+	QMutex mutex_;
+	Pending pending_[kKindCount] = {};
+	Pending probes_[kProbeCount] = {};
+	quint32 nextSeq_ = 1;
+
+	std::atomic<qint64> srttUs_ { 0 };
+	std::atomic<qint64> rttvarUs_ { 0 };
+	std::atomic_int samples_ { 0 };
+};
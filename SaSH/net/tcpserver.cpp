@@ -19,36 +19,23 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include "stdafx.h"
 #include "tcpserver.h"
 #include "autil.h"
+#include "battlepacket.h"
+#include "recvregistry.h"
+#include "protostats.h"
 #include <injector.h>
 #include "signaldispatcher.h"
 #include "map/mapanalyzer.h"
 #include "script/interpreter.h"
 
 #include <spdloger.hpp>
+#include <tuple>
 extern QString g_logger_name;//parser.cpp
 
 #pragma region StringControl
 // 0-9,a-z(10-35),A-Z(36-61)
 int Server::a62toi(const QString& a) const
 {
-	int ret = 0;
-	int sign = 1;
-	int size = a.length();
-	for (int i = 0; i < size; ++i)
-	{
-		ret *= 62;
-		if ('0' <= a[i] && a[i] <= '9')
-			ret += a[i].unicode() - '0';
-		else if ('a' <= a[i] && a[i] <= 'z')
-			ret += a[i].unicode() - 'a' + 10;
-		else if ('A' <= a[i] && a[i] <= 'Z')
-			ret += a[i].unicode() - 'A' + 36;
-		else if (a[i] == '-')
-			sign = -1;
-		else
-			return 0;
-	}
-	return ret * sign;
+	return util::TokenIndex::a62toi(QStringRef(&a));
 }
 
 int Server::getStringToken(const QString& src, const QString& delim, int count, QString& out) const
@@ -112,58 +99,10 @@ int Server::getInteger62Token(const QString& src, const QString& delim, int coun
 	return a62toi(s);
 }
 
-QString Server::makeStringFromEscaped(const QString& src) const
+//原地還原轉義字符 沒有反斜線時不會分離(detach)字串
+void Server::makeStringFromEscaped(QString& src) const
 {
-	struct EscapeChar
-	{
-		QChar escapechar;
-		QChar escapedchar;
-	};
-
-	static const EscapeChar escapeChar[] = {
-		{ QChar('n'), QChar('\n') },
-		{ QChar('c'), QChar(',')},
-		{ QChar('z'), QChar('|')},
-		{ QChar('y'), QChar('\\') },
-	};
-
-	QString result;
-	int srclen = src.length();
-
-	for (int i = 0; i < srclen; ++i)
-	{
-		if (src[i] == '\\' && i + 1 < srclen)
-		{
-			QChar nextChar = src[i + 1];
-
-			bool isDBCSLeadByte = false;
-			if (nextChar.isHighSurrogate() && i + 2 < srclen && src[i + 2].isLowSurrogate())
-			{
-				result.append(src.midRef(i, 2));
-				i += 2;
-				isDBCSLeadByte = true;
-			}
-
-			if (!isDBCSLeadByte)
-			{
-				for (int j = 0; j < sizeof(escapeChar) / sizeof(escapeChar[0]); ++j)
-				{
-					if (escapeChar[j].escapedchar == nextChar)
-					{
-						result.append(escapeChar[j].escapechar);
-						i++;
-						break;
-					}
-				}
-			}
-		}
-		else
-		{
-			result.append(src[i]);
-		}
-	}
-
-	return result;
+	util::unescape(src);
 }
 
 #if 0
@@ -203,42 +142,19 @@ int Server::a62toi(char* a) const
 
 void Server::clearNetBuffer()
 {
-	//memset(net_readbuf, 0, sizeof(net_readbuf));
 	net_readbuf.clear();
 	//memset(rpc_linebuffer, 0, sizeof(rpc_linebuffer));
-	Autil::util_Clear();
+	codec_.clear();
 }
 
-int Server::appendReadBuf(const QByteArray& data)
+bool Server::appendReadBuf(const QByteArray& data)
 {
-	net_readbuf.append(data);
-	return 0;
-}
-
-QByteArrayList Server::splitLinesFromReadBuf()
-{
-	QByteArrayList lines = net_readbuf.split('\n'); // Split net_readbuf into lines
-
-	if (!net_readbuf.endsWith('\n'))
-	{
-		// The last line is incomplete, remove it from the list and keep it in net_readbuf
-		int lastIndex = lines.size() - 1;
-		net_readbuf = lines[lastIndex];
-		lines.removeAt(lastIndex);
-	}
-	else
-	{
-		// net_readbuf does not contain any incomplete line
-		net_readbuf.clear();
-	}
-
-	for (int i = 0; i < lines.size(); ++i)
-	{
-		// Remove '\r' from each line
-		lines[i] = lines[i].replace('\r', "");
-	}
+	if (net_readbuf.append(data.constData(), static_cast<size_t>(data.size())))
+		return true;
 
-	return lines;
+	SPD_LOG(g_logger_name, QString("[proto] read buffer overflow, %1 bytes dropped").arg(data.size()));
+	codec_.clear();
+	return false;
 }
 
 #pragma endregion
@@ -260,21 +176,29 @@ Server::Server(QObject* parent)
 	connectingTimer.start();
 	repTimer.start();
 
-	Autil::util_Init();
 	clearNetBuffer();
 
-	sync_.setCancelOnWait(true);
 	ayncBattleCommandSync.setCancelOnWait(true);
 
 	mapAnalyzer.reset(new MapAnalyzer);
+
+	decodeThread_.reset(QThread::create([this]() { decodeLoop(); }));
+	decodeThread_->start();
 }
 
 Server::~Server()
 {
 	requestInterruption();
+
+	decodeStop_.store(true, std::memory_order_release);
+	readSignal_.release();
+	decodeThread_->wait();
+
 	clearNetBuffer();
+	stopCapture();
 
-	server_->close();
+	if (!server_.isNull())
+		server_->close();
 	for (QTcpSocket* clientSocket : clientSockets_)
 	{
 		clientSocket->close();
@@ -296,7 +220,6 @@ Server::~Server()
 	ayncBattleCommandSync.waitForFinished();
 	ayncBattleCommandSync.clearFutures();
 	ayncBattleCommandFlag.store(false, std::memory_order_release);
-	sync_.waitForFinished();
 	mapAnalyzer.reset(nullptr);
 	qDebug() << "Server is distroyed";
 }
@@ -306,6 +229,7 @@ void Server::clear()
 {
 	enemyNameListCache.clear();
 	mapUnitHash.clear();
+	emit SignalDispatcher::getInstance().mapUnitsCleared();
 	chatQueue.clear();
 	for (int i = 0; i < MAX_PET + 1; ++i)
 		recorder[i] = {};
@@ -388,6 +312,16 @@ bool Server::start(QObject* parent)
 	}
 
 	port_ = server_->serverPort();
+
+	//以 --capture 啟動時錄製每條連線
+	const QString captureDir(qgetenv("CAPTURE_DIR"));
+	if (!captureDir.isEmpty())
+	{
+		const QString fileName = QString("%1/%2_%3.sacap").arg(captureDir).arg(QCoreApplication::applicationPid()).arg(QDateTime::currentDateTime().toString("yyyyMMddhhmmss"));
+		if (!startCapture(fileName))
+			SPD_LOG(g_logger_name, QString("[proto] failed to open capture file: %1").arg(fileName));
+	}
+
 	return true;
 }
 
@@ -410,1126 +344,587 @@ void Server::onNewConnection()
 	connect(this, &Server::write, this, &Server::onWrite, Qt::QueuedConnection);
 }
 
-//異步接收客戶端數據
+//接收客戶端數據 只負責讀取並放入佇列
 void Server::onClientReadyRead()
 {
 	QTcpSocket* clientSocket = qobject_cast<QTcpSocket*>(sender());
 	if (!clientSocket)
 		return;
-	QByteArray badata = clientSocket->readAll();
-
-	sync_.addFuture(QtConcurrent::run([this, clientSocket, badata]()
-		{
-			QMutexLocker lock(&net_mutex);
-
-			QString preStr = QString::fromUtf8(badata);
-			if (preStr.startsWith("dc"))
-			{
-				setBattleFlag(false);
-				setOnlineFlag(false);
-				return;
-			}
-			else if (preStr.startsWith("bPK"))
-			{
-				Injector& injector = Injector::getInstance();
-				int value = mem::read<short>(injector.getProcess(), injector.getProcessModule() + 0xE21E4);
-				announce(QString("[async battle] 战斗面板生成了 类别:%1").arg(value));
-				isBattleDialogReady.store(true, std::memory_order_release);
-				asyncBattleWork(true);//sync
-				return;
-			}
-			else if (preStr.startsWith("dk|"))
-			{
-				//remove dk|s
-				preStr = preStr.mid(3);
-				lssproto_CustomWN_recv(preStr);
-				return;
-			}
-			else if (preStr.startsWith("tk|"))
-			{
-				//remove tk|s
-				preStr = preStr.mid(3);
-				lssproto_CustomTK_recv(preStr);
-				return;
-			}
 
-			handleData(clientSocket, badata);
-		}));
+	readFromSocket(clientSocket);
 }
 
-//異步發送數據
-void Server::onWrite(QTcpSocket* clientSocket, QByteArray ba, int size)
+//解碼線程消化了已滿的佇列 繼續讀取留在socket內的數據
+void Server::onReadQueueDrained()
 {
-	if (clientSocket && clientSocket->state() != QAbstractSocket::UnconnectedState)
-	{
-		clientSocket->write(ba, size);
-		clientSocket->flush();
-	}
+	QTcpSocket* clientSocket = stalledSocket_.data();
+	stalledSocket_.clear();
+	if (clientSocket)
+		readFromSocket(clientSocket);
 }
 
-//異步處理數據
-void Server::handleData(QTcpSocket*, QByteArray badata)
+void Server::readFromSocket(QTcpSocket* clientSocket)
 {
-	//char rpc_linebuffer[65536] = {};//Autil::NETBUFSIZ
-	//int len = badata.size();
-	//memset(rpc_linebuffer, 0, sizeof(rpc_linebuffer));
-	//memcpy_s(rpc_linebuffer, sizeof(rpc_linebuffer), badata, len);
-	//_snprintf_s(rpc_linebuffer, sizeof(rpc_linebuffer), _TRUNCATE, "%s", badata);
+	while (clientSocket->bytesAvailable() > 0)
+	{
+		if (readQueue_.isFull())
+		{
+			stalledSocket_ = clientSocket;
+			readStalled_.store(true, std::memory_order_release);
+			//解碼線程可能在設置標記前已取出數據 再確認一次以免沒人喚醒
+			if (readQueue_.isFull())
+			{
+				readStalls_.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
 
-	appendReadBuf(badata);
+			readStalled_.store(false, std::memory_order_release);
+			continue;
+		}
 
-	if (net_readbuf.isEmpty())
-	{
-		//emit write(clientSocket, badata, len);
+		ReadChunk chunk;
+		chunk.socket = clientSocket;
+		chunk.data = clientSocket->readAll();
+		chunk.received = std::chrono::steady_clock::now();
+		readQueue_.push(std::move(chunk));
 
-		return;
-	}
+		const size_t depth = readQueue_.size();
+		if (depth > readDepthMax_.load(std::memory_order_relaxed))
+			readDepthMax_.store(depth, std::memory_order_relaxed);
 
-	//qDebug() << "Received " << badata.size() << " bytes from client but actual len is:" << badata.trimmed().size();
-	SPD_LOG(g_logger_name, QString("[proto] Received %1 bytes from client but actual len is: %2").arg(badata.size()).arg(badata.trimmed().size()));
+		readSignal_.release();
+	}
+}
 
-	Injector& injector = Injector::getInstance();
-	QString key = mem::readString(injector.getProcess(), injector.getProcessModule() + kOffestPersonalKey, Autil::PERSONALKEYSIZE, true, true);
-	if (key != Autil::PersonalKey)
-		Autil::PersonalKey = key;
+//單一解碼線程 依接收順序處理所有數據
+void Server::decodeLoop()
+{
+	constexpr quint64 kStatsLogInterval = 4096;
 
+	ReadChunk chunk;
+	while (!decodeStop_.load(std::memory_order_acquire))
+	{
+		if (!readSignal_.tryAcquire(1, 100))
+			continue;
 
-	QByteArrayList dataList = splitLinesFromReadBuf();
-	if (dataList.isEmpty())
-		return;
+		if (!readQueue_.pop(&chunk))
+			continue;
 
-	SPD_LOG(g_logger_name, QString("[proto] Received %1 lines from client").arg(dataList.size()));
+		const quint64 waitUs = static_cast<quint64>(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - chunk.received).count());
+		const quint64 chunks = readChunks_.fetch_add(1, std::memory_order_relaxed) + 1;
+		readWaitTotalUs_.fetch_add(waitUs, std::memory_order_relaxed);
+		if (waitUs > readWaitMaxUs_.load(std::memory_order_relaxed))
+			readWaitMaxUs_.store(waitUs, std::memory_order_relaxed);
 
-	for (QByteArray& ba : dataList)
-	{
-		if (isInterruptionRequested())
-			break;
+		if (readStalled_.exchange(false, std::memory_order_acq_rel))
+			QMetaObject::invokeMethod(this, "onReadQueueDrained", Qt::QueuedConnection);
 
-		//memset(rpc_linebuffer, 0, sizeof(rpc_linebuffer));
-		// get line from read buffer
-		if (!ba.isEmpty())
 		{
-			int ret = saDispatchMessage(ba.data());
-
-			if (ret < 0)
-			{
-				qDebug() << "************************ LSSPROTO_END ************************";
-				//代表此段數據已到結尾
-				Autil::util_Clear();
-				break;
-			}
-			else if (ret == BC_NEED_TO_CLEAN)
-			{
-				qDebug() << "************************ CLEAR_BUFFER ************************";
-				//錯誤的數據 或 需要清除緩存
-				clearNetBuffer();
-				break;
-			}
+			QMutexLocker lock(&net_mutex);
+			handleData(chunk.socket, chunk.data);
 		}
-		else
+
+		chunk = ReadChunk();
+
+		if (((chunks % kStatsLogInterval) == 0) && SPD_ISENABLED())
 		{
-			qDebug() << "************************ DONE_BUFFER ************************";
-			//數據讀完了
-			Autil::util_Clear();
+			const ReadQueueStats stats = readQueueStats();
+			SPD_LOG(g_logger_name, QString("[proto] read queue: chunks %1 avg wait %2us max wait %3us max depth %4 stalls %5")
+				.arg(stats.chunks).arg(stats.totalWaitUs / qMax<quint64>(stats.chunks, 1)).arg(stats.maxWaitUs).arg(stats.maxDepth).arg(stats.stalls));
 		}
 	}
-
-	//emit write(clientSocket, sendBuf.data(), len);
 }
 
-//經由 handleData 調用同步解析數據
-int Server::saDispatchMessage(char* encoded)
+bool Server::startCapture(const QString& path)
 {
-	using namespace Autil;
+	QMutexLocker lock(&net_mutex);
+	capture_.reset(new capture::Writer);
+	if (!capture_->open(path))
+	{
+		capture_.reset();
+		return false;
+	}
 
-	int	func = 0, fieldcount = 0;
-	int	iChecksum = 0, iChecksumrecv = 0;
+	const Autil::KeySchedule& key = codec_.personalKey();
+	if (key.isValid())
+		capture_->write(capture::kKey, key.key, static_cast<size_t>(key.length));
 
-	//QByteArray raw(Autil::NETBUFSIZ, '\0');
-	char raw[NETBUFSIZ] = {};
-	memset(raw, 0, sizeof(raw));
+	return true;
+}
 
-	util_DecodeMessage(raw, Autil::NETBUFSIZ, encoded);
-	util_SplitMessage(raw, Autil::NETBUFSIZ, const_cast<char*>(Autil::SEPARATOR));
-	if (util_GetFunctionFromSlice(&func, &fieldcount) != 1)
-	{
-		return 0;
-	}
+void Server::stopCapture()
+{
+	QMutexLocker lock(&net_mutex);
+	capture_.reset();
+}
 
-	//qDebug() << "fun" << func << "fieldcount" << fieldcount;
+bool Server::replayCapture(const QString& path, bool realtime, capture::report_t* report)
+{
+	capture::Reader reader;
+	if (report == nullptr || !reader.open(path))
+		return false;
 
-	if (func == LSSPROTO_ERROR_RECV)
-	{
-		return -1;
-	}
+	QMutexLocker lock(&net_mutex);
+	clearNetBuffer();
+	replaying_ = true;
+	replayReport_ = report;
 
-	SPD_LOG(g_logger_name, QString("[proto] lssproto func: %1").arg(func));
+	//只計算 handleData 內的分配 不含讀取錄製檔
+	capture::AllocationCounter allocations;
+	if (allocations.count() >= 0)
+		report->allocations = 0;
 
-	switch (func)
-	{
-	case LSSPROTO_XYD_RECV: /*戰後刷新人物座標、方向2*/
-	{
-		int x = 0;
-		int y = 0;
-		int dir = 0;
-		iChecksum += util_deint(2, &x);
-		iChecksum += util_deint(3, &y);
-		iChecksum += util_deint(4, &dir);
+	QElapsedTimer elapsed;
+	elapsed.start();
 
-		util_deint(5, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_XYD_RECV" << "x" << x << "y" << y << "dir" << dir;
-		lssproto_XYD_recv(QPoint(x, y), dir);
-		break;
-	}
-	case LSSPROTO_EV_RECV: /*WRAP 4*/
-	{
-		int seqno = 0;
-		int result = 0;
-		iChecksum += util_deint(2, &seqno);
-		iChecksum += util_deint(3, &result);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_EV_RECV" << "seqno" << seqno << "result" << result;
-		lssproto_EV_recv(seqno, result);
-		break;
-	}
-	case LSSPROTO_EN_RECV: /*Battle EncountFlag //開始戰鬥 7*/
-	{
-		int result = 0;
-		int field = 0;
-		iChecksum += util_deint(2, &result);
-		iChecksum += util_deint(3, &field);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_EN_RECV" << "result" << result << "field" << field;
-		lssproto_EN_recv(result, field);
-		break;
-	}
-	case LSSPROTO_RS_RECV: /*戰後獎勵 12*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_RS_RECV" << util::toUnicode(data);
-		lssproto_RS_recv(data);
-		break;
-	}
-	case LSSPROTO_RD_RECV:/*戰後經驗 13*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_RD_RECV" << util::toUnicode(data);
-		lssproto_RD_recv(data);
-		break;
-	}
-	case LSSPROTO_B_RECV: /*每回合開始的戰場資訊 15*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_B_RECV" << util::toUnicode(data);
-		lssproto_B_recv(data);
-		break;
-	}
-	case LSSPROTO_I_RECV: /*物品變動 22*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_I_RECV" << util::toUnicode(data);
-		lssproto_I_recv(data);
-		break;
-	}
-	case LSSPROTO_SI_RECV:/* 道具位置交換24*/
+	capture::record_t record;
+	while (reader.next(&record) && !isInterruptionRequested())
 	{
-		int fromindex;
-		int toindex;
+		++report->records;
 
-		iChecksum += util_deint(2, &fromindex);
-		iChecksum += util_deint(3, &toindex);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
+		if (record.type == capture::kKey)
 		{
-			Autil::SliceCount = 0;
-			return 0;
+			codec_.setPersonalKey(record.data.constData(), static_cast<size_t>(record.data.size()));
+			continue;
 		}
-		qDebug() << "LSSPROTO_SI_RECV" << "fromindex" << fromindex << "toindex" << toindex;
-		lssproto_SI_recv(fromindex, toindex);
-		break;
-	}
-	case LSSPROTO_MSG_RECV:/*收到郵件26*/
-	{
-		int aindex;
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-		int color;
 
-		iChecksum += util_deint(2, &aindex);
-		iChecksum += util_destring(3, data);
-		iChecksum += util_deint(4, &color);
-		util_deint(5, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
+		if (realtime)
 		{
-			Autil::SliceCount = 0;
-			return 0;
+			const qint64 waitUs = record.timeUs - elapsed.nsecsElapsed() / 1000;
+			if (waitUs > 0)
+				QThread::usleep(static_cast<unsigned long>(waitUs));
 		}
-		qDebug() << "LSSPROTO_MSG_RECV" << util::toUnicode(data);
-		lssproto_MSG_recv(aindex, data, color);
-		break;
-	}
-	case LSSPROTO_PME_RECV:/*28*/
-	{
-		int objindex;
-		int graphicsno;
-		int x;
-		int y;
-		int dir;
-		int flg;
-		int no;
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-
-		iChecksum += util_deint(2, &objindex);
-		iChecksum += util_deint(3, &graphicsno);
-		iChecksum += util_deint(4, &x);
-		iChecksum += util_deint(5, &y);
-		iChecksum += util_deint(6, &dir);
-		iChecksum += util_deint(7, &flg);
-		iChecksum += util_deint(8, &no);
-		iChecksum += util_destring(9, data);
-		util_deint(10, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_PME_RECV" << "objindex" << objindex << "graphicsno" << graphicsno <<
-			"x" << x << "y" << y << "dir" << dir << "flg" << flg << "no" << no << "cdata" << util::toUnicode(data);
-		lssproto_PME_recv(objindex, graphicsno, QPoint(x, y), dir, flg, no, data);
-		break;
-	}
-	case LSSPROTO_AB_RECV:/* 30*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_AB_RECV" << util::toUnicode(data);
-		lssproto_AB_recv(data);
-		break;
+
+		report->bytes += static_cast<quint64>(record.data.size());
+
+		const qint64 allocated = allocations.count();
+		const qint64 begin = elapsed.nsecsElapsed();
+		handleData(nullptr, record.data);
+		report->busyNs += static_cast<quint64>(elapsed.nsecsElapsed() - begin);
+		if (allocated >= 0)
+			report->allocations += allocations.count() - allocated;
 	}
-	case LSSPROTO_ABI_RECV:/*名片數據31*/
+
+	replayReport_ = nullptr;
+	replaying_ = false;
+	clearNetBuffer();
+	return true;
+}
+
+Server::ReadQueueStats Server::readQueueStats() const
+{
+	ReadQueueStats stats;
+	stats.chunks = readChunks_.load(std::memory_order_relaxed);
+	stats.totalWaitUs = readWaitTotalUs_.load(std::memory_order_relaxed);
+	stats.maxWaitUs = readWaitMaxUs_.load(std::memory_order_relaxed);
+	stats.maxDepth = readDepthMax_.load(std::memory_order_relaxed);
+	stats.stalls = readStalls_.load(std::memory_order_relaxed);
+	return stats;
+}
+
+//異步發送數據
+void Server::onWrite(QTcpSocket* clientSocket, QByteArray ba, int size)
+{
+	if (clientSocket && clientSocket->state() != QAbstractSocket::UnconnectedState)
 	{
-		int num;
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-		iChecksum += util_deint(2, &num);
-		iChecksum += util_destring(3, data);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_ABI_RECV" << "num" << num << "data" << util::toUnicode(data);
-		lssproto_ABI_recv(num, data);
-		break;
+		clientSocket->write(ba, size);
+		clientSocket->flush();
 	}
-	case LSSPROTO_TK_RECV: /*收到對話36*/
-	{
-		int index;
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+}
 
-		int color;
+//異步處理數據
+void Server::handleData(QTcpSocket*, QByteArray badata)
+{
+	//char rpc_linebuffer[65536] = {};//Autil::NETBUFSIZ
+	//int len = badata.size();
+	//memset(rpc_linebuffer, 0, sizeof(rpc_linebuffer));
+	//memcpy_s(rpc_linebuffer, sizeof(rpc_linebuffer), badata, len);
+	//_snprintf_s(rpc_linebuffer, sizeof(rpc_linebuffer), _TRUNCATE, "%s", badata);
 
-		iChecksum += util_deint(2, &index);
-		iChecksum += util_destring(3, data);
-		iChecksum += util_deint(4, &color);
-		util_deint(5, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_TK_RECV" << "index" << index << "message" << util::toUnicode(data) << "color" << color;
-		lssproto_TK_recv(index, data, color);
-		break;
-	}
-	case LSSPROTO_MC_RECV: /*地圖數據更新，重新繪製地圖37*/
-	{
-		int fl;
-		int x1;
-		int y1;
-		int x2;
-		int y2;
-		int tilesum;
-		int objsum;
-		int eventsum;
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-
-		iChecksum += util_deint(2, &fl);
-		iChecksum += util_deint(3, &x1);
-		iChecksum += util_deint(4, &y1);
-		iChecksum += util_deint(5, &x2);
-		iChecksum += util_deint(6, &y2);
-		iChecksum += util_deint(7, &tilesum);
-		iChecksum += util_deint(8, &objsum);
-		iChecksum += util_deint(9, &eventsum);
-		iChecksum += util_destring(10, data);
-		util_deint(11, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-
-		qDebug() << "LSSPROTO_MC_RECV" << "fl" << fl << "x1" << x1 << "y1" << y1 << "x2" << x2 << "y2" << y2 <<
-			"tilesum" << tilesum << "objsum" << objsum << "eventsum" << eventsum << "data" << util::toUnicode(data);
-		lssproto_MC_recv(fl, x1, y1, x2, y2, tilesum, objsum, eventsum, data);
-		//m_map.name = qmap;
-		break;
-	}
-	case LSSPROTO_M_RECV: /*地圖數據更新，重新寫入地圖2 39*/
-	{
-		int fl;
-		int x1;
-		int y1;
-		int x2;
-		int y2;
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-
-		iChecksum += util_deint(2, &fl);
-		iChecksum += util_deint(3, &x1);
-		iChecksum += util_deint(4, &y1);
-		iChecksum += util_deint(5, &x2);
-		iChecksum += util_deint(6, &y2);
-		iChecksum += util_destring(7, data);
-		util_deint(8, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_M_RECV" << "fl" << fl << "x1" << x1 << "y1" << y1 << "x2" << x2 << "y2" << y2 << "data" << util::toUnicode(data);
-		lssproto_M_recv(fl, x1, y1, x2, y2, data);
-		//m_map.floor = fl;
-		break;
-	}
-	case LSSPROTO_C_RECV: /*服務端發送的靜態信息，可用於顯示玩家，其它玩家，公交，寵物等信息 41*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+	if (!capture_.isNull())
+		capture_->write(capture::kData, badata.constData(), static_cast<size_t>(badata.size()));
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_C_RECV" << util::toUnicode(data);
-		lssproto_C_recv(data);
-		break;
-	}
-	case LSSPROTO_CA_RECV: /*//周圍人、NPC..等等狀態改變必定是 _C_recv已經新增過的單位 42*/
+	if (!appendReadBuf(badata) || net_readbuf.isEmpty())
 	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+		//emit write(clientSocket, badata, len);
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_CA_RECV" << util::toUnicode(data);
-		lssproto_CA_recv(data);
-		break;
+		return;
 	}
-	case LSSPROTO_CD_RECV: /*刪除指定一個或多個周圍人、NPC單位 43*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_CD_RECV" << util::toUnicode(data);
-		lssproto_CD_recv(data);
-		break;
-	}
-	case LSSPROTO_R_RECV:
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+	//qDebug() << "Received " << badata.size() << " bytes from client but actual len is:" << badata.trimmed().size();
+	if (SPD_ISENABLED())
+		SPD_LOG(g_logger_name, QString("[proto] Received %1 bytes from client but actual len is: %2").arg(badata.size()).arg(badata.trimmed().size()));
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_R_RECV" << util::toUnicode(data);
-		lssproto_R_recv(data);
-		break;
-	}
-	case LSSPROTO_S_RECV: /*更新所有基礎資訊 46*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+	//每次收到數據都重新讀取金鑰 遊戲更換金鑰後發送端不會沿用舊金鑰 沒變時只比對32字節
+	refreshPersonalKey();
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_S_RECV" << util::toUnicode(data);
-		lssproto_S_recv(data);
-		break;
-	}
-	case LSSPROTO_D_RECV:/*47*/
+	char* line = nullptr;
+	size_t lineSize = 0;
+	int lineCount = 0;
+	while (net_readbuf.takeLine(&line, &lineSize))
 	{
-		int category;
-		int dx;
-		int dy;
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-
-		iChecksum += util_deint(2, &category);
-		iChecksum += util_deint(3, &dx);
-		iChecksum += util_deint(4, &dy);
-		iChecksum += util_destring(5, data);
-		util_deint(6, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
+		++lineCount;
+		if (isInterruptionRequested())
 		{
-			Autil::SliceCount = 0;
-			return 0;
+			net_readbuf.discardLines();
+			break;
 		}
-		qDebug() << "LSSPROTO_D_RECV" << "category" << category << "dx" << dx << "dy" << dy << "data" << util::toUnicode(data);
-		lssproto_D_recv(category, dx, dy, data);
-		break;
-	}
-	case LSSPROTO_FS_RECV:/*開關切換 49*/
-	{
-		int flg;
 
-		iChecksum += util_deint(2, &flg);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
+		// get line from read buffer
+		if (dispatchControlMessage(line, lineSize))
 		{
-			Autil::SliceCount = 0;
-			return 0;
+			continue;
 		}
-		qDebug() << "LSSPROTO_FS_RECV" << "flg" << flg;
-		lssproto_FS_recv(flg);
-		break;
-	}
-	case LSSPROTO_HL_RECV:/*51*/
-	{
-		int flg;
-
-		iChecksum += util_deint(2, &flg);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
+		else if (lineSize > 0)
 		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_HL_RECV" << "flg" << flg;
-		lssproto_HL_recv(flg);
-		break;
-	}
-	case LSSPROTO_PR_RECV:/*組隊變化 53*/
-	{
-		int request;
-		int result;
+			int ret = saDispatchMessage(codec_, line);
 
-		iChecksum += util_deint(2, &request);
-		iChecksum += util_deint(3, &result);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_PR_RECV" << "request" << request << "result" << result;
-		lssproto_PR_recv(request, result);
-		break;
-	}
-	case LSSPROTO_KS_RECV: /*寵物更換狀態55*/
-	{
-		int petarray;
-		int result;
+			//無法解析時可能是遊戲已更換金鑰 重新讀取後若有變動則重試一次
+			if ((ret == 0) && (codec_.sliceCount() == 0) && refreshPersonalKey())
+				ret = saDispatchMessage(codec_, line);
 
-		iChecksum += util_deint(2, &petarray);
-		iChecksum += util_deint(3, &result);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
+			if (ret < 0)
+			{
+				//qDebug() << "************************ LSSPROTO_END ************************";
+				//代表此段數據已到結尾
+				codec_.clear();
+				net_readbuf.discardLines();
+				break;
+			}
+			else if (ret == BC_NEED_TO_CLEAN)
+			{
+				//qDebug() << "************************ CLEAR_BUFFER ************************";
+				//錯誤的數據 或 需要清除緩存
+				clearNetBuffer();
+				break;
+			}
 		}
-		qDebug() << "LSSPROTO_KS_RECV" << "petarray" << petarray << "result" << result;
-		lssproto_KS_recv(petarray, result);
-		break;
-	}
-	case LSSPROTO_PS_RECV:
-	{
-		int result;
-		int havepetindex;
-		int havepetskill;
-		int toindex;
-
-		iChecksum += util_deint(2, &result);
-		iChecksum += util_deint(3, &havepetindex);
-		iChecksum += util_deint(4, &havepetskill);
-		iChecksum += util_deint(5, &toindex);
-		util_deint(6, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
+		else
 		{
-			Autil::SliceCount = 0;
-			return 0;
+			//qDebug() << "************************ DONE_BUFFER ************************";
+			//數據讀完了
+			codec_.clear();
 		}
-		qDebug() << "LSSPROTO_PS_RECV" << "result" << result << "havepetindex" << havepetindex << "havepetskill" << havepetskill << "toindex" << toindex;
-		lssproto_PS_recv(result, havepetindex, havepetskill, toindex);
-		break;
-	}
-	case LSSPROTO_SKUP_RECV: /*更新點數 63*/
-	{
-		int point;
 
-		iChecksum += util_deint(2, &point);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
+		//所有完整的行都處理完 與原本分行後結尾的空行相同
+		if (net_readbuf.isEmpty())
 		{
-			Autil::SliceCount = 0;
-			return 0;
+			//qDebug() << "************************ DONE_BUFFER ************************";
+			codec_.clear();
+			break;
 		}
-		qDebug() << "LSSPROTO_SKUP_RECV" << "point" << point;
-		lssproto_SKUP_recv(point);
-		break;
 	}
-	case LSSPROTO_WN_RECV:/*NPC對話框 66*/
-	{
-		int windowtype;
-		int buttontype;
-		int seqno;
-		int objindex;
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
 
-		iChecksum += util_deint(2, &windowtype);
-		iChecksum += util_deint(3, &buttontype);
-		iChecksum += util_deint(4, &seqno);
-		iChecksum += util_deint(5, &objindex);
-		iChecksum += util_destring(6, data);
-		util_deint(7, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_WN_RECV" << "windowtype" << windowtype << "buttontype" << buttontype << "seqno" << seqno << "objindex" << objindex << "data" << util::toUnicode(data);
-		lssproto_WN_recv(windowtype, buttontype, seqno, objindex, data);
-		break;
-	}
-	case LSSPROTO_EF_RECV: /*天氣68*/
-	{
-		int effect;
-		int level;
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+	if ((lineCount > 0) && SPD_ISENABLED())
+		SPD_LOG(g_logger_name, QString("[proto] Received %1 lines from client").arg(lineCount));
 
-		iChecksum += util_deint(2, &effect);
-		iChecksum += util_deint(3, &level);
-		iChecksum += util_destring(4, data);
-		util_deint(5, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_EF_RECV" << "effect" << effect << "level" << level << "option" << util::toUnicode(data);
-		lssproto_EF_recv(effect, level, data);
-		break;
-	}
-	case LSSPROTO_SE_RECV:/*69*/
+	//emit write(clientSocket, sendBuf.data(), len);
+}
+
+//DLL的控制訊息與封包在同一條連線上 各自以'\n'結尾
+//DLL只在轉發的封包停在行尾時才插入控制訊息 (見GameService::Send) 因此控制訊息一定是完整的一行
+//封包行經過反相 首字節必定大於0x7f 控制訊息則是ASCII開頭
+bool Server::dispatchControlMessage(const char* line, size_t size)
+{
+	if ((size == 0) || (static_cast<unsigned char>(line[0]) & 0x80))
+		return false;
+
+	auto startsWith = [line, size](const char* prefix, size_t prefixSize)
 	{
-		int x;
-		int y;
-		int senumber;
-		int sw;
+		return (size >= prefixSize) && (memcmp(line, prefix, prefixSize) == 0);
+	};
 
-		iChecksum += util_deint(2, &x);
-		iChecksum += util_deint(3, &y);
-		iChecksum += util_deint(4, &senumber);
-		iChecksum += util_deint(5, &sw);
-		util_deint(6, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_SE_RECV" << "x" << x << "y" << y << "senumber" << senumber << "sw" << sw;
-		lssproto_SE_recv(QPoint(x, y), senumber, sw);
-		break;
+	if (startsWith("dc", 2))
+	{
+		setBattleFlag(false);
+		setOnlineFlag(false);
 	}
-	case LSSPROTO_CLIENTLOGIN_RECV:/*選人畫面 72*/
+	else if (startsWith("bPK", 3))
 	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_CLIENTLOGIN_RECV" << util::toUnicode(data);
-		lssproto_ClientLogin_recv(data);
-
-		return BC_NEED_TO_CLEAN;
+		Injector& injector = Injector::getInstance();
+		int value = mem::read<short>(injector.getProcess(), injector.getProcessModule() + 0xE21E4);
+		announce(QString("[async battle] 战斗面板生成了 类别:%1").arg(value));
+		isBattleDialogReady.store(true, std::memory_order_release);
+		asyncBattleWork(true);//sync
 	}
-	case LSSPROTO_CREATENEWCHAR_RECV:/*人物新增74*/
+	else if (startsWith("dk|", 3))
 	{
-		char result[Autil::NETDATASIZE] = {}; memset(result, 0, sizeof(result));
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-
-		iChecksum += util_destring(2, result);
-		iChecksum += util_destring(3, data);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_CREATENEWCHAR_RECV" << util::toUnicode(result) << util::toUnicode(data);
-		lssproto_CreateNewChar_recv(result, data);
-		break;
+		//remove dk|s
+		lssproto_CustomWN_recv(QString::fromUtf8(line + 3, static_cast<int>(size - 3)));
 	}
-	case LSSPROTO_CHARDELETE_RECV:/*人物刪除 76*/
+	else if (startsWith("tk|", 3))
 	{
-		char result[Autil::NETDATASIZE] = {}; memset(result, 0, sizeof(result));
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-
-		iChecksum += util_destring(2, result);
-		iChecksum += util_destring(3, data);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_CHARDELETE_RECV" << util::toUnicode(result) << util::toUnicode(data);
-		lssproto_CharDelete_recv(result, data);
-		break;
+		//remove tk|s
+		lssproto_CustomTK_recv(QString::fromUtf8(line + 3, static_cast<int>(size - 3)));
 	}
-	case LSSPROTO_CHARLOGIN_RECV: /*成功登入 78*/
+	else
 	{
-		char result[Autil::NETDATASIZE] = {}; memset(result, 0, sizeof(result));
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-
-		iChecksum += util_destring(2, result);
-		iChecksum += util_destring(3, data);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_CHARLOGIN_RECV" << util::toUnicode(result) << util::toUnicode(data);
-		lssproto_CharLogin_recv(result, data);
-		break;
+		SPD_LOG(g_logger_name, QString("[proto] unknown control message: %1").arg(QString::fromUtf8(line, static_cast<int>(size))));
 	}
-	case LSSPROTO_CHARLIST_RECV:/*選人頁面資訊 80*/
-	{
-		char result[Autil::NETDATASIZE] = {}; memset(result, 0, sizeof(result));
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
 
-		iChecksum += util_destring(2, result);
-		iChecksum += util_destring(3, data);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+	return true;
+}
 
-		qDebug() << "LSSPROTO_CHARLIST_RECV" << util::toUnicode(result) << util::toUnicode(data);
-		lssproto_CharList_recv(result, data);
+//從遊戲內存讀取金鑰 返回金鑰是否有變動
+bool Server::refreshPersonalKey()
+{
+	//重播時只使用錄製檔內的金鑰
+	if (replaying_)
+		return false;
 
-		return BC_NEED_TO_CLEAN;
-	}
-	case LSSPROTO_CHARLOGOUT_RECV:/*登出 82*/
-	{
-		char result[Autil::NETDATASIZE] = {}; memset(result, 0, sizeof(result));
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+	Injector& injector = Injector::getInstance();
+	char key[Autil::PERSONALKEYSIZE] = {};
+	if (!mem::read(injector.getProcess(), injector.getProcessModule() + kOffestPersonalKey, sizeof(key), key))
+		return false;
 
-		iChecksum += util_destring(2, result);
-		iChecksum += util_destring(3, data);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+	if (!codec_.setPersonalKey(key, sizeof(key)))
+		return false;
 
-		qDebug() << "LSSPROTO_CHARLOGOUT_RECV" << util::toUnicode(result) << util::toUnicode(data);
-		lssproto_CharLogout_recv(result, data);
-		break;
-	}
-	case LSSPROTO_PROCGET_RECV:/*84*/
+	if (!capture_.isNull())
 	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+		const Autil::KeySchedule& schedule = codec_.personalKey();
+		capture_->write(capture::kKey, schedule.key, static_cast<size_t>(schedule.length));
+	}
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+	return true;
+}
 
-		qDebug() << "LSSPROTO_PROCGET_RECV" << util::toUnicode(data);
-		lssproto_ProcGet_recv(data);
-		break;
-	}
-	case LSSPROTO_PLAYERNUMGET_RECV:/*86*/
-	{
-		int logincount;
-		int player;
+//經由 handleData 調用同步解析數據
+int Server::saDispatchMessage(Autil::ProtocolCodec& codec, char* encoded)
+{
+	using namespace Autil;
 
-		iChecksum += util_deint(2, &logincount);
-		iChecksum += util_deint(3, &player);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+	int	func = 0, fieldcount = 0;
 
-		qDebug() << "LSSPROTO_PLAYERNUMGET_RECV" << "logincount:" << logincount << "player:" << player; //"logincount:%d player:%d\n
-		lssproto_PlayerNumGet_recv(logincount, player);
-		break;
-	}
-	case LSSPROTO_ECHO_RECV: /*伺服器定時ECHO "hoge" 88*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+	//重播時依功能編號統計耗時
+	const capture::DispatchTimer timer(replayReport_, func);
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point decodeBegin = Clock::now();
 
-		qDebug() << "LSSPROTO_ECHO_RECV" << util::toUnicode(data);
-		lssproto_Echo_recv(data);
-		break;
-	}
-	case LSSPROTO_NU_RECV: /*不知道幹嘛的 90*/
-	{
-		int AddCount;
+	//解碼後不會比原文長 只取所需的長度 欄位表直接指向此緩衝區
+	const size_t rawlen = strlen(encoded) + 1;
+	char* raw = codec.reserve(ScratchArena::kLine, rawlen);
 
-		iChecksum += util_deint(2, &AddCount);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_NU_RECV" << "AddCount:" << AddCount;
-		lssproto_NU_recv(AddCount);
-		break;
-	}
-	case LSSPROTO_TD_RECV:/*92*/
+	util_DecodeMessage(codec, raw, rawlen, encoded);
+	util_SplitMessage(codec, raw, rawlen, const_cast<char*>(Autil::SEPARATOR));
+	if (util_GetFunctionFromSlice(codec, &func, &fieldcount) != 1)
 	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+		return 0;
+	}
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+	//qDebug() << "fun" << func << "fieldcount" << fieldcount;
 
-		qDebug() << "LSSPROTO_TD_RECV" << util::toUnicode(data);
-		lssproto_TD_recv(data);
-		break;
-	}
-	case LSSPROTO_FM_RECV:/*家族頻道93*/
+	if (func == LSSPROTO_ERROR_RECV)
 	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+		return -1;
+	}
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+	//只在開啟調試日誌時才組字串
+	if (SPD_ISENABLED())
+		SPD_LOG(g_logger_name, QString("[proto] lssproto func: %1").arg(func));
 
-		qDebug() << "LSSPROTO_FM_RECV" << util::toUnicode(data);
-		lssproto_FM_recv(data);
-		break;
-	}
-	case LSSPROTO_WO_RECV:/*95*/
-	{
-		int effect;
+	const RecvHandler handler = (func >= 0 && func < kRecvTableSize) ? recvTable()[func] : nullptr;
+	const Clock::time_point handlerBegin = Clock::now();
+	const int ret = (handler != nullptr) ? handler(*this, codec) : BC_ABOUT_TO_END;
 
-		iChecksum += util_deint(2, &effect);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_WO_RECV" << "effect:" << effect;
-		lssproto_WO_recv(effect);
-		break;
-	}
-	case LSSPROTO_NC_RECV: /*沈默? 101* 戰鬥結束*/
+	auto elapsedNs = [](const Clock::time_point& begin, const Clock::time_point& end)
 	{
-		int flg = 0;
-		iChecksum += util_deint(2, &flg);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_NC_RECV" << "flg:" << flg;
-		lssproto_NC_recv(flg);
-		break;
-	}
-	case LSSPROTO_CS_RECV:/*固定客戶端的速度104*/
+		return static_cast<quint32>(qMin<long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count(), UINT_MAX));
+	};
+	ProtoStats::getInstance().record(func, elapsedNs(decodeBegin, handlerBegin), elapsedNs(handlerBegin, Clock::now()), static_cast<quint32>(rawlen - 1));
+
+	if (handler == nullptr)
 	{
-		int deltimes = 0;
-		iChecksum += util_deint(2, &deltimes);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_CS_RECV" << "deltimes:" << deltimes;
-		lssproto_CS_recv(deltimes);
-		break;
+		if (SPD_ISENABLED())
+			SPD_LOG(g_logger_name, QString("[proto] unknown func: %1 fieldcount: %2").arg(func).arg(fieldcount));
+		codec.discardMessage();
+		return BC_ABOUT_TO_END;
 	}
-	case LSSPROTO_PETST_RECV: /*寵物狀態改變 107*/
-	{
-		int petarray;
-		int result;
 
-		iChecksum += util_deint(2, &petarray);
-		iChecksum += util_deint(3, &result);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_PETST_RECV" << "petarray:" << petarray << "result:" << result;
-		lssproto_PETST_recv(petarray, result);
-		break;
-	}
-	case LSSPROTO_SPET_RECV: /*寵物更換狀態115*/
-	{
-		int standbypet;
-		int result;
+	if (ret != BC_ABOUT_TO_END)
+		return ret;
 
-		iChecksum += util_deint(2, &standbypet);
-		iChecksum += util_deint(3, &result);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_SPET_RECV" << "standbypet:" << standbypet << "result:" << result;
-		lssproto_SPET_recv(standbypet, result);
-		break;
-	}
-	case LSSPROTO_JOBDAILY_RECV:/*任務日誌120*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+	codec.discardMessage();
+	return BC_ABOUT_TO_END;
+}
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+//依函數的參數型別解碼所有欄位後原樣轉交
+template <typename T>
+struct RecvField
+{
+	using type = T;
+};
 
-		qDebug() << "LSSPROTO_JOBDAILY_RECV" << util::toUnicode(data);
-		lssproto_JOBDAILY_recv(data);
-		break;
-	}
-	case LSSPROTO_TEACHER_SYSTEM_RECV:/*導師系統123*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+//延遲轉碼的字段以原始字節解碼 呼叫時才建構
+template <>
+struct RecvField<util::LazyText>
+{
+	using type = char*;
+};
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+template <typename Fn>
+struct RecvFields;
 
-		qDebug() << "LSSPROTO_TEACHER_SYSTEM_RECV" << util::toUnicode(data);
-		lssproto_TEACHER_SYSTEM_recv(data);
-		break;
-	}
-	case LSSPROTO_FIREWORK_RECV:/*煙火?126*/
-	{
-		iChecksum = 0;
-		iChecksumrecv = 0;
-		int iCharaindex, iType, iActionNum;
+template <typename... Params>
+struct RecvFields<void (Server::*)(Params...)>
+{
+	using type = std::tuple<typename RecvField<std::decay_t<Params>>::type...>;
+};
 
-		iChecksum += util_deint(2, &iCharaindex);
-		iChecksum += util_deint(3, &iType);
-		iChecksum += util_deint(4, &iActionNum);
-		util_deint(5, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
-		qDebug() << "LSSPROTO_FIREWORK_RECV" << "iCharaindex:" << iCharaindex << "iType:" << iType << "iActionNum:" << iActionNum;
-		lssproto_Firework_recv(iCharaindex, iType, iActionNum);
-		break;
-	}
-	case LSSPROTO_CHAREFFECT_RECV:/*146*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+template <auto Fn, int Result>
+int Server::relayRecv(Server& server, Autil::ProtocolCodec& codec)
+{
+	typename RecvFields<decltype(Fn)>::type fields = {};
+	const bool ok = std::apply([&codec](auto&... field) { return Autil::util_Recv(codec, field...); }, fields);
+	if (!ok)
+		return 0;
 
-		iChecksum += util_destring(2, data);
-		util_deint(3, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+	std::apply([&server](auto&... field) { (server.*Fn)(field...); }, fields);
+	return Result;
+}
 
-		qDebug() << "LSSPROTO_CHAREFFECT_RECV" << util::toUnicode(data);
-		lssproto_CHAREFFECT_recv(data);
-		break;
-	}
-	case LSSPROTO_IMAGE_RECV:/*151*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+//只校驗不處理
+template <typename... Fields>
+int Server::dropRecv(Server&, Autil::ProtocolCodec& codec)
+{
+	std::tuple<Fields...> fields = {};
+	const bool ok = std::apply([&codec](auto&... field) { return Autil::util_Recv(codec, field...); }, fields);
+	return ok ? BC_ABOUT_TO_END : 0;
+}
+
+//沒有訂閱者時只校驗不轉交
+template <int Func, auto Fn>
+int Server::optionalRecv(Server& server, Autil::ProtocolCodec& codec)
+{
+	if (RecvRegistry::getInstance().isSubscribed(Func))
+		return relayRecv<Fn>(server, codec);
 
-		int x = 0;
-		int y = 0;
-		int z = 0;
-		//int iChecksumrecv;
+	typename RecvFields<decltype(Fn)>::type fields = {};
+	const bool ok = std::apply([&codec](auto&... field) { return Autil::util_Recv(codec, field...); }, fields);
+	return ok ? BC_ABOUT_TO_END : 0;
+}
 
-		iChecksum += util_destring(2, data);
-		iChecksum += util_deint(3, &x);
-		iChecksum += util_deint(4, &y);
-		iChecksum += util_deint(5, &z);
-		util_deint(6, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+//自訂接收函數的版本 Drop負責校驗
+template <int Func, Server::RecvHandler Handler, Server::RecvHandler Drop>
+int Server::subscribedRecv(Server& server, Autil::ProtocolCodec& codec)
+{
+	return RecvRegistry::getInstance().isSubscribed(Func) ? Handler(server, codec) : Drop(server, codec);
+}
 
-		//base64解碼
-		//QByteArray str = QByteArray::fromBase64(data);
-		//QImage image = QImage::fromData(str);
-		//image.save("demo.png");
-		break;
-	}
-	case LSSPROTO_DENGON_RECV:/*200*/
-	{
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
-		int coloer;
-		int num;
-		//int iChecksumrecv;
+int Server::ignoreRecv(Server&, Autil::ProtocolCodec&)
+{
+	return BC_ABOUT_TO_END;
+}
 
-		iChecksum += util_destring(2, data);
-		iChecksum += util_deint(3, &coloer);
-		iChecksum += util_deint(4, &num);
-		util_deint(5, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+int Server::recvXYD(Server& server, Autil::ProtocolCodec& codec)
+{
+	int x = 0;
+	int y = 0;
+	int dir = 0;
+	if (!Autil::util_Recv(codec, x, y, dir))
+		return 0;
 
-		qDebug() << "LSSPROTO_DENGON_RECV" << util::toUnicode(data) << "coloer:" << coloer << "num:" << num;
-		lssproto_DENGON_recv(data, coloer, num);
-		break;
-	}
-	case LSSPROTO_SAMENU_RECV:/*201*/
-	{
-		int count;
-		char data[Autil::NETDATASIZE] = {}; memset(data, 0, sizeof(data));
+	server.lssproto_XYD_recv(QPoint(x, y), dir);
+	return BC_ABOUT_TO_END;
+}
 
-		iChecksum += util_deint(2, &count);
-		iChecksum += util_destring(3, data);
-		util_deint(4, &iChecksumrecv);
-		if (iChecksum != iChecksumrecv)
-		{
-			Autil::SliceCount = 0;
-			return 0;
-		}
+int Server::recvPME(Server& server, Autil::ProtocolCodec& codec)
+{
+	int objindex = 0;
+	int graphicsno = 0;
+	int x = 0;
+	int y = 0;
+	int dir = 0;
+	int flg = 0;
+	int no = 0;
+	char* data = nullptr;
+	if (!Autil::util_Recv(codec, objindex, graphicsno, x, y, dir, flg, no, data))
+		return 0;
 
-		qDebug() << "LSSPROTO_SAMENU_RECV" << "count:" << count << util::toUnicode(data);
-		break;
-	}
-	case 220://SE SO驗證圖
-	{
-		break;
-	}
-	default:
-	{
-		qDebug() << "-------------------fun" << func << "fieldcount" << fieldcount;
-		break;
-	}
-	}
-	Autil::SliceCount = 0;
+	server.lssproto_PME_recv(objindex, graphicsno, QPoint(x, y), dir, flg, no, data);
+	return BC_ABOUT_TO_END;
+}
+
+int Server::recvSE(Server& server, Autil::ProtocolCodec& codec)
+{
+	int x = 0;
+	int y = 0;
+	int senumber = 0;
+	int sw = 0;
+	if (!Autil::util_Recv(codec, x, y, senumber, sw))
+		return 0;
+
+	server.lssproto_SE_recv(QPoint(x, y), senumber, sw);
 	return BC_ABOUT_TO_END;
+}
 
+//以功能編號索引的接收表 未登記的編號為nullptr
+const std::array<Server::RecvHandler, Server::kRecvTableSize>& Server::recvTable()
+{
+	static const std::array<RecvHandler, kRecvTableSize> recvHandlers = []()
+	{
+		std::array<RecvHandler, kRecvTableSize> table = {};
+		table[LSSPROTO_XYD_RECV] = &Server::recvXYD; /*戰後刷新人物座標、方向2*/
+		table[LSSPROTO_EV_RECV] = &Server::relayRecv<&Server::lssproto_EV_recv>; /*WRAP 4*/
+		table[LSSPROTO_EN_RECV] = &Server::relayRecv<&Server::lssproto_EN_recv>; /*Battle EncountFlag //開始戰鬥 7*/
+		table[LSSPROTO_RS_RECV] = &Server::relayRecv<&Server::lssproto_RS_recv>; /*戰後獎勵 12*/
+		table[LSSPROTO_RD_RECV] = &Server::relayRecv<&Server::lssproto_RD_recv>; /*戰後經驗 13*/
+		table[LSSPROTO_B_RECV] = &Server::relayRecv<&Server::lssproto_B_recv>; /*每回合開始的戰場資訊 15*/
+		table[LSSPROTO_I_RECV] = &Server::relayRecv<&Server::lssproto_I_recv>; /*物品變動 22*/
+		table[LSSPROTO_SI_RECV] = &Server::relayRecv<&Server::lssproto_SI_recv>; /* 道具位置交換24*/
+		table[LSSPROTO_MSG_RECV] = &Server::relayRecv<&Server::lssproto_MSG_recv>; /*收到郵件26*/
+		table[LSSPROTO_PME_RECV] = &Server::subscribedRecv<LSSPROTO_PME_RECV, &Server::recvPME, &Server::dropRecv<int, int, int, int, int, int, int, char*>>; /*28*/
+		table[LSSPROTO_AB_RECV] = &Server::relayRecv<&Server::lssproto_AB_recv>; /* 30*/
+		table[LSSPROTO_ABI_RECV] = &Server::relayRecv<&Server::lssproto_ABI_recv>; /*名片數據31*/
+		table[LSSPROTO_TK_RECV] = &Server::relayRecv<&Server::lssproto_TK_recv>; /*收到對話36*/
+		table[LSSPROTO_MC_RECV] = &Server::relayRecv<&Server::lssproto_MC_recv>; /*地圖數據更新，重新繪製地圖37*/
+		table[LSSPROTO_M_RECV] = &Server::relayRecv<&Server::lssproto_M_recv>; /*地圖數據更新，重新寫入地圖2 39*/
+		table[LSSPROTO_C_RECV] = &Server::relayRecv<&Server::lssproto_C_recv>; /*服務端發送的靜態信息，可用於顯示玩家，其它玩家，公交，寵物等信息 41*/
+		table[LSSPROTO_CA_RECV] = &Server::relayRecv<&Server::lssproto_CA_recv>; /*//周圍人、NPC..等等狀態改變必定是 _C_recv已經新增過的單位 42*/
+		table[LSSPROTO_CD_RECV] = &Server::relayRecv<&Server::lssproto_CD_recv>; /*刪除指定一個或多個周圍人、NPC單位 43*/
+		table[LSSPROTO_R_RECV] = &Server::relayRecv<&Server::lssproto_R_recv>;
+		table[LSSPROTO_S_RECV] = &Server::relayRecv<&Server::lssproto_S_recv>; /*更新所有基礎資訊 46*/
+		table[LSSPROTO_D_RECV] = &Server::relayRecv<&Server::lssproto_D_recv>; /*47*/
+		table[LSSPROTO_FS_RECV] = &Server::relayRecv<&Server::lssproto_FS_recv>; /*開關切換 49*/
+		table[LSSPROTO_HL_RECV] = &Server::relayRecv<&Server::lssproto_HL_recv>; /*51*/
+		table[LSSPROTO_PR_RECV] = &Server::relayRecv<&Server::lssproto_PR_recv>; /*組隊變化 53*/
+		table[LSSPROTO_KS_RECV] = &Server::relayRecv<&Server::lssproto_KS_recv>; /*寵物更換狀態55*/
+		table[LSSPROTO_PS_RECV] = &Server::relayRecv<&Server::lssproto_PS_recv>;
+		table[LSSPROTO_SKUP_RECV] = &Server::relayRecv<&Server::lssproto_SKUP_recv>; /*更新點數 63*/
+		table[LSSPROTO_WN_RECV] = &Server::relayRecv<&Server::lssproto_WN_recv>; /*NPC對話框 66*/
+		table[LSSPROTO_EF_RECV] = &Server::optionalRecv<LSSPROTO_EF_RECV, &Server::lssproto_EF_recv>; /*天氣68*/
+		table[LSSPROTO_SE_RECV] = &Server::subscribedRecv<LSSPROTO_SE_RECV, &Server::recvSE, &Server::dropRecv<int, int, int, int>>; /*69*/
+		table[LSSPROTO_CLIENTLOGIN_RECV] = &Server::relayRecv<&Server::lssproto_ClientLogin_recv, BC_NEED_TO_CLEAN>; /*選人畫面 72*/
+		table[LSSPROTO_CREATENEWCHAR_RECV] = &Server::relayRecv<&Server::lssproto_CreateNewChar_recv>; /*人物新增74*/
+		table[LSSPROTO_CHARDELETE_RECV] = &Server::relayRecv<&Server::lssproto_CharDelete_recv>; /*人物刪除 76*/
+		table[LSSPROTO_CHARLOGIN_RECV] = &Server::relayRecv<&Server::lssproto_CharLogin_recv>; /*成功登入 78*/
+		table[LSSPROTO_CHARLIST_RECV] = &Server::relayRecv<&Server::lssproto_CharList_recv, BC_NEED_TO_CLEAN>; /*選人頁面資訊 80*/
+		table[LSSPROTO_CHARLOGOUT_RECV] = &Server::relayRecv<&Server::lssproto_CharLogout_recv>; /*登出 82*/
+		table[LSSPROTO_PROCGET_RECV] = &Server::relayRecv<&Server::lssproto_ProcGet_recv>; /*84*/
+		table[LSSPROTO_PLAYERNUMGET_RECV] = &Server::relayRecv<&Server::lssproto_PlayerNumGet_recv>; /*86*/
+		table[LSSPROTO_ECHO_RECV] = &Server::relayRecv<&Server::lssproto_Echo_recv>; /*伺服器定時ECHO "hoge" 88*/
+		table[LSSPROTO_NU_RECV] = &Server::relayRecv<&Server::lssproto_NU_recv>; /*不知道幹嘛的 90*/
+		table[LSSPROTO_TD_RECV] = &Server::relayRecv<&Server::lssproto_TD_recv>; /*92*/
+		table[LSSPROTO_FM_RECV] = &Server::relayRecv<&Server::lssproto_FM_recv>; /*家族頻道93*/
+		table[LSSPROTO_WO_RECV] = &Server::relayRecv<&Server::lssproto_WO_recv>; /*95*/
+		table[LSSPROTO_NC_RECV] = &Server::relayRecv<&Server::lssproto_NC_recv>; /*沈默? 101* 戰鬥結束*/
+		table[LSSPROTO_CS_RECV] = &Server::relayRecv<&Server::lssproto_CS_recv>; /*固定客戶端的速度104*/
+		table[LSSPROTO_PETST_RECV] = &Server::relayRecv<&Server::lssproto_PETST_recv>; /*寵物狀態改變 107*/
+		table[LSSPROTO_SPET_RECV] = &Server::relayRecv<&Server::lssproto_SPET_recv>; /*寵物更換狀態115*/
+		table[LSSPROTO_JOBDAILY_RECV] = &Server::relayRecv<&Server::lssproto_JOBDAILY_recv>; /*任務日誌120*/
+		table[LSSPROTO_TEACHER_SYSTEM_RECV] = &Server::relayRecv<&Server::lssproto_TEACHER_SYSTEM_recv>; /*導師系統123*/
+		table[LSSPROTO_FIREWORK_RECV] = &Server::optionalRecv<LSSPROTO_FIREWORK_RECV, &Server::lssproto_Firework_recv>; /*煙火?126*/
+		table[LSSPROTO_CHAREFFECT_RECV] = &Server::optionalRecv<LSSPROTO_CHAREFFECT_RECV, &Server::lssproto_CHAREFFECT_recv>; /*146*/
+		table[LSSPROTO_IMAGE_RECV] = &Server::dropRecv<char*, int, int, int>; /*151*/
+		table[LSSPROTO_DENGON_RECV] = &Server::optionalRecv<LSSPROTO_DENGON_RECV, &Server::lssproto_DENGON_recv>; /*200*/
+		table[LSSPROTO_SAMENU_RECV] = &Server::dropRecv<int, char*>; /*201*/
+		table[220] = &Server::ignoreRecv; //SE SO驗證圖
+		return table;
+	}();
+
+	return recvHandlers;
 }
 #pragma endregion
 
@@ -2658,7 +2053,7 @@ void Server::announce(const QString& msg, int color)
 
 	if (msg.contains("[async battle]"))
 	{
-		if (!injector.getEnableHash(util::kScriptDebugModeEnable))
+		if (!injector.isDebugLogEnabled())
 			return;
 		SPD_LOG(protoBattleLogName, msg);
 		return;
@@ -2782,6 +2177,16 @@ void Server::setSwitcher(int flg)
 #pragma endregion
 
 #pragma region Connection
+//發送帶序號的ECHO 用於估計往返時間
+void Server::probeRtt()
+{
+	if (!getOnlineFlag())
+		return;
+
+	QByteArray probe = rtt_.makeProbe();
+	lssproto_Echo_send(probe.data());
+}
+
 //元神歸位
 void Server::EO()
 {
@@ -3941,22 +3346,23 @@ QString calculateDirection(int currentX, int currentY, int targetX, int targetY)
 	return "";
 }
 
-//移動(封包) [a-h]
-void Server::move(const QPoint& p, const QString& dir)
+//移動(封包) [a-h] 返回是否已發送
+bool Server::move(const QPoint& p, const QString& dir)
 {
 	if (!getOnlineFlag())
-		return;
+		return false;
 
 	if (getBattleFlag())
-		return;
+		return false;
 
 	if (p.x() < 0 || p.x() > 1500 || p.y() < 0 || p.y() > 1500)
-		return;
+		return false;
 
 	QWriteLocker locker(&pointMutex_);
 
 	std::string sdir = dir.toStdString();
 	lssproto_W2_send(p, const_cast<char*>(sdir.c_str()));
+	return true;
 }
 
 //移動(記憶體)
@@ -4797,8 +4203,10 @@ void Server::asyncBattleAction()
 
 	auto delay = [this, &injector, &checkAllFlags](const QString& name)
 	{
-		//战斗延时
+		//战斗延时 扣除回合数据在路上的单向延迟 让伺服器端看到的间隔与设定相同
 		int delay = injector.getValueHash(util::kBattleActionDelayValue);
+		if (delay > 0)
+			delay -= static_cast<int>(qMin<qint64>(rtt_.oneWayMs(), delay));
 		if (delay < 0)
 			delay = 0;
 		announce(QString("[async battle] 战斗 %1 开始延时 %2 毫秒").arg(name).arg(delay), 6);
@@ -7803,6 +7211,8 @@ void Server::lssproto_PR_recv(int request, int result)
 //地圖轉移
 void Server::lssproto_EV_recv(int seqno, int result)
 {
+	rtt_.acknowledge(RttTracker::kWarp);
+
 	Injector& injector = Injector::getInstance();
 	int floor = mem::read<int>(injector.getProcess(), injector.getProcessModule() + kOffestNowFloor);
 	SignalDispatcher& signalDispatcher = SignalDispatcher::getInstance();
@@ -7850,11 +7260,12 @@ void Server::lssproto_AB_recv(char* cdata)
 	if (!getOnlineFlag())
 		return;
 
+	const util::TokenIndex tokens(data, "|");
 	for (i = 0; i < MAX_ADR_BOOK; ++i)
 	{
 		//no = i * 6; //the second
 		no = i * 8;
-		useFlag = getIntegerToken(data, "|", no + 1);
+		useFlag = tokens.getInt(no + 1);
 		if (useFlag == -1)
 		{
 			useFlag = 0;
@@ -7885,18 +7296,17 @@ void Server::lssproto_AB_recv(char* cdata)
 		addressBook[i].useFlag = 1;
 #endif
 
-		flag = getStringToken(data, "|", no + 2, name);
+		flag = tokens.getEscaped(no + 2, name);
 
 		if (flag == 1)
 			break;
 
-		makeStringFromEscaped(name);
 		addressBook[i].name = name.simplified();
-		addressBook[i].level = getIntegerToken(data, "|", no + 3);
-		addressBook[i].dp = getIntegerToken(data, "|", no + 4);
-		addressBook[i].onlineFlag = (short)getIntegerToken(data, "|", no + 5);
-		addressBook[i].graNo = getIntegerToken(data, "|", no + 6);
-		addressBook[i].transmigration = getIntegerToken(data, "|", no + 7);
+		addressBook[i].level = tokens.getInt(no + 3);
+		addressBook[i].dp = tokens.getInt(no + 4);
+		addressBook[i].onlineFlag = (short)tokens.getInt(no + 5);
+		addressBook[i].graNo = tokens.getInt(no + 6);
+		addressBook[i].transmigration = tokens.getInt(no + 7);
 #ifdef _MAILSHOWPLANET				// (可開放) Syu ADD 顯示名片星球
 		for (j = 0; j < MAX_GMSV; ++j)
 		{
@@ -8127,6 +7537,7 @@ void Server::lssproto_I_recv(char* cdata)
 	//char *data = "9|烏力斯坦的肉||0|耐久力10前後回覆|24002|0|1|0|7|不會損壞|1|肉|20||10|烏力斯坦的肉||0|耐久力10前後回覆|24002|0|1|0|7|不會損壞|1|肉|20|";
 	SignalDispatcher& signalDispatcher = SignalDispatcher::getInstance();
 
+	const util::TokenIndex tokens(data, "|");
 	for (j = 0; ; ++j)
 	{
 #ifdef _ITEM_JIGSAW
@@ -8159,14 +7570,13 @@ void Server::lssproto_I_recv(char* cdata)
 #endif
 #endif//_PET_ITEM
 #endif//_ITEM_JIGSAW
-		i = getIntegerToken(data, "|", no + 1);//道具位
-		if (getStringToken(data, "|", no + 2, name) == 1)//道具名
+		i = tokens.getInt(no + 1);//道具位
+		if (tokens.getEscaped(no + 2, name) == 1)//道具名
 			break;
 
 		if (i < 0 || i >= MAX_ITEM)
 			break;
 
-		makeStringFromEscaped(name);
 		name = name.simplified();
 		if (name.isEmpty())
 		{
@@ -8178,20 +7588,18 @@ void Server::lssproto_I_recv(char* cdata)
 		}
 		pc.item[i].useFlag = 1;
 		pc.item[i].name = name;
-		getStringToken(data, "|", no + 3, name2);//第二個道具名
-		makeStringFromEscaped(name2);
+		tokens.getEscaped(no + 3, name2);//第二個道具名
 		name2 = name2.simplified();
 		pc.item[i].name2 = name2;
-		pc.item[i].color = getIntegerToken(data, "|", no + 4);//顏色
+		pc.item[i].color = tokens.getInt(no + 4);//顏色
 		if (pc.item[i].color < 0)
 			pc.item[i].color = 0;
-		getStringToken(data, "|", no + 5, memo);//道具介紹
-		makeStringFromEscaped(memo);
+		tokens.getEscaped(no + 5, memo);//道具介紹
 		memo = memo.simplified();
 		pc.item[i].memo = memo;
-		pc.item[i].graNo = getIntegerToken(data, "|", no + 6);//道具形像
-		pc.item[i].field = getIntegerToken(data, "|", no + 7);//
-		pc.item[i].target = getIntegerToken(data, "|", no + 8);
+		pc.item[i].graNo = tokens.getInt(no + 6);//道具形像
+		pc.item[i].field = tokens.getInt(no + 7);//
+		pc.item[i].target = tokens.getInt(no + 8);
 		if (pc.item[i].target >= 100)
 		{
 			pc.item[i].target %= 100;
@@ -8201,14 +7609,13 @@ void Server::lssproto_I_recv(char* cdata)
 		{
 			pc.item[i].deadTargetFlag = 0;
 		}
-		pc.item[i].level = getIntegerToken(data, "|", no + 9);//等級
-		pc.item[i].sendFlag = getIntegerToken(data, "|", no + 10);
+		pc.item[i].level = tokens.getInt(no + 9);//等級
+		pc.item[i].sendFlag = tokens.getInt(no + 10);
 
 		{
 			// 顯示物品耐久度
 			QString damage;
-			getStringToken(data, "|", no + 11, damage);
-			makeStringFromEscaped(damage);
+			tokens.getEscaped(no + 11, damage);
 			damage = damage.simplified();
 			if (damage.size() <= 16)
 			{
@@ -8218,8 +7625,7 @@ void Server::lssproto_I_recv(char* cdata)
 #ifdef _ITEM_PILENUMS
 		{
 			QString pile;
-			getStringToken(data, "|", no + 12, pile);
-			makeStringFromEscaped(pile);
+			tokens.getEscaped(no + 12, pile);
 			pile = pile.simplified();
 			pc.item[i].pile = pile.toInt();
 			if (pc.item[i].useFlag == 1 && pc.item[i].pile == 0)
@@ -8230,8 +7636,7 @@ void Server::lssproto_I_recv(char* cdata)
 #ifdef _ALCHEMIST //_ITEMSET7_TXT
 		{
 			QString alch;
-			getStringToken(data, "|", no + 13, alch);
-			makeStringFromEscaped(alch);
+			tokens.getEscaped(no + 13, alch);
 			alch = alch.simplified();
 			pc.item[i].alch = alch;
 		}
@@ -8239,8 +7644,7 @@ void Server::lssproto_I_recv(char* cdata)
 #ifdef _PET_ITEM
 		{
 			QString type;
-			getStringToken(data, "|", no + 14, type);
-			makeStringFromEscaped(type);
+			tokens.getEscaped(no + 14, type);
 			type = type.simplified();
 			pc.item[i].type = type.toInt();
 		}
@@ -8248,7 +7652,7 @@ void Server::lssproto_I_recv(char* cdata)
 		refreshItemInfo(i);
 #else
 #ifdef _MAGIC_ITEM_
-		pc.item[i].道具類型 = getIntegerToken(data, "|", no + 14);
+		pc.item[i].道具類型 = tokens.getInt(no + 14);
 #endif
 #endif
 		/*
@@ -8264,10 +7668,10 @@ void Server::lssproto_I_recv(char* cdata)
 		}
 #endif
 #ifdef _NPC_ITEMUP
-			pc.item[i].itemup = getIntegerToken(data, "|", no + 16);
+			pc.item[i].itemup = tokens.getInt(no + 16);
 #endif
 #ifdef _ITEM_COUNTDOWN
-			pc.item[i].counttime = getIntegerToken(data, "|", no + 17);
+			pc.item[i].counttime = tokens.getInt(no + 17);
 #endif
 			*/
 
@@ -8288,6 +7692,8 @@ void Server::lssproto_I_recv(char* cdata)
 //對話框
 void Server::lssproto_WN_recv(int windowtype, int buttontype, int seqno, int objindex, char* cdata)
 {
+	rtt_.acknowledge(RttTracker::kDialog);
+
 	QString data = util::toUnicode(cdata);
 	if (data.isEmpty() && buttontype == 0)
 		return;
@@ -8656,22 +8062,16 @@ void Server::lssproto_HL_recv(int flg)
 //戰鬥每回合資訊
 void Server::lssproto_B_recv(char* ccommand)
 {
-	QString command = util::toUnicode(ccommand);
-	if (command.isEmpty())
-		return;
-
-	QString first = command.left(2);
-	first.remove("B");
-
-	QString data = command.mid(3);
-	if (data.isEmpty())
+	char* payload = nullptr;
+	const battle::Kind kind = battle::classify(ccommand, &payload);
+	if (kind == battle::kNone)
 		return;
 
 	SignalDispatcher& signalDispatcher = SignalDispatcher::getInstance();
 	battledata_t bt = getBattleData();
 	PC pc = getPC();
 
-	if (first == "C")
+	if (kind == battle::kC)
 	{
 		QVector<QStringList> topList;
 		QVector<QStringList> bottomList;
@@ -8691,85 +8091,25 @@ void Server::lssproto_B_recv(char* ccommand)
 		11|貝恩達斯||187F0|4|4F|4F|1|0||0|0|0|
 		*/
 
-		QString temp;
-		//fl = getIntegerToken(data, "|", 1);
+		//單次掃描解出所有單位 名稱以外的欄位不經過轉碼
+		battle::round_t round;
+		battle::decodeC(payload, &round);
 
 		bt.allies.clear();
 		bt.enemies.clear();
-		bt.fieldAttr = 0;
+		bt.fieldAttr = round.fieldAttr;
 		bt.pet = {};
 		bt.player = {};
 		bt.objects.clear();
 		bt.objects.resize(MAX_ENEMY);
 		bt.charAlreadyAction = false;
 		bt.charAlreadyAction = false;
-		int i = 0;
 		int n = 0;
-		bt.fieldAttr = getIntegerToken(data, "|", 1);
 
-		bool ok = false;
-
-		for (;;)
+		for (int i = 0; i < round.count; ++i)
 		{
-			//16進制使用 a62toi
-			//string 使用 getStringToken(data, "|", n, var); 而後使用 makeStringFromEscaped(var) 處理轉譯
-			//int 使用 getIntegerToken(data, "|", n);
-			getStringToken(data, "|", i * 13 + 2, temp);
-			int pos = temp.toInt(&ok, 16);
-			if (!ok)
-				break;
-
-			if (pos < 0 || pos >= MAX_ENEMY)
-				break;
-
-			battleobject_t obj = {};
-
-			obj.pos = pos;
-
-			getStringToken(data, "|", i * 13 + 3, temp);
-			makeStringFromEscaped(temp);
-			temp = temp.simplified();
-			obj.name = temp;
-
-			getStringToken(data, "|", i * 13 + 4, temp);
-			makeStringFromEscaped(temp);
-			temp = temp.simplified();
-			obj.freename = temp;
-
-			getStringToken(data, "|", i * 13 + 5, temp);
-			obj.faceid = temp.toInt(nullptr, 16);
-
-			getStringToken(data, "|", i * 13 + 6, temp);
-			obj.level = temp.toInt(nullptr, 16);
-
-			getStringToken(data, "|", i * 13 + 7, temp);
-			obj.hp = temp.toInt(nullptr, 16);
-
-			getStringToken(data, "|", i * 13 + 8, temp);
-			obj.maxHp = temp.toInt(nullptr, 16);
-
-			obj.hpPercent = util::percent(obj.hp, obj.maxHp);
-
-			getStringToken(data, "|", i * 13 + 9, temp);
-			obj.status = temp.toInt(nullptr, 16);
-
-			obj.rideFlag = getIntegerToken(data, "|", i * 13 + 10);
-
-			getStringToken(data, "|", i * 13 + 11, temp);
-			makeStringFromEscaped(temp);
-			temp = temp.simplified();
-			obj.rideName = temp;
-
-			getStringToken(data, "|", i * 13 + 12, temp);
-			obj.rideLevel = temp.toInt(nullptr, 16);
-
-			getStringToken(data, "|", i * 13 + 13, temp);
-			obj.rideHp = temp.toInt(nullptr, 16);
-
-			getStringToken(data, "|", i * 13 + 14, temp);
-			obj.rideMaxHp = temp.toInt(nullptr, 16);
-
-			obj.rideHpPercent = util::percent(obj.rideHp, obj.rideMaxHp);
+			const int pos = round.order[i];
+			const battleobject_t& obj = round.units[pos];
 
 			if ((pos >= bt.enemymin) && (pos <= bt.enemymax) && obj.rideFlag == 0 && obj.faceid > 0 && !obj.name.isEmpty())
 			{
@@ -8861,8 +8201,7 @@ void Server::lssproto_B_recv(char* ccommand)
 					bt.enemies.append(obj);
 			}
 
-			if (pos < bt.objects.size())
-				bt.objects.insert(pos, obj);
+			bt.objects[pos] = obj;
 
 			QStringList tempList = {};
 			QString temp;
@@ -8921,7 +8260,6 @@ void Server::lssproto_B_recv(char* ccommand)
 				}
 			}
 
-			++i;
 		}
 
 		//更新戰場動態UI
@@ -9040,15 +8378,15 @@ void Server::lssproto_B_recv(char* ccommand)
 			setBattleEnd();
 		}
 	}
-	else if (first == "P")
+	else if (kind == battle::kP)
 	{
-		QStringList list = data.split(util::rexOR);
-		if (list.size() < 3)
+		int myNo = 0, bpFlag = 0, mp = 0;
+		if (!battle::decodeP(payload, &myNo, &bpFlag, &mp))
 			return;
 
-		BattleMyNo = list.at(0).toInt(nullptr, 16);
-		BattleBpFlag = list.at(1).toInt(nullptr, 16);
-		BattleMyMp = list.at(2).toInt(nullptr, 16);
+		BattleMyNo = myNo;
+		BattleBpFlag = bpFlag;
+		BattleMyMp = mp;
 
 		announce("[async battle] -----------------------------------------------");
 		announce("[async battle] -----------------------------------------------");
@@ -9065,14 +8403,14 @@ void Server::lssproto_B_recv(char* ccommand)
 		updateCurrentSideRange(bt);
 		isEnemyAllReady.store(false, std::memory_order_release);
 	}
-	else if (first == "A")
+	else if (kind == battle::kA)
 	{
-		QStringList list = data.split(util::rexOR);
-		if (list.size() < 2)
+		int animFlag = 0, turnNo = 0;
+		if (!battle::decodeA(payload, &animFlag, &turnNo))
 			return;
 
-		BattleAnimFlag = list.at(0).toInt(nullptr, 16);
-		BattleCliTurnNo = list.at(1).toInt(nullptr, 16);
+		BattleAnimFlag = animFlag;
+		BattleCliTurnNo = turnNo;
 
 		announce(QString("[async battle] 收到新的战斗 A 数据  回合:%1").arg(BattleCliTurnNo));
 
@@ -9123,24 +8461,24 @@ void Server::lssproto_B_recv(char* ccommand)
 
 		asyncBattleWork(true);//sync
 	}
-	else if (first == "U")
+	else if (kind == battle::kU)
 	{
 		BattleEscFlag = TRUE;
 	}
-	else if (first == "D")
+	else if (kind == battle::kD)
 	{
 
 	}
-	else if (first == "H")
+	else if (kind == battle::kH)
 	{
 	}
-	else if (first == "bn")
+	else if (kind == battle::kN)
 	{
 		//bn|5|BD|r0|0|2|A0|pA0|mA|BE|e0|f1|
 	}
 	else
 	{
-		qDebug() << "lssproto_B_recv: unknown command" << command;
+		qDebug() << "lssproto_B_recv: unknown command" << util::toUnicode(ccommand);
 	}
 
 	setPC(pc);
@@ -9443,7 +8781,10 @@ void Server::lssproto_WO_recv(int effect)
 //服務端發來的ECHO 一般是30秒
 void Server::lssproto_Echo_recv(char* test)
 {
-	if (isEOTTLSend.load(std::memory_order_acquire))
+	//帶序號的探測只用於估計往返時間 元神歸位的計時只看它自己送出的"hoge"
+	const bool isProbe = rtt_.acknowledgeProbe(test);
+
+	if (!isProbe && isEOTTLSend.load(std::memory_order_acquire))
 	{
 		int time = eottlTimer.elapsed();
 		lastEOTime.store(time, std::memory_order_release);
@@ -9736,7 +9077,7 @@ void Server::lssproto_Firework_recv(int nCharaindex, int nType, int nActionNum)
 #endif
 
 #ifdef _ANNOUNCEMENT_
-void Server::lssproto_DENGON_recv(char* cdata, int colors, int nums)
+void Server::lssproto_DENGON_recv(const util::LazyText& data, int colors, int nums)
 {
 }
 #endif
@@ -9763,7 +9104,8 @@ void Server::lssproto_TK_recv(int index, char* cmessage, int color)
 	QString message = util::toUnicode(cmessage);
 	if (message.isEmpty())
 		return;
-	message = makeStringFromEscaped(message);
+
+	//轉義要在切割欄位之後逐個還原 否則\z還原成的'|'會被當作分隔符
 
 	static const QRegularExpression rexGetGold(u8R"(得到(\d+)石)");
 	static const QRegularExpression rexPickGold(u8R"([獲|获] (\d+) Stone)");
@@ -9885,7 +9227,10 @@ void Server::lssproto_TK_recv(int index, char* cmessage, int color)
 			}
 		}
 		else
+		{
 			getStringToken(message, "|", 2, msg);
+			makeStringFromEscaped(msg);
+		}
 #ifdef _TALK_WINDOW
 		if (!g_bTalkWindow)
 #endif
@@ -10101,6 +9446,73 @@ void Server::lssproto_M_recv(int fl, int x1, int y1, int x2, int y2, char* cdata
 }
 
 
+//坐標與方向以外的屬性是否相同
+static bool isSameMapUnitAttributes(const mapunit_t& a, const mapunit_t& b)
+{
+	return a.type == b.type
+		&& a.id == b.id
+		&& a.graNo == b.graNo
+		&& a.level == b.level
+		&& a.nameColor == b.nameColor
+		&& a.name == b.name
+		&& a.freeName == b.freeName
+		&& a.walkable == b.walkable
+		&& a.height == b.height
+		&& a.charNameColor == b.charNameColor
+		&& a.fmname == b.fmname
+		&& a.petname == b.petname
+		&& a.petlevel == b.petlevel
+		&& a.classNo == b.classNo
+		&& a.item_name == b.item_name
+		&& a.gold == b.gold
+		&& a.profession_class == b.profession_class
+		&& a.profession_level == b.profession_level
+		&& a.profession_skill_point == b.profession_skill_point
+		&& a.objType == b.objType
+		&& a.isvisible == b.isvisible
+		&& a.status == b.status;
+}
+
+//與現有單位比較 只寫入有變動的單位並記錄變化類型
+void Server::stageMapUnit(const mapunit_t& unit, mapunitdiff_t* diff)
+{
+	mapunit_t old;
+	if (!mapUnitHash.contains(unit.id))
+	{
+		diff->added.append(unit.id);
+	}
+	else
+	{
+		old = mapUnitHash.value(unit.id);
+		if (!isSameMapUnitAttributes(old, unit))
+			diff->changed.append(unit.id);
+		else if (old.x != unit.x || old.y != unit.y || old.dir != unit.dir)
+			diff->moved.append(unit.id);
+		else
+			return;
+	}
+
+	mapUnitHash.insert(unit.id, unit);
+}
+
+//每個封包每種變化類型最多通知一次 只帶有實際變動的單位ID
+void Server::publishMapUnitDiff(const mapunitdiff_t& diff)
+{
+	if (diff.isEmpty())
+		return;
+
+	SignalDispatcher& signalDispatcher = SignalDispatcher::getInstance();
+	if (!diff.added.isEmpty())
+		emit signalDispatcher.mapUnitsAdded(diff.added);
+	if (!diff.moved.isEmpty())
+		emit signalDispatcher.mapUnitsMoved(diff.moved);
+	if (!diff.changed.isEmpty())
+		emit signalDispatcher.mapUnitsChanged(diff.changed);
+	if (!diff.removed.isEmpty())
+		emit signalDispatcher.mapUnitsRemoved(diff.removed);
+}
+
+
 //周圍人、NPC..等等數據
 void Server::lssproto_C_recv(char* cdata)
 {
@@ -10110,12 +9522,13 @@ void Server::lssproto_C_recv(char* cdata)
 	3 OBJTYPE_GOLD
 	4 NPC&other player
 	===========================*/
-	const QString data = util::toUnicode(cdata);
+	util::toUnicode(cdata, &mapUnitText_);
+	const QString& data = mapUnitText_;
 	if (data.isEmpty())
 		return;
 
 	int i, j, id, x, y, dir, graNo, level, nameColor, walkable, height, classNo, money, charType, charNameColor;
-	QString bigtoken, smalltoken, name, freeName, info, fmname, petname;
+	QString bigtoken, name, freeName, info, fmname, petname;
 #ifdef _CHARTITLE_STR_
 	QString titlestr;
 	int titleindex = 0;
@@ -10142,62 +9555,50 @@ void Server::lssproto_C_recv(char* cdata)
 	//SignalDispatcher& signalDispatcher = SignalDispatcher::getInstance();
 
 	PC pc = getPC();
+	mapunitdiff_t diff;
+	const util::TokenIndex records(data, ",");
 	for (i = 0; ; ++i)
 	{
-		getStringToken(data, ",", i + 1, bigtoken);
+		records.getString(i + 1, bigtoken);
 		if (bigtoken.isEmpty())
 			break;
+		const util::TokenIndex fields(bigtoken, "|");
 #ifdef _OBJSEND_C
-		getStringToken(bigtoken, "|", 1, smalltoken);
-		if (smalltoken.isEmpty())
+		const QStringRef objType = fields.ref(1);
+		if (objType.isEmpty())
 			break;
-		switch (smalltoken.toInt())
+		switch (objType.toInt())
 		{
 		case 1://OBJTYPE_CHARA
 		{
-			charType = getIntegerToken(bigtoken, "|", 2);
-			getStringToken(bigtoken, "|", 3, smalltoken);
-			id = a62toi(smalltoken);
+			charType = fields.getInt(2);
+			id = fields.getInt62(3);
 
 
-			getStringToken(bigtoken, "|", 4, smalltoken);
-			x = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 5, smalltoken);
-			y = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 6, smalltoken);
-			dir = (smalltoken.toInt() + 3) % 8;
-			getStringToken(bigtoken, "|", 7, smalltoken);
-			graNo = smalltoken.toInt();
+			x = fields.ref(4).toInt();
+			y = fields.ref(5).toInt();
+			dir = (fields.ref(6).toInt() + 3) % 8;
+			graNo = fields.ref(7).toInt();
 			if (graNo == 9999) continue;
-			getStringToken(bigtoken, "|", 8, smalltoken);
-			level = smalltoken.toInt();
-			nameColor = getIntegerToken(bigtoken, "|", 9);
-			getStringToken(bigtoken, "|", 10, name);
-			makeStringFromEscaped(name);
+			level = fields.ref(8).toInt();
+			nameColor = fields.getInt(9);
+			fields.getEscaped(10, name);
 			name = name.simplified();
-			getStringToken(bigtoken, "|", 11, freeName);
-			makeStringFromEscaped(freeName);
+			fields.getEscaped(11, freeName);
 			freeName = freeName.simplified();
-			getStringToken(bigtoken, "|", 12, smalltoken);
-			walkable = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 13, smalltoken);
-			height = smalltoken.toInt();
-			charNameColor = getIntegerToken(bigtoken, "|", 14);
-			getStringToken(bigtoken, "|", 15, fmname);
-			makeStringFromEscaped(fmname);
+			walkable = fields.ref(12).toInt();
+			height = fields.ref(13).toInt();
+			charNameColor = fields.getInt(14);
+			fields.getEscaped(15, fmname);
 			fmname = fmname.simplified();
-			getStringToken(bigtoken, "|", 16, petname);
-			makeStringFromEscaped(petname);
+			fields.getEscaped(16, petname);
 			petname = petname.simplified();
-			getStringToken(bigtoken, "|", 17, smalltoken);
-			petlevel = smalltoken.toInt();
+			petlevel = fields.ref(17).toInt();
 #ifdef _NPC_EVENT_NOTICE
-			getStringToken(bigtoken, "|", 18, smalltoken);
-			noticeNo = smalltoken.toInt();
+			noticeNo = fields.ref(18).toInt();
 #endif
 #ifdef _CHARTITLE_STR_
-			getStringToken(bigtoken, "|", 23, sizeof(titlestr) - 1, titlestr);
-			titleindex = atoi(titlestr);
+			titleindex = fields.ref(23).toInt();
 			memset(titlestr, 0, 128);
 			if (titleindex > 0)
 			{
@@ -10206,25 +9607,18 @@ void Server::lssproto_C_recv(char* cdata)
 			}
 #endif
 #ifdef _CHAR_PROFESSION			// WON ADD 人物職業
-			getStringToken(bigtoken, "|", 18, smalltoken);
-			profession_class = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 19, smalltoken);
-			profession_level = smalltoken.toInt();
-			//			getStringToken(bigtoken, "|", 20, smalltoken);
-			//			profession_exp = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 20, smalltoken);
-			profession_skill_point = smalltoken.toInt();
+			profession_class = fields.ref(18).toInt();
+			profession_level = fields.ref(19).toInt();
+			//			profession_exp = fields.ref(20).toInt();
+			profession_skill_point = fields.ref(20).toInt();
 #ifdef _ALLDOMAN // Syu ADD 排行榜NPC
-			getStringToken(bigtoken, "|", 21, smalltoken);
-			herofloor = smalltoken.toInt();
+			herofloor = fields.ref(21).toInt();
 #endif
 #ifdef _NPC_PICTURE
-			getStringToken(bigtoken, "|", 22, smalltoken);
-			picture = smalltoken.toInt();
+			picture = fields.ref(22).toInt();
 #endif
 			//    #ifdef _GM_IDENTIFY		// Rog ADD GM識別
-			//			getStringToken(bigtoken , "|", 23 , sizeof( gm_name ) - 1, gm_name );
-			//			makeStringFromEscaped( gm_name );
+			//			fields.getEscaped(23, gm_name);
 			//  #endif
 #endif
 			if (charNameColor < 0)
@@ -10358,23 +9752,18 @@ void Server::lssproto_C_recv(char* cdata)
 			unit.profession_skill_point = profession_skill_point;
 			unit.isvisible = graNo != 0 && graNo != 9999;
 			unit.objType = unit.type == CHAR_TYPEPLAYER ? util::OBJ_HUMAN : util::OBJ_NPC;
-			mapUnitHash.insert(id, unit);
+			stageMapUnit(unit, &diff);
 
 			break;
 		}
 		case 2://OBJTYPE_ITEM
 		{
-			getStringToken(bigtoken, "|", 2, smalltoken);
-			id = a62toi(smalltoken);
-			getStringToken(bigtoken, "|", 3, smalltoken);
-			x = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 4, smalltoken);
-			y = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 5, smalltoken);
-			graNo = smalltoken.toInt();
-			classNo = getIntegerToken(bigtoken, "|", 6);
-			getStringToken(bigtoken, "|", 7, info);
-			makeStringFromEscaped(info);
+			id = fields.getInt62(2);
+			x = fields.ref(3).toInt();
+			y = fields.ref(4).toInt();
+			graNo = fields.ref(5).toInt();
+			classNo = fields.getInt(6);
+			fields.getEscaped(7, info);
 			info = info.simplified();
 
 			mapunit_t unit = mapUnitHash.value(id);
@@ -10387,20 +9776,16 @@ void Server::lssproto_C_recv(char* cdata)
 			unit.item_name = info;
 			unit.isvisible = graNo != 0 && graNo != 9999;
 			unit.objType = util::OBJ_ITEM;
-			mapUnitHash.insert(id, unit);
+			stageMapUnit(unit, &diff);
 
 			break;
 		}
 		case 3://OBJTYPE_GOLD
 		{
-			getStringToken(bigtoken, "|", 2, smalltoken);
-			id = a62toi(smalltoken);
-			getStringToken(bigtoken, "|", 3, smalltoken);
-			x = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 4, smalltoken);
-			y = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 5, smalltoken);
-			money = smalltoken.toInt();
+			id = fields.getInt62(2);
+			x = fields.ref(3).toInt();
+			y = fields.ref(4).toInt();
+			money = fields.ref(5).toInt();
 			mapunit_t unit = mapUnitHash.value(id);
 			unit.id = id;
 			unit.x = x;
@@ -10409,25 +9794,19 @@ void Server::lssproto_C_recv(char* cdata)
 			unit.gold = money;
 			unit.isvisible = true;
 			unit.objType = util::OBJ_GOLD;
-			mapUnitHash.insert(id, unit);
+			stageMapUnit(unit, &diff);
 
 			break;
 		}
 		case 4://NPC&other player
 		{
-			getStringToken(bigtoken, "|", 2, smalltoken);
-			id = a62toi(smalltoken);
-			getStringToken(bigtoken, "|", 3, name);
-			makeStringFromEscaped(name);
+			id = fields.getInt62(2);
+			fields.getEscaped(3, name);
 			name = name.simplified();
-			getStringToken(bigtoken, "|", 4, smalltoken);
-			dir = (smalltoken.toInt() + 3) % 8;
-			getStringToken(bigtoken, "|", 5, smalltoken);
-			graNo = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 6, smalltoken);
-			x = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 7, smalltoken);
-			y = smalltoken.toInt();
+			dir = (fields.ref(4).toInt() + 3) % 8;
+			graNo = fields.ref(5).toInt();
+			x = fields.ref(6).toInt();
+			y = fields.ref(7).toInt();
 
 			mapunit_t unit = mapUnitHash.value(id);
 			unit.id = id;
@@ -10439,7 +9818,7 @@ void Server::lssproto_C_recv(char* cdata)
 			unit.graNo = graNo;
 			unit.isvisible = graNo != 0 && graNo != 9999;
 			unit.objType = util::OBJ_HUMAN;
-			mapUnitHash.insert(id, unit);
+			stageMapUnit(unit, &diff);
 		}
 
 #ifdef _CHAR_PROFESSION			// WON ADD 人物職業
@@ -10473,39 +9852,25 @@ void Server::lssproto_C_recv(char* cdata)
 		}
 #pragma region DISABLE
 #else
-		getStringToken(bigtoken, "|", 11, smalltoken);
-		if (!smalltoken.isEmpty())
+		if (!fields.ref(11).isEmpty())
 		{
 			// NPC
-			charType = getIntegerToken(bigtoken, "|", 1);
-			getStringToken(bigtoken, "|", 2, smalltoken);
-			id = a62toi(smalltoken);
-			getStringToken(bigtoken, "|", 3, smalltoken);
-			x = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 4, smalltoken);
-			y = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 5, smalltoken);
-			dir = (smalltoken.toInt() + 3) % 8;
-			getStringToken(bigtoken, "|", 6, smalltoken);
-			graNo = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 7, smalltoken);
-			level = smalltoken.toInt();
-			nameColor = getIntegerToken(bigtoken, "|", 8);
-			getStringToken(bigtoken, "|", 9, name);
-			makeStringFromEscaped(name);
-			getStringToken(bigtoken, "|", 10, freeName);
-			makeStringFromEscaped(freeName);
-			getStringToken(bigtoken, "|", 11, smalltoken);
-			walkable = smalltoken.toInt();
-			getStringToken(bigtoken, "|", 12, smalltoken);
-			height = smalltoken.toInt();
-			charNameColor = getIntegerToken(bigtoken, "|", 13);
-			getStringToken(bigtoken, "|", 14, fmname);
-			makeStringFromEscaped(fmname);
-			getStringToken(bigtoken, "|", 15, petname);
-			makeStringFromEscaped(petname);
-			getStringToken(bigtoken, "|", 16, smalltoken);
-			petlevel = smalltoken.toInt();
+			charType = fields.getInt(1);
+			id = fields.getInt62(2);
+			x = fields.ref(3).toInt();
+			y = fields.ref(4).toInt();
+			dir = (fields.ref(5).toInt() + 3) % 8;
+			graNo = fields.ref(6).toInt();
+			level = fields.ref(7).toInt();
+			nameColor = fields.getInt(8);
+			fields.getEscaped(9, name);
+			fields.getEscaped(10, freeName);
+			walkable = fields.ref(11).toInt();
+			height = fields.ref(12).toInt();
+			charNameColor = fields.getInt(13);
+			fields.getEscaped(14, fmname);
+			fields.getEscaped(15, petname);
+			petlevel = fields.ref(16).toInt();
 			if (charNameColor < 0)
 				charNameColor = 0;
 
@@ -10527,7 +9892,7 @@ void Server::lssproto_C_recv(char* cdata)
 			unit.petname = petname;
 			unit.petlevel = petlevel;
 			unit.isvisible = graNo > 0;
-			mapUnitHash.insert(id, unit);
+			stageMapUnit(unit, &diff);
 
 			if (pc.id == id)
 			{
@@ -10594,20 +9959,14 @@ void Server::lssproto_C_recv(char* cdata)
 		}
 		else
 		{
-			getStringToken(bigtoken, "|", 6, smalltoken);
-			if (!smalltoken.isEmpty())
-			{
-				getStringToken(bigtoken, "|", 1, smalltoken);
-				id = a62toi(smalltoken);
-				getStringToken(bigtoken, "|", 2, smalltoken);
-				x = smalltoken.toInt();
-				getStringToken(bigtoken, "|", 3, smalltoken);
-				y = smalltoken.toInt();
-				getStringToken(bigtoken, "|", 4, smalltoken);
-				graNo = smalltoken.toInt();
-				classNo = getIntegerToken(bigtoken, "|", 5);
-				getStringToken(bigtoken, "|", 6, info);
-				makeStringFromEscaped(info);
+			if (!fields.ref(6).isEmpty())
+			{
+				id = fields.getInt62(1);
+				x = fields.ref(2).toInt();
+				y = fields.ref(3).toInt();
+				graNo = fields.ref(4).toInt();
+				classNo = fields.getInt(5);
+				fields.getEscaped(6, info);
 
 				mapunit_t unit = mapUnitHash.value(id);
 				unit.id = id;
@@ -10617,23 +9976,18 @@ void Server::lssproto_C_recv(char* cdata)
 				unit.graNo = graNo;
 				unit.classNo = classNo;
 				unit.info = info;
-				mapUnitHash.insert(id, unit);
+				stageMapUnit(unit, &diff);
 
 				//setItemCharObj(id, graNo, x, y, 0, classNo, info);
 			}
 			else
 			{
-				getStringToken(bigtoken, "|", 4, smalltoken);
-				if (!smalltoken.isEmpty())
+				if (!fields.ref(4).isEmpty())
 				{
-					getStringToken(bigtoken, "|", 1, smalltoken);
-					id = a62toi(smalltoken);
-					getStringToken(bigtoken, "|", 2, smalltoken);
-					x = smalltoken.toInt();
-					getStringToken(bigtoken, "|", 3, smalltoken);
-					y = smalltoken.toInt();
-					getStringToken(bigtoken, "|", 4, smalltoken);
-					money = smalltoken.toInt();
+					id = fields.getInt62(1);
+					x = fields.ref(2).toInt();
+					y = fields.ref(3).toInt();
+					money = fields.ref(4).toInt();
 
 					mapunit_t unit = mapUnitHash.value(id);
 					unit.id = id;
@@ -10641,7 +9995,7 @@ void Server::lssproto_C_recv(char* cdata)
 					unit.y = y;
 					unit.p = QPoint(x, y);
 					unit.gold = money;
-					mapUnitHash.insert(id, unit);
+					stageMapUnit(unit, &diff);
 
 
 					//sprintf_s(info, "%d Stone", money);
@@ -10667,6 +10021,7 @@ void Server::lssproto_C_recv(char* cdata)
 #pragma endregion
 	}
 
+	publishMapUnitDiff(diff);
 	setPC(pc);
 }
 
@@ -10695,25 +10050,30 @@ void Server::lssproto_CA_recv(char* cdata)
 	//ACTION* ptAct;
 
 	PC pc = getPC();
+	mapunitdiff_t diff;
+	const util::TokenIndex records(data, ",");
 	for (i = 0; ; ++i)
 	{
-		getStringToken(data, ",", i + 1, bigtoken);
+		records.getString(i + 1, bigtoken);
 		if (bigtoken.isEmpty())
 			break;
 
-		getStringToken(bigtoken, "|", 1, smalltoken);
-		charindex = a62toi(smalltoken);
-		getStringToken(bigtoken, "|", 2, smalltoken);
-		x = smalltoken.toInt();
-		getStringToken(bigtoken, "|", 3, smalltoken);
-		y = smalltoken.toInt();
-		getStringToken(bigtoken, "|", 4, smalltoken);
-		act = smalltoken.toInt();
-		getStringToken(bigtoken, "|", 5, smalltoken);
-		dir = (smalltoken.toInt() + 3) % 8;
-		getStringToken(bigtoken, "|", 6, smalltoken);
+		const util::TokenIndex fields(bigtoken, "|");
+		charindex = fields.getInt62(1);
+		x = fields.ref(2).toInt();
+		y = fields.ref(3).toInt();
+		act = fields.ref(4).toInt();
+		dir = (fields.ref(5).toInt() + 3) % 8;
+#ifdef _STREET_VENDOR
+		fields.getString(6, smalltoken);
+#endif
 
+		const bool isNew = !mapUnitHash.contains(charindex);
 		mapunit_t unit = mapUnitHash.value(charindex);
+		if (isNew)
+			diff.added.append(charindex);
+		else if (unit.x != x || unit.y != y || unit.dir != dir || unit.status != static_cast<CHR_STATUS>(act))
+			diff.moved.append(charindex);
 		unit.id = charindex;
 		unit.x = x;
 		unit.y = y;
@@ -10729,8 +10089,8 @@ void Server::lssproto_CA_recv(char* cdata)
 #endif
 		{
 			//effectno = smalltoken.toInt();
-			//effectparam1 = getIntegerToken(bigtoken, "|", 7);
-			//effectparam2 = getIntegerToken(bigtoken, "|", 8);
+			//effectparam1 = fields.getInt(7);
+			//effectparam2 = fields.getInt(8);
 		}
 
 
@@ -10807,6 +10167,8 @@ void Server::lssproto_CA_recv(char* cdata)
 		//changeCharAct(ptAct, x, y, dir, act, effectno, effectparam1, effectparam2);
 	//}
 	}
+
+	publishMapUnitDiff(diff);
 }
 
 //刪除指定一個或多個周圍人、NPC單位
@@ -10818,15 +10180,23 @@ void Server::lssproto_CD_recv(char* cdata)
 
 	int i;
 	int id;
+	mapunitdiff_t diff;
 
+	const util::TokenIndex tokens(data, ",");
 	for (i = 1; ; ++i)
 	{
-		id = getInteger62Token(data, ",", i);
+		id = tokens.getInt62(i);
 		if (id == -1)
 			break;
 
+		if (!mapUnitHash.contains(id))
+			continue;
+
 		mapUnitHash.remove(id);
+		diff.removed.append(id);
 	}
+
+	publishMapUnitDiff(diff);
 }
 
 
@@ -10867,6 +10237,7 @@ void Server::lssproto_S_recv(char* cdata)
 	if (first == "C")//C warp 用
 	{
 		mapUnitHash.clear();
+		emit signalDispatcher.mapUnitsCleared();
 		int fl, maxx, maxy, gx, gy;
 
 		floorChangeFlag = true;
@@ -10884,11 +10255,12 @@ void Server::lssproto_S_recv(char* cdata)
 			warpEffectStart = true;
 		}
 
-		fl = getIntegerToken(data, "|", 1);
-		maxx = getIntegerToken(data, "|", 2);
-		maxy = getIntegerToken(data, "|", 3);
-		gx = getIntegerToken(data, "|", 4);
-		gy = getIntegerToken(data, "|", 5);
+		const util::TokenIndex tokens(data, "|");
+		fl = tokens.getInt(1);
+		maxx = tokens.getInt(2);
+		maxy = tokens.getInt(3);
+		gx = tokens.getInt(4);
+		gy = tokens.getInt(5);
 		setMap(fl, QPoint(gx, gy));
 		//createMap(fl, maxx, maxy);
 		nowFloorGxSize = maxx;
@@ -10908,8 +10280,9 @@ void Server::lssproto_S_recv(char* cdata)
 #pragma region TimeModify
 	else if (first == "D")// D 修正時間
 	{
-		pc.id = getIntegerToken(data, "|", 1);
-		serverTime = getIntegerToken(data, "|", 2);
+		const util::TokenIndex tokens(data, "|");
+		pc.id = tokens.getInt(1);
+		serverTime = tokens.getInt(2);
 		FirstTime = TimeGetTime();
 		realTimeToSATime(&SaTime);
 		SaTimeZoneNo = getLSTime(&SaTime);
@@ -10918,7 +10291,8 @@ void Server::lssproto_S_recv(char* cdata)
 #pragma region RideInfo
 	else if (first == "X")// X 騎寵
 	{
-		pc.lowsride = getIntegerToken(data, "|", 2);
+		const util::TokenIndex tokens(data, "|");
+		pc.lowsride = tokens.getInt(2);
 	}
 #pragma endregion
 #pragma region PlayerInfo
@@ -10928,62 +10302,61 @@ void Server::lssproto_S_recv(char* cdata)
 		int i, kubun;
 		unsigned int mask;
 
-		kubun = getInteger62Token(data, "|", 1);
+		const util::TokenIndex tokens(data, "|");
+		kubun = tokens.getInt62(1);
 
 		if (kubun == 1)
 		{
-			pc.hp = getIntegerToken(data, "|", 2);		// 0x00000002
-			pc.maxHp = getIntegerToken(data, "|", 3);		// 0x00000004
-			pc.mp = getIntegerToken(data, "|", 4);		// 0x00000008
-			pc.maxMp = getIntegerToken(data, "|", 5);		// 0x00000010
+			pc.hp = tokens.getInt(2);		// 0x00000002
+			pc.maxHp = tokens.getInt(3);		// 0x00000004
+			pc.mp = tokens.getInt(4);		// 0x00000008
+			pc.maxMp = tokens.getInt(5);		// 0x00000010
 
 			//custom
 			pc.hpPercent = util::percent(pc.hp, pc.maxHp);
 			pc.mpPercent = util::percent(pc.mp, pc.maxMp);
 			//
 
-			pc.vital = getIntegerToken(data, "|", 6);		// 0x00000020
-			pc.str = getIntegerToken(data, "|", 7);		// 0x00000040
-			pc.tgh = getIntegerToken(data, "|", 8);		// 0x00000080
-			pc.dex = getIntegerToken(data, "|", 9);		// 0x00000100
-			pc.exp = getIntegerToken(data, "|", 10);		// 0x00000200
-			pc.maxExp = getIntegerToken(data, "|", 11);		// 0x00000400
-			pc.level = getIntegerToken(data, "|", 12);		// 0x00000800
-			pc.atk = getIntegerToken(data, "|", 13);		// 0x00001000
-			pc.def = getIntegerToken(data, "|", 14);		// 0x00002000
-			pc.quick = getIntegerToken(data, "|", 15);		// 0x00004000
-			pc.charm = getIntegerToken(data, "|", 16);		// 0x00008000
-			pc.luck = getIntegerToken(data, "|", 17);		// 0x00010000
-			pc.earth = getIntegerToken(data, "|", 18);		// 0x00020000
-			pc.water = getIntegerToken(data, "|", 19);		// 0x00040000
-			pc.fire = getIntegerToken(data, "|", 20);		// 0x00080000
-			pc.wind = getIntegerToken(data, "|", 21);		// 0x00100000
-			pc.gold = getIntegerToken(data, "|", 22);		// 0x00200000
-			pc.titleNo = getIntegerToken(data, "|", 23);		// 0x00400000
-			pc.dp = getIntegerToken(data, "|", 24);		// 0x00800000
-			pc.transmigration = getIntegerToken(data, "|", 25);// 0x01000000
-			pc.ridePetNo = getIntegerToken(data, "|", 26);	// 0x02000000
-			pc.learnride = getIntegerToken(data, "|", 27);	// 0x04000000
-			pc.baseGraNo = getIntegerToken(data, "|", 28);	// 0x08000000
+			pc.vital = tokens.getInt(6);		// 0x00000020
+			pc.str = tokens.getInt(7);		// 0x00000040
+			pc.tgh = tokens.getInt(8);		// 0x00000080
+			pc.dex = tokens.getInt(9);		// 0x00000100
+			pc.exp = tokens.getInt(10);		// 0x00000200
+			pc.maxExp = tokens.getInt(11);		// 0x00000400
+			pc.level = tokens.getInt(12);		// 0x00000800
+			pc.atk = tokens.getInt(13);		// 0x00001000
+			pc.def = tokens.getInt(14);		// 0x00002000
+			pc.quick = tokens.getInt(15);		// 0x00004000
+			pc.charm = tokens.getInt(16);		// 0x00008000
+			pc.luck = tokens.getInt(17);		// 0x00010000
+			pc.earth = tokens.getInt(18);		// 0x00020000
+			pc.water = tokens.getInt(19);		// 0x00040000
+			pc.fire = tokens.getInt(20);		// 0x00080000
+			pc.wind = tokens.getInt(21);		// 0x00100000
+			pc.gold = tokens.getInt(22);		// 0x00200000
+			pc.titleNo = tokens.getInt(23);		// 0x00400000
+			pc.dp = tokens.getInt(24);		// 0x00800000
+			pc.transmigration = tokens.getInt(25);// 0x01000000
+			pc.ridePetNo = tokens.getInt(26);	// 0x02000000
+			pc.learnride = tokens.getInt(27);	// 0x04000000
+			pc.baseGraNo = tokens.getInt(28);	// 0x08000000
 #ifdef _NEW_RIDEPETS
-			pc.lowsride = getIntegerToken(data, "|", 29);		// 0x08000000
+			pc.lowsride = tokens.getInt(29);		// 0x08000000
 #endif
 #ifdef _SFUMATO
 			pc.sfumato = 0xff0000;
 #endif
-			getStringToken(data, "|", 30, name);
-			makeStringFromEscaped(name);
+			tokens.getEscaped(30, name);
 			name = name.simplified();
 			pc.name = name;
-			getStringToken(data, "|", 31, freeName);
-			makeStringFromEscaped(freeName);
+			tokens.getEscaped(31, freeName);
 			freeName = freeName.simplified();
 			pc.freeName = freeName;
 #ifdef _NEW_ITEM_
-			pc.道具欄狀態 = getIntegerToken(data, "|", 32);
+			pc.道具欄狀態 = tokens.getInt(32);
 #endif
 #ifdef _SA_VERSION_25
-			int pointindex = getIntegerToken(data, "|", 33);
+			int pointindex = tokens.getInt(33);
 			char pontname[][32] = {
 				"薩姆吉爾村",
 				"瑪麗娜絲村",
@@ -10992,8 +10365,8 @@ void Server::lssproto_S_recv(char* cdata)
 			};
 			sprintf(pc.chusheng, "%s", pontname[pointindex]);
 #ifdef _MAGIC_ITEM_
-			pc.法寶道具狀態 = getIntegerToken(data, "|", 34);
-			pc.道具光環效果 = getIntegerToken(data, "|", 35);
+			pc.法寶道具狀態 = tokens.getInt(34);
+			pc.道具光環效果 = tokens.getInt(35);
 #endif
 #endif
 
@@ -11008,7 +10381,7 @@ void Server::lssproto_S_recv(char* cdata)
 				{
 					if (mask == 0x00000002) // ( 1 << 1 )
 					{
-						pc.hp = getIntegerToken(data, "|", i);// 0x00000002
+						pc.hp = tokens.getInt(i);// 0x00000002
 						//custom
 						pc.hpPercent = util::percent(pc.hp, pc.maxHp);
 
@@ -11017,7 +10390,7 @@ void Server::lssproto_S_recv(char* cdata)
 					}
 					else if (mask == 0x00000004) // ( 1 << 2 )
 					{
-						pc.maxHp = getIntegerToken(data, "|", i);// 0x00000004
+						pc.maxHp = tokens.getInt(i);// 0x00000004
 						//custom
 						pc.hpPercent = util::percent(pc.hp, pc.maxHp);
 
@@ -11026,7 +10399,7 @@ void Server::lssproto_S_recv(char* cdata)
 					}
 					else if (mask == 0x00000008)
 					{
-						pc.mp = getIntegerToken(data, "|", i);// 0x00000008
+						pc.mp = tokens.getInt(i);// 0x00000008
 						//custom
 						pc.mpPercent = util::percent(pc.mp, pc.maxMp);
 
@@ -11035,7 +10408,7 @@ void Server::lssproto_S_recv(char* cdata)
 					}
 					else if (mask == 0x00000010)
 					{
-						pc.maxMp = getIntegerToken(data, "|", i);// 0x00000010
+						pc.maxMp = tokens.getInt(i);// 0x00000010
 						//custom
 						pc.mpPercent = util::percent(pc.mp, pc.maxMp);
 
@@ -11044,144 +10417,142 @@ void Server::lssproto_S_recv(char* cdata)
 					}
 					else if (mask == 0x00000020)
 					{
-						pc.vital = getIntegerToken(data, "|", i);// 0x00000020
+						pc.vital = tokens.getInt(i);// 0x00000020
 						i++;
 					}
 					else if (mask == 0x00000040)
 					{
-						pc.str = getIntegerToken(data, "|", i);// 0x00000040
+						pc.str = tokens.getInt(i);// 0x00000040
 						i++;
 					}
 					else if (mask == 0x00000080)
 					{
-						pc.tgh = getIntegerToken(data, "|", i);// 0x00000080
+						pc.tgh = tokens.getInt(i);// 0x00000080
 						i++;
 					}
 					else if (mask == 0x00000100)
 					{
-						pc.dex = getIntegerToken(data, "|", i);// 0x00000100
+						pc.dex = tokens.getInt(i);// 0x00000100
 						i++;
 					}
 					else if (mask == 0x00000200)
 					{
-						pc.exp = getIntegerToken(data, "|", i);// 0x00000200
+						pc.exp = tokens.getInt(i);// 0x00000200
 						i++;
 					}
 					else if (mask == 0x00000400)
 					{
-						pc.maxExp = getIntegerToken(data, "|", i);// 0x00000400
+						pc.maxExp = tokens.getInt(i);// 0x00000400
 						i++;
 					}
 					else if (mask == 0x00000800)
 					{
-						pc.level = getIntegerToken(data, "|", i);// 0x00000800
+						pc.level = tokens.getInt(i);// 0x00000800
 						i++;
 					}
 					else if (mask == 0x00001000)
 					{
-						pc.atk = getIntegerToken(data, "|", i);// 0x00001000
+						pc.atk = tokens.getInt(i);// 0x00001000
 						i++;
 					}
 					else if (mask == 0x00002000)
 					{
-						pc.def = getIntegerToken(data, "|", i);// 0x00002000
+						pc.def = tokens.getInt(i);// 0x00002000
 						i++;
 					}
 					else if (mask == 0x00004000)
 					{
-						pc.quick = getIntegerToken(data, "|", i);// 0x00004000
+						pc.quick = tokens.getInt(i);// 0x00004000
 						i++;
 					}
 					else if (mask == 0x00008000)
 					{
-						pc.charm = getIntegerToken(data, "|", i);// 0x00008000
+						pc.charm = tokens.getInt(i);// 0x00008000
 						i++;
 					}
 					else if (mask == 0x00010000)
 					{
-						pc.luck = getIntegerToken(data, "|", i);// 0x00010000
+						pc.luck = tokens.getInt(i);// 0x00010000
 						i++;
 					}
 					else if (mask == 0x00020000)
 					{
-						pc.earth = getIntegerToken(data, "|", i);// 0x00020000
+						pc.earth = tokens.getInt(i);// 0x00020000
 						i++;
 					}
 					else if (mask == 0x00040000)
 					{
-						pc.water = getIntegerToken(data, "|", i);// 0x00040000
+						pc.water = tokens.getInt(i);// 0x00040000
 						i++;
 					}
 					else if (mask == 0x00080000)
 					{
-						pc.fire = getIntegerToken(data, "|", i);// 0x00080000
+						pc.fire = tokens.getInt(i);// 0x00080000
 						i++;
 					}
 					else if (mask == 0x00100000)
 					{
-						pc.wind = getIntegerToken(data, "|", i);// 0x00100000
+						pc.wind = tokens.getInt(i);// 0x00100000
 						i++;
 					}
 					else if (mask == 0x00200000)
 					{
-						pc.gold = getIntegerToken(data, "|", i);// 0x00200000
+						pc.gold = tokens.getInt(i);// 0x00200000
 						i++;
 					}
 					else if (mask == 0x00400000)
 					{
-						pc.titleNo = getIntegerToken(data, "|", i);// 0x00400000
+						pc.titleNo = tokens.getInt(i);// 0x00400000
 						i++;
 					}
 					else if (mask == 0x00800000)
 					{
-						pc.dp = getIntegerToken(data, "|", i);// 0x00800000
+						pc.dp = tokens.getInt(i);// 0x00800000
 						i++;
 					}
 					else if (mask == 0x01000000)
 					{
-						pc.transmigration = getIntegerToken(data, "|", i);// 0x01000000
+						pc.transmigration = tokens.getInt(i);// 0x01000000
 						i++;
 					}
 					else if (mask == 0x02000000)
 					{
-						getStringToken(data, "|", i, name);// 0x01000000
-						makeStringFromEscaped(name);
+						tokens.getEscaped(i, name);// 0x01000000
 						name = name.simplified();
 						pc.name = name;
 						i++;
 					}
 					else if (mask == 0x04000000)
 					{
-						getStringToken(data, "|", i, freeName);// 0x02000000
-						makeStringFromEscaped(freeName);
+						tokens.getEscaped(i, freeName);// 0x02000000
 						freeName = freeName.simplified();
 						pc.freeName = freeName;
 						i++;
 					}
 					else if (mask == 0x08000000) // ( 1 << 27 )
 					{
-						pc.ridePetNo = getIntegerToken(data, "|", i);// 0x08000000
+						pc.ridePetNo = tokens.getInt(i);// 0x08000000
 						i++;
 					}
 					else if (mask == 0x10000000) // ( 1 << 28 )
 					{
-						pc.learnride = getIntegerToken(data, "|", i);// 0x10000000
+						pc.learnride = tokens.getInt(i);// 0x10000000
 						i++;
 					}
 					else if (mask == 0x20000000) // ( 1 << 29 )
 					{
-						pc.baseGraNo = getIntegerToken(data, "|", i);// 0x20000000
+						pc.baseGraNo = tokens.getInt(i);// 0x20000000
 						i++;
 					}
 					else if (mask == 0x40000000) // ( 1 << 30 )
 					{
-						pc.skywalker = getIntegerToken(data, "|", i);// 0x40000000
+						pc.skywalker = tokens.getInt(i);// 0x40000000
 						i++;
 					}
 #ifdef _CHARSIGNADY_NO_
 					else if (mask == 0x80000000) // ( 1 << 31 )
 					{
-						pc.簽到標記 = getIntegerToken(data, "|", i);// 0x80000000
+						pc.簽到標記 = tokens.getInt(i);// 0x80000000
 						i++;
 					}
 #endif
@@ -11272,15 +10643,15 @@ void Server::lssproto_S_recv(char* cdata)
 	{
 		QString familyName;
 
-		getStringToken(data, "|", 1, familyName);
-		makeStringFromEscaped(familyName);
+		const util::TokenIndex tokens(data, "|");
+		tokens.getEscaped(1, familyName);
 		familyName = familyName.simplified();
 		pc.familyName = familyName;
 
-		pc.familyleader = getIntegerToken(data, "|", 2);
-		pc.channel = getIntegerToken(data, "|", 3);
-		pc.familySprite = getIntegerToken(data, "|", 4);
-		pc.big4fm = getIntegerToken(data, "|", 5);
+		pc.familyleader = tokens.getInt(2);
+		pc.channel = tokens.getInt(3);
+		pc.familySprite = tokens.getInt(4);
+		pc.big4fm = tokens.getInt(5);
 #ifdef _CHANNEL_MODIFY
 		if (pc.familyleader == FMMEMBER_NONE)
 		{
@@ -11294,9 +10665,10 @@ void Server::lssproto_S_recv(char* cdata)
 #pragma region PlayerModify
 	else if (first == "M") // M HP,MP,EXP
 	{
-		pc.hp = getIntegerToken(data, "|", 1);
-		pc.mp = getIntegerToken(data, "|", 2);
-		pc.exp = getIntegerToken(data, "|", 3);
+		const util::TokenIndex tokens(data, "|");
+		pc.hp = tokens.getInt(1);
+		pc.mp = tokens.getInt(2);
+		pc.exp = tokens.getInt(3);
 		//updataPcAct();
 		if ((pc.status & CHR_STATUS_LEADER) != 0 && party[0].useFlag != 0)
 			party[0].hp = pc.hp;
@@ -11324,7 +10696,8 @@ void Server::lssproto_S_recv(char* cdata)
 		if (no < 0 || no >= MAX_PET)
 			return;
 
-		kubun = getInteger62Token(data, "|", 1);
+		const util::TokenIndex tokens(data, "|");
+		kubun = tokens.getInt62(1);
 		if (kubun == 0)
 		{
 			if (pet[no].useFlag)
@@ -11342,65 +10715,61 @@ void Server::lssproto_S_recv(char* cdata)
 			pet[no].useFlag = 1;
 			if (kubun == 1)
 			{
-				pet[no].graNo = getIntegerToken(data, "|", 2);		// 0x00000002
-				pet[no].hp = getIntegerToken(data, "|", 3);		// 0x00000004
-				pet[no].maxHp = getIntegerToken(data, "|", 4);		// 0x00000008
-				pet[no].mp = getIntegerToken(data, "|", 5);		// 0x00000010
-				pet[no].maxMp = getIntegerToken(data, "|", 6);		// 0x00000020
+				pet[no].graNo = tokens.getInt(2);		// 0x00000002
+				pet[no].hp = tokens.getInt(3);		// 0x00000004
+				pet[no].maxHp = tokens.getInt(4);		// 0x00000008
+				pet[no].mp = tokens.getInt(5);		// 0x00000010
+				pet[no].maxMp = tokens.getInt(6);		// 0x00000020
 
 				//custom
 				pet[no].hpPercent = util::percent(pet[no].hp, pet[no].maxHp);
 				pet[no].mpPercent = util::percent(pet[no].mp, pet[no].maxMp);
 
-				pet[no].exp = getIntegerToken(data, "|", 7);		// 0x00000040
-				pet[no].maxExp = getIntegerToken(data, "|", 8);		// 0x00000080
-				pet[no].level = getIntegerToken(data, "|", 9);		// 0x00000100
-				pet[no].atk = getIntegerToken(data, "|", 10);		// 0x00000200
-				pet[no].def = getIntegerToken(data, "|", 11);		// 0x00000400
-				pet[no].quick = getIntegerToken(data, "|", 12);		// 0x00000800
-				pet[no].ai = getIntegerToken(data, "|", 13);		// 0x00001000
-				pet[no].earth = getIntegerToken(data, "|", 14);		// 0x00002000
-				pet[no].water = getIntegerToken(data, "|", 15);		// 0x00004000
-				pet[no].fire = getIntegerToken(data, "|", 16);		// 0x00008000
-				pet[no].wind = getIntegerToken(data, "|", 17);		// 0x00010000
-				pet[no].maxSkill = getIntegerToken(data, "|", 18);		// 0x00020000
-				pet[no].changeNameFlag = getIntegerToken(data, "|", 19);// 0x00040000
-				pet[no].trn = getIntegerToken(data, "|", 20);
+				pet[no].exp = tokens.getInt(7);		// 0x00000040
+				pet[no].maxExp = tokens.getInt(8);		// 0x00000080
+				pet[no].level = tokens.getInt(9);		// 0x00000100
+				pet[no].atk = tokens.getInt(10);		// 0x00000200
+				pet[no].def = tokens.getInt(11);		// 0x00000400
+				pet[no].quick = tokens.getInt(12);		// 0x00000800
+				pet[no].ai = tokens.getInt(13);		// 0x00001000
+				pet[no].earth = tokens.getInt(14);		// 0x00002000
+				pet[no].water = tokens.getInt(15);		// 0x00004000
+				pet[no].fire = tokens.getInt(16);		// 0x00008000
+				pet[no].wind = tokens.getInt(17);		// 0x00010000
+				pet[no].maxSkill = tokens.getInt(18);		// 0x00020000
+				pet[no].changeNameFlag = tokens.getInt(19);// 0x00040000
+				pet[no].trn = tokens.getInt(20);
 #ifdef _SHOW_FUSION
-				pet[no].fusion = getIntegerToken(data, "|", 21);
-				getStringToken(data, "|", 22, name);// 0x00080000
-				makeStringFromEscaped(name);
+				pet[no].fusion = tokens.getInt(21);
+				tokens.getEscaped(22, name);// 0x00080000
 				name = name.simplified();
 				pet[no].name = name;
-				getStringToken(data, "|", 23, freeName);// 0x00100000
-				makeStringFromEscaped(freeName);
+				tokens.getEscaped(23, freeName);// 0x00100000
 				freeName = freeName.simplified();
 				pet[no].freeName = freeName;
 #else
-				getStringToken(data, "|", 21, name);// 0x00080000
-				makeStringFromEscaped(name);
+				tokens.getEscaped(21, name);// 0x00080000
 				pet[no].name = name;
 
-				getStringToken(data, "|", 22, freeName);// 0x00100000
-				makeStringFromEscaped(freeName);
+				tokens.getEscaped(22, freeName);// 0x00100000
 				pet[no].freeName = freeName;
 #endif
 #ifdef _PETCOM_
-				pet[no].oldhp = getIntegerToken(data, "|", 24);
-				pet[no].oldatk = getIntegerToken(data, "|", 25);
-				pet[no].olddef = getIntegerToken(data, "|", 26);
-				pet[no].oldquick = getIntegerToken(data, "|", 27);
-				pet[no].oldlevel = getIntegerToken(data, "|", 28);
+				pet[no].oldhp = tokens.getInt(24);
+				pet[no].oldatk = tokens.getInt(25);
+				pet[no].olddef = tokens.getInt(26);
+				pet[no].oldquick = tokens.getInt(27);
+				pet[no].oldlevel = tokens.getInt(28);
 #endif
 #ifdef _RIDEPET_
-				pet[no].rideflg = getIntegerToken(data, "|", 29);
+				pet[no].rideflg = tokens.getInt(29);
 #endif
 #ifdef _PETBLESS_
-				pet[no].blessflg = getIntegerToken(data, "|", 30);
-				pet[no].blesshp = getIntegerToken(data, "|", 31);
-				pet[no].blessatk = getIntegerToken(data, "|", 32);
-				pet[no].blessdef = getIntegerToken(data, "|", 33);
-				pet[no].blessquick = getIntegerToken(data, "|", 34);
+				pet[no].blessflg = tokens.getInt(30);
+				pet[no].blesshp = tokens.getInt(31);
+				pet[no].blessatk = tokens.getInt(32);
+				pet[no].blessdef = tokens.getInt(33);
+				pet[no].blessquick = tokens.getInt(34);
 #endif
 			}
 			else
@@ -11413,110 +10782,108 @@ void Server::lssproto_S_recv(char* cdata)
 					{
 						if (mask == 0x00000002)
 						{
-							pet[no].graNo = getIntegerToken(data, "|", i);// 0x00000002
+							pet[no].graNo = tokens.getInt(i);// 0x00000002
 							i++;
 						}
 						else if (mask == 0x00000004)
 						{
-							pet[no].hp = getIntegerToken(data, "|", i);// 0x00000004
+							pet[no].hp = tokens.getInt(i);// 0x00000004
 							pet[no].hpPercent = util::percent(pet[no].hp, pet[no].maxHp);
 							i++;
 						}
 						else if (mask == 0x00000008)
 						{
-							pet[no].maxHp = getIntegerToken(data, "|", i);// 0x00000008
+							pet[no].maxHp = tokens.getInt(i);// 0x00000008
 							pet[no].hpPercent = util::percent(pet[no].hp, pet[no].maxHp);
 							i++;
 						}
 						else if (mask == 0x00000010)
 						{
-							pet[no].mp = getIntegerToken(data, "|", i);// 0x00000010
+							pet[no].mp = tokens.getInt(i);// 0x00000010
 							pet[no].mpPercent = util::percent(pet[no].mp, pet[no].maxMp);
 							i++;
 						}
 						else if (mask == 0x00000020)
 						{
-							pet[no].maxMp = getIntegerToken(data, "|", i);// 0x00000020
+							pet[no].maxMp = tokens.getInt(i);// 0x00000020
 							pet[no].mpPercent = util::percent(pet[no].mp, pet[no].maxMp);
 							i++;
 						}
 						else if (mask == 0x00000040)
 						{
-							pet[no].exp = getIntegerToken(data, "|", i);// 0x00000040
+							pet[no].exp = tokens.getInt(i);// 0x00000040
 							i++;
 						}
 						else if (mask == 0x00000080)
 						{
-							pet[no].maxExp = getIntegerToken(data, "|", i);// 0x00000080
+							pet[no].maxExp = tokens.getInt(i);// 0x00000080
 							i++;
 						}
 						else if (mask == 0x00000100)
 						{
-							pet[no].level = getIntegerToken(data, "|", i);// 0x00000100
+							pet[no].level = tokens.getInt(i);// 0x00000100
 							i++;
 						}
 						else if (mask == 0x00000200)
 						{
-							pet[no].atk = getIntegerToken(data, "|", i);// 0x00000200
+							pet[no].atk = tokens.getInt(i);// 0x00000200
 							i++;
 						}
 						else if (mask == 0x00000400)
 						{
-							pet[no].def = getIntegerToken(data, "|", i);// 0x00000400
+							pet[no].def = tokens.getInt(i);// 0x00000400
 							i++;
 						}
 						else if (mask == 0x00000800)
 						{
-							pet[no].quick = getIntegerToken(data, "|", i);// 0x00000800
+							pet[no].quick = tokens.getInt(i);// 0x00000800
 							i++;
 						}
 						else if (mask == 0x00001000)
 						{
-							pet[no].ai = getIntegerToken(data, "|", i);// 0x00001000
+							pet[no].ai = tokens.getInt(i);// 0x00001000
 							i++;
 						}
 						else if (mask == 0x00002000)
 						{
-							pet[no].earth = getIntegerToken(data, "|", i);// 0x00002000
+							pet[no].earth = tokens.getInt(i);// 0x00002000
 							i++;
 						}
 						else if (mask == 0x00004000)
 						{
-							pet[no].water = getIntegerToken(data, "|", i);// 0x00004000
+							pet[no].water = tokens.getInt(i);// 0x00004000
 							i++;
 						}
 						else if (mask == 0x00008000)
 						{
-							pet[no].fire = getIntegerToken(data, "|", i);// 0x00008000
+							pet[no].fire = tokens.getInt(i);// 0x00008000
 							i++;
 						}
 						else if (mask == 0x00010000)
 						{
-							pet[no].wind = getIntegerToken(data, "|", i);// 0x00010000
+							pet[no].wind = tokens.getInt(i);// 0x00010000
 							i++;
 						}
 						else if (mask == 0x00020000)
 						{
-							pet[no].maxSkill = getIntegerToken(data, "|", i);// 0x00020000
+							pet[no].maxSkill = tokens.getInt(i);// 0x00020000
 							i++;
 						}
 						else if (mask == 0x00040000)
 						{
-							pet[no].changeNameFlag = getIntegerToken(data, "|", i);// 0x00040000
+							pet[no].changeNameFlag = tokens.getInt(i);// 0x00040000
 							i++;
 						}
 						else if (mask == 0x00080000)
 						{
-							getStringToken(data, "|", i, name);// 0x00080000
-							makeStringFromEscaped(name);
+							tokens.getEscaped(i, name);// 0x00080000
 							name = name.simplified();
 							pet[no].name = name;
 							i++;
 						}
 						else if (mask == 0x00100000)
 						{
-							getStringToken(data, "|", i, freeName);// 0x00100000
-							makeStringFromEscaped(freeName);
+							tokens.getEscaped(i, freeName);// 0x00100000
 							freeName = freeName.simplified();
 							pet[no].freeName = freeName;
 							i++;
@@ -11524,54 +10891,54 @@ void Server::lssproto_S_recv(char* cdata)
 #ifdef _PETCOM_
 						else if (mask == 0x200000)
 						{
-							pet[no].oldhp = getIntegerToken(data, "|", i);
+							pet[no].oldhp = tokens.getInt(i);
 							i++;
 						}
 						else if (mask == 0x400000)
 						{
-							pet[no].oldatk = getIntegerToken(data, "|", i);
+							pet[no].oldatk = tokens.getInt(i);
 							i++;
 						}
 						else if (mask == 0x800000)
 						{
-							pet[no].olddef = getIntegerToken(data, "|", i);
+							pet[no].olddef = tokens.getInt(i);
 							i++;
 						}
 						else if (mask == 0x1000000)
 						{
-							pet[no].oldquick = getIntegerToken(data, "|", i);
+							pet[no].oldquick = tokens.getInt(i);
 							i++;
 						}
 						else if (mask == 0x2000000)
 						{
-							pet[no].oldlevel = getIntegerToken(data, "|", i);
+							pet[no].oldlevel = tokens.getInt(i);
 							i++;
 						}
 #endif
 #ifdef _PETBLESS_
 						else if (mask == 0x4000000)
 						{
-							pet[no].blessflg = getIntegerToken(data, "|", i);
+							pet[no].blessflg = tokens.getInt(i);
 							i++;
 						}
 						else if (mask == 0x8000000)
 						{
-							pet[no].blesshp = getIntegerToken(data, "|", i);
+							pet[no].blesshp = tokens.getInt(i);
 							i++;
 						}
 						else if (mask == 0x10000000)
 						{
-							pet[no].blessatk = getIntegerToken(data, "|", i);
+							pet[no].blessatk = tokens.getInt(i);
 							i++;
 						}
 						else if (mask == 0x20000000)
 						{
-							pet[no].blessquick = getIntegerToken(data, "|", i);
+							pet[no].blessquick = tokens.getInt(i);
 							i++;
 						}
 						else if (mask == 0x40000000)
 						{
-							pet[no].blessdef = getIntegerToken(data, "|", i);
+							pet[no].blessdef = tokens.getInt(i);
 							i++;
 						}
 #endif
@@ -11634,8 +11001,9 @@ void Server::lssproto_S_recv(char* cdata)
 #pragma region EncountPercentage
 	else if (first == "E") // E nowEncountPercentage
 	{
-		//minEncountPercentage = getIntegerToken(data, "|", 1);
-		//maxEncountPercentage = getIntegerToken(data, "|", 2);
+		//const util::TokenIndex tokens(data, "|");
+		//minEncountPercentage = tokens.getInt(1);
+		//maxEncountPercentage = tokens.getInt(2);
 		//nowEncountPercentage = minEncountPercentage;
 	}
 #pragma endregion
@@ -11654,12 +11022,13 @@ void Server::lssproto_S_recv(char* cdata)
 		if (data.isEmpty())
 			return;
 
-		magic[no].useFlag = getIntegerToken(data, "|", 1);
+		const util::TokenIndex tokens(data, "|");
+		magic[no].useFlag = tokens.getInt(1);
 		if (magic[no].useFlag != 0)
 		{
-			magic[no].mp = getIntegerToken(data, "|", 2);
-			magic[no].field = getIntegerToken(data, "|", 3);
-			magic[no].target = getIntegerToken(data, "|", 4);
+			magic[no].mp = tokens.getInt(2);
+			magic[no].field = tokens.getInt(3);
+			magic[no].target = tokens.getInt(4);
 			if (magic[no].target >= 100)
 			{
 				magic[no].target %= 100;
@@ -11667,12 +11036,10 @@ void Server::lssproto_S_recv(char* cdata)
 			}
 			else
 				magic[no].deadTargetFlag = 0;
-			getStringToken(data, "|", 5, name);
-			makeStringFromEscaped(name);
+			tokens.getEscaped(5, name);
 			name = name.simplified();
 			magic[no].name = name;
-			getStringToken(data, "|", 6, memo);
-			makeStringFromEscaped(memo);
+			tokens.getEscaped(6, memo);
 			memo = memo.simplified();
 			magic[no].memo = memo;
 		}
@@ -11725,7 +11092,8 @@ void Server::lssproto_S_recv(char* cdata)
 		if (data.isEmpty())
 			return;
 
-		kubun = getInteger62Token(data, "|", 1);
+		const util::TokenIndex tokens(data, "|");
+		kubun = tokens.getInt62(1);
 		if (kubun == 0)
 		{
 			if (party[no].useFlag != 0 && party[no].id != pc.id)
@@ -11774,13 +11142,12 @@ void Server::lssproto_S_recv(char* cdata)
 
 		if (kubun == 1)
 		{
-			party[no].id = getIntegerToken(data, "|", 2);	// 0x00000002
-			party[no].level = getIntegerToken(data, "|", 3);	// 0x00000004
-			party[no].maxHp = getIntegerToken(data, "|", 4);	// 0x00000008
-			party[no].hp = getIntegerToken(data, "|", 5);	// 0x00000010
-			party[no].mp = getIntegerToken(data, "|", 6);	// 0x00000020
-			getStringToken(data, "|", 7, name);	// 0x00000040
-			makeStringFromEscaped(name);
+			party[no].id = tokens.getInt(2);	// 0x00000002
+			party[no].level = tokens.getInt(3);	// 0x00000004
+			party[no].maxHp = tokens.getInt(4);	// 0x00000008
+			party[no].hp = tokens.getInt(5);	// 0x00000010
+			party[no].mp = tokens.getInt(6);	// 0x00000020
+			tokens.getEscaped(7, name);	// 0x00000040
 			name = name.simplified();
 			party[no].name = name;
 		}
@@ -11794,33 +11161,32 @@ void Server::lssproto_S_recv(char* cdata)
 				{
 					if (mask == 0x00000002)
 					{
-						party[no].id = getIntegerToken(data, "|", i);// 0x00000002
+						party[no].id = tokens.getInt(i);// 0x00000002
 						i++;
 					}
 					else if (mask == 0x00000004)
 					{
-						party[no].level = getIntegerToken(data, "|", i);// 0x00000004
+						party[no].level = tokens.getInt(i);// 0x00000004
 						i++;
 					}
 					else if (mask == 0x00000008)
 					{
-						party[no].maxHp = getIntegerToken(data, "|", i);// 0x00000008
+						party[no].maxHp = tokens.getInt(i);// 0x00000008
 						i++;
 					}
 					else if (mask == 0x00000010)
 					{
-						party[no].hp = getIntegerToken(data, "|", i);// 0x00000010
+						party[no].hp = tokens.getInt(i);// 0x00000010
 						i++;
 					}
 					else if (mask == 0x00000020)
 					{
-						party[no].mp = getIntegerToken(data, "|", i);// 0x00000020
+						party[no].mp = tokens.getInt(i);// 0x00000020
 						i++;
 					}
 					else if (mask == 0x00000040)
 					{
-						getStringToken(data, "|", i, name);// 0x00000040
-						makeStringFromEscaped(name);
+						tokens.getEscaped(i, name);// 0x00000040
 						name = name.simplified();
 						party[no].name = name;
 						i++;
@@ -11861,6 +11227,7 @@ void Server::lssproto_S_recv(char* cdata)
 		QString temp;
 		QMutexLocker lock(&swapItemMutex_);
 
+		const util::TokenIndex tokens(data, "|");
 		for (i = 0; i < MAX_ITEM; ++i)
 		{
 #ifdef _ITEM_JIGSAW
@@ -11894,8 +11261,7 @@ void Server::lssproto_S_recv(char* cdata)
 #endif//_ITEM_PILENUMS
 #endif//_PET_ITEM
 #endif//_ITEM_JIGSAW
-			getStringToken(data, "|", no + 1, temp);
-			makeStringFromEscaped(temp);
+			tokens.getEscaped(no + 1, temp);
 			temp = temp.simplified();
 			if (temp.isEmpty())
 			{
@@ -11907,20 +11273,18 @@ void Server::lssproto_S_recv(char* cdata)
 			}
 			pc.item[i].useFlag = 1;
 			pc.item[i].name = temp.simplified();
-			getStringToken(data, "|", no + 2, temp);
-			makeStringFromEscaped(temp);
+			tokens.getEscaped(no + 2, temp);
 			temp = temp.simplified();
 			pc.item[i].name2 = temp;
-			pc.item[i].color = getIntegerToken(data, "|", no + 3);
+			pc.item[i].color = tokens.getInt(no + 3);
 			if (pc.item[i].color < 0)
 				pc.item[i].color = 0;
-			getStringToken(data, "|", no + 4, temp);
-			makeStringFromEscaped(temp);
+			tokens.getEscaped(no + 4, temp);
 			temp = temp.simplified();
 			pc.item[i].memo = temp;
-			pc.item[i].graNo = getIntegerToken(data, "|", no + 5);
-			pc.item[i].field = getIntegerToken(data, "|", no + 6);
-			pc.item[i].target = getIntegerToken(data, "|", no + 7);
+			pc.item[i].graNo = tokens.getInt(no + 5);
+			pc.item[i].field = tokens.getInt(no + 6);
+			pc.item[i].target = tokens.getInt(no + 7);
 			if (pc.item[i].target >= 100)
 			{
 				pc.item[i].target %= 100;
@@ -11928,43 +11292,40 @@ void Server::lssproto_S_recv(char* cdata)
 			}
 			else
 				pc.item[i].deadTargetFlag = 0;
-			pc.item[i].level = getIntegerToken(data, "|", no + 8);
-			pc.item[i].sendFlag = getIntegerToken(data, "|", no + 9);
+			pc.item[i].level = tokens.getInt(no + 8);
+			pc.item[i].sendFlag = tokens.getInt(no + 9);
 
 			// 顯示物品耐久度
-			getStringToken(data, "|", no + 10, temp);
-			makeStringFromEscaped(temp);
+			tokens.getEscaped(no + 10, temp);
 			temp = temp.simplified();
 			pc.item[i].damage = temp;
 #ifdef _ITEM_PILENUMS
-			getStringToken(data, "|", no + 11, temp);
-			makeStringFromEscaped(temp);
+			tokens.getEscaped(no + 11, temp);
 			temp = temp.simplified();
 			pc.item[i].pile = temp.toInt();
 #endif
 #ifdef _ALCHEMIST //_ITEMSET7_TXT
-			getStringToken(data, "|", no + 12, temp);
-			makeStringFromEscaped(temp);
+			tokens.getEscaped(no + 12, temp);
 			temp = temp.simplified();
 			pc.item[i].alch = temp;
 #endif
 #ifdef _PET_ITEM
-			pc.item[i].type = getIntegerToken(data, "|", no + 13);
+			pc.item[i].type = tokens.getInt(no + 13);
 #else
 #ifdef _MAGIC_ITEM_
-			pc.item[i].道具類型 = getIntegerToken(data, "|", no + 13);
+			pc.item[i].道具類型 = tokens.getInt(no + 13);
 #endif
 #endif
 #ifdef _ITEM_JIGSAW
-			getStringToken(data, "|", no + 14, temp);
+			tokens.getString(no + 14, temp);
 			pc.item[i].jigsaw = temp.simplified();
 
 #endif
 #ifdef _NPC_ITEMUP
-			pc.item[i].itemup = getIntegerToken(data, "|", no + 15);
+			pc.item[i].itemup = tokens.getInt(no + 15);
 #endif
 #ifdef _ITEM_COUNTDOWN
-			pc.item[i].counttime = getIntegerToken(data, "|", no + 16);
+			pc.item[i].counttime = tokens.getInt(no + 16);
 #endif
 
 			refreshItemInfo(i);
@@ -12002,21 +11363,20 @@ void Server::lssproto_S_recv(char* cdata)
 		}
 
 		QStringList skillNameList;
+		const util::TokenIndex tokens(data, "|");
 		for (i = 0; i < MAX_SKILL; ++i)
 		{
 			no2 = i * 5;
-			getStringToken(data, "|", no2 + 4, temp);
-			makeStringFromEscaped(temp);
+			tokens.getEscaped(no2 + 4, temp);
 			temp = temp.simplified();
 			if (temp.isEmpty())
 				continue;
 			petSkill[no][i].useFlag = 1;
 			petSkill[no][i].name = temp;
-			petSkill[no][i].skillId = getIntegerToken(data, "|", no2 + 1);
-			petSkill[no][i].field = getIntegerToken(data, "|", no2 + 2);
-			petSkill[no][i].target = getIntegerToken(data, "|", no2 + 3);
-			getStringToken(data, "|", no2 + 5, temp);
-			makeStringFromEscaped(temp);
+			petSkill[no][i].skillId = tokens.getInt(no2 + 1);
+			petSkill[no][i].field = tokens.getInt(no2 + 2);
+			petSkill[no][i].target = tokens.getInt(no2 + 3);
+			tokens.getEscaped(no2 + 5, temp);
 			temp = temp.simplified();
 			petSkill[no][i].memo = temp;
 
@@ -12041,24 +11401,23 @@ void Server::lssproto_S_recv(char* cdata)
 			profession_skill[i].useFlag = 0;
 			profession_skill[i].kind = 0;
 		}
+		const util::TokenIndex tokens(data, "|");
 		for (i = 0; i < MAX_PROFESSION_SKILL; ++i)
 		{
 			count = i * 9;
-			profession_skill[i].useFlag = getIntegerToken(data, "|", 1 + count);
-			profession_skill[i].skillId = getIntegerToken(data, "|", 2 + count);
-			profession_skill[i].target = getIntegerToken(data, "|", 3 + count);
-			profession_skill[i].kind = getIntegerToken(data, "|", 4 + count);
-			profession_skill[i].icon = getIntegerToken(data, "|", 5 + count);
-			profession_skill[i].costmp = getIntegerToken(data, "|", 6 + count);
-			profession_skill[i].skill_level = getIntegerToken(data, "|", 7 + count);
-
-			getStringToken(data, "|", 8 + count, name);
-			makeStringFromEscaped(name);
+			profession_skill[i].useFlag = tokens.getInt(1 + count);
+			profession_skill[i].skillId = tokens.getInt(2 + count);
+			profession_skill[i].target = tokens.getInt(3 + count);
+			profession_skill[i].kind = tokens.getInt(4 + count);
+			profession_skill[i].icon = tokens.getInt(5 + count);
+			profession_skill[i].costmp = tokens.getInt(6 + count);
+			profession_skill[i].skill_level = tokens.getInt(7 + count);
+
+			tokens.getEscaped(8 + count, name);
 			name = name.simplified();
 			profession_skill[i].name = name;
 
-			getStringToken(data, "|", 9 + count, memo);
-			makeStringFromEscaped(memo);
+			tokens.getEscaped(9 + count, memo);
 			memo = memo.simplified();
 			profession_skill[i].memo = memo;
 		}
@@ -12086,12 +11445,13 @@ void Server::lssproto_S_recv(char* cdata)
 	{
 		int i, count = 0;
 		data++;
+		const util::TokenIndex tokens(data, "|");
 		for (i = 0; i < MAX_PROFESSION_SKILL; ++i)
 			profession_skill[i].cooltime = 0;
 		for (i = 0; i < MAX_PROFESSION_SKILL; ++i)
 		{
 			count = i * 1;
-			profession_skill[i].cooltime = getIntegerToken(data, "|", 1 + count);
+			profession_skill[i].cooltime = tokens.getInt(1 + count);
 		}
 		break;
 	}
@@ -12113,6 +11473,7 @@ void Server::lssproto_S_recv(char* cdata)
 		if (data.isEmpty())
 			return;
 
+		const util::TokenIndex tokens(data, "|");
 		for (i = 0; i < MAX_PET_ITEM; ++i)
 		{
 #ifdef _ITEM_JIGSAW
@@ -12128,8 +11489,7 @@ void Server::lssproto_S_recv(char* cdata)
 #else
 			no = i * 13;
 #endif
-			getStringToken(data, "|", no + 1, szData);
-			makeStringFromEscaped(szData);
+			tokens.getEscaped(no + 1, szData);
 			szData = szData.simplified();
 			if (szData.isEmpty())	// 沒道具
 			{
@@ -12138,20 +11498,18 @@ void Server::lssproto_S_recv(char* cdata)
 			}
 			pet[nPetIndex].item[i].useFlag = 1;
 			pet[nPetIndex].item[i].name = szData;
-			getStringToken(data, "|", no + 2, szData);
-			makeStringFromEscaped(szData);
+			tokens.getEscaped(no + 2, szData);
 			szData = szData.simplified();
 			pet[nPetIndex].item[i].name2 = szData;
-			pet[nPetIndex].item[i].color = getIntegerToken(data, "|", no + 3);
+			pet[nPetIndex].item[i].color = tokens.getInt(no + 3);
 			if (pet[nPetIndex].item[i].color < 0)
 				pet[nPetIndex].item[i].color = 0;
-			getStringToken(data, "|", no + 4, szData);
-			makeStringFromEscaped(szData);
+			tokens.getEscaped(no + 4, szData);
 			szData = szData.simplified();
 			pet[nPetIndex].item[i].memo = szData.simplified();
-			pet[nPetIndex].item[i].graNo = getIntegerToken(data, "|", no + 5);
-			pet[nPetIndex].item[i].field = getIntegerToken(data, "|", no + 6);
-			pet[nPetIndex].item[i].target = getIntegerToken(data, "|", no + 7);
+			pet[nPetIndex].item[i].graNo = tokens.getInt(no + 5);
+			pet[nPetIndex].item[i].field = tokens.getInt(no + 6);
+			pet[nPetIndex].item[i].target = tokens.getInt(no + 7);
 			if (pet[nPetIndex].item[i].target >= 100)
 			{
 				pet[nPetIndex].item[i].target %= 100;
@@ -12159,25 +11517,22 @@ void Server::lssproto_S_recv(char* cdata)
 			}
 			else
 				pet[nPetIndex].item[i].deadTargetFlag = 0;
-			pet[nPetIndex].item[i].level = getIntegerToken(data, "|", no + 8);
-			pet[nPetIndex].item[i].sendFlag = getIntegerToken(data, "|", no + 9);
+			pet[nPetIndex].item[i].level = tokens.getInt(no + 8);
+			pet[nPetIndex].item[i].sendFlag = tokens.getInt(no + 9);
 
 			// 顯示物品耐久度
-			getStringToken(data, "|", no + 10, szData);
-			makeStringFromEscaped(szData);
+			tokens.getEscaped(no + 10, szData);
 			szData = szData.simplified();
 			pet[nPetIndex].item[i].damage = szData;
-			pet[nPetIndex].item[i].pile = getIntegerToken(data, "|", no + 11);
+			pet[nPetIndex].item[i].pile = tokens.getInt(no + 11);
 #ifdef _ALCHEMIST //_ITEMSET7_TXT
-			getStringToken(data, "|", no + 12, szData);
-			makeStringFromEscaped(szData);
+			tokens.getEscaped(no + 12, szData);
 			szData = szData.simplified();
 			pet[nPetIndex].item[i].alch = szData;
 #endif
-			pet[nPetIndex].item[i].type = getIntegerToken(data, "|", no + 13);
+			pet[nPetIndex].item[i].type = tokens.getInt(no + 13);
 #ifdef _ITEM_JIGSAW
-			getStringToken(data, "|", no + 14, szData);
-			makeStringFromEscaped(szData);
+			tokens.getEscaped(no + 14, szData);
 			szData = szData.simplified();
 			pet[nPetIndex].item[i].jigsaw = szData;
 			//可拿給寵物裝備的道具,就不會是拼圖了,以下就免了
@@ -12185,10 +11540,10 @@ void Server::lssproto_S_recv(char* cdata)
 			//	SetJigsaw( pc.item[i].graNo, pc.item[i].jigsaw );
 #endif
 #ifdef _NPC_ITEMUP
-			pet[nPetIndex].item[i].itemup = getIntegerToken(data, "|", no + 15);
+			pet[nPetIndex].item[i].itemup = tokens.getInt(no + 15);
 #endif
 #ifdef _ITEM_COUNTDOWN
-			pet[nPetIndex].item[i].counttime = getIntegerToken(data, "|", no + 16);
+			pet[nPetIndex].item[i].counttime = tokens.getInt(no + 16);
 #endif
 		}
 	}
@@ -12614,9 +11969,8 @@ void Server::lssproto_TD_recv(char* cdata)//交易
 	}
 }
 
-void Server::lssproto_CHAREFFECT_recv(char* cdata)
+void Server::lssproto_CHAREFFECT_recv(const util::LazyText& data)
 {
-	QString data = util::toUnicode(cdata);
 	if (data.isEmpty())
 		return;
 }
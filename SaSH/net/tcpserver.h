@@ -22,11 +22,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <iostream>
 #include <string>
 #include <vector>
+#include <array>
 #include <WS2tcpip.h>
 
 #include <threadplugin.h>
 #include <util.h>
 #include "lssproto.h"
+#include "packetcapture.h"
 
 static const QHash<QString, BUTTON_TYPE> buttonMap = {
 	{"OK", BUTTON_OK},
@@ -207,17 +209,68 @@ public:
 signals:
 	void write(QTcpSocket* clientSocket, QByteArray ba, int size);
 
+public:
+	//讀取佇列的統計 等待時間為收到數據到解碼線程取出的時間
+	struct ReadQueueStats
+	{
+		quint64 chunks = 0;
+		quint64 totalWaitUs = 0;
+		quint64 maxWaitUs = 0;
+		size_t maxDepth = 0;
+		quint64 stalls = 0;
+	};
+
+	Q_REQUIRED_RESULT ReadQueueStats readQueueStats() const;
+
+	//錄製之後收到的所有數據與金鑰 path已存在時覆寫
+	bool startCapture(const QString& path);
+	void stopCapture();
+
+	//不連接遊戲 將錄製檔依序交給 handleData realtime為false時以最快速度重播
+	bool replayCapture(const QString& path, bool realtime, capture::report_t* report);
+
 private slots:
 	void onWrite(QTcpSocket* clientSocket, QByteArray ba, int size);
 	void onNewConnection();
 	void onClientReadyRead();
+	void onReadQueueDrained();
 
 
 private:
-	int saDispatchMessage(char* encoded);
+	int saDispatchMessage(Autil::ProtocolCodec& codec, char* encoded);
+
+	//每個接收函數負責解碼並轉交 返回0表示校驗失敗 BC_ABOUT_TO_END表示處理完畢
+	using RecvHandler = int(*)(Server& server, Autil::ProtocolCodec& codec);
+	static constexpr int kRecvTableSize = 256;
+
+	static const std::array<RecvHandler, kRecvTableSize>& recvTable();
+
+	template <auto Fn, int Result = BC_ABOUT_TO_END>
+	static int relayRecv(Server& server, Autil::ProtocolCodec& codec);
+	template <typename... Fields>
+	static int dropRecv(Server& server, Autil::ProtocolCodec& codec);
+	template <int Func, auto Fn>
+	static int optionalRecv(Server& server, Autil::ProtocolCodec& codec);
+	template <int Func, RecvHandler Handler, RecvHandler Drop>
+	static int subscribedRecv(Server& server, Autil::ProtocolCodec& codec);
+	static int ignoreRecv(Server& server, Autil::ProtocolCodec& codec);
+	static int recvXYD(Server& server, Autil::ProtocolCodec& codec);
+	static int recvPME(Server& server, Autil::ProtocolCodec& codec);
+	static int recvSE(Server& server, Autil::ProtocolCodec& codec);
+
+	void readFromSocket(QTcpSocket* clientSocket);
+
+	void stageMapUnit(const mapunit_t& unit, mapunitdiff_t* diff);
+	void publishMapUnitDiff(const mapunitdiff_t& diff);
+
+	void decodeLoop();
 
 	void handleData(QTcpSocket* clientSocket, QByteArray data);
 
+	bool dispatchControlMessage(const char* line, size_t size);
+
+	bool refreshPersonalKey();
+
 public://actions
 	Q_REQUIRED_RESULT int getWorldStatus();
 
@@ -243,7 +296,7 @@ public://actions
 
 	void logBack();
 
-	void move(const QPoint& p, const QString& dir);
+	bool move(const QPoint& p, const QString& dir);
 
 	void move(const QPoint& p);
 
@@ -257,6 +310,8 @@ public://actions
 
 	void EO();
 
+	void probeRtt();
+
 	void dropItem(int index);
 	void dropItem(QVector<int> index);
 
@@ -874,6 +929,7 @@ public:
 
 	util::SafeHash<int, mapunit_t> mapUnitHash;
 	util::SafeHash<QPoint, mapunit_t> npcUnitPointHash;
+
 	util::SafeQueue<QPair<int, QString>> chatQueue;
 
 	QPair<int, QVector<bankpet_t>> currentBankPetList;
@@ -897,7 +953,31 @@ public:
 	QString labelPetAction;
 
 private:
-	QFutureSynchronizer <void> sync_;
+	struct ReadChunk
+	{
+		QTcpSocket* socket = nullptr;
+		QByteArray data;
+		std::chrono::steady_clock::time_point received;
+	};
+
+	static constexpr size_t kReadQueueSize = 256;
+
+	//主線程讀取socket後放入佇列 由單一解碼線程依序取出處理
+	util::SpscQueue<ReadChunk, kReadQueueSize> readQueue_;
+	QSemaphore readSignal_;
+	QScopedPointer<QThread> decodeThread_;
+	std::atomic_bool decodeStop_ { false };
+	std::atomic_bool readStalled_ { false };   //佇列已滿 數據留在socket內等待解碼線程消化
+	QPointer<QTcpSocket> stalledSocket_;
+
+	std::atomic<quint64> readChunks_ { 0 };
+	std::atomic<quint64> readWaitTotalUs_ { 0 };
+	std::atomic<quint64> readWaitMaxUs_ { 0 };
+	std::atomic<size_t> readDepthMax_ { 0 };
+	std::atomic<quint64> readStalls_ { 0 };
+
+	//C封包轉碼用的緩衝 只在解碼線程使用 重複使用容量
+	QString mapUnitText_;
 
 	unsigned short port_ = 0;
 
@@ -905,18 +985,22 @@ private:
 
 	QList<QTcpSocket*> clientSockets_;
 
-	QByteArray net_readbuf;
+	Autil::LineBuffer net_readbuf;
 
 	QMutex net_mutex;
 
+	//以下只在持有 net_mutex 時存取
+	QScopedPointer<capture::Writer> capture_;
+	capture::report_t* replayReport_ = nullptr;
+	bool replaying_ = false;
+
 private://lssproto
-	int appendReadBuf(const QByteArray& data);
-	QByteArrayList splitLinesFromReadBuf();
+	bool appendReadBuf(const QByteArray& data);
 	int a62toi(const QString& a) const;
 	int getStringToken(const QString& src, const QString& delim, int count, QString& out) const;
 	int getIntegerToken(const QString& src, const QString& delim, int count) const;
 	int getInteger62Token(const QString& src, const QString& delim, int count) const;
-	QString makeStringFromEscaped(const QString& src) const;
+	void makeStringFromEscaped(QString& src) const;
 
 private://lssproto_recv
 #pragma region Lssproto_Recv
@@ -991,7 +1075,7 @@ private://lssproto_recv
 #ifdef _OUTOFBATTLESKILL			// (不可開) Syu ADD 非戰鬥時技能Protocol
 	virtual void lssproto_BATTLESKILL_recv(char* data) override;
 #endif
-	virtual void lssproto_CHAREFFECT_recv(char* data) override;
+	virtual void lssproto_CHAREFFECT_recv(const util::LazyText& data) override;
 
 #ifdef _STREET_VENDOR
 	virtual void lssproto_STREET_VENDOR_recv(char* data) override;	// 擺攤功能
@@ -1029,7 +1113,7 @@ private://lssproto_recv
 	virtual void lssproto_DancemanOption_recv(int option) override;	//動一動狀態
 #endif
 #ifdef _ANNOUNCEMENT_
-	virtual void lssproto_DENGON_recv(char* data, int colors, int nums) override;
+	virtual void lssproto_DENGON_recv(const util::LazyText& data, int colors, int nums) override;
 #endif
 #ifdef _HUNDRED_KILL
 	virtual void lssproto_hundredkill_recv(int flag) override;
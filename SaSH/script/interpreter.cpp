@@ -798,6 +798,17 @@ bool Interpreter::waitfor(qint64 timeout, std::function<bool()> exprfun)
 	Injector& injector = Injector::getInstance();
 	bool bret = false;
 	QElapsedTimer timer; timer.start();
+
+	//依連線延遲調整 至少等一個往返才算逾時 輪詢間隔取往返時間的1/4 介於10~100毫秒
+	qint64 pollMs = 100;
+	if (!injector.server.isNull())
+	{
+		const RttTracker& rtt = injector.server->getRttTracker();
+		timeout = qMax(timeout, rtt.rtoMs(timeout));
+		if (rtt.hasSample())
+			pollMs = qBound<qint64>(10, rtt.srttMs() / 4, 100);
+	}
+
 	for (;;)
 	{
 		checkPause();
@@ -817,7 +828,7 @@ bool Interpreter::waitfor(qint64 timeout, std::function<bool()> exprfun)
 			break;
 		}
 
-		QThread::msleep(100);
+		QThread::msleep(static_cast<unsigned long>(pollMs));
 	}
 	return bret;
 }
@@ -1417,8 +1428,9 @@ bool Interpreter::findPath(QPoint dst, qint64 steplen, qint64 step_cost, qint64
 		injector.server->announce(QObject::tr("<findpath>start searching the path"));//"<尋路>開始搜尋路徑"
 
 	QVector<QPoint> path;
+	int estimate = 0;
 	QElapsedTimer timer; timer.start();
-	if (mapAnalyzer.isNull() || !mapAnalyzer->calcNewRoute(_map, src, dst, &path))
+	if (mapAnalyzer.isNull() || !mapAnalyzer->calcNewRoute(_map, src, dst, &path, &estimate))
 	{
 		if (!noAnnounce && !injector.server.isNull())
 			injector.server->announce(QObject::tr("<findpath>unable to findpath"));//"<尋路>找不到路徑"
@@ -1427,7 +1439,12 @@ bool Interpreter::findPath(QPoint dst, qint64 steplen, qint64 step_cost, qint64
 
 	qint64 cost = static_cast<qint64>(timer.elapsed());
 	if (!noAnnounce && !injector.server.isNull())
-		injector.server->announce(QObject::tr("<findpath>path found, cost:%1 step:%2").arg(cost).arg(path.size()));//"<尋路>成功找到路徑，耗時：%1"
+	{
+		if (estimate > path.size())
+			injector.server->announce(QObject::tr("<findpath>path found, cost:%1 step:%2 of about %3").arg(cost).arg(path.size()).arg(estimate));//"<尋路>成功找到路徑，耗時：%1 步數:%2 (全程約%3步)"
+		else
+			injector.server->announce(QObject::tr("<findpath>path found, cost:%1 step:%2").arg(cost).arg(path.size()));//"<尋路>成功找到路徑，耗時：%1"
+	}
 
 	QPoint point;
 	qint64 steplen_cache = -1;
@@ -1440,6 +1457,9 @@ bool Interpreter::findPath(QPoint dst, qint64 steplen, qint64 step_cost, qint64
 	QElapsedTimer blockDetectTimer; blockDetectTimer.start();
 	QPoint lastPoint = src;
 
+	//以絕對時間點控制每步間隔 避免sleep誤差與發送耗時累積
+	util::StepPacer pacer(step_cost);
+
 	for (;;)
 	{
 		if (injector.server.isNull())
@@ -1468,13 +1488,50 @@ bool Interpreter::findPath(QPoint dst, qint64 steplen, qint64 step_cost, qint64
 			}
 
 			point = path.at(steplen_cache);
-			injector.server->move(point);
 			if (step_cost > 0)
-				QThread::msleep(step_cost);
+			{
+				//不快於連線的往返時間 避免伺服器來不及處理
+				pacer.setInterval(injector.server->getRttTracker().paceMs(step_cost));
+				pacer.wait();
+			}
+			injector.server->move(point);
+			pacer.step();
 			//QThread::msleep(50);
 		}
 
-		if (!checkBattleThenWait())
+		checkPause();
+
+		if (injector.server->getBattleFlag())
+		{
+			//戰鬥中利用等待時間預先計算戰後的續走路徑
+			const QPoint battlePos = getPos();
+			QFuture<QVector<QPoint>> resumeFuture = QtConcurrent::run([mapAnalyzer, _map, battlePos, dst]()->QVector<QPoint>
+				{
+					QVector<QPoint> resume;
+					if (!mapAnalyzer.isNull())
+						mapAnalyzer->calcNewRoute(_map, battlePos, dst, &resume);
+					return resume;
+				});
+
+			//等待戰鬥結束 結束後不再停滯 下一輪直接出發
+			QElapsedTimer battleTimer; battleTimer.start();
+			while (!isInterruptionRequested() && !injector.server.isNull() && injector.server->getBattleFlag() && !battleTimer.hasExpired(60000))
+			{
+				checkPause();
+				QThread::msleep(100);
+			}
+
+			QVector<QPoint> resume = resumeFuture.result();
+			if (!resume.isEmpty() && getPos() == battlePos)
+			{
+				path = resume;
+				pathsize = path.size();
+			}
+
+			pacer.reset();
+			blockDetectTimer.restart();
+		}
+		else
 		{
 			src = getPos();
 			if (src == dst)
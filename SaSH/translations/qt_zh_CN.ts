@@ -2669,6 +2669,10 @@ MESSAGE：<byte value="xd"/>
         <source>&lt;findpath&gt;path found, cost:%1 step:%2</source>
         <translation>&lt;寻路&gt;成功找到路径，耗时：%1 步数:%2</translation>
     </message>
+    <message>
+        <source>&lt;findpath&gt;path found, cost:%1 step:%2 of about %3</source>
+        <translation>&lt;寻路&gt;成功找到路径，耗时：%1 步数:%2 (全程约%3步)</translation>
+    </message>
     <message>
         <source>unknown command: %1</source>
         <translation>未知的命令:%1</translation>
@@ -2669,6 +2669,10 @@ MESSAGE：<byte value="xd"/>
         <source>&lt;findpath&gt;path found, cost:%1 step:%2</source>
         <translation>&lt;尋路&gt;成功找到路徑，耗時：%1 步數:%2</translation>
     </message>
+    <message>
+        <source>&lt;findpath&gt;path found, cost:%1 step:%2 of about %3</source>
+        <translation>&lt;尋路&gt;成功找到路徑，耗時：%1 步數:%2 (全程約%3步)</translation>
+    </message>
     <message>
         <source>unknown command: %1</source>
         <translation>未知的命令:%1</translation>
@@ -18,9 +18,114 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
 #include "stdafx.h"
 #include <util.h>
+#include "net/autil.h"
 
 QReadWriteLock g_fileLock;
 
+const ushort* util::traditionalChineseTable()
+{
+	//LCMAP_TRADITIONAL_CHINESE是逐字映射 輸出長度與輸入相同 因此整個BMP映射一次即可得到完整對照表
+	static const QVector<ushort> table = []()->QVector<ushort>
+	{
+#ifdef Q_OS_WIN
+		if (::GetACP() != 950)
+			return QVector<ushort>();
+
+		QVector<ushort> map(0x10000);
+		for (int i = 0; i < map.size(); ++i)
+			map[i] = static_cast<ushort>(i);
+
+		//代理對不能單獨映射 保持原值
+		auto mapRange = [&map](int first, int last)
+		{
+			const int count = last - first + 1;
+			QVector<wchar_t> src(count);
+			QVector<wchar_t> dst(count);
+			for (int i = 0; i < count; ++i)
+				src[i] = static_cast<wchar_t>(first + i);
+
+			const int ret = LCMapStringEx(LOCALE_NAME_SYSTEM_DEFAULT, LCMAP_TRADITIONAL_CHINESE, src.constData(), count, dst.data(), count, NULL, NULL, NULL);
+			if (ret == count)
+			{
+				for (int i = 0; i < count; ++i)
+					map[first + i] = static_cast<ushort>(dst.at(i));
+				return;
+			}
+
+			//整段映射失敗時逐字映射
+			for (int i = 0; i < count; ++i)
+			{
+				wchar_t out = src.at(i);
+				if (LCMapStringEx(LOCALE_NAME_SYSTEM_DEFAULT, LCMAP_TRADITIONAL_CHINESE, &src.at(i), 1, &out, 1, NULL, NULL, NULL) == 1)
+					map[first + i] = static_cast<ushort>(out);
+			}
+		};
+
+		mapRange(0x0001, 0xd7ff);
+		mapRange(0xe000, 0xffff);
+		return map;
+#else
+		return QVector<ushort>();
+#endif
+	}();
+
+	return table.isEmpty() ? nullptr : table.constData();
+}
+
+const ushort* util::gb2312PairTable()
+{
+	//以解碼器本身逐個解碼雙字節組合 查表結果與直接呼叫解碼器相同
+	static const std::vector<ushort> table = gbcodec::buildPairTable([](const char* bytes, int size, ushort* out)->bool
+		{
+			static QTextCodec* codec = QTextCodec::codecForMib(2025);
+			QTextCodec::ConverterState state;
+			const QString s = codec->toUnicode(bytes, size, &state);
+			if ((state.invalidChars != 0) || (state.remainingChars != 0) || (s.size() != 1))
+				return false;
+
+			*out = s.at(0).unicode();
+			return true;
+		});
+
+	return table.data();
+}
+
+void util::unescape(QString& src)
+{
+	int i = src.indexOf('\\');
+	if (i == -1)
+		return;
+
+	const int size = src.size();
+	QChar* data = src.data();
+	int dst = i;
+
+	while (i != -1)
+	{
+		//搬移上一個轉義與這個反斜線之間的字符
+		const int next = src.indexOf('\\', i + 1);
+		const int runEnd = (next == -1) ? size : next;
+
+		const ushort c = (i + 1 < size) ? data[i + 1].unicode() : 0;
+		const char escaped = (c < 0x80) ? Autil::ESCAPETABLE.value[c] : '\0';
+
+		//不是轉義時原樣保留反斜線
+		int from = i;
+		if (escaped != '\0')
+		{
+			data[dst++] = QChar(escaped);
+			from = i + 2;
+		}
+
+		if (dst != from)
+			std::copy(data + from, data + runEnd, data + dst);
+		dst += runEnd - from;
+		i = next;
+	}
+
+	src.truncate(dst);
+}
+
 util::Config::Config(const QString& fileName)
 	: fileName_(fileName)
 	, file_(fileName)
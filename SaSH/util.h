@@ -33,7 +33,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <QHash>
 #include "3rdparty/simplecrypt.h"
 #include "model/treewidgetitem.h"
+#include "net/gbcodec.h"
 #include <type_traits>
+#include <chrono>
 
 constexpr int SASH_VERSION_MAJOR = 1;
 constexpr int SASH_VERSION_MINOR = 0;
@@ -778,22 +780,50 @@ namespace util
 			return static_cast<int>(d);
 	}
 
-	inline Q_REQUIRED_RESULT QString toUnicode(const char* str, bool ext = true)
+	//簡體轉繁體的逐字對照表(65536項) 只在繁體系統(950)上首次使用時建立一次 其他系統返回nullptr
+	Q_REQUIRED_RESULT const ushort* traditionalChineseTable();
+
+	//GB2312解碼器的雙字節對照表(65536項) 首次使用時由解碼器逐個組合建立一次
+	Q_REQUIRED_RESULT const ushort* gb2312PairTable();
+
+	//解碼到呼叫端的緩衝 緩衝沒有共享時重複使用其容量 不另外配置
+	inline void toUnicode(const char* str, QString* out, bool ext = true)
 	{
-		QTextCodec* codec = QTextCodec::codecForMib(2025);//取GB2312解碼器
-		QString qstr = codec->toUnicode(str);//先以GB2312解碼轉成UNICODE
-		std::wstring wstr = qstr.toStdWString();
-		UINT ACP = ::GetACP();
-		if (950 == ACP && ext)
+		if (out == nullptr)
+			return;
+
+		if (str == nullptr)
+		{
+			out->clear();
+			return;
+		}
+
+		//ASCII一字節一字符 雙字節一字符 輸出不會超過輸入的字節數
+		const int size = static_cast<int>(strlen(str));
+		out->resize(size);
+		const int n = gbcodec::decode(gb2312PairTable(), str, size, reinterpret_cast<ushort*>(out->data()));
+		if (n >= 0)
+			out->resize(n);
+		else
+		{
+			//含表外的字節 交由解碼器處理以保持原本的替代字符行為
+			static QTextCodec* codec = QTextCodec::codecForMib(2025);//取GB2312解碼器
+			*out = codec->toUnicode(str, size);
+		}
+
+		if (ext)
 		{
 			// 繁體系統要轉繁體否則遊戲視窗標題會亂碼(一堆問號字)
-			int size = lstrlenW(wstr.c_str());
-			QScopedArrayPointer <wchar_t> wbuf(new wchar_t[size + 1]());
-			//繁體字碼表映射
-			LCMapStringEx(LOCALE_NAME_SYSTEM_DEFAULT, LCMAP_TRADITIONAL_CHINESE, wstr.c_str(), size, wbuf.data(), size, NULL, NULL, NULL);
-			qstr = QString::fromWCharArray(wbuf.data());
+			const ushort* table = traditionalChineseTable();
+			if (table != nullptr)
+				gbcodec::mapChars(table, reinterpret_cast<ushort*>(out->data()), out->size());
 		}
+	}
 
+	inline Q_REQUIRED_RESULT QString toUnicode(const char* str, bool ext = true)
+	{
+		QString qstr;
+		toUnicode(str, &qstr, ext);
 		return qstr;
 	}
 
@@ -1302,6 +1332,61 @@ namespace util
 		mutable QReadWriteLock lock_;
 	};;
 
+	//單一生產者/單一消費者的無鎖環形佇列 容量固定為N-1 滿時push失敗由呼叫端決定如何處理
+	template <typename T, size_t N>
+	class SpscQueue
+	{
+		static_assert((N >= 2) && ((N & (N - 1)) == 0), "SpscQueue size must be a power of two");
+
+	public:
+		SpscQueue() = default;
+		virtual ~SpscQueue() = default;
+
+		//僅限生產者線程
+		bool push(T&& value)
+		{
+			const size_t tail = tail_.load(std::memory_order_relaxed);
+			const size_t next = (tail + 1) & (N - 1);
+			if (next == head_.load(std::memory_order_acquire))
+				return false;
+
+			buffer_[tail] = std::move(value);
+			tail_.store(next, std::memory_order_release);
+			return true;
+		}
+
+		//僅限消費者線程
+		bool pop(T* pvalue)
+		{
+			const size_t head = head_.load(std::memory_order_relaxed);
+			if (head == tail_.load(std::memory_order_acquire))
+				return false;
+
+			if (pvalue)
+				*pvalue = std::move(buffer_[head]);
+			buffer_[head] = T();
+			head_.store((head + 1) & (N - 1), std::memory_order_release);
+			return true;
+		}
+
+		//任意線程 僅供參考
+		size_t size() const
+		{
+			const size_t tail = tail_.load(std::memory_order_acquire);
+			const size_t head = head_.load(std::memory_order_acquire);
+			return (tail - head) & (N - 1);
+		}
+
+		inline bool isFull() const { return size() == (N - 1); }
+
+		static constexpr size_t capacity() { return N - 1; }
+
+	private:
+		T buffer_[N] = {};
+		alignas(64) std::atomic<size_t> head_ { 0 };
+		alignas(64) std::atomic<size_t> tail_ { 0 };
+	};
+
 	template <typename T>
 	class SafeData
 	{
@@ -1721,6 +1806,261 @@ namespace util
 
 	};
 
+	//步伐節拍器 以單調時鐘的絕對時間點排程每一步 避免sleep誤差與發送耗時累積造成的漂移
+	class StepPacer
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		explicit StepPacer(qint64 intervalMs = 0)
+		{
+			setInterval(intervalMs);
+			reset();
+		}
+
+		//變更間隔 保留目前的節拍相位
+		void setInterval(qint64 intervalMs)
+		{
+			interval_ = std::chrono::milliseconds(intervalMs > 0 ? intervalMs : 0);
+		}
+
+		Q_REQUIRED_RESULT qint64 interval() const
+		{
+			return std::chrono::duration_cast<std::chrono::milliseconds>(interval_).count();
+		}
+
+		//從現在開始重新計時 (例如戰鬥結束後)
+		void reset()
+		{
+			deadline_ = Clock::now();
+			head_ = 0;
+			count_ = 0;
+		}
+
+		//等待到下一個時間點 並排定再下一個時間點
+		//落後超過一個間隔時直接重新對齊 不會為了追趕而連續發送
+		void wait()
+		{
+			Clock::time_point now = Clock::now();
+			if (now < deadline_)
+			{
+				//粗略休眠到時間點前2ms 剩餘部分讓出時間片等待 避開系統計時器的解析度誤差
+				constexpr auto kSpinWindow = std::chrono::milliseconds(2);
+				const auto remain = deadline_ - now;
+				if (remain > kSpinWindow)
+					QThread::msleep(static_cast<unsigned long>(std::chrono::duration_cast<std::chrono::milliseconds>(remain - kSpinWindow).count()));
+
+				while (Clock::now() < deadline_)
+					QThread::yieldCurrentThread();
+
+				deadline_ += interval_;
+			}
+			else if (now - deadline_ > interval_)
+			{
+				deadline_ = now + interval_;
+			}
+			else
+			{
+				deadline_ += interval_;
+			}
+		}
+
+		//紀錄實際送出的步數
+		void step(int steps = 1)
+		{
+			const Clock::time_point now = Clock::now();
+			samples_[head_] = { now, steps };
+			head_ = (head_ + 1) % kSampleSize;
+			if (count_ < kSampleSize)
+				++count_;
+		}
+
+		//最近取樣區間內實際達成的每秒步數
+		Q_REQUIRED_RESULT qreal stepsPerSecond() const
+		{
+			if (count_ < 2)
+				return 0.0;
+
+			const int newest = (head_ + kSampleSize - 1) % kSampleSize;
+			const int oldest = (head_ + kSampleSize - count_) % kSampleSize;
+			const qreal seconds = std::chrono::duration<qreal>(samples_[newest].time - samples_[oldest].time).count();
+			if (seconds <= 0.0)
+				return 0.0;
+
+			//最舊一筆的步數發生在區間起點之前 不列入計算
+			int steps = 0;
+			for (int i = 1; i < count_; ++i)
+				steps += samples_[(oldest + i) % kSampleSize].steps;
+
+			return steps / seconds;
+		}
+
+	private:
+		static constexpr int kSampleSize = 32;
+
+		struct Sample
+		{
+			Clock::time_point time;
+			int steps = 0;
+		};
+
+		Clock::duration interval_ = Clock::duration::zero();
+		Clock::time_point deadline_;
+		Sample samples_[kSampleSize] = {};
+		int head_ = 0;
+		int count_ = 0;
+	};
+
+	//原地還原伺服器字串欄位的轉義字符(\n \c \z \y) 沒有反斜線時不會分離(detach)字串
+	//須在轉碼後呼叫 雙字節字已合成單一QChar 反斜線不會是尾字節
+	void unescape(QString& src);
+
+	//封包欄位索引 建構時一次掃描記錄每個欄位的起訖位置 之後以序號(由1起算 0視同1)直接取用
+	//取代對同一字串反覆從頭搜尋分隔符的getStringToken 回傳值語意與其相同
+	class TokenIndex
+	{
+	public:
+		TokenIndex(const QString& src, const QString& delim)
+			: src_(src)
+		{
+			if (src_.isEmpty() || delim.isEmpty())
+				return;
+
+			const int step = delim.length();
+			int i = 0;
+			for (;;)
+			{
+				const int j = src_.indexOf(delim, i);
+				if (j == -1)
+				{
+					spans_.append(qMakePair(i, src_.length() - i));
+					break;
+				}
+
+				spans_.append(qMakePair(i, j - i));
+				i = j + step;
+			}
+		}
+
+		Q_REQUIRED_RESULT inline int size() const { return spans_.size(); }
+
+		//欄位不存在時返回空引用
+		Q_REQUIRED_RESULT QStringRef ref(int count) const
+		{
+			if (count < 0 || count > spans_.size() || spans_.isEmpty())
+				return QStringRef();
+
+			const QPair<int, int>& span = spans_.at(count > 0 ? count - 1 : 0);
+			return src_.midRef(span.first, span.second);
+		}
+
+		//成功返回0 欄位不存在返回1並清空out
+		int getString(int count, QString& out) const
+		{
+			if (count < 0 || count > spans_.size() || spans_.isEmpty())
+			{
+				out.clear();
+				return 1;
+			}
+
+			out = ref(count).toString();
+			return 0;
+		}
+
+		//與getString相同 並還原轉義字符
+		int getEscaped(int count, QString& out) const
+		{
+			const int ret = getString(count, out);
+			if (ret == 0)
+				unescape(out);
+			return ret;
+		}
+
+		//欄位不存在或非十進制整數時返回-1
+		Q_REQUIRED_RESULT int getInt(int count) const
+		{
+			if (count < 0 || count > spans_.size() || spans_.isEmpty())
+				return -1;
+
+			bool ok = false;
+			const int value = ref(count).toInt(&ok);
+			return ok ? value : -1;
+		}
+
+		//欄位為空時返回-1
+		Q_REQUIRED_RESULT int getInt62(int count) const
+		{
+			const QStringRef s = ref(count);
+			if (s.isEmpty())
+				return -1;
+			return a62toi(s);
+		}
+
+		//與 toInt(nullptr, 16) 相同 失敗時返回0
+		Q_REQUIRED_RESULT int getHex(int count, bool* ok = nullptr) const
+		{
+			return ref(count).toInt(ok, 16);
+		}
+
+		// 0-9,a-z(10-35),A-Z(36-61)
+		Q_REQUIRED_RESULT static int a62toi(const QStringRef& a)
+		{
+			int ret = 0;
+			int sign = 1;
+			const int size = a.length();
+			for (int i = 0; i < size; ++i)
+			{
+				const ushort c = a.at(i).unicode();
+				ret *= 62;
+				if ('0' <= c && c <= '9')
+					ret += c - '0';
+				else if ('a' <= c && c <= 'z')
+					ret += c - 'a' + 10;
+				else if ('A' <= c && c <= 'Z')
+					ret += c - 'A' + 36;
+				else if (c == '-')
+					sign = -1;
+				else
+					return 0;
+			}
+			return ret * sign;
+		}
+
+	private:
+		QString src_;
+		QVector<QPair<int, int>> spans_;
+	};
+
+	//延遲轉碼的封包字段 第一次讀取時才轉為UNICODE
+	//只指向解碼緩衝區 僅在接收函數內有效 不可保存
+	class LazyText
+	{
+	public:
+		LazyText(const char* raw)
+			: raw_(raw)
+		{
+		}
+
+		Q_REQUIRED_RESULT inline const char* raw() const { return raw_ != nullptr ? raw_ : ""; }
+
+		Q_REQUIRED_RESULT inline bool isEmpty() const { return raw_ == nullptr || *raw_ == '\0'; }
+
+		Q_REQUIRED_RESULT const QString& text() const
+		{
+			if (!decoded_)
+			{
+				toUnicode(raw(), &text_);
+				decoded_ = true;
+			}
+			return text_;
+		}
+
+	private:
+		const char* raw_ = nullptr;
+		mutable QString text_;
+		mutable bool decoded_ = false;
+	};
+
 	//簡易字符串加解密 主要用於將一些二進制數據轉換為可視字符串方便保存json
 	class Crypt
 	{
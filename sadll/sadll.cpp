@@ -707,13 +707,19 @@ void GameService::uninitialize()
 
 	isInitialized_.store(false, std::memory_order_release);
 
+	{
+		//轉發中的線程不可拿到已釋放的連線 下次連線從新的一行開始
+		std::lock_guard<std::mutex> lock(forwardMutex_);
 #ifdef USE_ASYNC_TCP
-	if (asyncClient_)
-		asyncClient_.reset();
+		if (asyncClient_)
+			asyncClient_.reset();
 #else
-	if (syncClient_)
-		syncClient_.reset();
+		if (syncClient_)
+			syncClient_.reset();
 #endif
+		forwardAtLineEnd_ = true;
+		pendingControl_.clear();
+	}
 
 	DetourRestoreAfterWith();
 	DetourTransactionBegin();
@@ -739,16 +745,66 @@ void GameService::uninitialize()
 	util::undetour(pBattleCommandReady, oldBattleCommandReadyByte, sizeof(oldBattleCommandReadyByte));
 }
 
-void GameService::Send(const std::string& str)
+//發送控制訊息 與封包共用同一條連線 以'\n'結尾成為獨立的一行 內容中的換行改為空白
+//轉發的封包停在行中間時先排隊 否則會接在半行封包後面 由forwardRecv在行尾送出
+void GameService::Send(const std::string& text)
+{
+	std::string str = text;
+	for (char& c : str)
+	{
+		if (c == '\n' || c == '\r')
+			c = ' ';
+	}
+	str += '\n';
+
+	std::lock_guard<std::mutex> lock(forwardMutex_);
+	if (forwardAtLineEnd_)
+		sendToClient(str.c_str(), static_cast<int>(str.size()));
+	else
+		pendingControl_ += str;
+}
+
+//轉發收到的封包 recv的邊界與行無關 轉發到行尾時才送出排隊中的控制訊息
+void GameService::forwardRecv(const char* buf, int len)
+{
+	if ((buf == nullptr) || (len <= 0))
+		return;
+
+	std::lock_guard<std::mutex> lock(forwardMutex_);
+	sendToClient(buf, len);
+	forwardAtLineEnd_ = (buf[len - 1] == '\n');
+	if (forwardAtLineEnd_ && !pendingControl_.empty())
+	{
+		sendToClient(pendingControl_.c_str(), static_cast<int>(pendingControl_.size()));
+		pendingControl_.clear();
+	}
+}
+
+//連線中斷時剩下的半行不會再有後續 補上'\n'結束它 (外掛端解不開會直接丟棄) 再送出排隊中的控制訊息
+void GameService::endForwardedLine()
+{
+	std::lock_guard<std::mutex> lock(forwardMutex_);
+	if (forwardAtLineEnd_)
+		return;
+
+	sendToClient("\n", 1);
+	forwardAtLineEnd_ = true;
+	if (!pendingControl_.empty())
+	{
+		sendToClient(pendingControl_.c_str(), static_cast<int>(pendingControl_.size()));
+		pendingControl_.clear();
+	}
+}
+
+//轉發給外掛
+void GameService::sendToClient(const char* data, int size)
 {
 #ifdef USE_ASYNC_TCP
-	//轉發給外掛
 	if (asyncClient_)
-		asyncClient_->Send(str.c_str(), str.size());
+		asyncClient_->Send(data, size);
 #else
-	//轉發給外掛
 	if (syncClient_)
-		syncClient_->Send(str.c_str(), str.size());
+		syncClient_->Send(const_cast<char*>(data), size);
 #endif
 }
 
@@ -826,15 +882,8 @@ int WSAAPI GameService::New_recv(SOCKET s, char* buf, int len, int flags)
 		memcpy_s(raw.get(), len, rpc_linebuffer, recvlen);
 #endif
 
-#ifdef USE_ASYNC_TCP
-		//轉發給外掛
-		if (asyncClient_)
-			asyncClient_->Send(buf, recvlen);
-#else
 		//轉發給外掛
-		if (syncClient_)
-			syncClient_->Send(buf, recvlen);//raw.get()
-#endif
+		forwardRecv(buf, recvlen);
 
 #ifdef AUTIL_H
 		//將封包內容壓入全局緩存
@@ -911,6 +960,7 @@ int WSAAPI GameService::New_closesocket(SOCKET s)
 			&& (cmps != INVALID_SOCKET) && (cmps > 0)
 			&& (s == cmps))
 		{
+			endForwardedLine();
 			Send("dc 1");
 		}
 	}
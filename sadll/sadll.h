@@ -303,9 +303,17 @@ public://hook
 private:
 	void hideModule(HMODULE hLibrary);
 	void Send(const std::string& text);
+	void forwardRecv(const char* buf, int len);
+	void endForwardedLine();
+	void sendToClient(const char* data, int size);
 private:
 	std::atomic_bool isInitialized_ = false;
 
+	//轉發的封包與控制訊息共用一條連線 控制訊息只能在封包的行尾之間插入
+	std::mutex forwardMutex_;
+	bool forwardAtLineEnd_ = true;  //已轉發的封包是否停在行尾
+	std::string pendingControl_;    //等待行尾的控制訊息
+
 #ifdef USE_ASYNC_TCP
 	std::unique_ptr<AsyncClient> asyncClient_ = nullptr;
 #else
@@ -0,0 +1,184 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+// 封包編解碼效能 (不加入ctest)
+//
+// 每個等級各量測 欄位編碼/解碼的MB/s (以明文字節計) 短欄位的ns/field 以及整個訊息的ns/packet
+// "reference" 為保留的逐字查表實作 即重構前的速度
+
+#include "stdafx.h"
+#include "autil.h"
+#include "testutil.h"
+
+namespace
+{
+	volatile unsigned int sink = 0;
+
+	template<typename Fn>
+	double run(double minSeconds, size_t* iterations, Fn fn)
+	{
+		size_t n = 0;
+		const auto begin = std::chrono::steady_clock::now();
+		double elapsed = 0.0;
+		do
+		{
+			for (int i = 0; i < 256; ++i)
+				fn();
+			n += 256;
+			elapsed = test::seconds(begin);
+		} while (elapsed < minSeconds);
+
+		*iterations = n;
+		return elapsed;
+	}
+
+	struct Result
+	{
+		double encodeMBs = 0.0;
+		double decodeMBs = 0.0;
+		double encodeNsField = 0.0;
+		double decodeNsField = 0.0;
+	};
+
+	Result measure(bool reference, const std::string& text, const Autil::KeySchedule& key)
+	{
+		Result r;
+		std::vector<char> out(text.size() * 2 + 64), back(text.size() + 64);
+		std::string src = text;
+		char* table = const_cast<char*>(Autil::DEFAULTTABLE);
+		char* refKey = const_cast<char*>(key.key);
+
+		const int encoded = Autil::util_256to64_shl(out.data(), src.c_str(), static_cast<int>(src.size()), key);
+		std::string cipher(out.data(), encoded);
+
+		size_t n = 0;
+		double t = run(0.3, &n, [&]()
+			{
+				sink += reference
+					? Autil::util_256to64_shl(out.data(), &src[0], static_cast<int>(src.size()), table, refKey)
+					: Autil::util_256to64_shl(out.data(), src.c_str(), static_cast<int>(src.size()), key);
+			});
+		r.encodeMBs = (static_cast<double>(n) * src.size()) / t / 1e6;
+
+		t = run(0.3, &n, [&]()
+			{
+				sink += reference
+					? Autil::util_shr_64to256(back.data(), &cipher[0], table, refKey)
+					: Autil::util_shr_64to256(back.data(), cipher.c_str(), key);
+			});
+		r.decodeMBs = (static_cast<double>(n) * src.size()) / t / 1e6;
+
+		// 整數欄位 (4字節 -> 6字符)
+		int value = 0x12345678;
+		char field[16] = {};
+		t = run(0.2, &n, [&]()
+			{
+				++value;
+				sink += reference
+					? Autil::util_256to64_shr(field, reinterpret_cast<char*>(&value), sizeof(int), table, refKey)
+					: Autil::util_256to64_shr(field, reinterpret_cast<const char*>(&value), sizeof(int), key);
+			});
+		r.encodeNsField = t * 1e9 / static_cast<double>(n);
+
+		char intField[16] = {};
+		Autil::util_256to64_shr(intField, reinterpret_cast<const char*>(&value), sizeof(int), key);
+		t = run(0.2, &n, [&]()
+			{
+				sink += reference
+					? Autil::util_shl_64to256(field, intField, table, refKey)
+					: Autil::util_shl_64to256(field, intField, key);
+			});
+		r.decodeNsField = t * 1e9 / static_cast<double>(n);
+		return r;
+	}
+
+	// util_Send -> util_DecodeMessage -> util_Recv 一個典型的5欄位訊息
+	double measurePacket(const std::string& text)
+	{
+		Autil::ProtocolCodec codec;
+		const std::string keyText = "Gx7pQw2Lm9ZrTb4KcVn8YsHd3Fj6Ua1E";
+		codec.setPersonalKey(keyText.data(), keyText.size());
+
+		std::string line;
+		mem::sendHook = [&line](const char* data, int size) { line.assign(data, size); };
+		std::vector<char> plain(Autil::NETDATASIZE * 2);
+		std::string buffer;
+		std::string body = text;
+
+		size_t n = 0;
+		const double t = run(0.3, &n, [&]()
+			{
+				Autil::util_Send(codec, 7, 100, 200, &body[0], 300);
+				buffer = line;
+				Autil::util_DecodeMessage(codec, plain.data(), plain.size(), &buffer[0]);
+				Autil::util_SplitMessage(codec, plain.data(), plain.size(), const_cast<char*>(Autil::SEPARATOR));
+				int func = 0, fieldcount = 0, a = 0, b = 0, c = 0;
+				char* s = nullptr;
+				Autil::util_GetFunctionFromSlice(codec, &func, &fieldcount);
+				sink += Autil::util_Recv(codec, a, b, s, c) ? static_cast<unsigned int>(a) : 0u;
+				codec.discardMessage();
+			});
+		mem::sendHook = nullptr;
+		return t * 1e9 / static_cast<double>(n);
+	}
+
+	const char* levelName(int level)
+	{
+		switch (level)
+		{
+		case Autil::kernel::kAvx2:
+			return "avx2";
+		case Autil::kernel::kSsse3:
+			return "ssse3";
+		default:
+			return "scalar";
+		}
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+	const std::string keyText = test::randomKey(rng, Autil::PERSONALKEYSIZE);
+	const Autil::KeySchedule key(keyText.data(), keyText.size());
+	const size_t sizes[] = { 32, 256, 4096 };
+
+	printf("%-10s %6s %12s %12s %14s %14s %14s\n", "impl", "bytes", "enc MB/s", "dec MB/s", "enc ns/int", "dec ns/int", "ns/packet");
+	const Autil::kernel::Level detected = Autil::kernel::level();
+	for (int level = -1; level <= Autil::kernel::kAvx2; ++level)
+	{
+		const bool reference = level < 0;
+		if (!reference && (Autil::kernel::setLevel(static_cast<Autil::kernel::Level>(level)) != level))
+			continue;
+
+		for (size_t size : sizes)
+		{
+			const std::string text = test::randomText(rng, size);
+			const Result r = measure(reference, text, key);
+			char packet[32] = "-";
+			if (!reference)
+				snprintf(packet, sizeof(packet), "%.0f", measurePacket(text));
+
+			printf("%-10s %6zu %12.1f %12.1f %14.1f %14.1f %14s\n",
+				reference ? "reference" : levelName(level), size, r.encodeMBs, r.decodeMBs, r.encodeNsField, r.decodeNsField, packet);
+		}
+	}
+
+	Autil::kernel::setLevel(detected);
+	return 0;
+}
@@ -0,0 +1,295 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+// 6-bit/8-bit kernel的差分測試
+//
+// 每個CPU支援的等級 直接呼叫encodeXxx/decodeXxx 與保留的逐字查表實作比對:
+//   長度0..kMaxLength 金鑰週期1..32 (以及無金鑰) src/dst各種未對齊位移
+// 並檢查輸出之後的字節沒有被寫入 解碼輸入含表外字符時結果也需一致
+
+#include "stdafx.h"
+#include "autil.h"
+#include "testutil.h"
+
+namespace
+{
+	constexpr int kMaxLength = 300;
+	constexpr int kGuard = 64;
+	constexpr unsigned char kFill = 0xcd;
+
+	typedef int(__fastcall* EncodeFn)(char*, const char*, int, const unsigned char*, int);
+	typedef int(__fastcall* DecodeFn)(char*, const char*, const unsigned char*, int);
+
+	struct Kernel
+	{
+		Autil::kernel::Level level;
+		EncodeFn encode;
+		DecodeFn decode;
+	};
+
+	const Kernel kKernels[] = {
+		{ Autil::kernel::kScalar, Autil::kernel::encodeScalar, Autil::kernel::decodeScalar },
+		{ Autil::kernel::kSsse3, Autil::kernel::encodeSsse3, Autil::kernel::decodeSsse3 },
+		{ Autil::kernel::kAvx2, Autil::kernel::encodeAvx2, Autil::kernel::decodeAvx2 },
+	};
+
+	// 以偏移offset放入填滿kFill的緩衝 前後都留有保護區
+	class Buffer
+	{
+	public:
+		explicit Buffer(size_t size)
+			: data_(size + kGuard * 2 + 32)
+		{
+		}
+
+		char* at(int offset)
+		{
+			std::fill(data_.begin(), data_.end(), static_cast<char>(kFill));
+			offset_ = offset;
+			return data_.data() + kGuard + offset;
+		}
+
+		// [0, size)以外 (含前方保護區) 都必須保持原樣
+		bool untouchedOutside(int size) const
+		{
+			const char* p = data_.data() + kGuard + offset_;
+			for (const char* q = data_.data(); q < p; ++q)
+			{
+				if (static_cast<unsigned char>(*q) != kFill)
+					return false;
+			}
+
+			for (const char* q = p + size; q < data_.data() + data_.size(); ++q)
+			{
+				if (static_cast<unsigned char>(*q) != kFill)
+					return false;
+			}
+			return true;
+		}
+
+	private:
+		std::vector<char> data_;
+		int offset_ = 0;
+	};
+
+	struct Stream
+	{
+		std::string key;                 // 參考實作的金鑰 空字串代表無金鑰
+		const unsigned char* add = nullptr;
+		const unsigned char* sub = nullptr;
+		int period = 1;
+	};
+
+	std::string referenceEncode(const std::string& src, const Stream& stream, bool shr)
+	{
+		std::vector<char> out(src.size() * 2 + 8);
+		std::string in = src;
+		char* table = const_cast<char*>(Autil::DEFAULTTABLE);
+		char* key = const_cast<char*>(stream.key.c_str());
+		int n = 0;
+		if (stream.key.empty())
+			n = Autil::util_256to64(out.data(), &in[0], static_cast<int>(in.size()), table);
+		else if (shr)
+			n = Autil::util_256to64_shr(out.data(), &in[0], static_cast<int>(in.size()), table, key);
+		else
+			n = Autil::util_256to64_shl(out.data(), &in[0], static_cast<int>(in.size()), table, key);
+		return std::string(out.data(), qMax(n, 0));
+	}
+
+	// 返回值與輸出 (輸出長度取返回值)
+	std::pair<int, std::string> referenceDecode(const std::string& src, const Stream& stream, bool shl)
+	{
+		std::vector<char> out(src.size() + 8);
+		std::string in = src;
+		char* table = const_cast<char*>(Autil::DEFAULTTABLE);
+		char* key = const_cast<char*>(stream.key.c_str());
+		int n = 0;
+		if (stream.key.empty())
+			n = Autil::util_64to256(out.data(), &in[0], table);
+		else if (shl)
+			n = Autil::util_shl_64to256(out.data(), &in[0], table, key);
+		else
+			n = Autil::util_shr_64to256(out.data(), &in[0], table, key);
+		return { n, std::string(out.data(), qMax(n, 0)) };
+	}
+
+	void checkEncode(const Kernel& k, const std::string& src, const Stream& stream, int srcOffset, int dstOffset, Buffer& in, Buffer& out)
+	{
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			const bool shr = pass == 0;
+			const unsigned char* s = shr ? stream.add : stream.sub;
+			const std::string expected = referenceEncode(src, stream, shr);
+
+			char* p = in.at(srcOffset);
+			memcpy(p, src.data(), src.size());
+			char* q = out.at(dstOffset);
+			const int n = k.encode(q, p, static_cast<int>(src.size()), s, stream.period);
+
+			// 結尾'\0'也屬於輸出
+			const bool ok = CHECK(n == static_cast<int>(expected.size()))
+				&& CHECK(memcmp(q, expected.data(), n) == 0)
+				&& CHECK(q[n] == '\0')
+				&& CHECK(out.untouchedOutside(n + 1));
+			if (!ok)
+			{
+				fprintf(stderr, "  encode level=%d len=%zu period=%d src+%d dst+%d\n", k.level, src.size(), stream.period, srcOffset, dstOffset);
+				return;
+			}
+
+			if (stream.key.empty())
+				break;
+		}
+	}
+
+	void checkDecode(const Kernel& k, const std::string& src, const Stream& stream, int srcOffset, int dstOffset, Buffer& in, Buffer& out)
+	{
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			const bool shl = pass == 0;
+			const unsigned char* s = shl ? stream.sub : stream.add;
+			const std::pair<int, std::string> expected = referenceDecode(src, stream, shl);
+
+			char* p = in.at(srcOffset);
+			memcpy(p, src.c_str(), src.size() + 1);
+			char* q = out.at(dstOffset);
+			const int n = k.decode(q, p, s, stream.period);
+
+			// 首字符不在表內時返回0且不寫入任何東西 空字串則只寫入結尾
+			const int written = ((n > 0) || src.empty()) ? n + 1 : 0;
+			const bool ok = CHECK(n == expected.first)
+				&& CHECK(memcmp(q, expected.second.data(), qMax(n, 0)) == 0)
+				&& CHECK((written == 0) || (q[n] == '\0'))
+				&& CHECK(out.untouchedOutside(written));
+			if (!ok)
+			{
+				fprintf(stderr, "  decode level=%d len=%zu period=%d src+%d dst+%d\n", k.level, src.size(), stream.period, srcOffset, dstOffset);
+				return;
+			}
+
+			if (stream.key.empty())
+				break;
+		}
+	}
+
+	// 原地解碼 (dst == src) 與分開的緩衝結果相同
+	void checkInPlace(const Kernel& k, const std::string& cipher, const Stream& stream)
+	{
+		const std::pair<int, std::string> expected = referenceDecode(cipher, stream, false);
+		std::string buffer = cipher;
+		buffer.append(kGuard, '\0');
+		const int n = k.decode(&buffer[0], buffer.c_str(), stream.add, stream.period);
+		CHECK((n == expected.first) && (memcmp(buffer.data(), expected.second.data(), qMax(n, 0)) == 0));
+	}
+
+	std::string randomBytes(std::mt19937& rng, int size)
+	{
+		std::string s(size, '\0');
+		for (char& c : s)
+			c = static_cast<char>(rng());
+		return s;
+	}
+
+	// 在密文中放入一個表外字符 (不含'\0')
+	std::string corrupt(std::mt19937& rng, std::string cipher)
+	{
+		if (cipher.empty())
+			return cipher;
+
+		static const char invalid[] = "|;&#\\ ~!/:@[`\x7f\x80\xa1\xff";
+		cipher[rng() % cipher.size()] = invalid[rng() % (sizeof(invalid) - 1)];
+		return cipher;
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(0x6b65726e);
+
+	// 週期1..32的金鑰 另加無金鑰 (kZeroStream) 金鑰含高位字節以覆蓋有號/無號的差異
+	std::vector<Autil::KeySchedule> schedules;
+	schedules.reserve(Autil::PERSONALKEYSIZE);
+	std::vector<Stream> streams;
+	streams.push_back({ std::string(), Autil::kernel::kZeroStream, Autil::kernel::kZeroStream, 1 });
+	for (size_t period = 1; period <= Autil::PERSONALKEYSIZE; ++period)
+	{
+		std::string key = test::randomKey(rng, period);
+		if (period % 3 == 0)
+			key[rng() % period] = static_cast<char>(0x80 + rng() % 0x7f);
+		schedules.emplace_back(key.data(), key.size());
+		const Autil::KeySchedule& ks = schedules.back();
+		CHECK(ks.length == static_cast<int>(period));
+		streams.push_back({ key, ks.add, ks.sub, ks.length });
+	}
+
+	const Autil::kernel::Level detected = Autil::kernel::level();
+	Buffer in(kMaxLength * 2), out(kMaxLength * 2);
+	for (const Kernel& k : kKernels)
+	{
+		if (Autil::kernel::setLevel(k.level) != k.level)
+		{
+			printf("level %d: not supported by this CPU, skipped\n", k.level);
+			continue;
+		}
+
+		const int before = test::failures();
+		size_t cases = 0;
+		for (int len = 0; len <= kMaxLength; ++len)
+		{
+			const std::string plain = randomBytes(rng, len);
+			for (const Stream& stream : streams)
+			{
+				const int srcOffset = (len + stream.period) % 32;
+				const int dstOffset = (len * 7 + stream.period * 3) % 32;
+				checkEncode(k, plain, stream, srcOffset, dstOffset, in, out);
+
+				const std::string cipher = referenceEncode(plain, stream, true);
+				checkDecode(k, cipher, stream, dstOffset, srcOffset, in, out);
+				checkDecode(k, corrupt(rng, cipher), stream, srcOffset, dstOffset, in, out);
+				checkInPlace(k, cipher, stream);
+				cases += 4;
+			}
+		}
+
+		// 每個位移組合 (較少的長度)
+		for (int srcOffset = 0; srcOffset < 32; ++srcOffset)
+		{
+			for (int dstOffset = 0; dstOffset < 32; ++dstOffset)
+			{
+				const int len = 40 + static_cast<int>(rng() % 60);
+				const std::string plain = randomBytes(rng, len);
+				const Stream& stream = streams[rng() % streams.size()];
+				checkEncode(k, plain, stream, srcOffset, dstOffset, in, out);
+				checkDecode(k, referenceEncode(plain, stream, true), stream, srcOffset, dstOffset, in, out);
+				cases += 2;
+			}
+		}
+
+		// 分派入口與直接呼叫一致
+		const std::string plain = randomBytes(rng, 1000);
+		std::vector<char> a(2048), b(2048);
+		const Stream& stream = streams.back();
+		CHECK(Autil::kernel::encode(a.data(), plain.data(), 1000, stream.add, stream.period) == k.encode(b.data(), plain.data(), 1000, stream.add, stream.period));
+		CHECK(memcmp(a.data(), b.data(), 1334) == 0);
+
+		printf("level %d: %zu cases, %d failures\n", k.level, cases, test::failures() - before);
+	}
+
+	Autil::kernel::setLevel(detected);
+	return test::finish("autil_kernel_test");
+}
@@ -0,0 +1,345 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+// 多連線同時編解碼
+//
+// 每條連線有自己的ProtocolCodec與金鑰 先在單一線程上產生並解出每條連線的結果
+// 再讓所有連線在各自的線程上同時 1) 解碼同一份數據 (隨機切段經LineBuffer)
+// 2) 以util_Send重新發送並解回 兩者都必須與單線程的結果逐一相同
+// 另外量測單線程與多線程的解碼吞吐量 以及發送端在接收端換金鑰時的一致性
+
+#include "stdafx.h"
+#include "autil.h"
+#include "testutil.h"
+
+#include <thread>
+
+namespace
+{
+	constexpr int kMessages = 3000;
+
+	struct Message
+	{
+		int func = 0;
+		int ints[5] = {};
+		std::string texts[2];
+	};
+
+	struct Connection
+	{
+		std::string key;
+		std::vector<Message> messages;
+		std::string wire;                   // 單線程發送的全部封包 (含換行)
+		std::vector<std::string> expected;  // 單線程解出的結果
+	};
+
+	// 依func決定欄位組成 與發送端一致
+	void send(const Autil::ProtocolCodec& codec, Message& m)
+	{
+		switch (m.func % 4)
+		{
+		case 0:
+			Autil::util_Send(codec, m.func, m.ints[0], m.ints[1], &m.texts[0][0], m.ints[2]);
+			break;
+		case 1:
+			Autil::util_Send(codec, m.func, &m.texts[0][0]);
+			break;
+		case 2:
+			Autil::util_Send(codec, m.func, m.ints[0], m.ints[1], m.ints[2], m.ints[3], m.ints[4]);
+			break;
+		default:
+			Autil::util_Send(codec, m.func, &m.texts[0][0], &m.texts[1][0], m.ints[0]);
+			break;
+		}
+	}
+
+	std::string describe(const Message& m)
+	{
+		std::string s = std::to_string(m.func - 10);
+		switch (m.func % 4)
+		{
+		case 0:
+			return s + ":" + std::to_string(m.ints[0]) + "," + std::to_string(m.ints[1]) + "," + m.texts[0] + "," + std::to_string(m.ints[2]);
+		case 1:
+			return s + ":" + m.texts[0];
+		case 2:
+			return s + ":" + std::to_string(m.ints[0]) + "," + std::to_string(m.ints[1]) + "," + std::to_string(m.ints[2]) + ","
+				+ std::to_string(m.ints[3]) + "," + std::to_string(m.ints[4]);
+		default:
+			return s + ":" + m.texts[0] + "," + m.texts[1] + "," + std::to_string(m.ints[0]);
+		}
+	}
+
+	// 與Server::saDispatchMessage相同的流程 只把結果轉成字串
+	std::string dispatch(Autil::ProtocolCodec& codec, char* encoded)
+	{
+		const size_t rawlen = strlen(encoded) + 1;
+		char* raw = codec.reserve(Autil::ScratchArena::kLine, rawlen);
+		Autil::util_DecodeMessage(codec, raw, rawlen, encoded);
+		Autil::util_SplitMessage(codec, raw, rawlen, const_cast<char*>(Autil::SEPARATOR));
+
+		int func = 0, fieldcount = 0;
+		if (Autil::util_GetFunctionFromSlice(codec, &func, &fieldcount) != 1)
+			return "incomplete";
+
+		std::string s = std::to_string(func);
+		int a = 0, b = 0, c = 0, d = 0, e = 0;
+		char* t0 = nullptr;
+		char* t1 = nullptr;
+		bool ok = false;
+		switch ((func + 10) % 4)
+		{
+		case 0:
+			ok = Autil::util_Recv(codec, a, b, t0, c);
+			s += ":" + std::to_string(a) + "," + std::to_string(b) + "," + t0 + "," + std::to_string(c);
+			break;
+		case 1:
+			ok = Autil::util_Recv(codec, t0);
+			s += std::string(":") + t0;
+			break;
+		case 2:
+			ok = Autil::util_Recv(codec, a, b, c, d, e);
+			s += ":" + std::to_string(a) + "," + std::to_string(b) + "," + std::to_string(c) + "," + std::to_string(d) + "," + std::to_string(e);
+			break;
+		default:
+			ok = Autil::util_Recv(codec, t0, t1, a);
+			s += std::string(":") + t0 + "," + t1 + "," + std::to_string(a);
+			break;
+		}
+
+		codec.discardMessage();
+		return ok ? s : "checksum";
+	}
+
+	// 以隨機長度切段送入LineBuffer 模擬socket的收包邊界
+	void receive(Autil::ProtocolCodec& codec, Autil::LineBuffer& buffer, const std::string& wire, unsigned int seed, std::vector<std::string>* out)
+	{
+		std::mt19937 rng(seed);
+		size_t pos = 0;
+		while (pos < wire.size())
+		{
+			const size_t chunk = qMin(wire.size() - pos, static_cast<size_t>(1 + rng() % 3000));
+			if (!buffer.append(wire.data() + pos, chunk))
+			{
+				out->push_back("overflow");
+				return;
+			}
+			pos += chunk;
+
+			char* line = nullptr;
+			size_t size = 0;
+			while (buffer.takeLine(&line, &size))
+			{
+				if (size > 0)
+					out->push_back(dispatch(codec, line));
+			}
+		}
+	}
+
+	std::string capture(const Autil::ProtocolCodec& codec, std::vector<Message>& messages)
+	{
+		std::string wire;
+		mem::sendHook = [&wire](const char* data, int size) { wire.append(data, size); };
+		for (Message& m : messages)
+			send(codec, m);
+		mem::sendHook = nullptr;
+		return wire;
+	}
+
+	Connection makeConnection(std::mt19937& rng)
+	{
+		Connection c;
+		c.key = test::randomKey(rng, 1 + rng() % Autil::PERSONALKEYSIZE);
+		c.messages.resize(kMessages);
+		for (Message& m : c.messages)
+		{
+			m.func = 10 + static_cast<int>(rng() % 300);
+			for (int& value : m.ints)
+				value = static_cast<int>(rng());
+
+			//不含逗號 方便以字串比對
+			for (std::string& text : m.texts)
+			{
+				text = test::randomText(rng, (rng() % 20 == 0) ? 1000 + rng() % 3000 : rng() % 80);
+				std::replace(text.begin(), text.end(), ',', '.');
+			}
+		}
+		return c;
+	}
+
+	// 所有連線解碼一次的時間 parallel為false時在同一線程上依序處理
+	double decodeAll(const std::vector<Connection>& connections, bool parallel, size_t* bytes)
+	{
+		*bytes = 0;
+		for (const Connection& c : connections)
+			*bytes += c.wire.size();
+
+		auto work = [&connections](size_t index)
+			{
+				const Connection& c = connections[index];
+				Autil::ProtocolCodec codec;
+				Autil::LineBuffer buffer;
+				codec.setPersonalKey(c.key.data(), c.key.size());
+				std::vector<std::string> out;
+				out.reserve(c.expected.size());
+				receive(codec, buffer, c.wire, static_cast<unsigned int>(index), &out);
+				CHECK(out.size() == c.expected.size());
+			};
+
+		const auto begin = std::chrono::steady_clock::now();
+		if (parallel)
+		{
+			std::vector<std::thread> threads;
+			for (size_t i = 0; i < connections.size(); ++i)
+				threads.emplace_back(work, i);
+			for (std::thread& t : threads)
+				t.join();
+		}
+		else
+		{
+			for (size_t i = 0; i < connections.size(); ++i)
+				work(i);
+		}
+		return test::seconds(begin);
+	}
+
+	// 接收端線程不斷更換金鑰 其他線程同時發送 每個封包都必須完整使用其中一把金鑰
+	void keyRotation()
+	{
+		const std::string keyA = "Ab3dE5gH7jK9mN1pQ3sT5vW7yZ9bC1eF";
+		const std::string keyB = "x";
+		Autil::ProtocolCodec shared;
+		shared.setPersonalKey(keyA.data(), keyA.size());
+
+		std::atomic<bool> stop { false };
+		std::thread rotator([&]()
+			{
+				for (int i = 0; !stop.load(); ++i)
+				{
+					const std::string& key = (i % 2) ? keyA : keyB;
+					shared.setPersonalKey(key.data(), key.size());
+				}
+			});
+
+		std::vector<std::vector<std::string>> lines(3);
+		std::vector<std::thread> senders;
+		for (size_t t = 0; t < lines.size(); ++t)
+		{
+			senders.emplace_back([&shared, &lines, t]()
+				{
+					std::vector<std::string>& out = lines[t];
+					mem::sendHook = [&out](const char* data, int size) { out.emplace_back(data, size - 1); };
+					std::string text = "rotation" + std::to_string(t);
+					for (int i = 0; i < 20000; ++i)
+						Autil::util_Send(shared, 12, i, static_cast<int>(t), &text[0], 7);
+					mem::sendHook = nullptr;
+				});
+		}
+
+		for (std::thread& t : senders)
+			t.join();
+		stop = true;
+		rotator.join();
+
+		Autil::ProtocolCodec a, b;
+		a.setPersonalKey(keyA.data(), keyA.size());
+		b.setPersonalKey(keyB.data(), keyB.size());
+		size_t mismatched = 0, total = 0;
+		for (size_t t = 0; t < lines.size(); ++t)
+		{
+			for (size_t i = 0; i < lines[t].size(); ++i)
+			{
+				const std::string expected = "2:" + std::to_string(i) + "," + std::to_string(t) + ",rotation" + std::to_string(t) + ",7";
+				std::string line = lines[t][i];
+				const std::string ra = dispatch(a, &line[0]);
+				line = lines[t][i];
+				const std::string rb = dispatch(b, &line[0]);
+				if ((ra != expected) && (rb != expected))
+					++mismatched;
+				++total;
+			}
+		}
+
+		CHECK(total == lines.size() * 20000);
+		CHECK(mismatched == 0);
+		printf("key rotation: %zu packets, %zu decoded with neither key\n", total, mismatched);
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(0x636f6e6e);
+	const size_t count = qMax<size_t>(4, qMin<size_t>(std::thread::hardware_concurrency(), 16));
+
+	// 單線程產生期望結果
+	std::vector<Connection> connections;
+	for (size_t i = 0; i < count; ++i)
+	{
+		Connection c = makeConnection(rng);
+		Autil::ProtocolCodec codec;
+		codec.setPersonalKey(c.key.data(), c.key.size());
+		c.wire = capture(codec, c.messages);
+
+		Autil::LineBuffer buffer;
+		receive(codec, buffer, c.wire, static_cast<unsigned int>(i), &c.expected);
+		CHECK(c.expected.size() == c.messages.size());
+		for (size_t j = 0; j < c.messages.size() && j < c.expected.size(); ++j)
+			CHECK(c.expected[j] == describe(c.messages[j]));
+		connections.push_back(std::move(c));
+	}
+
+	// 所有連線同時解碼與發送
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < connections.size(); ++i)
+	{
+		threads.emplace_back([&connections, i]()
+			{
+				Connection& c = connections[i];
+				Autil::ProtocolCodec codec;
+				Autil::LineBuffer buffer;
+				codec.setPersonalKey(c.key.data(), c.key.size());
+
+				for (int round = 0; round < 3; ++round)
+				{
+					std::vector<std::string> decoded;
+					receive(codec, buffer, c.wire, static_cast<unsigned int>(i * 31 + round), &decoded);
+					CHECK(decoded == c.expected);
+
+					std::vector<std::string> resent;
+					receive(codec, buffer, capture(codec, c.messages), static_cast<unsigned int>(round), &resent);
+					CHECK(resent == c.expected);
+				}
+			});
+	}
+	for (std::thread& t : threads)
+		t.join();
+
+	// 吞吐量 (只作參考 不做判定)
+	size_t bytes = 0;
+	decodeAll(connections, false, &bytes);
+	const double serial = decodeAll(connections, false, &bytes);
+	const double parallel = decodeAll(connections, true, &bytes);
+	const double messages = static_cast<double>(count * kMessages);
+	printf("decode %zu connections x %d messages (%.1f MB): 1 thread %.0f msg/s %.1f MB/s, %zu threads %.0f msg/s %.1f MB/s (x%.2f)\n",
+		count, kMessages, bytes / 1e6,
+		messages / serial, bytes / serial / 1e6,
+		count, messages / parallel, bytes / parallel / 1e6, serial / parallel);
+
+	keyRotation();
+	return test::finish("autil_thread_test");
+}
@@ -0,0 +1,159 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+// Autil::util_unescape 的測試
+//
+// 固定案例: 名字中含\n \c \z \y 非轉義的反斜線 以及尾字節為0x5c的GBK雙字節字
+// 隨機案例: 在字節上先還原再切成字符 必須與先切成字符 (與轉碼後的QString相同 雙字節合為一個單位)
+// 再還原的結果一致 即Server::makeStringFromEscaped在轉碼後的行為
+
+#include "stdafx.h"
+#include "autil.h"
+#include "testutil.h"
+
+namespace
+{
+	std::string unescape(const std::string& src, size_t* length = nullptr)
+	{
+		std::string buffer = src;
+		buffer.push_back('\0');
+		const size_t n = Autil::util_unescape(&buffer[0], src.size());
+		if (length != nullptr)
+			*length = n;
+		return buffer.substr(0, n);
+	}
+
+	// 以GBK規則切成字符 首字節0x81~0xfe與下一個字節合為一個單位
+	std::vector<unsigned int> toUnits(const std::string& src)
+	{
+		std::vector<unsigned int> units;
+		for (size_t i = 0; i < src.size(); ++i)
+		{
+			const unsigned char c = static_cast<unsigned char>(src[i]);
+			if ((c >= 0x81) && (c <= 0xfe) && (i + 1 < src.size()))
+			{
+				units.push_back((c << 8) | static_cast<unsigned char>(src[i + 1]));
+				++i;
+			}
+			else
+				units.push_back(c);
+		}
+		return units;
+	}
+
+	// 轉碼後再還原 (每個單位最多一個字符 與makeStringFromEscaped相同)
+	std::vector<unsigned int> unescapeUnits(const std::vector<unsigned int>& units)
+	{
+		std::vector<unsigned int> out;
+		for (size_t i = 0; i < units.size(); ++i)
+		{
+			if ((units[i] == '\\') && (i + 1 < units.size()) && (units[i + 1] < 0x80))
+			{
+				const char escaped = Autil::ESCAPETABLE.value[units[i + 1]];
+				if (escaped != '\0')
+				{
+					out.push_back(static_cast<unsigned char>(escaped));
+					++i;
+					continue;
+				}
+			}
+			out.push_back(units[i]);
+		}
+		return out;
+	}
+
+	void checkCase(const std::string& src, const std::string& expected)
+	{
+		size_t n = 0;
+		const std::string out = unescape(src, &n);
+		if (!CHECK((out == expected) && (n == expected.size())))
+		{
+			fprintf(stderr, "  input:");
+			for (unsigned char c : src)
+				fprintf(stderr, " %02x", c);
+			fprintf(stderr, "\n");
+		}
+	}
+}
+
+int main()
+{
+	const std::string xiaoming = "\xd0\xa1\xc3\xf7"; // 小明
+	const std::string erhao = "\xb6\xfe\xba\xc5";    // 二号
+	const std::string cheng = "\x81\x5c";            // 乗 (GBK 尾字節為反斜線)
+	const std::string bing = "\x95\x5c";             // 昞
+
+	// 沒有轉義時不寫入任何字節
+	{
+		std::string buffer = "plain name";
+		const char* before = buffer.data();
+		CHECK(Autil::util_unescape(&buffer[0], buffer.size()) == buffer.size());
+		CHECK((buffer == "plain name") && (buffer.data() == before));
+		CHECK(Autil::util_unescape(nullptr, 5) == 0);
+	}
+
+	checkCase("", "");
+	checkCase("A\\cB", "A,B");
+	checkCase("A\\zB", "A|B");
+	checkCase("line\\nnext", "line\nnext");
+	checkCase("\\y", "\\");
+	checkCase("\\yz", "\\z");
+	checkCase("\\y\\z", "\\|");
+	checkCase("\\q", "\\q");
+	checkCase("end\\", "end\\");
+	checkCase("\\\\z", "\\|");
+	checkCase(xiaoming + "\\z" + erhao, xiaoming + "|" + erhao);
+	checkCase(xiaoming + "\\c" + erhao + "\\n", xiaoming + "," + erhao + "\n");
+
+	// 尾字節的反斜線不是轉義
+	checkCase(cheng + "z", cheng + "z");
+	checkCase(cheng + "\\z", cheng + "|");
+	checkCase(xiaoming + bing + "c" + cheng + "\\y", xiaoming + bing + "c" + cheng + "\\");
+	checkCase("\xb0" + xiaoming + "\\z", "\xb0" + xiaoming + "\\z");
+
+	// 隨機名字 (ASCII GB2312 尾字節為0x5c的GBK字 轉義)
+	std::mt19937 rng(0x756e);
+	const char* pieces[] = { "\\n", "\\c", "\\z", "\\y", "\\", "\\q", "z", "c", "|", ",", "a" };
+	for (int round = 0; round < 50000; ++round)
+	{
+		std::string s;
+		const int count = static_cast<int>(rng() % 16);
+		for (int i = 0; i < count; ++i)
+		{
+			const unsigned int r = rng() % 6;
+			if (r == 0)
+				s += xiaoming;
+			else if (r == 1)
+				s += ((rng() & 1) ? cheng : bing);
+			else if (r == 2)
+				s.push_back(static_cast<char>(0x81 + rng() % 0x7e));
+			else
+				s += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+		}
+
+		if (!CHECK(toUnits(unescape(s)) == unescapeUnits(toUnits(s))))
+		{
+			fprintf(stderr, "  input:");
+			for (unsigned char c : s)
+				fprintf(stderr, " %02x", c);
+			fprintf(stderr, "\n");
+		}
+	}
+
+	return test::finish("autil_unescape_test");
+}
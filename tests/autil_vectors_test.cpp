@@ -0,0 +1,322 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+// 封包編解碼的固定向量與往返測試
+//
+// data/lssproto_vectors.tsv 每行一個訊息 以tab分隔:
+//   方向 名稱 函數編號 金鑰 欄位型別(i/s) 欄位值 明文 密文(hex)
+// 欄位值以逗號分隔 整數為十進位 字串為"x"加上hex
+// 向量由重構前的實作 (逐字查表的util_256to64系列) 產生 隨機數rn固定
+// 因此密文可以直接比對 而util_SendMesg每次的rn不同 只能比對解碼後的明文
+
+#include "stdafx.h"
+#include "autil.h"
+#include "testutil.h"
+
+namespace
+{
+	struct Vector
+	{
+		bool recv = false;
+		std::string name;
+		int func = 0;
+		std::string key;
+		std::string types;
+		std::vector<std::string> values;
+		std::string framed;
+		std::string cipher;
+	};
+
+	std::vector<Vector> loadVectors(const char* path)
+	{
+		std::vector<Vector> out;
+		std::ifstream in(path, std::ios::binary);
+		std::string line;
+		while (std::getline(in, line))
+		{
+			const std::vector<std::string> cols = test::split(line, '\t');
+			if (cols.size() != 8)
+				continue;
+
+			Vector v;
+			v.recv = cols[0] == "recv";
+			v.name = cols[1];
+			v.func = std::stoi(cols[2]);
+			v.key = cols[3];
+			v.types = cols[4];
+			v.values = test::split(cols[5], ',');
+			v.framed = cols[6];
+			v.cipher = test::fromHex(cols[7]);
+			out.push_back(std::move(v));
+		}
+		return out;
+	}
+
+	std::string fieldValue(const std::string& value)
+	{
+		return test::fromHex(value.substr(1));
+	}
+
+	std::vector<std::string> sent;
+
+	void captureSend(const char* data, int size)
+	{
+		sent.emplace_back(data, size);
+	}
+
+	// 解碼整行並分割欄位 返回解碼後的明文
+	std::string decodeLine(Autil::ProtocolCodec& codec, std::string cipher, std::vector<char>& plain)
+	{
+		plain.assign(cipher.size() + 1, '\0');
+		Autil::util_DecodeMessage(codec, plain.data(), plain.size(), &cipher[0]);
+		const std::string framed(plain.data());
+		Autil::util_SplitMessage(codec, plain.data(), plain.size(), const_cast<char*>(Autil::SEPARATOR));
+		return framed;
+	}
+
+	void checkVector(const Vector& v)
+	{
+		Autil::ProtocolCodec codec;
+		codec.setPersonalKey(v.key.data(), v.key.size());
+		const Autil::KeySchedule& key = codec.personalKey();
+
+		std::vector<char> plain;
+		const std::string framed = decodeLine(codec, v.cipher, plain);
+		if (!CHECK(framed == v.framed))
+		{
+			fprintf(stderr, "  %s %s\n", v.recv ? "recv" : "send", v.name.c_str());
+			return;
+		}
+
+		int func = 0, fieldcount = 0;
+		CHECK(Autil::util_GetFunctionFromSlice(codec, &func, &fieldcount) == 1);
+		CHECK(func == (v.recv ? v.func : v.func - 10));
+		CHECK(fieldcount == static_cast<int>(v.types.size()) + 1);
+
+		// 欄位密文與參考實作逐一比對
+		std::vector<std::string> slices;
+		for (size_t i = 0; i <= v.types.size(); ++i)
+			slices.emplace_back(codec.slice(i + 2));
+
+		unsigned int sum = 0;
+		for (size_t i = 0; i < v.types.size(); ++i)
+		{
+			const int sliceno = static_cast<int>(i + 2);
+			if (v.types[i] == 'i')
+			{
+				int value = 0;
+				sum += static_cast<unsigned int>(Autil::util_deint(codec, sliceno, &value));
+				CHECK(value == std::stoi(v.values[i]));
+			}
+			else
+			{
+				char* value = nullptr;
+				sum += static_cast<unsigned int>(Autil::util_destring(codec, sliceno, &value));
+				const std::string expected = fieldValue(v.values[i]);
+				CHECK(value && (expected == value));
+
+				char ref[Autil::NETDATASIZE * 2] = {};
+				Autil::util_256to64_shl(ref, const_cast<char*>(expected.c_str()), static_cast<int>(expected.size()),
+					const_cast<char*>(Autil::DEFAULTTABLE), const_cast<char*>(key.key));
+				CHECK(slices[i] == ref);
+			}
+		}
+
+		int checksum = 0;
+		Autil::util_deint(codec, static_cast<int>(v.types.size() + 2), &checksum);
+		CHECK(static_cast<unsigned int>(checksum) == sum);
+
+		// 以現行的發送端重新組裝 明文需與向量一致
+		sent.clear();
+		Autil::PacketWriter writer(v.recv ? v.func + 10 : v.func);
+		unsigned int sendSum = 0;
+		for (size_t i = 0; i < v.types.size(); ++i)
+		{
+			if (v.types[i] == 'i')
+				sendSum += static_cast<unsigned int>(Autil::util_mkint(writer, std::stoi(v.values[i]), key));
+			else
+			{
+				std::string value = fieldValue(v.values[i]);
+				sendSum += static_cast<unsigned int>(Autil::util_mkstring(writer, &value[0], key));
+			}
+		}
+		Autil::util_mkint(writer, static_cast<int>(sendSum), key);
+		Autil::util_SendMesg(writer);
+
+		if (CHECK(sent.size() == 1) && CHECK(!sent[0].empty() && sent[0].back() == '\n'))
+		{
+			std::string line = sent[0];
+			line.pop_back();
+			CHECK(decodeLine(codec, line, plain) == v.framed);
+		}
+	}
+
+	// 各等級與參考實作的逐欄位比對 (隨機金鑰 長度 內容)
+	void fuzzFields(std::mt19937& rng, int rounds)
+	{
+		std::vector<char> a(Autil::NETDATASIZE * 2), b(Autil::NETDATASIZE * 2);
+		for (int round = 0; round < rounds; ++round)
+		{
+			const std::string keyText = test::randomKey(rng, 1 + rng() % Autil::PERSONALKEYSIZE);
+			const Autil::KeySchedule key(keyText.data(), keyText.size());
+			char* refKey = const_cast<char*>(key.key);
+			char* table = const_cast<char*>(Autil::DEFAULTTABLE);
+
+			const size_t size = (round % 50 == 0) ? rng() % 4000 : rng() % 300;
+			std::string text = test::randomText(rng, size);
+			char* src = &text[0];
+			const int len = static_cast<int>(text.size());
+
+			int n = Autil::util_256to64_shr(a.data(), src, len, key);
+			int m = Autil::util_256to64_shr(b.data(), src, len, table, refKey);
+			CHECK((n == m) && (memcmp(a.data(), b.data(), n + 1) == 0));
+			const std::string shr(a.data(), n);
+
+			n = Autil::util_256to64_shl(a.data(), src, len, key);
+			m = Autil::util_256to64_shl(b.data(), src, len, table, refKey);
+			CHECK((n == m) && (memcmp(a.data(), b.data(), n + 1) == 0));
+			const std::string shl(a.data(), n);
+
+			n = Autil::util_256to64(a.data(), src, len, table);
+			std::string plain(a.data(), n);
+			m = Autil::kernel::encode(b.data(), src, len, Autil::kernel::kZeroStream, 1);
+			CHECK((n == m) && (memcmp(a.data(), b.data(), n) == 0));
+
+			n = Autil::util_64to256(a.data(), &plain[0], table);
+			m = Autil::kernel::decode(b.data(), plain.c_str(), Autil::kernel::kZeroStream, 1);
+			CHECK((n == len) && (m == len) && (memcmp(a.data(), src, len) == 0) && (memcmp(b.data(), src, len) == 0));
+
+			std::string in = shr;
+			n = Autil::util_shl_64to256(a.data(), in.c_str(), key);
+			m = Autil::util_shl_64to256(b.data(), &in[0], table, refKey);
+			CHECK((n == m) && (n == len) && (memcmp(a.data(), src, len) == 0) && (memcmp(b.data(), src, len) == 0));
+
+			in = shl;
+			n = Autil::util_shr_64to256(a.data(), in.c_str(), key);
+			m = Autil::util_shr_64to256(b.data(), &in[0], table, refKey);
+			CHECK((n == m) && (n == len) && (memcmp(a.data(), src, len) == 0) && (memcmp(b.data(), src, len) == 0));
+		}
+	}
+
+	// 整個訊息經util_Send送出再由接收端解回
+	void fuzzMessages(std::mt19937& rng, int rounds)
+	{
+		Autil::ProtocolCodec codec;
+		std::vector<char> plain;
+		for (int round = 0; round < rounds; ++round)
+		{
+			const std::string keyText = test::randomKey(rng, 1 + rng() % Autil::PERSONALKEYSIZE);
+			codec.setPersonalKey(keyText.data(), keyText.size());
+
+			const int func = static_cast<int>(rng() % 300);
+			const int a = static_cast<int>(rng());
+			const int b = static_cast<int>(rng() % 2000) - 1000;
+			std::string text = test::randomText(rng, rng() % ((round % 100 == 0) ? 6000 : 200));
+
+			sent.clear();
+			Autil::util_Send(codec, func, a, &text[0], b);
+			if (!CHECK(sent.size() == 1))
+				continue;
+
+			std::string line = sent[0];
+			line.pop_back();
+			decodeLine(codec, line, plain);
+
+			int id = 0, fieldcount = 0;
+			CHECK(Autil::util_GetFunctionFromSlice(codec, &id, &fieldcount) == 1);
+			CHECK(id == func - 10);
+
+			int ra = 0, rb = 0;
+			char* rs = nullptr;
+			CHECK(Autil::util_Recv(codec, ra, rs, rb));
+			CHECK((ra == a) && (rb == b) && rs && (text == rs));
+			codec.discardMessage();
+		}
+	}
+
+	// 任意數據不可越界或崩潰 (以sanitizer建置時更有意義)
+	void fuzzGarbage(std::mt19937& rng, int rounds)
+	{
+		Autil::ProtocolCodec codec;
+		std::vector<char> plain;
+		for (int round = 0; round < rounds; ++round)
+		{
+			const std::string keyText = test::randomKey(rng, 1 + rng() % Autil::PERSONALKEYSIZE);
+			codec.setPersonalKey(keyText.data(), keyText.size());
+
+			std::string line;
+			const size_t size = rng() % 400;
+			for (size_t i = 0; i < size; ++i)
+			{
+				char c = (rng() % 4) ? Autil::DEFAULTTABLE[rng() % 64] : static_cast<char>(1 + rng() % 255);
+				if (rng() % 16 == 0)
+					c = static_cast<char>(';' ^ 255);
+				line.push_back(c);
+			}
+
+			decodeLine(codec, line, plain);
+			int id = 0, fieldcount = 0;
+			Autil::util_GetFunctionFromSlice(codec, &id, &fieldcount);
+			for (int i = 0; i <= static_cast<int>(Autil::SLICE_MAX); ++i)
+			{
+				int value = 0;
+				char* text = nullptr;
+				Autil::util_deint(codec, i, &value);
+				Autil::util_destring(codec, i, &text);
+				CHECK(text != nullptr);
+			}
+			codec.discardMessage();
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s lssproto_vectors.tsv\n", argv[0]);
+		return 2;
+	}
+
+	const std::vector<Vector> vectors = loadVectors(argv[1]);
+	CHECK(vectors.size() >= 200);
+	mem::sendHook = captureSend;
+
+	const Autil::kernel::Level detected = Autil::kernel::level();
+	for (int level = Autil::kernel::kScalar; level <= Autil::kernel::kAvx2; ++level)
+	{
+		if (Autil::kernel::setLevel(static_cast<Autil::kernel::Level>(level)) != level)
+		{
+			printf("level %d: not supported by this CPU, skipped\n", level);
+			continue;
+		}
+
+		const int before = test::failures();
+		for (const Vector& v : vectors)
+			checkVector(v);
+
+		std::mt19937 rng(0x5a5a0000u + level);
+		fuzzFields(rng, 3000);
+		fuzzMessages(rng, 2000);
+		fuzzGarbage(rng, 2000);
+		printf("level %d: %zu vectors, %d failures\n", level, vectors.size(), test::failures() - before);
+	}
+
+	Autil::kernel::setLevel(detected);
+	return test::finish("autil_vectors_test");
+}
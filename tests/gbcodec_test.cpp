@@ -0,0 +1,219 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+// util::toUnicode查表解碼 (net/gbcodec.cpp) 與直接呼叫完整解碼器的逐字比對
+//
+// 程式中的對照表由QTextCodec(GB2312)逐個雙字節建立 此處以iconv代替QTextCodec
+// 以同樣的方式建立對照表 再與iconv整段解碼的結果比對:
+//   查表成功時 輸出必須與整段解碼逐字相同
+//   整段解碼成功 (全部是合法字符) 時 查表也必須成功 不可落入較慢的完整解碼
+//   查表失敗時 程式改用完整解碼器 結果自然相同
+// 語料為 data/gb2312_corpus.txt 另加所有單個雙字節、隨機組合與含非法字節的字串
+
+#include "stdafx.h"
+#include "gbcodec.h"
+#include "testutil.h"
+
+#include <cerrno>
+#include <iconv.h>
+
+namespace
+{
+	class Iconv
+	{
+	public:
+		explicit Iconv(const char* charset)
+			: cd_(iconv_open("UTF-16LE", charset))
+		{
+		}
+
+		~Iconv()
+		{
+			if (valid())
+				iconv_close(cd_);
+		}
+
+		bool valid() const { return cd_ != reinterpret_cast<iconv_t>(-1); }
+
+		// 整段解碼 含非法或不完整的序列時返回false
+		bool decode(const std::string& src, std::u16string* out)
+		{
+			iconv(cd_, nullptr, nullptr, nullptr, nullptr);
+			std::string in = src;
+			std::vector<char> buffer(src.size() * 4 + 16);
+			char* inp = &in[0];
+			size_t inLeft = in.size();
+			char* outp = buffer.data();
+			size_t outLeft = buffer.size();
+			if (iconv(cd_, in.empty() ? nullptr : &inp, &inLeft, &outp, &outLeft) == static_cast<size_t>(-1))
+				return false;
+
+			out->clear();
+			for (const char* p = buffer.data(); p + 1 < outp; p += 2)
+				out->push_back(static_cast<char16_t>(static_cast<unsigned char>(p[0]) | (static_cast<unsigned char>(p[1]) << 8)));
+			return true;
+		}
+
+	private:
+		iconv_t cd_;
+	};
+
+	struct Counts
+	{
+		size_t fast = 0;
+		size_t fallback = 0;
+	};
+
+	void checkString(Iconv& reference, const std::vector<unsigned short>& table, const std::string& src, Counts* counts)
+	{
+		std::vector<unsigned short> dst(src.size() + 1, 0xcdcd);
+		const int n = gbcodec::decode(table.data(), src.c_str(), static_cast<int>(src.size()), dst.data());
+
+		std::u16string expected;
+		const bool whole = reference.decode(src, &expected);
+		if (n < 0)
+		{
+			++counts->fallback;
+			CHECK(!whole);
+			return;
+		}
+
+		++counts->fast;
+		const bool ok = CHECK(whole)
+			&& CHECK(n == static_cast<int>(expected.size()))
+			&& CHECK(std::equal(expected.begin(), expected.end(), dst.begin()))
+			&& CHECK(dst[n] == 0xcdcd);
+		if (!ok)
+		{
+			fprintf(stderr, "  input:");
+			for (unsigned char c : src)
+				fprintf(stderr, " %02x", c);
+			fprintf(stderr, "\n");
+		}
+	}
+
+	std::vector<std::string> readCorpus(const char* path)
+	{
+		std::vector<std::string> lines;
+		std::ifstream file(path, std::ios::binary);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && (line.back() == '\r'))
+				line.pop_back();
+			if (!line.empty() && (line[0] != '#'))
+				lines.push_back(line);
+		}
+		return lines;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: gbcodec_test <gb2312_corpus.txt>\n");
+		return 2;
+	}
+
+	const std::vector<std::string> corpus = readCorpus(argv[1]);
+	CHECK(corpus.size() >= 50);
+
+	std::mt19937 rng(0x6762);
+	for (const char* charset : { "GB2312", "GBK" })
+	{
+		Iconv reference(charset);
+		if (!CHECK(reference.valid()))
+			continue;
+
+		Iconv single(charset);
+		const std::vector<unsigned short> table = gbcodec::buildPairTable([&single](const char* bytes, int size, unsigned short* out)->bool
+			{
+				std::u16string s;
+				if (!single.decode(std::string(bytes, size), &s) || (s.size() != 1))
+					return false;
+				*out = static_cast<unsigned short>(s[0]);
+				return true;
+			});
+
+		const int before = test::failures();
+		Counts counts;
+		// 可以單獨解碼的字符 (高位單字節與雙字節)
+		std::vector<std::string> pairs;
+		for (int i = 0x80; i < gbcodec::kTableSize; ++i)
+		{
+			if (table[i] == 0)
+				continue;
+
+			if (i < 0x100)
+				pairs.push_back(std::string(1, static_cast<char>(i)));
+			else
+				pairs.push_back(std::string{ static_cast<char>(i >> 8), static_cast<char>(i & 0xff) });
+		}
+
+		// 語料 以及每行的所有前綴 (截斷在雙字節中間時必須失敗)
+		for (const std::string& line : corpus)
+		{
+			for (size_t size = 0; size <= line.size(); ++size)
+				checkString(reference, table, line.substr(0, size), &counts);
+		}
+
+		// 每個單獨的雙字節 前後夾ASCII
+		for (const std::string& pair : pairs)
+			checkString(reference, table, "a" + pair + "|", &counts);
+
+		// 所有首字節與尾字節的組合 (含表外)
+		for (int lead = 0x80; lead <= 0xff; ++lead)
+		{
+			for (int trail = 0x01; trail <= 0xff; ++trail)
+				checkString(reference, table, std::string{ static_cast<char>(lead), static_cast<char>(trail) }, &counts);
+		}
+
+		// 隨機組合: 合法字符 ASCII 分隔符 偶爾插入單個高位字節
+		for (int round = 0; round < 20000; ++round)
+		{
+			std::string s;
+			const int count = 1 + static_cast<int>(rng() % 40);
+			for (int i = 0; i < count; ++i)
+			{
+				const unsigned int r = rng() % 20;
+				if (r < 10)
+					s += pairs[rng() % pairs.size()];
+				else if (r < 19)
+					s.push_back(static_cast<char>(0x20 + rng() % 0x5f));
+				else if ((round % 4) == 0)
+					s.push_back(static_cast<char>(0x80 + rng() % 0x80));
+			}
+			checkString(reference, table, s, &counts);
+		}
+
+		// 逐字映射與逐個查表相同
+		std::vector<unsigned short> map(gbcodec::kTableSize);
+		for (int i = 0; i < gbcodec::kTableSize; ++i)
+			map[i] = static_cast<unsigned short>((i * 7919) & 0xffff);
+		std::vector<unsigned short> data(table.begin(), table.end());
+		std::vector<unsigned short> mapped = data;
+		gbcodec::mapChars(map.data(), mapped.data(), static_cast<int>(mapped.size()));
+		for (size_t i = 0; i < data.size(); ++i)
+			CHECK(mapped[i] == map[data[i]]);
+
+		printf("%s: %zu pairs, %zu fast, %zu fallback, %d failures\n", charset, pairs.size(), counts.fast, counts.fallback, test::failures() - before);
+	}
+
+	return test::finish("gbcodec_test");
+}
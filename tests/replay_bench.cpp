@@ -0,0 +1,516 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+// 封包錄製檔 (SACAP 格式同 net/packetcapture.cpp) 在Linux上的重播 (不加入ctest)
+//
+//   replay_bench <capture.sacap>                    以最高速度重播並輸出報告
+//   replay_bench --synthesize <out.sacap> [seconds] 產生合成的對局錄製檔
+//
+// 只涵蓋不依賴Qt的部分: LineBuffer切行 -> util_DecodeMessage -> util_SplitMessage
+// -> util_GetFunctionFromSlice -> 依接收函數的參數型別呼叫util_Recv
+// lssproto_*_recv 本身 (轉碼、TokenIndex、戰鬥解碼) 需要Qt 請以主程式的 --replay 量測
+//
+// 合成錄製檔只模擬封包的種類、頻率與長度 不是真實的對局
+
+#include "stdafx.h"
+#include "autil.h"
+#include "testutil.h"
+
+#include <new>
+
+namespace
+{
+	std::atomic<long long> g_allocations { 0 };
+}
+
+void* operator new(size_t size)
+{
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace
+{
+	constexpr char kMagic[] = { 'S', 'A', 'C', 'A', 'P' };
+	constexpr char kVersion = 1;
+	constexpr int kFuncCount = 256;
+
+	enum RecordType
+	{
+		kData = 1,
+		kKey = 2,
+	};
+
+	// 與 database.h 的 LSSPROTO_*_RECV 相同
+	enum Func
+	{
+		kXYD = 2,
+		kEV = 4,
+		kB = 15,
+		kI = 22,
+		kAB = 30,
+		kTK = 36,
+		kMC = 37,
+		kM = 39,
+		kC = 41,
+		kCA = 42,
+		kCD = 43,
+		kS = 46,
+		kEcho = 88,
+	};
+
+	// 伺服器的訊息編號比接收函數多23 util_Send加13 因此以func + 10送出
+	constexpr int kSendOffset = 10;
+
+	struct FuncStats
+	{
+		unsigned long long count = 0;
+		unsigned long long totalNs = 0;
+		unsigned long long maxNs = 0;
+	};
+
+	struct Report
+	{
+		unsigned long long records = 0;
+		unsigned long long bytes = 0;
+		unsigned long long messages = 0;
+		unsigned long long failures = 0;
+		unsigned long long busyNs = 0;
+		long long allocations = 0;
+		FuncStats funcs[kFuncCount] = {};
+	};
+
+	void appendVarint(std::string* out, unsigned long long value)
+	{
+		while (value >= 0x80)
+		{
+			out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+			value >>= 7;
+		}
+		out->push_back(static_cast<char>(value));
+	}
+
+	bool readVarint(const std::string& in, size_t* pos, unsigned long long* value)
+	{
+		unsigned long long result = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			if (*pos >= in.size())
+				return false;
+
+			const unsigned char c = static_cast<unsigned char>(in[(*pos)++]);
+			result |= static_cast<unsigned long long>(c & 0x7f) << shift;
+			if ((c & 0x80) == 0)
+			{
+				*value = result;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// 依接收函數的參數解出欄位 與 Server::relayRecv 相同 返回false表示校驗失敗
+	bool recvFields(Autil::ProtocolCodec& codec, int func, int fieldcount)
+	{
+		int a = 0, b = 0, c = 0, d = 0, e = 0, f = 0, g = 0, h = 0;
+		char* text = nullptr;
+		switch (func)
+		{
+		case kB:
+		case kI:
+		case kAB:
+		case kC:
+		case kCA:
+		case kCD:
+		case kS:
+		case kEcho:
+			return Autil::util_Recv(codec, text);
+		case kTK:
+			return Autil::util_Recv(codec, a, text, b);
+		case kM:
+			return Autil::util_Recv(codec, a, b, c, d, e, text);
+		case kMC:
+			return Autil::util_Recv(codec, a, b, c, d, e, f, g, h, text);
+		case kEV:
+			return Autil::util_Recv(codec, a, b);
+		case kXYD:
+			return Autil::util_Recv(codec, a, b, c);
+		default:
+			// 不知道型別 逐個以字串解出
+			for (int i = 2; i < fieldcount; ++i)
+				Autil::util_destring(codec, i, &text);
+			return true;
+		}
+	}
+
+	void dispatch(Autil::ProtocolCodec& codec, char* encoded, Report* report)
+	{
+		const auto begin = std::chrono::steady_clock::now();
+
+		const size_t rawlen = strlen(encoded) + 1;
+		char* raw = codec.reserve(Autil::ScratchArena::kLine, rawlen);
+		Autil::util_DecodeMessage(codec, raw, rawlen, encoded);
+		Autil::util_SplitMessage(codec, raw, rawlen, const_cast<char*>(Autil::SEPARATOR));
+
+		int func = 0, fieldcount = 0;
+		bool ok = false;
+		if (Autil::util_GetFunctionFromSlice(codec, &func, &fieldcount) == 1)
+			ok = recvFields(codec, func, fieldcount);
+		codec.discardMessage();
+
+		const unsigned long long ns = static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - begin).count());
+
+		//無法解析的封包計入0號
+		FuncStats& stats = report->funcs[(func > 0 && func < kFuncCount) ? func : 0];
+		++stats.count;
+		stats.totalNs += ns;
+		if (ns > stats.maxNs)
+			stats.maxNs = ns;
+
+		++report->messages;
+		if (!ok)
+			++report->failures;
+	}
+
+	bool replay(const std::string& content, Report* report)
+	{
+		if ((content.size() < sizeof(kMagic) + 1) || (memcmp(content.data(), kMagic, sizeof(kMagic)) != 0) || (content[sizeof(kMagic)] != kVersion))
+		{
+			fprintf(stderr, "not a SACAP v%d capture\n", kVersion);
+			return false;
+		}
+
+		Autil::ProtocolCodec codec;
+		Autil::LineBuffer buffer;
+		size_t pos = sizeof(kMagic) + 1;
+		const long long allocationsBefore = g_allocations.load();
+		while (pos < content.size())
+		{
+			const char type = content[pos++];
+			unsigned long long deltaUs = 0;
+			unsigned long long size = 0;
+			if (!readVarint(content, &pos, &deltaUs) || !readVarint(content, &pos, &size) || (size > content.size() - pos))
+			{
+				fprintf(stderr, "truncated record at offset %zu\n", pos);
+				return false;
+			}
+
+			const char* data = content.data() + pos;
+			pos += size;
+			++report->records;
+
+			if (type == kKey)
+			{
+				codec.setPersonalKey(data, size);
+				continue;
+			}
+
+			if (type != kData)
+			{
+				fprintf(stderr, "unknown record type %d\n", type);
+				return false;
+			}
+
+			// 只計算handleData的部分 與主程式的報告相同
+			const auto begin = std::chrono::steady_clock::now();
+			report->bytes += size;
+			if (!buffer.append(data, size))
+				buffer.clear();
+
+			char* line = nullptr;
+			size_t lineSize = 0;
+			while (buffer.takeLine(&line, &lineSize))
+			{
+				if (lineSize > 0)
+					dispatch(codec, line, report);
+			}
+			report->busyNs += static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - begin).count());
+		}
+
+		report->allocations = g_allocations.load() - allocationsBefore;
+		return true;
+	}
+
+	void print(const Report& report)
+	{
+		const double busyMs = static_cast<double>(report.busyNs) / 1e6;
+		const double seconds = static_cast<double>(report.busyNs) / 1e9;
+		printf("records %llu bytes %llu messages %llu failures %llu busy %.3f ms throughput %.2f MB/s %.0f msg/s allocations %lld\n",
+			report.records, report.bytes, report.messages, report.failures, busyMs,
+			seconds > 0 ? (static_cast<double>(report.bytes) / 1048576.0) / seconds : 0.0,
+			seconds > 0 ? static_cast<double>(report.messages) / seconds : 0.0,
+			report.allocations);
+
+		//依總耗時排序
+		std::vector<int> order;
+		for (int func = 0; func < kFuncCount; ++func)
+		{
+			if (report.funcs[func].count > 0)
+				order.push_back(func);
+		}
+
+		std::sort(order.begin(), order.end(), [&report](int a, int b) { return report.funcs[a].totalNs > report.funcs[b].totalNs; });
+
+		for (const int func : order)
+		{
+			const FuncStats& stats = report.funcs[func];
+			printf("func %3d count %llu avg %.2f us max %.2f us total %.3f ms\n",
+				func, stats.count,
+				static_cast<double>(stats.totalNs) / stats.count / 1e3,
+				static_cast<double>(stats.maxNs) / 1e3,
+				static_cast<double>(stats.totalNs) / 1e6);
+		}
+	}
+
+	// ---------------------------------------------------------------
+	// 合成錄製檔
+
+	class Synthesizer
+	{
+	public:
+		explicit Synthesizer(unsigned int seed)
+			: rng_(seed)
+		{
+			content_.append(kMagic, sizeof(kMagic));
+			content_.push_back(kVersion);
+			mem::sendHook = [this](const char* data, int size) { pending_.append(data, size); };
+		}
+
+		~Synthesizer()
+		{
+			mem::sendHook = nullptr;
+		}
+
+		void setKey(const std::string& key)
+		{
+			codec_.setPersonalKey(key.data(), key.size());
+			record(kKey, key);
+		}
+
+		// 模擬一秒: 地圖上的單位更新 狀態 聊天 每10秒一場8回合的戰鬥
+		void second(int index)
+		{
+			for (int i = 0; i < 10; ++i)
+				text(kC, units(3 + rng_() % 12));
+			for (int i = 0; i < 20; ++i)
+				text(kCA, actions(1 + rng_() % 4));
+			for (int i = 0; i < 2; ++i)
+				text(kCD, ids(1 + rng_() % 3));
+			text(kS, status());
+			text(kI, items(1 + rng_() % 4));
+			for (int i = 0; i < 3; ++i)
+				chat();
+			if ((index % 5) == 0)
+				text(kEcho, "hoge");
+
+			if ((index % 10) == 9)
+			{
+				for (int round = 0; round < 8; ++round)
+				{
+					text(kB, battle());
+					text(kB, "BP|" + hex(rng_() % 20) + "|0|" + hex(rng_() % 500) + "|");
+					text(kB, "BA|" + hex(rng_() & 0xfffff) + "|" + hex(round) + "|");
+				}
+			}
+			flush();
+		}
+
+		bool save(const char* path) const
+		{
+			std::ofstream file(path, std::ios::binary);
+			file.write(content_.data(), static_cast<std::streamsize>(content_.size()));
+			return static_cast<bool>(file);
+		}
+
+	private:
+		std::string hex(unsigned int value) const
+		{
+			char buffer[16];
+			snprintf(buffer, sizeof(buffer), "%x", value);
+			return buffer;
+		}
+
+		std::string name()
+		{
+			static const char* const names[] = {
+				"\xb4\xe5\xb3\xa4\xb5\xc4\xbc\xd2",   // 村长的家
+				"\xd0\xa1\xd6\xed",                   // 小猪
+				"\xd1\xd2\xca\xaf\xbe\xde\xc8\xcb",   // 岩石巨人
+				"\xbb\xc6\xbd\xf0\xbc\xa6",           // 黄金鸡
+				"\xb2\xbc\xd2\xc1",                   // 布伊
+				"Player\\z01",
+				"\xd0\xa1\xc3\xf7\\c\xb6\xfe\xba\xc5", // 小明\c二号
+			};
+			return names[rng_() % (sizeof(names) / sizeof(names[0]))];
+		}
+
+		std::string units(int count)
+		{
+			std::string s;
+			for (int i = 0; i < count; ++i)
+			{
+				s += "1|" + hex(rng_() & 0xffffff) + "|" + std::to_string(rng_() % 500) + "|" + std::to_string(rng_() % 500) + "|"
+					+ std::to_string(rng_() % 8) + "|" + std::to_string(100000 + rng_() % 1000) + "|" + std::to_string(rng_() % 140) + "|"
+					+ std::to_string(rng_() % 10) + "|" + name() + "|" + ((rng_() & 1) ? name() : std::string()) + "|0|0|"
+					+ std::to_string(rng_() % 12) + "|0|" + name() + "|0|0|0|0|,";
+			}
+			return s;
+		}
+
+		std::string actions(int count)
+		{
+			std::string s;
+			for (int i = 0; i < count; ++i)
+			{
+				s += hex(rng_() & 0xffffff) + "|" + std::to_string(rng_() % 500) + "|" + std::to_string(rng_() % 500) + "|"
+					+ std::to_string(rng_() % 40) + "|" + std::to_string(rng_() % 8) + "|,";
+			}
+			return s;
+		}
+
+		std::string ids(int count)
+		{
+			std::string s;
+			for (int i = 0; i < count; ++i)
+				s += hex(rng_() & 0xffffff) + ",";
+			return s;
+		}
+
+		std::string status()
+		{
+			std::string s = "P1";
+			for (int i = 0; i < 40; ++i)
+				s += "|" + std::to_string(rng_() % 100000);
+			return s + "|" + name() + "|" + name() + "|";
+		}
+
+		std::string items(int count)
+		{
+			std::string s = "";
+			for (int i = 0; i < count; ++i)
+			{
+				s += std::to_string(rng_() % 20) + "|" + name() + "|0|" + name() + "|" + std::to_string(rng_() % 30000) + "|"
+					+ std::to_string(rng_() % 100) + "|" + std::to_string(rng_() % 5) + "|0|0|" + name() + "|1|0|0|0|,";
+			}
+			return s;
+		}
+
+		std::string battle()
+		{
+			std::string s = "BC|" + hex(rng_() % 5) + "|";
+			for (int pos = 0; pos < 20; ++pos)
+			{
+				s += hex(pos) + "|" + name() + "|" + name() + "|" + hex(100000 + rng_() % 1000) + "|" + hex(rng_() % 140) + "|"
+					+ hex(rng_() % 5000) + "|" + hex(5000) + "|" + hex(rng_() & 0xffff) + "|0|" + hex(rng_() % 2) + "|"
+					+ hex(rng_() % 140) + "|" + hex(rng_() % 5000) + "|" + hex(5000) + "|";
+			}
+			return s;
+		}
+
+		void text(int func, std::string payload)
+		{
+			payload.push_back('\0');
+			Autil::util_Send(codec_, func + kSendOffset, &payload[0]);
+		}
+
+		void chat()
+		{
+			std::string message = "P|" + name() + "\xa3\xba" + name() + " " + std::to_string(rng_() % 1000);
+			Autil::util_Send(codec_, kTK + kSendOffset, static_cast<int>(rng_() % 100), &message[0], static_cast<int>(rng_() % 10));
+		}
+
+		// 以隨機長度切成數據記錄 模擬socket每次收到的量
+		void flush()
+		{
+			size_t pos = 0;
+			while (pos < pending_.size())
+			{
+				const size_t chunk = qMin(pending_.size() - pos, static_cast<size_t>(64 + rng_() % 1400));
+				record(kData, pending_.substr(pos, chunk));
+				pos += chunk;
+			}
+			pending_.clear();
+		}
+
+		void record(RecordType type, const std::string& data)
+		{
+			content_.push_back(static_cast<char>(type));
+			appendVarint(&content_, 1000000 / 64);
+			appendVarint(&content_, data.size());
+			content_ += data;
+		}
+
+		std::mt19937 rng_;
+		Autil::ProtocolCodec codec_;
+		std::string content_;
+		std::string pending_;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	if ((argc >= 3) && (strcmp(argv[1], "--synthesize") == 0))
+	{
+		const int seconds = (argc >= 4) ? atoi(argv[3]) : 600;
+		Synthesizer synthesizer(0x73616361);
+		synthesizer.setKey("Gx7pQw2Lm9ZrTb4KcVn8YsHd3Fj6Ua1E");
+		for (int i = 0; i < seconds; ++i)
+			synthesizer.second(i);
+		if (!synthesizer.save(argv[2]))
+		{
+			fprintf(stderr, "cannot write %s\n", argv[2]);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: replay_bench <capture.sacap>\n       replay_bench --synthesize <out.sacap> [seconds]\n");
+		return 2;
+	}
+
+	std::ifstream file(argv[1], std::ios::binary);
+	if (!file)
+	{
+		fprintf(stderr, "cannot read %s\n", argv[1]);
+		return 1;
+	}
+
+	const std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	Report report;
+	if (!replay(content, &report))
+		return 1;
+
+	print(report);
+	return report.failures ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+#include "util.h"
+
+// 測試用 只保留util_SendMesg用到的部分
+class Injector
+{
+public:
+	enum
+	{
+		kSendPacket,
+	};
+
+	static Injector& getInstance()
+	{
+		static Injector instance;
+		return instance;
+	}
+
+	inline HANDLE getProcess() const { return nullptr; }
+	inline int sendMessage(int, int, int) const { return 0; }
+};
@@ -0,0 +1,47 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+
+// 測試用 以GCC/Clang的內建函數提供MSVC的CPUID/XGETBV介面
+#include <cpuid.h>
+#include <immintrin.h>
+
+inline void shimCpuid(int info[4], int leaf)
+{
+	__cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+}
+
+inline void shimCpuidex(int info[4], int leaf, int subleaf)
+{
+	__cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+}
+
+inline unsigned long long shimXgetbv(unsigned int index)
+{
+	unsigned int eax = 0, edx = 0;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+	return (static_cast<unsigned long long>(edx) << 32) | eax;
+}
+
+// 新版cpuid.h已有同名函數或巨集 一律改用上面的版本
+#undef __cpuid
+#undef __cpuidex
+#define __cpuid shimCpuid
+#define __cpuidex shimCpuidex
+#define _xgetbv shimXgetbv
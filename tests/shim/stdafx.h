@@ -0,0 +1,59 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+
+// 測試用的最小預編譯標頭 只提供net/autil*.cpp用到的Windows/Qt名稱
+// 不可把SaSH根目錄加入搜尋路徑 否則會取到真正的stdafx.h/util.h
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <random>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+#ifndef _WIN32
+#define __stdcall
+#define __fastcall
+#define __forceinline inline __attribute__((always_inline))
+
+#define _TRUNCATE (static_cast<size_t>(-1))
+
+typedef void* HANDLE;
+typedef unsigned long DWORD;
+
+template<typename... Args>
+inline int _snprintf_s(char* buffer, size_t size, size_t, const char* format, Args... args)
+{
+	const int n = snprintf(buffer, size, format, args...);
+	return ((n < 0) || (static_cast<size_t>(n) >= size)) ? -1 : n;
+}
+#endif
+
+#define Q_REQUIRED_RESULT
+
+template<typename T>
+inline const T& qMax(const T& a, const T& b) { return (a < b) ? b : a; }
+
+template<typename T>
+inline const T& qMin(const T& a, const T& b) { return (a < b) ? a : b; }
@@ -0,0 +1,47 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+#include "stdafx.h"
+
+#include <functional>
+
+// 測試用 取代遠端記憶體寫入 把util_SendMesg送出的封包交給hook
+namespace mem
+{
+	// 送出的封包 (已含換行) 由測試設置 每個線程各自一份
+	using SendHook = std::function<void(const char* data, int size)>;
+	inline thread_local SendHook sendHook;
+
+	inline bool write(HANDLE, int, const char* data, int size)
+	{
+		if (sendHook)
+			sendHook(data, size);
+		return true;
+	}
+}
+
+namespace util
+{
+	class VirtualMemory
+	{
+	public:
+		VirtualMemory(HANDLE, int, bool) {}
+		inline operator int() const { return 0; }
+	};
+}
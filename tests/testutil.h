@@ -0,0 +1,108 @@
+﻿/*
+				GNU GENERAL PUBLIC LICENSE
+				   Version 2, June 1991
+COPYRIGHT (C) Bestkakkoii 2023 All Rights Reserved.
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+*/
+
+#pragma once
+#include "stdafx.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+// 測試共用的檢查與資料處理 失敗只計數並印出位置 由main返回非零 (可由多個線程呼叫)
+namespace test
+{
+	inline std::atomic<int>& failures()
+	{
+		static std::atomic<int> count { 0 };
+		return count;
+	}
+
+	inline bool check(bool ok, const char* expr, const char* file, int line)
+	{
+		if (!ok && (++failures() <= 20))
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expr);
+		return ok;
+	}
+
+	inline int finish(const char* name)
+	{
+		const int count = failures().load();
+		printf("%s: %s (%d failures)\n", name, count ? "FAILED" : "passed", count);
+		return count ? 1 : 0;
+	}
+
+	inline std::string fromHex(const std::string& hex)
+	{
+		std::string out;
+		out.reserve(hex.size() / 2);
+		for (size_t i = 0; i + 1 < hex.size(); i += 2)
+			out.push_back(static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+		return out;
+	}
+
+	inline std::vector<std::string> split(const std::string& text, char separator)
+	{
+		std::vector<std::string> out;
+		std::string item;
+		std::istringstream stream(text);
+		while (std::getline(stream, item, separator))
+			out.push_back(item);
+		if (!text.empty() && (text.back() == separator))
+			out.emplace_back();
+		return out;
+	}
+
+	inline double seconds(std::chrono::steady_clock::time_point begin)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	}
+
+	// 不含'\0'的隨機字串 (GB2312雙字節 跳脫序列 ASCII混合)
+	inline std::string randomText(std::mt19937& rng, size_t size)
+	{
+		std::string s;
+		while (s.size() < size)
+		{
+			const unsigned int r = rng() % 10;
+			if (r < 4)
+			{
+				s.push_back(static_cast<char>(0xb0 + rng() % 0x48));
+				s.push_back(static_cast<char>(0xa1 + rng() % 0x5e));
+			}
+			else if (r < 5)
+			{
+				s.push_back('\\');
+				s.push_back("nczy\\"[rng() % 5]);
+			}
+			else
+				s.push_back(static_cast<char>(1 + rng() % 255));
+		}
+		s.resize(size);
+		return s;
+	}
+
+	inline std::string randomKey(std::mt19937& rng, size_t size)
+	{
+		std::string key;
+		for (size_t i = 0; i < size; ++i)
+			key.push_back(static_cast<char>(0x21 + rng() % 0x5e));
+		return key;
+	}
+}
+
+#define CHECK(expr) test::check(static_cast<bool>(expr), #expr, __FILE__, __LINE__)